@@ -158,6 +158,7 @@ testScripts = [
     'preciousblock.py',
     'importprunedfunds.py',
     'createauxblock.py',
+    'auxemptytemplate.py',
     'signmessages.py',
     # 'nulldummy.py',
     'import-rescan.py',
@@ -0,0 +1,67 @@
+#!/usr/bin/env python
+# Copyright (c) 2025 The Trumpow Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test coinbase-only aux work with -auxemptytemplate.
+
+Coinbase-only work is handed out on a new tip only. On an unchanged tip, a
+block template gone stale is brought up to date instead.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+
+import time
+
+class AuxEmptyTemplateTest(BitcoinTestFramework):
+
+  def __init__(self):
+      super().__init__()
+      self.setup_clean_chain = True
+      self.num_nodes = 1
+
+  def setup_network(self):
+      self.nodes = []
+      self.nodes.append(start_node(0, self.options.tmpdir, ["-debug", "-auxemptytemplate"]))
+      self.is_network_split = False
+
+  def is_empty(self, auxblock):
+      # Coinbase-only work is flagged in its longpollid
+      return auxblock["longpollid"].endswith("e")
+
+  def run_test(self):
+    node = self.nodes[0]
+    dummy_p2pkh_addr = "mmMP9oKFdADezYzduwJFcLNmmi8JHUKdx9"
+    dummy_p2sh_addr = "2Mwvgpd2H7wDPXx8jWe3Vqiciix6JqSbsyz"
+
+    # Generate a chain so that we are not "downloading blocks".
+    node.generatetoaddress(100, dummy_p2pkh_addr)
+
+    # The first work on a new tip holds only the coinbase
+    auxblock = node.createauxblock(dummy_p2pkh_addr)
+    assert self.is_empty(auxblock)
+    assert_equal(auxblock["previousblockhash"], node.getbestblockhash())
+
+    # It is replaced once the full block has been assembled in the background
+    for i in range(100):
+      auxblock = node.createauxblock(dummy_p2pkh_addr)
+      if not self.is_empty(auxblock):
+        break
+      time.sleep(0.1)
+    assert not self.is_empty(auxblock)
+
+    # A stale template on the same tip is updated before handing out work,
+    # rather than giving coinbase-only work again
+    node.prioritisetransaction("00" * 32, 0, 1000)
+    auxblock = node.createauxblock(dummy_p2sh_addr)
+    assert not self.is_empty(auxblock)
+    assert_equal(auxblock["previousblockhash"], node.getbestblockhash())
+
+    # On the next tip, work is coinbase-only again
+    node.generatetoaddress(1, dummy_p2pkh_addr)
+    auxblock = node.createauxblock(dummy_p2sh_addr)
+    assert self.is_empty(auxblock)
+    assert_equal(auxblock["previousblockhash"], node.getbestblockhash())
+
+if __name__ == "__main__":
+  AuxEmptyTemplateTest().main()
@@ -12,6 +12,21 @@ from test_framework.util import *
 
 from test_framework import scrypt_auxpow as auxpow
 
+import threading
+
+class LongpollThread(threading.Thread):
+  def __init__(self, node, address, longpollid):
+    threading.Thread.__init__(self)
+    self.address = address
+    self.longpollid = longpollid
+    self.auxblock = None
+    # create a new connection to the node, we can't use the same
+    # connection from two threads
+    self.node = get_rpc_proxy(node.url, 1, timeout=600)
+
+  def run(self):
+    self.auxblock = self.node.createauxblock(self.address, self.longpollid)
+
 class CreateAuxBlockTest(BitcoinTestFramework):
 
   def __init__(self):
@@ -198,6 +213,19 @@ class CreateAuxBlockTest(BitcoinTestFramework):
     res = self.nodes[1].submitauxblock(nmc_api_auxblock["hash"], apow)
     assert res
 
+    # A long poll on current work returns once another node finds a block
+    self.sync_all()
+    auxblock = self.nodes[0].createauxblock(dummy_p2pkh_addr)
+    assert auxblock["longpollid"].startswith(auxblock["previousblockhash"])
+    thr = LongpollThread(self.nodes[0], dummy_p2pkh_addr, auxblock["longpollid"])
+    thr.start()
+    thr.join(5)
+    assert thr.is_alive()
+    self.nodes[1].generate(1)
+    thr.join(5)
+    assert not thr.is_alive()
+    assert_equal(thr.auxblock["previousblockhash"], self.nodes[1].getbestblockhash())
+
     self.sync_all()
 
     # check the mined block
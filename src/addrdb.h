@@ -8,13 +8,13 @@
 
 #include "fs.h"
 #include "serialize.h"
+#include "streams.h"
 
 #include <string>
 #include <map>
 
 class CSubNet;
 class CAddrMan;
-class CDataStream;
 
 typedef enum BanReason
 {
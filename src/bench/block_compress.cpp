@@ -0,0 +1,37 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "blockcompress.h"
+
+#include <assert.h>
+#include <vector>
+
+namespace block_bench {
+#include "bench/data/block413567.raw.h"
+}
+
+// A full block as -compressblocks stores it, and reads it back
+
+static void CompressBlock(benchmark::State& state)
+{
+    std::vector<char> vchFrame;
+    while (state.KeepRunning()) {
+        bool fCompressed = CompressRecord((const char*)block_bench::block413567, sizeof(block_bench::block413567), vchFrame);
+        assert(fCompressed);
+    }
+}
+
+static void DecompressBlock(benchmark::State& state)
+{
+    std::vector<char> vchFrame, vchRecord;
+    CompressRecord((const char*)block_bench::block413567, sizeof(block_bench::block413567), vchFrame);
+    while (state.KeepRunning()) {
+        bool fDecompressed = DecompressRecord(vchFrame.data(), vchFrame.size(), vchRecord, sizeof(block_bench::block413567));
+        assert(fDecompressed);
+    }
+}
+
+BENCHMARK(CompressBlock);
+BENCHMARK(DecompressBlock);
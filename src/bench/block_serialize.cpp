@@ -0,0 +1,84 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "primitives/block.h"
+#include "streams.h"
+#include "version.h"
+
+#include <vector>
+
+static const unsigned int BLOCK_TXS = 5000;
+
+// Close to a full block: one-in, two-out P2PKH transactions
+static CBlock MakeBlock()
+{
+    CBlock block;
+    block.nVersion = 4;
+    block.nTime = 1500000000;
+    block.nBits = 0x1e0ffff0;
+    for (unsigned int i = 0; i < BLOCK_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.hash = block.hashPrevBlock;
+        tx.vin[0].prevout.n = i;
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, i) << std::vector<unsigned char>(33, i);
+        tx.vout.resize(2);
+        for (unsigned int j = 0; j < tx.vout.size(); j++) {
+            tx.vout[j].nValue = COIN;
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, j) << OP_EQUALVERIFY << OP_CHECKSIG;
+        }
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    return block;
+}
+
+template <typename Stream>
+static void SerializeBlock(benchmark::State& state)
+{
+    const CBlock block = MakeBlock();
+    while (state.KeepRunning()) {
+        Stream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << block;
+        assert(stream.size() > 1000000);
+    }
+}
+
+template <typename Stream>
+static void DeserializeBlock(benchmark::State& state)
+{
+    CPooledDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << MakeBlock();
+    while (state.KeepRunning()) {
+        Stream stream(ssBlock.data(), ssBlock.data() + ssBlock.size(), SER_NETWORK, PROTOCOL_VERSION);
+        CBlock block;
+        stream >> block;
+        assert(block.vtx.size() == BLOCK_TXS);
+    }
+}
+
+static void SerializeBlockPooled(benchmark::State& state)
+{
+    SerializeBlock<CPooledDataStream>(state);
+}
+
+static void SerializeBlockZeroAfterFree(benchmark::State& state)
+{
+    SerializeBlock<CDataStream>(state);
+}
+
+static void DeserializeBlockPooled(benchmark::State& state)
+{
+    DeserializeBlock<CPooledDataStream>(state);
+}
+
+static void DeserializeBlockZeroAfterFree(benchmark::State& state)
+{
+    DeserializeBlock<CDataStream>(state);
+}
+
+BENCHMARK(SerializeBlockPooled);
+BENCHMARK(SerializeBlockZeroAfterFree);
+BENCHMARK(DeserializeBlockPooled);
+BENCHMARK(DeserializeBlockZeroAfterFree);
@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "bench.h"
+#include "random.h"
 #include "wallet/wallet.h"
 
 #include <boost/foreach.hpp>
@@ -58,3 +59,72 @@ static void CoinSelection(benchmark::State& state)
 }
 
 BENCHMARK(CoinSelection);
+
+// A wallet that has been receiving payments for a while: many outputs whose
+// values are spread over six orders of magnitude, from 0.01 to 10000 coins.
+static void addRealisticCoins(int nCount, const CWallet& wallet, std::vector<COutput>& vCoins)
+{
+    FastRandomContext rand(true);
+    for (int i = 0; i < nCount; i++) {
+        CAmount nValue = COIN / 100;
+        for (int nMagnitude = rand.randrange(6); nMagnitude > 0; nMagnitude--)
+            nValue *= 10;
+        nValue += rand.randrange(nValue * 9);
+        addCoin(nValue, wallet, vCoins);
+    }
+}
+
+static void emptyWallet(std::vector<COutput>& vCoins)
+{
+    BOOST_FOREACH (COutput output, vCoins)
+        delete output.tx;
+    vCoins.clear();
+}
+
+// Paying an amount no subset of the wallet can hit without change, which
+// exhausts branch and bound before falling back to the knapsack solver.
+static void CoinSelectionLargeWallet(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    addRealisticCoins(20000, wallet, vCoins);
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(12345 * COIN + 1, 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet > 12345 * COIN);
+    }
+
+    emptyWallet(vCoins);
+}
+
+// Paying the exact sum of a few existing outputs, which branch and bound
+// resolves to a transaction without change.
+static void CoinSelectionLargeWalletChangeless(benchmark::State& state)
+{
+    const CWallet wallet;
+    std::vector<COutput> vCoins;
+    LOCK(wallet.cs_wallet);
+
+    addRealisticCoins(20000, wallet, vCoins);
+    CAmount nTarget = 0;
+    for (int i = 0; i < 5; i++)
+        nTarget += vCoins[i * 1000].tx->tx->vout[0].nValue;
+
+    while (state.KeepRunning()) {
+        std::set<std::pair<const CWalletTx*, unsigned int> > setCoinsRet;
+        CAmount nValueRet;
+        bool success = wallet.SelectCoinsMinConf(nTarget, 1, 6, 0, vCoins, setCoinsRet, nValueRet);
+        assert(success);
+        assert(nValueRet >= nTarget);
+    }
+
+    emptyWallet(vCoins);
+}
+
+BENCHMARK(CoinSelectionLargeWallet);
+BENCHMARK(CoinSelectionLargeWalletChangeless);
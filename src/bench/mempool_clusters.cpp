@@ -0,0 +1,80 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <vector>
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    double dPriority = 10.0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        MakeTransactionRef(tx), nFee, nTime, dPriority, nHeight,
+                                        tx.GetValueOut(), spendsCoinbase, sigOpCost, lp));
+}
+
+// Fill the pool with child-pays-for-parent chains: every transaction spends
+// the previous one, and every fifth one pays enough to pull its ancestors in.
+static void FillChains(CTxMemPool& pool, int nChains, int nLength, std::vector<uint256>& vTips)
+{
+    for (int c = 0; c < nChains; c++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].scriptSig = CScript() << c << OP_1;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        for (int i = 0; i < nLength; i++) {
+            AddTx(tx, i % 5 == 4 ? 50000LL : 1000LL, pool);
+            uint256 hash = tx.GetHash();
+            tx.vin[0].prevout = COutPoint(hash, 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            if (i == nLength - 1)
+                vTips.push_back(hash);
+        }
+    }
+}
+
+// Linearize a pool of long chains from scratch
+static void MempoolClusterLinearize(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    std::vector<uint256> vTips;
+    FillChains(pool, 40, 25, vTips);
+
+    std::vector<CTxMemPool::ClusterRef> vClusters;
+    while (state.KeepRunning()) {
+        // Prioritising the tip of every chain dirties all clusters
+        for (size_t i = 0; i < vTips.size(); i++)
+            pool.PrioritiseTransaction(vTips[i], vTips[i].ToString(), 0., 1);
+        pool.GetClusters(vClusters);
+    }
+}
+
+// Relinearize after a single fee bump, as happens between template refreshes
+static void MempoolClusterPrioritise(benchmark::State& state)
+{
+    CTxMemPool pool(CFeeRate(1000));
+    std::vector<uint256> vTips;
+    FillChains(pool, 40, 25, vTips);
+
+    std::vector<CTxMemPool::ClusterRef> vClusters;
+    pool.GetClusters(vClusters);
+    size_t n = 0;
+    while (state.KeepRunning()) {
+        const uint256& hash = vTips[n++ % vTips.size()];
+        pool.PrioritiseTransaction(hash, hash.ToString(), 0., 1);
+        pool.GetClusters(vClusters);
+    }
+}
+
+BENCHMARK(MempoolClusterLinearize);
+BENCHMARK(MempoolClusterPrioritise);
@@ -0,0 +1,160 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "fs.h"
+#include "key.h"
+#include "net_processing.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "util.h"
+#include "validation.h"
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+static const int FLOOD_SIZE = 256;
+
+/**
+ * A chain of just the regtest genesis block, kept in memory, with one coin
+ * for every transaction of a flood of signed pay-to-pubkey-hash spends.
+ * The databases are in memory too, but flushing needs them to exist.
+ */
+class FloodSetup
+{
+public:
+    fs::path pathTemp;
+    std::vector<CTransactionRef> vFlood;
+    boost::thread_group threadGroup;
+    int nScriptCheckThreadsOld;
+
+    FloodSetup()
+    {
+        SelectParams(CBaseChainParams::REGTEST);
+        // Room for the results of the flood, while small enough to be
+        // emptied cheaply between replays
+        ForceSetArg("-maxsigcachesize", "1");
+        ClearDatadirCache();
+        pathTemp = fs::temp_directory_path() / strprintf("bench_mempool_flood_%lu", (unsigned long)GetTime());
+        fs::create_directories(pathTemp);
+        ForceSetArg("-datadir", pathTemp.string());
+
+        LOCK(cs_main);
+        const CBlock& genesis = Params().GenesisBlock();
+        CBlockIndex* pindex = InsertBlockIndex(genesis.GetHash());
+        pindex->nTime = genesis.nTime;
+        pindex->nBits = genesis.nBits;
+        chainActive.SetTip(pindex);
+        pindexdb = new CIndexDB(1 << 20, true);
+        pcoinsdbview = new CCoinsViewDB(1 << 23, true);
+        pcoinsTip = new CCoinsViewCache(pcoinsdbview);
+        pcoinsTip->SetBestBlock(genesis.GetHash());
+
+        CKey key;
+        key.MakeNewKey(true);
+        const CScript scriptPubKey = GetScriptForDestination(key.GetPubKey().GetID());
+
+        CMutableTransaction txFund;
+        txFund.vin.resize(1);
+        txFund.vin[0].prevout = COutPoint(genesis.vtx[0]->GetHash(), 0);
+        txFund.vout.resize(FLOOD_SIZE);
+        for (int i = 0; i < FLOOD_SIZE; i++) {
+            txFund.vout[i].scriptPubKey = scriptPubKey;
+            txFund.vout[i].nValue = 10 * COIN;
+        }
+        const CTransaction txFunding(txFund);
+        *pcoinsTip->ModifyNewCoins(txFunding.GetHash(), false) = CCoins(txFunding, 1);
+
+        // Record the flood once: signing costs about as much as verifying
+        for (int i = 0; i < FLOOD_SIZE; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(txFunding.GetHash(), i);
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = scriptPubKey;
+            tx.vout[0].nValue = 9 * COIN;
+            std::vector<unsigned char> vchSig;
+            uint256 hash = SignatureHash(scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+            key.Sign(hash, vchSig);
+            vchSig.push_back((unsigned char)SIGHASH_ALL);
+            tx.vin[0].scriptSig = CScript() << vchSig << ToByteVector(key.GetPubKey());
+            vFlood.push_back(MakeTransactionRef(tx));
+        }
+
+        nScriptCheckThreadsOld = nScriptCheckThreads;
+        nScriptCheckThreads = std::max(GetNumCores(), 2);
+        for (int i = 0; i < nScriptCheckThreads - 1; i++)
+            threadGroup.create_thread(&ThreadMempoolScriptCheck);
+    }
+
+    ~FloodSetup()
+    {
+        threadGroup.interrupt_all();
+        threadGroup.join_all();
+        nScriptCheckThreads = nScriptCheckThreadsOld;
+        UnloadBlockIndex();
+        delete pcoinsTip;
+        pcoinsTip = NULL;
+        delete pcoinsdbview;
+        pcoinsdbview = NULL;
+        delete pindexdb;
+        pindexdb = NULL;
+        ClearDatadirCache();
+        fs::remove_all(pathTemp);
+    }
+
+    // Start every replay from empty caches, like a node first seeing the flood
+    void Reset(CTxMemPool& pool)
+    {
+        pool.clear();
+        InitSignatureCache();
+        InitScriptExecutionCache();
+    }
+};
+
+static void Accept(CTxMemPool& pool, const CTransactionRef& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    bool fAccepted = AcceptToMemoryPool(pool, state, tx, false, NULL);
+    assert(fAccepted);
+}
+
+// Accept the flood one transaction at a time, running its scripts in place
+static void MempoolFloodSerial(benchmark::State& state)
+{
+    FloodSetup setup;
+    CTxMemPool pool(CFeeRate(0));
+    while (state.KeepRunning()) {
+        setup.Reset(pool);
+        for (size_t i = 0; i < setup.vFlood.size(); i++)
+            Accept(pool, setup.vFlood[i]);
+    }
+}
+
+// Accept the flood the way a peer's queued tx messages are: the scripts of
+// each batch run on the script check threads first
+static void MempoolFloodPreVerified(benchmark::State& state)
+{
+    FloodSetup setup;
+    CTxMemPool pool(CFeeRate(0));
+    while (state.KeepRunning()) {
+        setup.Reset(pool);
+        for (size_t i = 0; i < setup.vFlood.size(); i += MAX_TX_PREVERIFY_BATCH) {
+            std::vector<CTransactionRef> vBatch(setup.vFlood.begin() + i, setup.vFlood.begin() + std::min(i + MAX_TX_PREVERIFY_BATCH, setup.vFlood.size()));
+            PreVerifyTransactions(pool, vBatch);
+            for (size_t j = 0; j < vBatch.size(); j++)
+                Accept(pool, vBatch[j]);
+        }
+    }
+}
+
+BENCHMARK(MempoolFloodSerial);
+BENCHMARK(MempoolFloodPreVerified);
@@ -0,0 +1,61 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/policy.h"
+#include "txmempool.h"
+
+#include <iostream>
+#include <vector>
+
+static void AddTx(const CTransaction& tx, const CAmount& nFee, CTxMemPool& pool)
+{
+    int64_t nTime = 0;
+    double dPriority = 10.0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 4;
+    LockPoints lp;
+    pool.addUnchecked(tx.GetHash(), CTxMemPoolEntry(
+                                        MakeTransactionRef(tx), nFee, nTime, dPriority, nHeight,
+                                        tx.GetValueOut(), spendsCoinbase, sigOpCost, lp));
+}
+
+// Fill a pool with one-in, two-out transactions, every third of which
+// spends an output of the one before it, and report what the pool's own
+// bookkeeping costs per transaction on top of the transactions themselves.
+static void MempoolMemoryUsage(benchmark::State& state)
+{
+    const int nTxs = 2000;
+    std::vector<CMutableTransaction> vTxs(nTxs);
+    size_t nTxUsage = 0;
+    for (int i = 0; i < nTxs; i++) {
+        CMutableTransaction& tx = vTxs[i];
+        tx.vin.resize(1);
+        if (i % 3 == 0 && i > 0) {
+            tx.vin[0].prevout = COutPoint(vTxs[i - 1].GetHash(), 1);
+        } else {
+            tx.vin[0].prevout = COutPoint(uint256(), i);
+        }
+        tx.vin[0].scriptSig = CScript() << i << OP_1;
+        tx.vout.resize(2);
+        for (int j = 0; j < 2; j++) {
+            tx.vout[j].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, i) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vout[j].nValue = COIN;
+        }
+        CTransactionRef ref = MakeTransactionRef(tx);
+        nTxUsage += RecursiveDynamicUsage(*ref) + memusage::DynamicUsage(ref);
+    }
+
+    size_t nUsage = 0;
+    while (state.KeepRunning()) {
+        CTxMemPool pool(CFeeRate(1000));
+        for (int i = 0; i < nTxs; i++)
+            AddTx(vTxs[i], 1000LL, pool);
+        nUsage = pool.DynamicMemoryUsage();
+    }
+    std::cout << "#MempoolMemoryUsage," << (nUsage - nTxUsage) / nTxs << " bytes/tx of overhead," << nUsage / nTxs << " bytes/tx in total\n";
+}
+
+BENCHMARK(MempoolMemoryUsage);
@@ -0,0 +1,75 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "policy/fees.h"
+#include "txmempool.h"
+
+#include <vector>
+
+static const unsigned int BLOCK_TXS = 20;
+
+static CTransactionRef MakeTx(unsigned int n)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout.n = n;
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = 0;
+    return MakeTransactionRef(tx);
+}
+
+static CTxMemPoolEntry MakeEntry(const CTransactionRef& tx, unsigned int nHeight)
+{
+    // Spread the feerates over a good part of the buckets
+    CAmount nFee = 10000 + (tx->vin[0].prevout.n % 97) * 20000;
+    LockPoints lp;
+    return CTxMemPoolEntry(tx, nFee, 0, 0, nHeight, 0, false, 4, lp);
+}
+
+// Each block mines the BLOCK_TXS transactions that came in during the one
+// before, while a backlog of nMempool transactions is never mined
+static void ProcessBlocks(benchmark::State& state, unsigned int nMempool)
+{
+    CBlockPolicyEstimator estimator(CFeeRate(100000));
+    for (unsigned int i = 0; i < nMempool; i++)
+        estimator.processTransaction(MakeEntry(MakeTx(i), 0), true);
+
+    // Transactions are reused once mined
+    std::vector<CTransactionRef> vTxs;
+    for (unsigned int i = 0; i < 2 * BLOCK_TXS; i++)
+        vTxs.push_back(MakeTx(nMempool + i));
+
+    unsigned int nHeight = 0;
+    std::vector<CTxMemPoolEntry> vPending;
+    std::vector<const CTxMemPoolEntry*> vBlock;
+    while (state.KeepRunning()) {
+        vBlock.clear();
+        for (size_t i = 0; i < vPending.size(); i++)
+            vBlock.push_back(&vPending[i]);
+        estimator.processBlock(++nHeight, vBlock);
+
+        std::vector<CTxMemPoolEntry> vNext;
+        for (unsigned int i = 0; i < BLOCK_TXS; i++) {
+            vNext.push_back(MakeEntry(vTxs[(nHeight % 2) * BLOCK_TXS + i], nHeight));
+            estimator.processTransaction(vNext.back(), true);
+        }
+        vPending.swap(vNext);
+    }
+}
+
+static void PolicyEstimatorProcessBlock1k(benchmark::State& state)
+{
+    ProcessBlocks(state, 1000);
+}
+
+static void PolicyEstimatorProcessBlock100k(benchmark::State& state)
+{
+    ProcessBlocks(state, 100000);
+}
+
+BENCHMARK(PolicyEstimatorProcessBlock1k);
+BENCHMARK(PolicyEstimatorProcessBlock100k);
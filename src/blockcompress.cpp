@@ -0,0 +1,167 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+
+#include "crypto/common.h"
+
+#include <string.h>
+
+/**
+ * The LZ4 block format: a sequence of literals and a match copied from up to
+ * 64KiB back, repeated, each led by a token holding both lengths. Matches are
+ * found through a table of the last position each 4-byte prefix was seen at.
+ */
+namespace {
+
+const size_t MIN_MATCH = 4;
+/** The last bytes of a block are always literals */
+const size_t LAST_LITERALS = 5;
+/** No match starts closer to the end of a block than this */
+const size_t MATCH_LIMIT = 12;
+const size_t MAX_OFFSET = 65535;
+const int HASH_LOG = 14;
+/** Skip ahead faster the longer no match was found, over incompressible data */
+const int SKIP_TRIGGER = 6;
+
+uint32_t Hash4(const unsigned char* p)
+{
+    return (ReadLE32(p) * 2654435761U) >> (32 - HASH_LOG);
+}
+
+void WriteLength(std::vector<char>& vch, size_t nLength)
+{
+    while (nLength >= 255) {
+        vch.push_back((char)255);
+        nLength -= 255;
+    }
+    vch.push_back((char)nLength);
+}
+
+void WriteSequence(std::vector<char>& vch, const unsigned char* pliterals, size_t nLiterals, size_t nOffset, size_t nMatch)
+{
+    const size_t nMatchCode = nMatch - MIN_MATCH;
+    vch.push_back((char)(((nLiterals < 15 ? nLiterals : 15) << 4) | (nMatchCode < 15 ? nMatchCode : 15)));
+    if (nLiterals >= 15)
+        WriteLength(vch, nLiterals - 15);
+    vch.insert(vch.end(), pliterals, pliterals + nLiterals);
+    vch.push_back((char)(nOffset & 0xff));
+    vch.push_back((char)(nOffset >> 8));
+    if (nMatchCode >= 15)
+        WriteLength(vch, nMatchCode - 15);
+}
+
+void WriteLastLiterals(std::vector<char>& vch, const unsigned char* pliterals, size_t nLiterals)
+{
+    vch.push_back((char)((nLiterals < 15 ? nLiterals : 15) << 4));
+    if (nLiterals >= 15)
+        WriteLength(vch, nLiterals - 15);
+    vch.insert(vch.end(), pliterals, pliterals + nLiterals);
+}
+
+bool ReadLength(const unsigned char*& p, const unsigned char* pend, size_t& nLength)
+{
+    unsigned char ch;
+    do {
+        if (p == pend)
+            return false;
+        ch = *p++;
+        nLength += ch;
+    } while (ch == 255);
+    return true;
+}
+
+} // namespace
+
+bool CompressRecord(const char* pbegin, size_t nSize, std::vector<char>& vchFrame)
+{
+    if (nSize > 0xffffffff)
+        return false;
+    const unsigned char* src = (const unsigned char*)pbegin;
+    vchFrame.clear();
+    vchFrame.reserve(nSize);
+    vchFrame.resize(4);
+    WriteLE32((unsigned char*)vchFrame.data(), nSize);
+
+    size_t nAnchor = 0;
+    if (nSize > MATCH_LIMIT) {
+        // Positions plus one, so that zero means none
+        std::vector<uint32_t> vTable(1 << HASH_LOG, 0);
+        const size_t nMatchStartLimit = nSize - MATCH_LIMIT;
+        const size_t nMatchEndLimit = nSize - LAST_LITERALS;
+        size_t nPos = 0;
+        while (nPos < nMatchStartLimit) {
+            uint32_t& nEntry = vTable[Hash4(src + nPos)];
+            size_t nRef = nEntry;
+            nEntry = nPos + 1;
+            if (nRef == 0 || nPos - (nRef - 1) > MAX_OFFSET || ReadLE32(src + nRef - 1) != ReadLE32(src + nPos)) {
+                nPos += 1 + ((nPos - nAnchor) >> SKIP_TRIGGER);
+                continue;
+            }
+            nRef--;
+            while (nPos > nAnchor && nRef > 0 && src[nPos - 1] == src[nRef - 1]) {
+                nPos--;
+                nRef--;
+            }
+            size_t nMatch = MIN_MATCH;
+            while (nPos + nMatch < nMatchEndLimit && src[nRef + nMatch] == src[nPos + nMatch])
+                nMatch++;
+            WriteSequence(vchFrame, src + nAnchor, nPos - nAnchor, nPos - nRef, nMatch);
+            nPos += nMatch;
+            nAnchor = nPos;
+            if (vchFrame.size() >= nSize)
+                return false;
+        }
+    }
+    WriteLastLiterals(vchFrame, src + nAnchor, nSize - nAnchor);
+    return vchFrame.size() < nSize;
+}
+
+bool DecompressRecord(const char* pbegin, size_t nSize, std::vector<char>& vchRecord, size_t nMaxSize)
+{
+    if (nSize < 4)
+        return false;
+    const unsigned char* p = (const unsigned char*)pbegin;
+    const unsigned char* pend = p + nSize;
+    const size_t nRecordSize = ReadLE32(p);
+    p += 4;
+    if (nRecordSize > nMaxSize)
+        return false;
+    vchRecord.resize(nRecordSize);
+    unsigned char* dst = (unsigned char*)vchRecord.data();
+    size_t nOut = 0;
+
+    while (p < pend) {
+        const unsigned char token = *p++;
+        size_t nLiterals = token >> 4;
+        if (nLiterals == 15 && !ReadLength(p, pend, nLiterals))
+            return false;
+        if (nLiterals > (size_t)(pend - p) || nLiterals > nRecordSize - nOut)
+            return false;
+        memcpy(dst + nOut, p, nLiterals);
+        p += nLiterals;
+        nOut += nLiterals;
+        if (p == pend)
+            break;
+
+        if (pend - p < 2)
+            return false;
+        const size_t nOffset = p[0] | (p[1] << 8);
+        p += 2;
+        if (nOffset == 0 || nOffset > nOut)
+            return false;
+        size_t nMatch = token & 15;
+        if (nMatch == 15 && !ReadLength(p, pend, nMatch))
+            return false;
+        nMatch += MIN_MATCH;
+        if (nMatch > nRecordSize - nOut)
+            return false;
+        // Byte by byte, as a match may overlap what it copies
+        const unsigned char* pmatch = dst + nOut - nOffset;
+        for (size_t i = 0; i < nMatch; i++)
+            dst[nOut + i] = pmatch[i];
+        nOut += nMatch;
+    }
+    return nOut == nRecordSize;
+}
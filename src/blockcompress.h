@@ -0,0 +1,33 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCOMPRESS_H
+#define BITCOIN_BLOCKCOMPRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <vector>
+
+/**
+ * Flag in the size written in front of a record in a block or undo file,
+ * marking the record as a compressed frame: the size of the record itself as
+ * 4 little-endian bytes, then the record compressed in the LZ4 block format.
+ * The rest of the size is the size of the frame.
+ */
+static const uint32_t DISK_RECORD_COMPRESSED = 0x80000000;
+
+/**
+ * Compress a record into a frame. Returns false, leaving the record to be
+ * stored as it is, if the frame would not be smaller.
+ */
+bool CompressRecord(const char* pbegin, size_t nSize, std::vector<char>& vchFrame);
+
+/**
+ * Decompress a frame made by CompressRecord into the record, as long as it is
+ * at most nMaxSize bytes. Returns false if the frame is corrupt.
+ */
+bool DecompressRecord(const char* pbegin, size_t nSize, std::vector<char>& vchRecord, size_t nMaxSize);
+
+#endif // BITCOIN_BLOCKCOMPRESS_H
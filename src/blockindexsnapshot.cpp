@@ -0,0 +1,135 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexsnapshot.h"
+
+#include "chain.h"
+#include "clientversion.h"
+#include "hash.h"
+#include "mappedfile.h"
+#include "streams.h"
+#include "util.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+namespace {
+
+const char SNAPSHOT_MAGIC[4] = {'b', 'i', 'd', 'x'};
+const uint32_t SNAPSHOT_VERSION = 2;
+/** Magic, version, the state of the databases and number of entries */
+const size_t SNAPSHOT_HEADER_SIZE = 4 + 4 + (8 + 4 * 4 + 32) + 4;
+/** Hash, predecessor, and the fields of CDiskBlockIndex */
+const size_t SNAPSHOT_ENTRY_SIZE = 32 + 4 + 4 * 7 + 32 + 4 * 3;
+/** The SipHash of everything before it closes the file */
+const size_t SNAPSHOT_CHECKSUM_SIZE = 8;
+
+CSipHasher SnapshotHasher()
+{
+    return CSipHasher(0x626c6f636b696478ULL, SNAPSHOT_VERSION);
+}
+
+bool CompareByHeight(const CBlockIndex* a, const CBlockIndex* b)
+{
+    return a->nHeight < b->nHeight;
+}
+
+} // namespace
+
+bool WriteBlockIndexSnapshot(const fs::path& path, const std::vector<const CBlockIndex*>& vIndexIn, const BlockIndexSnapshotState& state)
+{
+    // In height order, every predecessor comes before what builds on it
+    std::vector<const CBlockIndex*> vIndex(vIndexIn);
+    std::sort(vIndex.begin(), vIndex.end(), CompareByHeight);
+    std::unordered_map<const CBlockIndex*, int32_t> mapPosition;
+    mapPosition.reserve(vIndex.size());
+
+    const fs::path pathTmp = path.string() + ".new";
+    CAutoFile fileout(fsbridge::fopen(pathTmp, "wb"), SER_DISK, CLIENT_VERSION);
+    if (fileout.IsNull())
+        return error("%s: cannot open %s", __func__, pathTmp.string());
+
+    try {
+        CSipHasher hasher = SnapshotHasher();
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << FLATDATA(SNAPSHOT_MAGIC) << SNAPSHOT_VERSION << state << (uint32_t)vIndex.size();
+        for (const CBlockIndex* pindex : vIndex) {
+            int32_t nPrev = -1;
+            if (pindex->pprev) {
+                std::unordered_map<const CBlockIndex*, int32_t>::const_iterator it = mapPosition.find(pindex->pprev);
+                if (it == mapPosition.end())
+                    throw std::runtime_error("predecessor missing from block index");
+                nPrev = it->second;
+            }
+            mapPosition.emplace(pindex, (int32_t)mapPosition.size());
+            ss << pindex->GetBlockHash() << nPrev << pindex->nHeight << pindex->nStatus << pindex->nTx;
+            ss << pindex->nFile << pindex->nDataPos << pindex->nUndoPos;
+            ss << pindex->nVersion << pindex->hashMerkleRoot << pindex->nTime << pindex->nBits << pindex->nNonce;
+            if (ss.size() >= 1 << 20) {
+                hasher.Write((const unsigned char*)ss.data(), ss.size());
+                fileout.write(ss.data(), ss.size());
+                ss.clear();
+            }
+        }
+        hasher.Write((const unsigned char*)ss.data(), ss.size());
+        fileout.write(ss.data(), ss.size());
+        fileout << hasher.Finalize();
+        FileCommit(fileout.Get());
+    } catch (const std::exception& e) {
+        fileout.fclose();
+        fs::remove(pathTmp);
+        return error("%s: %s", __func__, e.what());
+    }
+    fileout.fclose();
+    if (!RenameOver(pathTmp, path)) {
+        fs::remove(pathTmp);
+        return error("%s: cannot rename %s", __func__, pathTmp.string());
+    }
+    return true;
+}
+
+bool LoadBlockIndexSnapshot(const fs::path& path, const BlockIndexSnapshotState& state, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, std::vector<CBlockIndex*>& vIndex)
+{
+    std::shared_ptr<const CMappedFile> mapping = CMappedFile::Open(path);
+    if (!mapping)
+        return false;
+    const char* pbegin = mapping->data();
+    const size_t nSize = mapping->size();
+    mapping->WillRead(0, nSize);
+
+    // Check it all before inserting anything
+    if (nSize < SNAPSHOT_HEADER_SIZE + SNAPSHOT_CHECKSUM_SIZE)
+        return error("%s: %s is truncated", __func__, path.string());
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, pbegin + nSize - SNAPSHOT_CHECKSUM_SIZE);
+    char magic[4];
+    uint32_t nVersion, nCount;
+    uint64_t nChecksum;
+    reader >> FLATDATA(magic) >> nVersion;
+    if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) || nVersion != SNAPSHOT_VERSION)
+        return error("%s: %s is not a block index snapshot of this version", __func__, path.string());
+    BlockIndexSnapshotState stateRead;
+    reader >> stateRead >> nCount;
+    if (stateRead != state)
+        return error("%s: %s is not the snapshot of this block index", __func__, path.string());
+    if (nSize != SNAPSHOT_HEADER_SIZE + (uint64_t)nCount * SNAPSHOT_ENTRY_SIZE + SNAPSHOT_CHECKSUM_SIZE)
+        return error("%s: %s has the wrong size", __func__, path.string());
+    CSpanReader(SER_DISK, CLIENT_VERSION, pbegin + nSize - SNAPSHOT_CHECKSUM_SIZE, pbegin + nSize) >> nChecksum;
+    if (SnapshotHasher().Write((const unsigned char*)pbegin, nSize - SNAPSHOT_CHECKSUM_SIZE).Finalize() != nChecksum)
+        return error("%s: %s is corrupt", __func__, path.string());
+
+    vIndex.clear();
+    vIndex.reserve(nCount);
+    for (uint32_t i = 0; i < nCount; i++) {
+        uint256 hash;
+        int32_t nPrev;
+        reader >> hash >> nPrev;
+        CBlockIndex* pindexNew = insertBlockIndex(hash);
+        pindexNew->pprev = nPrev >= 0 && (uint32_t)nPrev < i ? vIndex[nPrev] : NULL;
+        reader >> pindexNew->nHeight >> pindexNew->nStatus >> pindexNew->nTx;
+        reader >> pindexNew->nFile >> pindexNew->nDataPos >> pindexNew->nUndoPos;
+        reader >> pindexNew->nVersion >> pindexNew->hashMerkleRoot >> pindexNew->nTime >> pindexNew->nBits >> pindexNew->nNonce;
+        vIndex.push_back(pindexNew);
+    }
+    return true;
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKINDEXSNAPSHOT_H
+#define BITCOIN_BLOCKINDEXSNAPSHOT_H
+
+#include "fs.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+#include <functional>
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * A snapshot of the block index, written at shutdown so that the next startup
+ * can load it instead of iterating over the block tree database.
+ *
+ * Entries are fixed-size records in height order, each referring to its
+ * predecessor by position, and the file is read through a memory mapping. A
+ * snapshot is only valid as long as the database has not changed since it
+ * was written: nId ties it to a marker written to the database alongside it,
+ * and what the databases held at the time is recorded with it, so that one
+ * changed by a binary that does not know about the marker is caught too.
+ */
+
+/** What identifies the databases a snapshot was written from */
+struct BlockIndexSnapshotState
+{
+    uint64_t nId;
+    //! The last block file, and from its info, what grows with every block written
+    int32_t nLastBlockFile;
+    uint32_t nBlocks;
+    uint32_t nSize;
+    uint32_t nHeightLast;
+    //! The block the chainstate is at
+    uint256 hashBestChain;
+
+    BlockIndexSnapshotState() : nId(0), nLastBlockFile(0), nBlocks(0), nSize(0), nHeightLast(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nId);
+        READWRITE(nLastBlockFile);
+        READWRITE(nBlocks);
+        READWRITE(nSize);
+        READWRITE(nHeightLast);
+        READWRITE(hashBestChain);
+    }
+
+    friend bool operator==(const BlockIndexSnapshotState& a, const BlockIndexSnapshotState& b)
+    {
+        return a.nId == b.nId && a.nLastBlockFile == b.nLastBlockFile && a.nBlocks == b.nBlocks &&
+               a.nSize == b.nSize && a.nHeightLast == b.nHeightLast && a.hashBestChain == b.hashBestChain;
+    }
+
+    friend bool operator!=(const BlockIndexSnapshotState& a, const BlockIndexSnapshotState& b)
+    {
+        return !(a == b);
+    }
+};
+
+/** Write vIndex to a snapshot at path. Leaves no snapshot behind on failure. */
+bool WriteBlockIndexSnapshot(const fs::path& path, const std::vector<const CBlockIndex*>& vIndex, const BlockIndexSnapshotState& state);
+
+/**
+ * Load the snapshot at path, if it is intact and was written from state, creating
+ * its entries through insertBlockIndex and returning them in height order in
+ * vIndex. Nothing is inserted if it is not.
+ */
+bool LoadBlockIndexSnapshot(const fs::path& path, const BlockIndexSnapshotState& state, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, std::vector<CBlockIndex*>& vIndex);
+
+#endif // BITCOIN_BLOCKINDEXSNAPSHOT_H
@@ -5,6 +5,8 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "chain.h"
+#include "headerstore.h"
+#include "trumpow.h"
 #include "validation.h"
 
 using namespace std;
@@ -18,10 +20,14 @@ CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParam
     block.nVersion       = nVersion;
 
     /* The CBlockIndex object's block header is missing the auxpow.
-       So if this is an auxpow block, read it from disk instead.  We only
-       have to read the actual *header*, not the full block.  */
+       So if this is an auxpow block, take it from the header store, or
+       read it from disk if it is not there.  We only have to read the
+       actual *header*, not the full block.  */
     if (block.IsAuxpow())
     {
+        if (pauxpowheaders && pauxpowheaders->Read(nHeight, GetBlockHash(), block)
+            && (!fCheckPOW || CheckAuxPowProofOfWork(block, consensusParams)))
+            return block;
         ReadBlockHeaderFromDisk(block, this, consensusParams, fCheckPOW);
         return block;
     }
@@ -39,6 +45,7 @@ CBlockHeader CBlockIndex::GetBlockHeader(const Consensus::Params& consensusParam
  * CChain implementation
  */
 void CChain::SetTip(CBlockIndex *pindex) {
+    tipSnapshot.store(pindex);
     if (pindex == NULL) {
         vChain.clear();
         return;
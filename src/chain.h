@@ -14,6 +14,7 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <atomic>
 #include <vector>
 
 class CBlockFileInfo
@@ -433,8 +434,12 @@ public:
 class CChain {
 private:
     std::vector<CBlockIndex*> vChain;
+    //! Tip published for readers that do not hold cs_main
+    std::atomic<CBlockIndex*> tipSnapshot;
 
 public:
+    CChain() : tipSnapshot(NULL) {}
+
     /** Returns the index entry for the genesis block of this chain, or NULL if none. */
     CBlockIndex *Genesis() const {
         return vChain.size() > 0 ? vChain[0] : NULL;
@@ -445,6 +450,15 @@ public:
         return vChain.size() > 0 ? vChain[vChain.size() - 1] : NULL;
     }
 
+    /**
+     * Returns the tip as of the last SetTip(). Unlike the other accessors this
+     * may be called without cs_main; walk back from the result with
+     * GetAncestor() rather than indexing the chain, which may have moved on.
+     */
+    CBlockIndex *TipSnapshot() const {
+        return tipSnapshot.load();
+    }
+
     /** Returns the index entry at a particular height in this chain, or NULL if no such height exists. */
     CBlockIndex *operator[](int nHeight) const {
         if (nHeight < 0 || nHeight >= (int)vChain.size())
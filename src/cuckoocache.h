@@ -307,7 +307,8 @@ public:
     /** setup initializes the container to store no more than new_size
      * elements. setup rounds down to a power of two size.
      *
-     * setup should only be called once.
+     * Calling setup again empties the container. It is not safe while other
+     * threads use it.
      *
      * @param new_size the desired number of elements to store
      * @returns the maximum number of elements storable
@@ -318,9 +319,9 @@ public:
         depth_limit = static_cast<uint8_t>(std::log2(static_cast<float>(std::max((uint32_t)2, new_size))));
         size = 1 << depth_limit;
         hash_mask = size-1;
-        table.resize(size);
+        table.assign(size, Element());
         collection_flags.setup(size);
-        epoch_flags.resize(size);
+        epoch_flags.assign(size, false);
         // Set to 45% as described above
         epoch_size = std::max((uint32_t)1, (45 * size) / 100);
         // Initially set to wait for a whole epoch
@@ -14,14 +14,96 @@
 #include <memenv.h>
 #include <stdint.h>
 
-static leveldb::Options GetOptions(size_t nCacheSize)
+#include <sstream>
+
+#include <boost/foreach.hpp>
+
+/** The bundled LevelDB is built without Snappy (HAVE_SNAPPY=0), so it stores every table uncompressed */
+static const bool fLevelDBSnappy = false;
+
+static CDBOptions GetDefaultDBOptions(const std::string& strProfile)
+{
+    CDBOptions dbOptions;
+    dbOptions.strProfile = strProfile;
+    if (strProfile == "indexes") {
+        // Large and mostly read in ranges: fewer and bigger blocks
+        dbOptions.nMaxOpenFiles = 256;
+        dbOptions.nBlockSize = 32 << 10;
+    }
+    return dbOptions;
+}
+
+static bool ParseDBOption(const std::string& strOption, std::string& strProfile, std::string& strSetting, std::string& strValue)
+{
+    size_t nDot = strOption.find('.');
+    size_t nEquals = strOption.find('=');
+    if (nDot == std::string::npos || nEquals == std::string::npos || nDot > nEquals)
+        return false;
+    strProfile = strOption.substr(0, nDot);
+    strSetting = strOption.substr(nDot + 1, nEquals - nDot - 1);
+    strValue = strOption.substr(nEquals + 1);
+    return strProfile == "chainstate" || strProfile == "blocktree" || strProfile == "indexes";
+}
+
+static bool ApplyDBOption(CDBOptions& dbOptions, const std::string& strSetting, const std::string& strValue)
+{
+    int64_t n;
+    if (!ParseInt64(strValue, &n))
+        return false;
+    if (strSetting == "compression" && (n == 0 || n == 1)) {
+        dbOptions.fCompression = n;
+    } else if (strSetting == "maxopenfiles" && n >= 64 && n <= 50000) {
+        dbOptions.nMaxOpenFiles = n;
+    } else if (strSetting == "blocksize" && n >= 1024 && n <= (4 << 20)) {
+        dbOptions.nBlockSize = n;
+    } else if (strSetting == "bloombits" && n >= 0 && n <= 32) {
+        dbOptions.nBloomBits = n;
+    } else if (strSetting == "writebuffer" && n >= 1 && n <= 45) {
+        dbOptions.nWriteBufferPercent = n;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+CDBOptions GetDBProfile(const std::string& strProfile)
+{
+    CDBOptions dbOptions = GetDefaultDBOptions(strProfile);
+    if (mapMultiArgs.count("-dboption")) {
+        BOOST_FOREACH(const std::string& strOption, mapMultiArgs.at("-dboption")) {
+            std::string strOptionProfile, strSetting, strValue;
+            if (ParseDBOption(strOption, strOptionProfile, strSetting, strValue) && strOptionProfile == strProfile)
+                ApplyDBOption(dbOptions, strSetting, strValue);
+        }
+    }
+    return dbOptions;
+}
+
+bool CheckDBOptions(std::string& strError)
+{
+    if (!mapMultiArgs.count("-dboption"))
+        return true;
+    BOOST_FOREACH(const std::string& strOption, mapMultiArgs.at("-dboption")) {
+        std::string strProfile, strSetting, strValue;
+        CDBOptions dbOptions;
+        if (!ParseDBOption(strOption, strProfile, strSetting, strValue) || !ApplyDBOption(dbOptions, strSetting, strValue)) {
+            strError = strprintf(_("Invalid -dboption: '%s'"), strOption);
+            return false;
+        }
+    }
+    return true;
+}
+
+static leveldb::Options GetOptions(size_t nCacheSize, const CDBOptions& dbOptions)
 {
     leveldb::Options options;
-    options.block_cache = leveldb::NewLRUCache(nCacheSize / 2);
-    options.write_buffer_size = nCacheSize / 4; // up to two write buffers may be held in memory simultaneously
-    options.filter_policy = leveldb::NewBloomFilterPolicy(10);
-    options.compression = leveldb::kNoCompression;
-    options.max_open_files = 64;
+    // up to two write buffers may be held in memory simultaneously
+    options.write_buffer_size = nCacheSize * dbOptions.nWriteBufferPercent / 100;
+    options.block_cache = leveldb::NewLRUCache(nCacheSize - 2 * options.write_buffer_size);
+    options.filter_policy = dbOptions.nBloomBits > 0 ? leveldb::NewBloomFilterPolicy(dbOptions.nBloomBits) : NULL;
+    options.compression = dbOptions.fCompression && fLevelDBSnappy ? leveldb::kSnappyCompression : leveldb::kNoCompression;
+    options.max_open_files = dbOptions.nMaxOpenFiles;
+    options.block_size = dbOptions.nBlockSize;
     if (leveldb::kMajorVersion > 1 || (leveldb::kMajorVersion == 1 && leveldb::kMinorVersion >= 16)) {
         // LevelDB versions before 1.16 consider short writes to be corruption. Only trigger error
         // on corruption in later versions.
@@ -30,14 +112,15 @@ static leveldb::Options GetOptions(size_t nCacheSize)
     return options;
 }
 
-CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate)
+CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bool fWipe, bool obfuscate, const CDBOptions& dbOptionsIn)
+    : pathDB(path), dbOptions(dbOptionsIn), nBatchesWritten(0), nSyncsWritten(0), nBytesWritten(0)
 {
     penv = NULL;
     readoptions.verify_checksums = true;
     iteroptions.verify_checksums = true;
     iteroptions.fill_cache = false;
     syncoptions.sync = true;
-    options = GetOptions(nCacheSize);
+    options = GetOptions(nCacheSize, dbOptions);
     options.create_if_missing = true;
     if (fMemory) {
         penv = leveldb::NewMemEnv(leveldb::Env::Default());
@@ -50,6 +133,9 @@ CDBWrapper::CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory, bo
         }
         TryCreateDirectory(path);
         LogPrintf("Opening LevelDB in %s\n", path.string());
+        LogPrint(BCLog::LEVELDB, "LevelDB options for %s: profile=%s compression=%d maxopenfiles=%d blocksize=%u bloombits=%d writebuffer=%d%%\n",
+            path.string(), dbOptions.strProfile, IsCompressed(), dbOptions.nMaxOpenFiles, dbOptions.nBlockSize,
+            dbOptions.nBloomBits, dbOptions.nWriteBufferPercent);
     }
     leveldb::Status status = leveldb::DB::Open(options, path.string(), &pdb);
     dbwrapper_private::HandleError(status);
@@ -91,9 +177,46 @@ bool CDBWrapper::WriteBatch(CDBBatch& batch, bool fSync)
 {
     leveldb::Status status = pdb->Write(fSync ? syncoptions : writeoptions, &batch.batch);
     dbwrapper_private::HandleError(status);
+    nBatchesWritten++;
+    if (fSync)
+        nSyncsWritten++;
+    nBytesWritten += batch.SizeEstimate();
     return true;
 }
 
+bool CDBWrapper::IsCompressed() const
+{
+    return options.compression != leveldb::kNoCompression;
+}
+
+CDBWrapper::Stats CDBWrapper::GetStats() const
+{
+    Stats stats;
+    stats.nBatchesWritten = nBatchesWritten;
+    stats.nSyncsWritten = nSyncsWritten;
+    stats.nBytesWritten = nBytesWritten;
+    stats.nMemoryUsage = 0;
+
+    std::string strValue;
+    if (pdb->GetProperty("leveldb.approximate-memory-usage", &strValue))
+        stats.nMemoryUsage = atoi64(strValue);
+    if (pdb->GetProperty("leveldb.stats", &stats.strLevelDBStats)) {
+        // One line per level after the three header lines:
+        // level, files, size, then compaction time, read and written
+        std::istringstream stream(stats.strLevelDBStats);
+        std::string strLine;
+        for (int nLine = 0; std::getline(stream, strLine); nLine++) {
+            if (nLine < 3)
+                continue;
+            LevelStats level;
+            std::istringstream line(strLine);
+            if (line >> level.nLevel >> level.nFiles >> level.dSize >> level.dCompactionTime >> level.dCompactionRead >> level.dCompactionWritten)
+                stats.vLevels.push_back(level);
+        }
+    }
+    return stats;
+}
+
 // Prefixed with null character to avoid collisions with other keys
 //
 // We must use a string constructor which specifies length so that we copy
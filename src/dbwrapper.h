@@ -13,6 +13,8 @@
 #include "utilstrencodings.h"
 #include "version.h"
 
+#include <atomic>
+
 #include <leveldb/db.h>
 #include <leveldb/write_batch.h>
 
@@ -27,6 +29,32 @@ public:
 
 class CDBWrapper;
 
+/**
+ * LevelDB settings of a database. Each kind of database starts from its own
+ * profile ("chainstate", "blocktree" or "indexes"), and -dboption can change
+ * any setting of a profile.
+ */
+struct CDBOptions
+{
+    std::string strProfile;
+    //! Compress blocks with Snappy, if LevelDB was built with it
+    bool fCompression;
+    int nMaxOpenFiles;
+    //! Approximate size of the data in a block of a table file
+    size_t nBlockSize;
+    //! Bloom filter bits per key, 0 for none
+    int nBloomBits;
+    //! Percentage of the cache for each of the (up to two) write buffers, the rest is block cache
+    int nWriteBufferPercent;
+
+    CDBOptions() : fCompression(false), nMaxOpenFiles(64), nBlockSize(4096), nBloomBits(10), nWriteBufferPercent(25) {}
+};
+
+/** The settings for a profile, with the -dboption changes applied */
+CDBOptions GetDBProfile(const std::string& strProfile);
+/** Check the -dboption arguments. Returns false with an error for the first bad one. */
+bool CheckDBOptions(std::string& strError);
+
 /** These should be considered an implementation detail of the specific database.
  */
 namespace dbwrapper_private {
@@ -52,8 +80,8 @@ private:
     const CDBWrapper &parent;
     leveldb::WriteBatch batch;
 
-    CDataStream ssKey;
-    CDataStream ssValue;
+    CPooledDataStream ssKey;
+    CPooledDataStream ssValue;
 
 public:
     /**
@@ -88,6 +116,10 @@ public:
         batch.Delete(slKey);
         ssKey.clear();
     }
+
+    void Clear() { batch.Clear(); }
+
+    size_t SizeEstimate() const { return batch.ApproximateSize(); }
 };
 
 class CDBIterator
@@ -111,7 +143,7 @@ public:
     void SeekToFirst();
 
     template<typename K> void Seek(const K& key) {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPooledDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -123,7 +155,7 @@ public:
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
-            CDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
+            CPooledDataStream ssKey(slKey.data(), slKey.data() + slKey.size(), SER_DISK, CLIENT_VERSION);
             ssKey >> key;
         } catch (const std::exception&) {
             return false;
@@ -138,7 +170,7 @@ public:
     template<typename V> bool GetValue(V& value) {
         leveldb::Slice slValue = piter->value();
         try {
-            CDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
+            CPooledDataStream ssValue(slValue.data(), slValue.data() + slValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(dbwrapper_private::GetObfuscateKey(parent));
             ssValue >> value;
         } catch (const std::exception&) {
@@ -151,6 +183,15 @@ public:
         return piter->value().size();
     }
 
+    /**
+     * Append the value as stored to vch, to be deserialized elsewhere through
+     * a stream Xored with the obfuscation key, as GetValue does
+     */
+    void AppendValue(std::vector<char>& vch) {
+        leveldb::Slice slValue = piter->value();
+        vch.insert(vch.end(), slValue.data(), slValue.data() + slValue.size());
+    }
+
 };
 
 class CDBWrapper
@@ -178,6 +219,14 @@ private:
     //! the database itself
     leveldb::DB* pdb;
 
+    fs::path pathDB;
+    CDBOptions dbOptions;
+
+    //! counters of what was written, for GetStats
+    std::atomic<uint64_t> nBatchesWritten;
+    std::atomic<uint64_t> nSyncsWritten;
+    std::atomic<uint64_t> nBytesWritten;
+
     //! a key used for optional XOR-obfuscation of the database
     std::vector<unsigned char> obfuscate_key;
 
@@ -197,14 +246,15 @@ public:
      * @param[in] fWipe       If true, remove all existing data.
      * @param[in] obfuscate   If true, store data obfuscated via simple XOR. If false, XOR
      *                        with a zero'd byte array.
+     * @param[in] dbOptions   LevelDB settings, see GetDBProfile.
      */
-    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false);
+    CDBWrapper(const fs::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, const CDBOptions& dbOptions = CDBOptions());
     ~CDBWrapper();
 
     template <typename K, typename V>
     bool Read(const K& key, V& value) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPooledDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -218,7 +268,7 @@ public:
             dbwrapper_private::HandleError(status);
         }
         try {
-            CDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
+            CPooledDataStream ssValue(strValue.data(), strValue.data() + strValue.size(), SER_DISK, CLIENT_VERSION);
             ssValue.Xor(obfuscate_key);
             ssValue >> value;
         } catch (const std::exception&) {
@@ -238,7 +288,7 @@ public:
     template <typename K>
     bool Exists(const K& key) const
     {
-        CDataStream ssKey(SER_DISK, CLIENT_VERSION);
+        CPooledDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
         ssKey << key;
         leveldb::Slice slKey(ssKey.data(), ssKey.size());
@@ -285,6 +335,48 @@ public:
      * Return true if the database managed by this class contains no entries.
      */
     bool IsEmpty();
+
+    /** Compact the keys from key_begin up to, but not including, key_end */
+    template <typename K>
+    void CompactRange(const K& key_begin, const K& key_end) const
+    {
+        CPooledDataStream ssKey1(SER_DISK, CLIENT_VERSION), ssKey2(SER_DISK, CLIENT_VERSION);
+        ssKey1.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey2.reserve(DBWRAPPER_PREALLOC_KEY_SIZE);
+        ssKey1 << key_begin;
+        ssKey2 << key_end;
+        leveldb::Slice slKey1(ssKey1.data(), ssKey1.size());
+        leveldb::Slice slKey2(ssKey2.data(), ssKey2.size());
+        pdb->CompactRange(&slKey1, &slKey2);
+    }
+
+    struct LevelStats {
+        int nLevel;
+        int nFiles;
+        //! In MiB, as LevelDB reports them
+        double dSize;
+        double dCompactionTime;
+        double dCompactionRead;
+        double dCompactionWritten;
+    };
+
+    struct Stats {
+        uint64_t nBatchesWritten;
+        uint64_t nSyncsWritten;
+        uint64_t nBytesWritten;
+        //! Memory taken by the block cache and the write buffers
+        uint64_t nMemoryUsage;
+        //! Levels that have files or had compactions
+        std::vector<LevelStats> vLevels;
+        //! LevelDB's own summary
+        std::string strLevelDBStats;
+    };
+
+    const fs::path& GetPath() const { return pathDB; }
+    const CDBOptions& GetDBOptions() const { return dbOptions; }
+    /** Whether LevelDB compresses the tables: asked for, and built with Snappy */
+    bool IsCompressed() const;
+    Stats GetStats() const;
 };
 
 #endif // BITCOIN_DBWRAPPER_H
@@ -0,0 +1,169 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "headerstore.h"
+
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "crypto/common.h"
+#include "mappedfile.h"
+#include "streams.h"
+#include "uint256.h"
+#include "util.h"
+
+#include <algorithm>
+
+/** Position in the data file and size of the header, 0 if there is none */
+static const size_t HEADER_STORE_ENTRY_SIZE = 8 + 4;
+/** Heights in a range of decoded headers, as many as a headers message holds */
+static const int HEADER_STORE_RANGE = 2000;
+
+CAuxpowHeaderStore::CAuxpowHeaderStore(const fs::path& dir, size_t nMaxRangesIn) :
+    pathData(dir / "headers.dat"), pathIndex(dir / "index.dat"), fileData(NULL), fileIndex(NULL),
+    nDataSize(0), nHeight(0), fDirty(false), nMaxRanges(std::max<size_t>(nMaxRangesIn, 1))
+{
+    TryCreateDirectory(dir);
+    fileData = fsbridge::fopen(pathData, "ab");
+    fileIndex = fsbridge::fopen(pathIndex, "rb+");
+    if (!fileIndex)
+        fileIndex = fsbridge::fopen(pathIndex, "wb+");
+    if (!fileData || !fileIndex) {
+        LogPrintf("Unable to open the auxpow header store in %s\n", dir.string());
+        if (fileData)
+            fclose(fileData);
+        if (fileIndex)
+            fclose(fileIndex);
+        fileData = fileIndex = NULL;
+        return;
+    }
+    fseek(fileData, 0, SEEK_END);
+    nDataSize = ftell(fileData);
+    fseek(fileIndex, 0, SEEK_END);
+    nHeight = ftell(fileIndex) / HEADER_STORE_ENTRY_SIZE;
+}
+
+CAuxpowHeaderStore::~CAuxpowHeaderStore()
+{
+    Flush();
+    if (fileData)
+        fclose(fileData);
+    if (fileIndex)
+        fclose(fileIndex);
+}
+
+int CAuxpowHeaderStore::Height()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return nHeight;
+}
+
+bool CAuxpowHeaderStore::Write(int nHeightIn, const CBlockHeader& header)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!fileData || !fileIndex || nHeightIn < 0 || nHeightIn > nHeight)
+        return false;
+
+    unsigned char entry[HEADER_STORE_ENTRY_SIZE] = {};
+    std::shared_ptr<const CBlockHeader> pheader;
+    if (header.IsAuxpow()) {
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << header;
+        if (fwrite(ss.data(), 1, ss.size(), fileData) != ss.size()) {
+            fseek(fileData, 0, SEEK_END);
+            nDataSize = ftell(fileData);
+            return error("%s: failed to write header at height %d", __func__, nHeightIn);
+        }
+        WriteLE64(entry, nDataSize);
+        WriteLE32(entry + 8, ss.size());
+        nDataSize += ss.size();
+        pheader = std::make_shared<const CBlockHeader>(header);
+    }
+    if (fseek(fileIndex, (long)nHeightIn * HEADER_STORE_ENTRY_SIZE, SEEK_SET) != 0 ||
+        fwrite(entry, 1, sizeof(entry), fileIndex) != sizeof(entry))
+        return error("%s: failed to write index entry at height %d", __func__, nHeightIn);
+    if (nHeightIn == nHeight)
+        nHeight++;
+    fDirty = true;
+
+    HeaderRange* prange = GetRange(nHeightIn / HEADER_STORE_RANGE, false);
+    if (prange)
+        (*prange)[nHeightIn % HEADER_STORE_RANGE] = pheader;
+    return true;
+}
+
+bool CAuxpowHeaderStore::Read(int nHeightIn, const uint256& hash, CBlockHeader& header)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (nHeightIn < 0 || nHeightIn >= nHeight)
+        return false;
+
+    std::shared_ptr<const CBlockHeader>& pheader = (*GetRange(nHeightIn / HEADER_STORE_RANGE, true))[nHeightIn % HEADER_STORE_RANGE];
+    if (!pheader)
+        pheader = ReadEntry(nHeightIn);
+    if (!pheader || pheader->GetHash() != hash)
+        return false;
+    header = *pheader;
+    return true;
+}
+
+void CAuxpowHeaderStore::Flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (fDirty) {
+        fflush(fileData);
+        fflush(fileIndex);
+        fDirty = false;
+    }
+}
+
+std::shared_ptr<const CBlockHeader> CAuxpowHeaderStore::ReadEntry(int nHeightIn)
+{
+    // The mappings see what was written once it is out of the stdio buffers
+    if (fDirty) {
+        fflush(fileData);
+        fflush(fileIndex);
+        fDirty = false;
+    }
+
+    const size_t nEntryPos = (size_t)nHeightIn * HEADER_STORE_ENTRY_SIZE;
+    if (!mappingIndex || mappingIndex->size() < nEntryPos + HEADER_STORE_ENTRY_SIZE)
+        mappingIndex = CMappedFile::Open(pathIndex);
+    if (!mappingIndex || mappingIndex->size() < nEntryPos + HEADER_STORE_ENTRY_SIZE)
+        return nullptr;
+    const unsigned char* pentry = (const unsigned char*)mappingIndex->data() + nEntryPos;
+    const uint64_t nPos = ReadLE64(pentry);
+    const uint32_t nSize = ReadLE32(pentry + 8);
+    if (nSize == 0 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return nullptr;
+
+    if (!mappingData || nPos > mappingData->size() || nSize > mappingData->size() - nPos)
+        mappingData = CMappedFile::Open(pathData);
+    if (!mappingData || nPos > mappingData->size() || nSize > mappingData->size() - nPos)
+        return nullptr;
+    mappingData->WillRead(nPos, nSize);
+    std::shared_ptr<CBlockHeader> pheader = std::make_shared<CBlockHeader>();
+    try {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, mappingData->data() + nPos, mappingData->data() + nPos + nSize);
+        reader >> *pheader;
+    } catch (const std::exception&) {
+        return nullptr;
+    }
+    return pheader;
+}
+
+CAuxpowHeaderStore::HeaderRange* CAuxpowHeaderStore::GetRange(int nRange, bool fCreate)
+{
+    for (RangeList::iterator it = listRanges.begin(); it != listRanges.end(); ++it) {
+        if (it->first == nRange) {
+            listRanges.splice(listRanges.begin(), listRanges, it);
+            return &listRanges.front().second;
+        }
+    }
+    if (!fCreate)
+        return NULL;
+    listRanges.emplace_front(nRange, HeaderRange(HEADER_STORE_RANGE));
+    if (listRanges.size() > nMaxRanges)
+        listRanges.pop_back();
+    return &listRanges.front().second;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_HEADERSTORE_H
+#define BITCOIN_HEADERSTORE_H
+
+#include "fs.h"
+#include "primitives/block.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class CMappedFile;
+class uint256;
+
+/**
+ * The auxpow headers of the active chain, so that serving them costs neither
+ * a block file read nor the lookup of where the block is.
+ *
+ * Headers with their auxpow proofs are appended to a data file. An index file
+ * holds an entry per height, pointing into it: at a reorganization, the
+ * entries of the heights connected again are overwritten, and the data file
+ * only grows. Both files are read through memory mappings, so headers stored
+ * one height after the other are read one after the other. Every header read
+ * is checked against the hash of the block it is asked for, so neither a
+ * stale entry nor one cut short by a crash is ever returned.
+ *
+ * Headers decoded are kept, in ranges of consecutive heights, for the ranges
+ * most recently served.
+ */
+class CAuxpowHeaderStore
+{
+public:
+    /** Open the store in dir, creating it if it does not exist yet */
+    CAuxpowHeaderStore(const fs::path& dir, size_t nMaxRanges);
+    ~CAuxpowHeaderStore();
+
+    /** Number of heights with an entry, stale or not */
+    int Height();
+
+    /**
+     * Store header as the one at nHeight, which is at most Height(). Nothing is
+     * stored for a header without auxpow, which the block index holds in full.
+     */
+    bool Write(int nHeight, const CBlockHeader& header);
+
+    /** Read the auxpow header at nHeight, if it is the one of block hash */
+    bool Read(int nHeight, const uint256& hash, CBlockHeader& header);
+
+    /** Write out what is buffered */
+    void Flush();
+
+private:
+    typedef std::vector<std::shared_ptr<const CBlockHeader> > HeaderRange;
+    typedef std::list<std::pair<int, HeaderRange> > RangeList;
+
+    std::mutex mutex;
+    const fs::path pathData;
+    const fs::path pathIndex;
+    FILE* fileData;
+    FILE* fileIndex;
+    uint64_t nDataSize;
+    int nHeight;
+    bool fDirty;
+    std::shared_ptr<const CMappedFile> mappingData;
+    std::shared_ptr<const CMappedFile> mappingIndex;
+    RangeList listRanges; //!< Most recently used first
+    const size_t nMaxRanges;
+
+    std::shared_ptr<const CBlockHeader> ReadEntry(int nHeightIn);
+    HeaderRange* GetRange(int nRange, bool fCreate);
+
+    CAuxpowHeaderStore(const CAuxpowHeaderStore&);
+    CAuxpowHeaderStore& operator=(const CAuxpowHeaderStore&);
+};
+
+#endif // BITCOIN_HEADERSTORE_H
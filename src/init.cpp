@@ -19,6 +19,7 @@
 #include "consensus/validation.h"
 #include "crypto/scrypt.h" // for scrypt_detect_sse2
 #include "fs.h"
+#include "headerstore.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -27,6 +28,8 @@
 #include "netbase.h"
 #include "net.h"
 #include "net_processing.h"
+#include "perfstats.h"
+#include "policy/fees.h"
 #include "policy/policy.h"
 #include "rpc/server.h"
 #include "rpc/register.h"
@@ -100,6 +103,41 @@ enum BindFlags {
 };
 
 static const char* FEE_ESTIMATES_FILENAME="fee_estimates.dat";
+/** How often the blocks seen by the fee estimator are saved, in seconds */
+static const int64_t FEE_ESTIMATES_FLUSH_INTERVAL = 10 * 60;
+//! Whether fee_estimates.dat was written in full since startup, so that blocks can be appended to it
+static bool fFeeEstimatesWritten = false;
+
+/**
+ * Save the fee estimates. The blocks processed since the last time are
+ * appended to fee_estimates.dat, unless fFull is set, the file was not
+ * written since startup, or enough blocks were appended already: then the
+ * whole file is written anew.
+ */
+static void FlushFeeEstimates(bool fFull)
+{
+    fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
+    if (!fFull && fFeeEstimatesWritten && mempool.GetFeeEstimatesJournalSize() < MAX_FEE_ESTIMATES_JOURNAL) {
+        CAutoFile est_fileout(fsbridge::fopen(est_path, "ab"), SER_DISK, CLIENT_VERSION);
+        if (!est_fileout.IsNull() && mempool.AppendFeeEstimates(est_fileout))
+            return;
+        LogPrintf("%s: Failed to append fee estimates to %s, writing them in full\n", __func__, est_path.string());
+    }
+
+    // The old file stays in place until the new one is complete
+    fs::path est_path_new = est_path.string() + ".new";
+    {
+        CAutoFile est_fileout(fsbridge::fopen(est_path_new, "wb"), SER_DISK, CLIENT_VERSION);
+        if (est_fileout.IsNull()) {
+            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path_new.string());
+            return;
+        }
+        if (!mempool.WriteFeeEstimates(est_fileout))
+            return;
+        FileCommit(est_fileout.Get());
+    }
+    fFeeEstimatesWritten = RenameOver(est_path_new, est_path);
+}
 
 //////////////////////////////////////////////////////////////////////////////
 //
@@ -168,7 +206,6 @@ public:
     // Writes do not need similar protection, as failure to write is handled by the caller.
 };
 
-static CCoinsViewDB *pcoinsdbview = NULL;
 static CCoinsViewErrorCatcher *pcoinscatcher = NULL;
 static std::unique_ptr<ECCVerifyHandle> globalVerifyHandle;
 
@@ -212,6 +249,7 @@ void Shutdown()
     UnregisterValidationInterface(peerLogic.get());
     peerLogic.reset();
     g_connman.reset();
+    g_blockTemplateManager.reset();
 
     StopTorControl();
     UnregisterNodeSignals(GetNodeSignals());
@@ -220,12 +258,7 @@ void Shutdown()
 
     if (fFeeEstimatesInitialized)
     {
-        fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
-        CAutoFile est_fileout(fsbridge::fopen(est_path, "wb"), SER_DISK, CLIENT_VERSION);
-        if (!est_fileout.IsNull())
-            mempool.WriteFeeEstimates(est_fileout);
-        else
-            LogPrintf("%s: Failed to write fee estimates to %s\n", __func__, est_path.string());
+        FlushFeeEstimates(true);
         fFeeEstimatesInitialized = false;
     }
 
@@ -233,6 +266,7 @@ void Shutdown()
         LOCK(cs_main);
         if (pcoinsTip != NULL) {
             FlushStateToDisk();
+            DumpBlockIndexSnapshot();
         }
         delete pcoinsTip;
         pcoinsTip = NULL;
@@ -242,6 +276,10 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete pauxpowheaders;
+        pauxpowheaders = NULL;
+        delete pindexdb;
+        pindexdb = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -271,6 +309,7 @@ void Shutdown()
     globalVerifyHandle.reset();
     ECC_Stop();
     LogPrintf("%s: done\n", __func__);
+    StopLogWriter();
 }
 
 /**
@@ -307,7 +346,7 @@ void OnRPCStopped()
     uiInterface.NotifyBlockTip.disconnect(&RPCNotifyBlockChange);
     RPCNotifyBlockChange(false, nullptr);
     cvBlockChange.notify_all();
-    LogPrint("rpc", "RPC stopped.\n");
+    LogPrint(BCLog::RPC, "RPC stopped.\n");
 }
 
 void OnRPCPreCommand(const CRPCCommand& cmd)
@@ -343,13 +382,20 @@ std::string HelpMessage(HelpMessageMode mode)
     }
     strUsage += HelpMessageOpt("-datadir=<dir>", _("Specify data directory"));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt("-dboption=<db>.<setting>=<n>", _("Change a LevelDB setting of the chainstate, blocktree or indexes database: compression (0 or 1, needs LevelDB built with Snappy), maxopenfiles, blocksize (in bytes), bloombits (per key) or writebuffer (percent of the database cache). Can be specified multiple times"));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+    strUsage += HelpMessageOpt("-maxorphanpeersize=<n>", strprintf(_("Keep at most <n> kilobytes of unconnectable transactions from any one peer, evicting its oldest ones first (default: %u)"), DEFAULT_MAX_ORPHAN_PEER_SIZE));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
+    strUsage += HelpMessageOpt("-trustmempoolsnapshot", strprintf(_("Skip script checks for transactions reloaded from mempool.dat when it was written at the current chain tip (default: %u)"), DEFAULT_TRUST_MEMPOOL_SNAPSHOT));
     strUsage += HelpMessageOpt("-blockreconstructionextratxn=<n>", strprintf(_("Extra transactions to keep in memory for compact block reconstructions (default: %u)"), DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN));
+    strUsage += HelpMessageOpt("-mmapblocks", strprintf(_("Read blocks from memory-mapped block files (default: %u)"), DEFAULT_MMAP_BLOCKS));
+    strUsage += HelpMessageOpt("-compressblocks", strprintf(_("Store blocks and undo data compressed, and recompress old block files in the background. Versions without this option cannot read the block files once it has been used (default: %u)"), DEFAULT_COMPRESS_BLOCKS));
+    strUsage += HelpMessageOpt("-blockindexsnapshot", strprintf(_("Write a snapshot of the block index at shutdown to load at the next startup (default: %u)"), DEFAULT_BLOCK_INDEX_SNAPSHOT));
+    strUsage += HelpMessageOpt("-auxpowheaderstore", strprintf(_("Keep the auxpow headers of the active chain in a store of their own, to serve them from (default: %u)"), DEFAULT_AUXPOW_HEADER_STORE));
     strUsage += HelpMessageOpt("-par=<n>", strprintf(_("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)"),
         -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS));
 #ifndef WIN32
@@ -419,6 +465,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("ZeroMQ notification options:"));
     strUsage += HelpMessageOpt("-zmqpubhashblock=<address>", _("Enable publish hash block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubhashauxblock=<address>", _("Enable publish of new merge-mining work (hash of the block it builds on) in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
 #endif
@@ -432,6 +479,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-checkblockindex", strprintf("Do a full consistency check for mapBlockIndex, setBlockIndexCandidates, chainActive and mapBlocksUnlinked occasionally. Also sets -checkmempool (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkmempool=<n>", strprintf("Run checks every <n> transactions (default: %u)", Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
         strUsage += HelpMessageOpt("-checkpoints", strprintf("Disable expensive verification for known chain history (default: %u)", DEFAULT_CHECKPOINTS_ENABLED));
+        strUsage += HelpMessageOpt("-dbbatchsize=<n>", strprintf("Write the chainstate to disk in chunks of at most <n> bytes (default: %u)", nDefaultDbBatchSize));
         strUsage += HelpMessageOpt("-disablesafemode", strprintf("Disable safemode, override a real safe mode event (default: %u)", DEFAULT_DISABLE_SAFEMODE));
         strUsage += HelpMessageOpt("-testsafemode", strprintf("Force safe mode (default: %u)", DEFAULT_TESTSAFEMODE));
         strUsage += HelpMessageOpt("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages");
@@ -443,23 +491,22 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-bip9params=deployment:start:end", "Use given start/end times for specified BIP9 deployment (regtest-only)");
     }
-    std::string debugCategories = "addrman, alert, bench, cmpctblock, coindb, db, http, libevent, lock, mempool, mempoolrej, net, proxy, prune, rand, reindex, rpc, selectcoins, tor, zmq"; // Don't translate these and qt below
-    if (mode == HMM_BITCOIN_QT)
-        debugCategories += ", qt";
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
-        _("If <category> is not supplied or if <category> = 1, output all debugging information.") + _("<category> can be:") + " " + debugCategories + ".");
+        _("If <category> is not supplied or if <category> = 1, output all debugging information.") + " " + _("<category> can be:") + " " + ListLogCategories() + ".");
     if (showDebug)
         strUsage += HelpMessageOpt("-nodebug", "Turn off debugging messages, same as -debug=0");
     strUsage += HelpMessageOpt("-help-debug", _("Show all debugging options (usage: --help -help-debug)"));
+    strUsage += HelpMessageOpt("-logasync", strprintf(_("Write debug.log from a background thread, dropping messages rather than waiting when it falls behind (default: %u)"), DEFAULT_LOGASYNC));
     strUsage += HelpMessageOpt("-logips", strprintf(_("Include IP addresses in debug output (default: %u)"), DEFAULT_LOGIPS));
     strUsage += HelpMessageOpt("-logtimestamps", strprintf(_("Prepend debug output with timestamp (default: %u)"), DEFAULT_LOGTIMESTAMPS));
     if (showDebug)
     {
+        strUsage += HelpMessageOpt("-perfstats", strprintf("Time block connection, script checks, mempool acceptance and message handling for getperfstats (default: %u)", DEFAULT_PERFSTATS));
         strUsage += HelpMessageOpt("-logtimemicros", strprintf("Add microsecond precision to debug timestamps (default: %u)", DEFAULT_LOGTIMEMICROS));
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
@@ -488,6 +535,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-mempoolreplacement", strprintf(_("Enable transaction replacement in the memory pool (default: %u)"), DEFAULT_ENABLE_REPLACEMENT));
 
     strUsage += HelpMessageGroup(_("Block creation options:"));
+    strUsage += HelpMessageOpt("-auxemptytemplate", strprintf(_("On a new tip, have createauxblock and getauxblock hand out a coinbase-only block at once and the full block once it is assembled in the background (default: %u)"), DEFAULT_AUX_EMPTY_TEMPLATE));
+    strUsage += HelpMessageOpt("-auxtemplatenotify=<cmd>", _("Execute command when a full block template assembled in the background is ready (%s in cmd is replaced by the hash of the block it builds on, %i by its height)"));
+    strUsage += HelpMessageOpt("-blockclusters", strprintf(_("Select block transactions by merging the linearized mempool clusters rather than by ancestor feerate (default: %u)"), DEFAULT_BLOCK_CLUSTERS));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(_("Set maximum BIP141 block weight (default: %d)"), DEFAULT_BLOCK_MAX_WEIGHT));
     strUsage += HelpMessageOpt("-blockmaxsize=<n>", strprintf(_("Set maximum block size in bytes (default: %d)"), DEFAULT_BLOCK_MAX_SIZE));
     strUsage += HelpMessageOpt("-blockprioritysize=<n>", strprintf(_("Set maximum size of high-priority/low-fee transactions in bytes (default: %d)"), DEFAULT_BLOCK_PRIORITY_SIZE));
@@ -549,6 +599,15 @@ static void BlockNotifyCallback(bool initialSync, const CBlockIndex *pBlockIndex
     boost::thread t(runCommand, strCmd); // thread runs free
 }
 
+static void TemplateNotifyCallback(const CBlockIndex *pBlockIndex)
+{
+    std::string strCmd = GetArg("-auxtemplatenotify", "");
+
+    boost::replace_all(strCmd, "%s", pBlockIndex->GetBlockHash().GetHex());
+    boost::replace_all(strCmd, "%i", boost::lexical_cast<std::string>(pBlockIndex->nHeight));
+    boost::thread t(runCommand, strCmd); // thread runs free
+}
+
 static bool fHaveGenesis = false;
 static boost::mutex cs_GenesisWait;
 static CConditionVariable condvar_GenesisWait;
@@ -686,6 +745,7 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
     }
     } // End scope of CImportingNow
     LoadMempool();
+    mempool.SetIsLoaded(!fRequestShutdown);
     fDumpMempoolLater = !fRequestShutdown;
 }
 
@@ -904,6 +964,10 @@ bool AppInitParameterInteraction()
             return InitError(_("Prune mode is incompatible with -txindex."));
     }
 
+    std::string strDBError;
+    if (!CheckDBOptions(strDBError))
+        return InitError(strDBError);
+
     // Make sure enough file descriptors are available
     int nBind = std::max(
                 (mapMultiArgs.count("-bind") ? mapMultiArgs.at("-bind").size() : 0) +
@@ -911,12 +975,23 @@ bool AppInitParameterInteraction()
     nUserMaxConnections = GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
+    // Databases allowed more open files than the default need more than MIN_CORE_FILEDESCRIPTORS
+    int nMinCoreFDs = MIN_CORE_FILEDESCRIPTORS;
+#ifndef WIN32
+    std::vector<std::string> vProfiles = {"chainstate", "blocktree"};
+    // The index database is only opened for one of the indexes
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) || GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX))
+        vProfiles.push_back("indexes");
+    for (const std::string& strProfile : vProfiles)
+        nMinCoreFDs += std::max(GetDBProfile(strProfile).nMaxOpenFiles - CDBOptions().nMaxOpenFiles, 0);
+#endif
+
     // Trim requested connection counts, to fit into system limitations
-    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS)), 0);
-    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS + MAX_ADDNODE_CONNECTIONS);
-    if (nFD < MIN_CORE_FILEDESCRIPTORS)
+    nMaxConnections = std::max(std::min(nMaxConnections, (int)(FD_SETSIZE - nBind - nMinCoreFDs - MAX_ADDNODE_CONNECTIONS)), 0);
+    nFD = RaiseFileDescriptorLimit(nMaxConnections + nMinCoreFDs + MAX_ADDNODE_CONNECTIONS);
+    if (nFD < nMinCoreFDs)
         return InitError(_("Not enough file descriptors available."));
-    nAvailableFds = nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS;
+    nAvailableFds = nFD - nMinCoreFDs - MAX_ADDNODE_CONNECTIONS;
     nMaxConnections = std::min(nAvailableFds, nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections)
@@ -924,13 +999,23 @@ bool AppInitParameterInteraction()
 
     // ********************************************************* Step 3: parameter-to-internal-flags
 
-    fDebug = mapMultiArgs.count("-debug");
-    // Special-case: if -debug=0/-nodebug is set, turn off debugging messages
-    if (fDebug) {
+    if (mapMultiArgs.count("-debug") > 0) {
+        // Special-case: if -debug=0/-nodebug is set, turn off debugging messages
         const std::vector<std::string>& categories = mapMultiArgs.at("-debug");
-        if (GetBoolArg("-nodebug", false) || find(categories.begin(), categories.end(), std::string("0")) != categories.end())
-            fDebug = false;
+
+        if (!(GetBoolArg("-nodebug", false) || find(categories.begin(), categories.end(), std::string("0")) != categories.end())) {
+            for (const auto& cat : categories) {
+                uint32_t flag = 0;
+                if (!GetLogCategory(&flag, &cat)) {
+                    InitWarning(strprintf(_("Unsupported logging category %s=%s."), "-debug", cat));
+                    continue;
+                }
+                logCategories |= flag;
+            }
+        }
     }
+    fDebug = logCategories != BCLog::NONE;
+    fPerfStats = GetBoolArg("-perfstats", DEFAULT_PERFSTATS);
 
     // Check for -debugnet
     if (GetBoolArg("-debugnet", false))
@@ -958,6 +1043,10 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fMmapBlocks = GetBoolArg("-mmapblocks", DEFAULT_MMAP_BLOCKS);
+    fCompressBlocks = GetBoolArg("-compressblocks", DEFAULT_COMPRESS_BLOCKS);
+    fBlockIndexSnapshot = GetBoolArg("-blockindexsnapshot", DEFAULT_BLOCK_INDEX_SNAPSHOT);
+    fAuxpowHeaderStore = GetBoolArg("-auxpowheaderstore", DEFAULT_AUXPOW_HEADER_STORE);
 
     hashAssumeValid = uint256S(GetArg("-assumevalid", chainparams.GetConsensus(0).defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1098,6 +1187,7 @@ bool AppInitParameterInteraction()
 
     // Configure usage of the namecoin AuxPow API structure
     fUseNamecoinApi = GetBoolArg("-rpcnamecoinapi", DEFAULT_USE_NAMECOIN_API);
+    fAuxEmptyTemplate = GetBoolArg("-auxemptytemplate", DEFAULT_AUX_EMPTY_TEMPLATE);
 
     fIsBareMultisigStd = GetBoolArg("-permitbaremultisig", DEFAULT_PERMIT_BAREMULTISIG);
     fAcceptDatacarrier = GetBoolArg("-datacarrier", DEFAULT_ACCEPT_DATACARRIER);
@@ -1224,8 +1314,11 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         ShrinkDebugFile();
     }
 
-    if (fPrintToDebugLog)
+    if (fPrintToDebugLog) {
         OpenDebugLog();
+        if (!fPrintToConsole && GetBoolArg("-logasync", DEFAULT_LOGASYNC))
+            StartLogWriter();
+    }
 
     if (!fLogTimestamps)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()));
@@ -1236,11 +1329,14 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Using at most %i automatic connections (%i file descriptors available)\n", nMaxConnections, nFD);
 
     InitSignatureCache();
+    InitScriptExecutionCache();
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadMempoolScriptCheck);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1468,6 +1564,9 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    bool fAnyIndex = GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) || GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX);
+    int64_t nIndexDBCache = fAnyIndex ? std::min(nTotalCache / 8, nMaxIndexDBCache << 20) : (nMinIndexDBCache << 20);
+    nTotalCache -= nIndexDBCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1475,9 +1574,13 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for address/spent/timestamp index database\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
 
+    if (fAuxpowHeaderStore)
+        pauxpowheaders = new CAuxpowHeaderStore(GetDataDir() / "blocks" / "auxpow", AUXPOW_HEADER_STORE_RANGES);
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -1493,12 +1596,20 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete pindexdb;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
+                pindexdb = new CIndexDB(nIndexDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
                 pcoinsTip = new CCoinsViewCache(pcoinscatcher);
 
+                // Older versions kept the indexes in the block tree database
+                if (!pindexdb->MigrateFromBlockTree(*pblocktree)) {
+                    strLoadError = _("Error moving the indexes to their own database");
+                    break;
+                }
+
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
                     //If we're reindexing in prune mode, wipe away unusable block files and all undo data files
@@ -1610,7 +1721,21 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     // Allowed to fail as this file IS missing on first startup.
     if (!est_filein.IsNull())
         mempool.ReadFeeEstimates(est_filein);
+    est_filein.fclose();
     fFeeEstimatesInitialized = true;
+    scheduler.scheduleEvery(boost::bind(&FlushFeeEstimates, false), FEE_ESTIMATES_FLUSH_INTERVAL);
+    if (fCompressBlocks)
+        scheduler.scheduleEvery(&RecompressBlockFiles, BLOCKFILE_RECOMPRESS_INTERVAL);
+    if (fAuxpowHeaderStore)
+        scheduler.scheduleEvery(&ExtendAuxpowHeaderStore, AUXPOW_HEADER_STORE_INTERVAL);
+
+    g_blockTemplateManager.reset(new BlockTemplateManager(chainparams, mempool));
+    if (IsArgSet("-auxtemplatenotify"))
+        g_blockTemplateManager->NotifyTemplateRebuilt.connect(TemplateNotifyCallback);
+#if ENABLE_ZMQ
+    if (pzmqNotificationInterface)
+        g_blockTemplateManager->NotifyTemplateRebuilt.connect(boost::bind(&CZMQNotificationInterface::NotifyAuxWork, pzmqNotificationInterface, _1));
+#endif
 
     // ********************************************************* Step 8: load wallet
 #ifdef ENABLE_WALLET
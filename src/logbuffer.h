@@ -0,0 +1,121 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_LOGBUFFER_H
+#define BITCOIN_LOGBUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+/**
+ * Bounded lock-free queue of log lines between the threads logging and the
+ * thread writing debug.log (a bounded MPMC ring, each slot carrying a
+ * sequence number that tells whose turn it is).
+ *
+ * Both the number of lines and their total size are capped. A line that
+ * does not fit is dropped and counted instead of blocking the caller.
+ */
+class CLogBuffer
+{
+public:
+    CLogBuffer(size_t nSlotsIn, size_t nMaxBytesIn) : nMaxBytes(nMaxBytesIn), nEnqueuePos(0), nDequeuePos(0), nBytes(0), nDropped(0)
+    {
+        size_t nSlots = 2;
+        while (nSlots < nSlotsIn)
+            nSlots <<= 1;
+        nMask = nSlots - 1;
+        slots.reset(new Slot[nSlots]);
+        for (size_t i = 0; i < nSlots; i++)
+            slots[i].nSequence.store(i, std::memory_order_relaxed);
+    }
+
+    /** Queue a line logged at nTimeMicros; false if it was dropped */
+    bool Push(std::string&& str, int64_t nTimeMicros)
+    {
+        const size_t nSize = str.size();
+        if (nBytes.fetch_add(nSize, std::memory_order_relaxed) + nSize > nMaxBytes)
+            return Drop(nSize);
+        Slot* slot;
+        size_t nPos = nEnqueuePos.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &slots[nPos & nMask];
+            const size_t nSeq = slot->nSequence.load(std::memory_order_acquire);
+            const intptr_t nDiff = (intptr_t)nSeq - (intptr_t)nPos;
+            if (nDiff == 0) {
+                if (nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (nDiff < 0) {
+                // Every slot is taken
+                return Drop(nSize);
+            } else {
+                nPos = nEnqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        slot->str = std::move(str);
+        slot->nTimeMicros = nTimeMicros;
+        slot->nSequence.store(nPos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Take the oldest line; false if there is none */
+    bool Pop(std::string& str, int64_t& nTimeMicros)
+    {
+        Slot* slot;
+        size_t nPos = nDequeuePos.load(std::memory_order_relaxed);
+        while (true) {
+            slot = &slots[nPos & nMask];
+            const size_t nSeq = slot->nSequence.load(std::memory_order_acquire);
+            const intptr_t nDiff = (intptr_t)nSeq - (intptr_t)(nPos + 1);
+            if (nDiff == 0) {
+                if (nDequeuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+                    break;
+            } else if (nDiff < 0) {
+                return false;
+            } else {
+                nPos = nDequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        str = std::move(slot->str);
+        nTimeMicros = slot->nTimeMicros;
+        std::string().swap(slot->str);
+        slot->nSequence.store(nPos + nMask + 1, std::memory_order_release);
+        nBytes.fetch_sub(str.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    /** Lines dropped so far */
+    uint64_t GetDropped() const { return nDropped.load(std::memory_order_relaxed); }
+    size_t GetQueuedBytes() const { return nBytes.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<size_t> nSequence;
+        std::string str;
+        int64_t nTimeMicros;
+    };
+
+    std::unique_ptr<Slot[]> slots;
+    size_t nMask;
+    const size_t nMaxBytes;
+    std::atomic<size_t> nEnqueuePos;
+    std::atomic<size_t> nDequeuePos;
+    std::atomic<size_t> nBytes;
+    std::atomic<uint64_t> nDropped;
+
+    bool Drop(size_t nSize)
+    {
+        nBytes.fetch_sub(nSize, std::memory_order_relaxed);
+        nDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    CLogBuffer(const CLogBuffer&);
+    CLogBuffer& operator=(const CLogBuffer&);
+};
+
+#endif // BITCOIN_LOGBUFFER_H
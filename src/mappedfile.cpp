@@ -0,0 +1,108 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include "util.h"
+
+#include <algorithm>
+#include <limits>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/** How far past the end of one read the next may start and still continue a scan */
+static const size_t MAPPED_SCAN_GAP = 4096;
+/** How much of a scanned file to read ahead */
+static const size_t MAPPED_READAHEAD = 16 << 20;
+
+std::shared_ptr<const CMappedFile> CMappedFile::Open(const fs::path& path)
+{
+#ifdef WIN32
+    return nullptr;
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0 || (uint64_t)st.st_size > std::numeric_limits<size_t>::max()) {
+        close(fd);
+        return nullptr;
+    }
+    void* p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping keeps its own reference to the file
+    close(fd);
+    if (p == MAP_FAILED) {
+        LogPrintf("Unable to map %s: %s\n", path.string(), strerror(errno));
+        return nullptr;
+    }
+    return std::shared_ptr<const CMappedFile>(new CMappedFile((const char*)p, st.st_size));
+#endif
+}
+
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pbegin, nSize);
+#endif
+}
+
+void CMappedFile::WillRead(size_t nOffset, size_t nLength) const
+{
+#ifndef WIN32
+    if (nOffset >= nSize)
+        return;
+    nLength = std::min(nLength, nSize - nOffset);
+    const size_t nLastEnd = nLastReadEnd.exchange(nOffset + nLength, std::memory_order_relaxed);
+    if (nOffset >= nLastEnd && nOffset - nLastEnd <= MAPPED_SCAN_GAP)
+        nLength = std::min(nLength + MAPPED_READAHEAD, nSize - nOffset);
+    static const size_t nPageSize = sysconf(_SC_PAGESIZE);
+    const size_t nStart = nOffset - nOffset % nPageSize;
+    madvise((void*)(pbegin + nStart), nOffset + nLength - nStart, MADV_WILLNEED);
+#endif
+}
+
+std::shared_ptr<const CMappedFile> CMappedFileCache::Get(const fs::path& path, size_t nMinSize)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (MappingList::iterator it = listMappings.begin(); it != listMappings.end(); ++it) {
+        if (it->first != path)
+            continue;
+        if (it->second->size() >= nMinSize) {
+            listMappings.splice(listMappings.begin(), listMappings, it);
+            return it->second;
+        }
+        // The file grew past the mapping
+        listMappings.erase(it);
+        break;
+    }
+    std::shared_ptr<const CMappedFile> mapping = CMappedFile::Open(path);
+    if (!mapping || mapping->size() < nMinSize)
+        return nullptr;
+    listMappings.emplace_front(path, mapping);
+    if (listMappings.size() > nMaxFiles)
+        listMappings.pop_back();
+    return mapping;
+}
+
+void CMappedFileCache::Erase(const fs::path& path)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    for (MappingList::iterator it = listMappings.begin(); it != listMappings.end(); ++it) {
+        if (it->first == path) {
+            listMappings.erase(it);
+            return;
+        }
+    }
+}
+
+void CMappedFileCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    listMappings.clear();
+}
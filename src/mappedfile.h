@@ -0,0 +1,80 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_MAPPEDFILE_H
+#define BITCOIN_MAPPEDFILE_H
+
+#include "fs.h"
+
+#include <stddef.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <utility>
+
+/**
+ * A whole file mapped read-only into memory. Reads through it cost no system
+ * call and no copy into a stdio buffer; the pages are the kernel's page cache.
+ *
+ * The mapping covers the file as it was when mapped. Data appended later is
+ * only visible through a new mapping, and the file must not be truncated
+ * below what is read from it.
+ */
+class CMappedFile
+{
+public:
+    /** Map path, or return nullptr if it is empty, missing or cannot be mapped */
+    static std::shared_ptr<const CMappedFile> Open(const fs::path& path);
+
+    ~CMappedFile();
+
+    const char* data() const { return pbegin; }
+    size_t size() const { return nSize; }
+
+    /**
+     * Tell the kernel that [nOffset, nOffset + nLength) is about to be read.
+     * Reads that continue where the previous one ended are taken as a scan,
+     * and the file is read ahead further.
+     */
+    void WillRead(size_t nOffset, size_t nLength) const;
+
+private:
+    const char* pbegin;
+    size_t nSize;
+    mutable std::atomic<size_t> nLastReadEnd;
+
+    CMappedFile(const char* pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn), nLastReadEnd(0) {}
+    CMappedFile(const CMappedFile&);
+    CMappedFile& operator=(const CMappedFile&);
+};
+
+/**
+ * The most recently used mappings of a set of files. A mapping handed out
+ * stays valid for as long as it is referenced, even once evicted.
+ */
+class CMappedFileCache
+{
+public:
+    explicit CMappedFileCache(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn) {}
+
+    /**
+     * A mapping of path at least nMinSize bytes long, remapping the file if
+     * it has grown since it was mapped. nullptr if there is no such mapping.
+     */
+    std::shared_ptr<const CMappedFile> Get(const fs::path& path, size_t nMinSize);
+    /** Drop the mapping of a file that is about to be removed or rewritten */
+    void Erase(const fs::path& path);
+    void Clear();
+
+private:
+    typedef std::list<std::pair<fs::path, std::shared_ptr<const CMappedFile> > > MappingList;
+
+    std::mutex mutex;
+    MappingList listMappings; //!< Most recently used first
+    const size_t nMaxFiles;
+};
+
+#endif // BITCOIN_MAPPEDFILE_H
@@ -17,6 +17,7 @@
 #include "hash.h"
 #include "validation.h"
 #include "net.h"
+#include "perfstats.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
@@ -28,6 +29,7 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <boost/bind/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 #include <queue>
@@ -47,6 +49,9 @@
 uint64_t nLastBlockTx = 0;
 uint64_t nLastBlockSize = 0;
 uint64_t nLastBlockWeight = 0;
+BlockValidityTimings lastBlockValidityTimings;
+
+std::unique_ptr<BlockTemplateManager> g_blockTemplateManager;
 
 class ScoreCompare
 {
@@ -109,6 +114,8 @@ BlockAssembler::BlockAssembler(const CChainParams& _chainparams)
     nBlockMaxSize = std::max((unsigned int)1000, std::min((unsigned int)(MAX_BLOCK_SERIALIZED_SIZE-1000), nBlockMaxSize));
     // Whether we need to account for byte usage (in addition to weight usage)
     fNeedSizeAccounting = (nBlockMaxSize < MAX_BLOCK_SERIALIZED_SIZE-1000);
+
+    fUseClusters = GetBoolArg("-blockclusters", DEFAULT_BLOCK_CLUSTERS);
 }
 
 void BlockAssembler::resetBlock()
@@ -129,8 +136,9 @@ void BlockAssembler::resetBlock()
     blockFinished = false;
 }
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, bool fEmpty)
 {
+    PERF_TIMER("createnewblock");
     int64_t nTimeStart = GetTimeMicros();
 
     resetBlock();
@@ -176,10 +184,15 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, consensus) && fMineWitnessTx;
 
-    addPriorityTxs();
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    if (!fEmpty) {
+        addPriorityTxs();
+        if (fUseClusters)
+            addClusterTxs(nPackagesSelected);
+        else
+            addPackageTxs(nPackagesSelected, nDescendantsUpdated);
+    }
 
     int64_t nTime1 = GetTimeMicros();
 
@@ -211,12 +224,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
 
     CValidationState state;
-    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
+    if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false, &lastBlockValidityTimings)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint("bench", "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
@@ -552,6 +565,99 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     }
 }
 
+namespace {
+/** Orders (cluster, chunk) positions by chunk feerate, best on top of a heap */
+struct CompareClusterChunk {
+    const std::vector<CTxMemPool::ClusterRef>& vClusters;
+    explicit CompareClusterChunk(const std::vector<CTxMemPool::ClusterRef>& vClustersIn) : vClusters(vClustersIn) {}
+
+    bool operator()(const std::pair<size_t, size_t>& a, const std::pair<size_t, size_t>& b) const
+    {
+        const CTxMemPool::Cluster::Chunk& ca = vClusters[a.first]->vChunks[a.second];
+        const CTxMemPool::Cluster::Chunk& cb = vClusters[b.first]->vChunks[b.second];
+        double f1 = (double)ca.nFee * cb.nSize;
+        double f2 = (double)cb.nFee * ca.nSize;
+        if (f1 == f2)
+            return a.first > b.first;
+        return f1 < f2;
+    }
+};
+}
+
+void BlockAssembler::addClusterTxs(int &nPackagesSelected)
+{
+    std::vector<CTxMemPool::ClusterRef> vClusters;
+    mempool.GetClusters(vClusters);
+
+    // The chunks of each cluster come in non-increasing feerate, so only the
+    // next chunk of every cluster has to be in the running
+    CompareClusterChunk comp(vClusters);
+    std::vector<std::pair<size_t, size_t> > heap;
+    heap.reserve(vClusters.size());
+    for (size_t i = 0; i < vClusters.size(); i++)
+        heap.push_back(std::make_pair(i, (size_t)0));
+    std::make_heap(heap.begin(), heap.end(), comp);
+
+    // Same give-up heuristic as addPackageTxs
+    const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
+    int64_t nConsecutiveFailed = 0;
+
+    while (!heap.empty()) {
+        std::pop_heap(heap.begin(), heap.end(), comp);
+        const size_t nCluster = heap.back().first;
+        const size_t nChunk = heap.back().second;
+        heap.pop_back();
+        const CTxMemPool::Cluster& cluster = *vClusters[nCluster];
+        const CTxMemPool::Cluster::Chunk& chunk = cluster.vChunks[nChunk];
+
+        if (chunk.nFee < blockMinFeeRate.GetFee(chunk.nSize)) {
+            // Everything else we might consider has a lower fee rate
+            return;
+        }
+
+        // Transactions addPriorityTxs already took do not count again
+        CTxMemPool::setEntries package;
+        uint64_t packageSize = 0;
+        int64_t packageSigOpsCost = 0;
+        for (size_t i = nChunk == 0 ? 0 : cluster.vChunks[nChunk - 1].nEnd; i < chunk.nEnd; i++) {
+            CTxMemPool::txiter it = cluster.vTxs[i];
+            if (inBlock.count(it))
+                continue;
+            package.insert(it);
+            packageSize += it->GetTxSize();
+            packageSigOpsCost += it->GetSigOpCost();
+        }
+
+        // A failed chunk takes the rest of its cluster, which may build on it,
+        // out of the running
+        if (!package.empty()) {
+            if (!TestPackage(packageSize, packageSigOpsCost)) {
+                ++nConsecutiveFailed;
+                if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
+                        nBlockMaxWeight - 4000) {
+                    // Give up if we're close to full and haven't succeeded in a while
+                    break;
+                }
+                continue;
+            }
+            if (!TestPackageTransactions(package))
+                continue;
+
+            nConsecutiveFailed = 0;
+            for (size_t i = nChunk == 0 ? 0 : cluster.vChunks[nChunk - 1].nEnd; i < chunk.nEnd; i++) {
+                if (package.count(cluster.vTxs[i]))
+                    AddToBlock(cluster.vTxs[i]);
+            }
+            ++nPackagesSelected;
+        }
+
+        if (nChunk + 1 < cluster.vChunks.size()) {
+            heap.push_back(std::make_pair(nCluster, nChunk + 1));
+            std::push_heap(heap.begin(), heap.end(), comp);
+        }
+    }
+}
+
 void BlockAssembler::addPriorityTxs()
 {
     // How much of the block should be dedicated to high-priority transactions,
@@ -634,6 +740,336 @@ void BlockAssembler::addPriorityTxs()
     fNeedSizeAccounting = fSizeAccounting;
 }
 
+BlockTemplateManager::LiveTemplate::LiveTemplate()
+    : pindexPrev(NULL), fIncludeWitness(false), fBehind(false), nTimeBuilt(0),
+      nHeight(0), nLockTimeCutoff(0), nSubsidy(0), nFees(0), nBlockWeight(0), nBlockSize(0), nBlockSigOpsCost(0)
+{
+}
+
+BlockTemplateManager::BlockTemplateManager(const CChainParams& _chainparams, CTxMemPool& _pool)
+    : chainparams(_chainparams), pool(_pool), assembler(_chainparams), fStopRebuild(false)
+{
+    fRebuildRequested[0] = fRebuildRequested[1] = false;
+    pool.NotifyEntryAdded.connect(boost::bind(&BlockTemplateManager::TransactionAddedToMempool,
+                                              this, boost::placeholders::_1));
+    pool.NotifyEntryRemoved.connect(boost::bind(&BlockTemplateManager::TransactionRemovedFromMempool,
+                                                this, boost::placeholders::_1,
+                                                boost::placeholders::_2));
+}
+
+BlockTemplateManager::~BlockTemplateManager()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csRebuild);
+        fStopRebuild = true;
+        condRebuild.notify_all();
+    }
+    if (threadRebuild.joinable())
+        threadRebuild.join();
+
+    pool.NotifyEntryAdded.disconnect(boost::bind(&BlockTemplateManager::TransactionAddedToMempool,
+                                                 this, boost::placeholders::_1));
+    pool.NotifyEntryRemoved.disconnect(boost::bind(&BlockTemplateManager::TransactionRemovedFromMempool,
+                                                   this, boost::placeholders::_1,
+                                                   boost::placeholders::_2));
+}
+
+void BlockTemplateManager::TransactionAddedToMempool(CTransactionRef tx)
+{
+    LOCK(cs);
+    for (LiveTemplate& live : templates) {
+        if (!live.pblocktemplate)
+            continue;
+        if (live.vPendingAdded.size() + live.setPendingRemoved.size() >= BLOCK_TEMPLATE_MAX_PENDING) {
+            // Nobody asked for this template in a long time; start over when they do
+            live.pblocktemplate.reset();
+            continue;
+        }
+        live.vPendingAdded.push_back(tx->GetHash());
+    }
+}
+
+void BlockTemplateManager::TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    // Removals for a block come with a tip change, which rebuilds anyway
+    if (reason == MemPoolRemovalReason::BLOCK)
+        return;
+    LOCK(cs);
+    for (LiveTemplate& live : templates) {
+        if (!live.pblocktemplate || !live.setInBlock.count(tx->GetHash()))
+            continue;
+        if (live.vPendingAdded.size() + live.setPendingRemoved.size() >= BLOCK_TEMPLATE_MAX_PENDING) {
+            live.pblocktemplate.reset();
+            continue;
+        }
+        live.setPendingRemoved.insert(tx->GetHash());
+    }
+}
+
+void BlockTemplateManager::Invalidate()
+{
+    LOCK(cs);
+    for (LiveTemplate& live : templates)
+        live.pblocktemplate.reset();
+}
+
+bool BlockTemplateManager::IsCurrent(const CBlockIndex* pindex, bool fMineWitnessTx)
+{
+    LOCK(cs);
+    const LiveTemplate& live = templates[fMineWitnessTx];
+    return live.pblocktemplate && live.pindexPrev == pindex;
+}
+
+void BlockTemplateManager::RebuildInBackground(bool fMineWitnessTx)
+{
+    boost::unique_lock<boost::mutex> lock(csRebuild);
+    if (fStopRebuild)
+        return;
+    if (!threadRebuild.joinable())
+        threadRebuild = boost::thread(&TraceThread<boost::function<void()> >, "blocktemplate",
+                                      boost::function<void()>(boost::bind(&BlockTemplateManager::ThreadRebuild, this)));
+    fRebuildRequested[fMineWitnessTx] = true;
+    condRebuild.notify_one();
+}
+
+void BlockTemplateManager::ThreadRebuild()
+{
+    while (true) {
+        bool fRequested[2];
+        {
+            boost::unique_lock<boost::mutex> lock(csRebuild);
+            while (!fRebuildRequested[0] && !fRebuildRequested[1] && !fStopRebuild)
+                condRebuild.wait(lock);
+            if (fStopRebuild)
+                return;
+            fRequested[0] = fRebuildRequested[0];
+            fRequested[1] = fRebuildRequested[1];
+            fRebuildRequested[0] = fRebuildRequested[1] = false;
+        }
+
+        for (int fMineWitnessTx = 0; fMineWitnessTx < 2; fMineWitnessTx++) {
+            if (!fRequested[fMineWitnessTx])
+                continue;
+            const CBlockIndex* pindexBuilt = NULL;
+            int64_t nTimeStart = GetTimeMicros();
+            try {
+                LOCK2(cs_main, pool.cs);
+                LOCK(cs);
+                LiveTemplate& live = templates[fMineWitnessTx];
+                if (!live.pblocktemplate || live.pindexPrev != chainActive.Tip()) {
+                    if (Rebuild(live, fMineWitnessTx))
+                        pindexBuilt = live.pindexPrev;
+                }
+            } catch (const std::runtime_error& e) {
+                LogPrintf("BlockTemplateManager: background rebuild failed: %s\n", e.what());
+            }
+            if (pindexBuilt) {
+                LogPrint(BCLog::BENCH, "BlockTemplateManager: rebuilt template for %s in the background in %.2fms\n",
+                         pindexBuilt->GetBlockHash().ToString(), 0.001 * (GetTimeMicros() - nTimeStart));
+                NotifyTemplateRebuilt(pindexBuilt);
+                // Wake long polls waiting for the full block
+                boost::unique_lock<boost::mutex> lock(csBestBlock);
+                cvBlockChange.notify_all();
+            }
+        }
+    }
+}
+
+bool BlockTemplateManager::Rebuild(LiveTemplate& live, bool fMineWitnessTx)
+{
+    live.pblocktemplate.reset();
+    live.vPendingAdded.clear();
+    live.setPendingRemoved.clear();
+    live.setInBlock.clear();
+
+    const CBlockIndex* pindexPrevNew = chainActive.Tip();
+    std::unique_ptr<CBlockTemplate> pblocktemplateNew = assembler.CreateNewBlock(CScript() << OP_TRUE, fMineWitnessTx);
+    if (!pblocktemplateNew)
+        return false;
+
+    const CBlock& block = pblocktemplateNew->block;
+    const Consensus::Params& consensus = chainparams.GetConsensus(pindexPrevNew->nHeight + 1);
+    live.pindexPrev = pindexPrevNew;
+    live.fIncludeWitness = IsWitnessEnabled(live.pindexPrev, consensus) && fMineWitnessTx;
+    live.fBehind = false;
+    live.nTimeBuilt = GetTime();
+    live.nHeight = live.pindexPrev->nHeight + 1;
+    live.nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST)
+                            ? live.pindexPrev->GetMedianTimePast()
+                            : block.GetBlockTime();
+
+    // Same reservations for the coinbase as BlockAssembler::resetBlock()
+    live.nBlockWeight = 4000;
+    live.nBlockSize = 1000;
+    live.nBlockSigOpsCost = 400;
+    live.nFees = -pblocktemplateNew->vTxFees[0];
+    live.nSubsidy = block.vtx[0]->vout[0].nValue - live.nFees;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        live.nBlockWeight += GetTransactionWeight(tx);
+        if (assembler.NeedSizeAccounting())
+            live.nBlockSize += ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+        live.nBlockSigOpsCost += pblocktemplateNew->vTxSigOpsCost[i];
+        live.setInBlock.insert(tx.GetHash());
+    }
+
+    live.pblocktemplate = std::move(pblocktemplateNew);
+    return true;
+}
+
+void BlockTemplateManager::ApplyRemovals(LiveTemplate& live)
+{
+    if (live.setPendingRemoved.empty())
+        return;
+
+    CBlockTemplate& blocktemplate = *live.pblocktemplate;
+    CBlock& block = blocktemplate.block;
+    std::set<uint256> setDropped;
+    size_t nKept = 1;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        const CTransaction& tx = *block.vtx[i];
+        bool fDrop = live.setPendingRemoved.count(tx.GetHash()) > 0;
+        // Children follow their parents in the block, so one pass finds all descendants
+        for (size_t j = 0; !fDrop && j < tx.vin.size(); j++)
+            fDrop = setDropped.count(tx.vin[j].prevout.hash) > 0;
+        if (fDrop) {
+            setDropped.insert(tx.GetHash());
+            live.setInBlock.erase(tx.GetHash());
+            live.nBlockWeight -= GetTransactionWeight(tx);
+            if (assembler.NeedSizeAccounting())
+                live.nBlockSize -= ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+            live.nBlockSigOpsCost -= blocktemplate.vTxSigOpsCost[i];
+            live.nFees -= blocktemplate.vTxFees[i];
+            continue;
+        }
+        block.vtx[nKept] = block.vtx[i];
+        blocktemplate.vTxFees[nKept] = blocktemplate.vTxFees[i];
+        blocktemplate.vTxSigOpsCost[nKept] = blocktemplate.vTxSigOpsCost[i];
+        nKept++;
+    }
+    block.vtx.resize(nKept);
+    blocktemplate.vTxFees.resize(nKept);
+    blocktemplate.vTxSigOpsCost.resize(nKept);
+    live.setPendingRemoved.clear();
+
+    // Dropped descendants that are still in the mempool may be re-added
+    // later, once their parents are back; until then something may be missing
+    if (setDropped.size() > 0)
+        live.fBehind = true;
+}
+
+bool BlockTemplateManager::AppendTransaction(LiveTemplate& live, CTxMemPool::txiter iter)
+{
+    const CTransaction& tx = iter->GetTx();
+    if (iter->GetModifiedFee() < assembler.GetBlockMinFeeRate().GetFee(iter->GetTxSize()))
+        return false;
+    if (!IsFinalTx(tx, live.nHeight, live.nLockTimeCutoff))
+        return false;
+    if (!live.fIncludeWitness && tx.HasWitness())
+        return false;
+
+    BOOST_FOREACH(CTxMemPool::txiter parent, pool.GetMemPoolParents(iter)) {
+        if (!live.setInBlock.count(parent->GetTx().GetHash())) {
+            live.fBehind = true;
+            return false;
+        }
+    }
+
+    uint64_t nTxSize = 0;
+    if (assembler.NeedSizeAccounting())
+        nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    if (live.nBlockWeight + WITNESS_SCALE_FACTOR * iter->GetTxSize() >= assembler.GetBlockMaxWeight() ||
+        live.nBlockSigOpsCost + iter->GetSigOpCost() >= MAX_BLOCK_SIGOPS_COST ||
+        (assembler.NeedSizeAccounting() && live.nBlockSize + nTxSize >= assembler.GetBlockMaxSize())) {
+        live.fBehind = true;
+        return false;
+    }
+
+    live.pblocktemplate->block.vtx.emplace_back(iter->GetSharedTx());
+    live.pblocktemplate->vTxFees.push_back(iter->GetFee());
+    live.pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
+    live.nBlockWeight += iter->GetTxWeight();
+    live.nBlockSize += nTxSize;
+    live.nBlockSigOpsCost += iter->GetSigOpCost();
+    live.nFees += iter->GetFee();
+    live.setInBlock.insert(tx.GetHash());
+    return true;
+}
+
+int BlockTemplateManager::ApplyAdditions(LiveTemplate& live)
+{
+    int nAppended = 0;
+    BOOST_FOREACH(const uint256& hash, live.vPendingAdded) {
+        if (live.setInBlock.count(hash))
+            continue;
+        CTxMemPool::txiter iter = pool.mapTx.find(hash);
+        if (iter == pool.mapTx.end())
+            continue;
+        if (AppendTransaction(live, iter))
+            nAppended++;
+    }
+    live.vPendingAdded.clear();
+    return nAppended;
+}
+
+void BlockTemplateManager::UpdateCommitment(LiveTemplate& live)
+{
+    CBlock& block = live.pblocktemplate->block;
+    CMutableTransaction coinbaseTx(*block.vtx[0]);
+    for (size_t i = 0; i < coinbaseTx.vout.size(); i++) {
+        const CScript& script = coinbaseTx.vout[i].scriptPubKey;
+        if (std::vector<unsigned char>(script.begin(), script.end()) == live.pblocktemplate->vchCoinbaseCommitment) {
+            coinbaseTx.vout.erase(coinbaseTx.vout.begin() + i);
+            break;
+        }
+    }
+    coinbaseTx.vin[0].scriptWitness.SetNull();
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    live.pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, live.pindexPrev, chainparams.GetConsensus(live.nHeight));
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateManager::GetBlockTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, pool.cs);
+    LOCK(cs);
+    LiveTemplate& live = templates[fMineWitnessTx];
+
+    const bool fPending = !live.vPendingAdded.empty() || !live.setPendingRemoved.empty();
+    if (!live.pblocktemplate || live.pindexPrev != chainActive.Tip() ||
+        (live.fBehind && GetTime() - live.nTimeBuilt >= BLOCK_TEMPLATE_REBUILD_INTERVAL)) {
+        if (!Rebuild(live, fMineWitnessTx))
+            return nullptr;
+        LogPrint(BCLog::BENCH, "BlockTemplateManager: rebuilt template in %.2fms\n", 0.001 * (GetTimeMicros() - nTimeStart));
+    } else if (fPending) {
+        const size_t nBefore = live.pblocktemplate->block.vtx.size();
+        ApplyRemovals(live);
+        const int nAppended = ApplyAdditions(live);
+        if (!live.pblocktemplate->vchCoinbaseCommitment.empty())
+            UpdateCommitment(live);
+        LogPrint(BCLog::BENCH, "BlockTemplateManager: updated template in %.2fms (%d removed, %d appended)\n",
+                 0.001 * (GetTimeMicros() - nTimeStart), nBefore + nAppended - live.pblocktemplate->block.vtx.size(), nAppended);
+    }
+
+    std::unique_ptr<CBlockTemplate> pblocktemplateRet(new CBlockTemplate(*live.pblocktemplate));
+    CBlock* pblock = &pblocktemplateRet->block;
+
+    CMutableTransaction coinbaseTx(*pblock->vtx[0]);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+    coinbaseTx.vout[0].nValue = live.nFees + live.nSubsidy;
+    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    pblocktemplateRet->vTxFees[0] = -live.nFees;
+    pblocktemplateRet->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    UpdateTime(pblock, chainparams.GetConsensus(live.nHeight), live.pindexPrev);
+
+    nLastBlockTx = pblock->vtx.size() - 1;
+    nLastBlockSize = live.nBlockSize;
+    nLastBlockWeight = live.nBlockWeight;
+
+    return pblocktemplateRet;
+}
+
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
 {
     // Update nExtraNonce
@@ -8,12 +8,17 @@
 #define BITCOIN_MINER_H
 
 #include "primitives/block.h"
+#include "sync.h"
 #include "txmempool.h"
 
 #include <stdint.h>
 #include <memory>
+#include <set>
+#include <vector>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
+#include <boost/signals2/signal.hpp>
+#include <boost/thread/thread.hpp>
 
 class CBlockIndex;
 class CChainParams;
@@ -24,6 +29,12 @@ class CWallet;
 namespace Consensus { struct Params; };
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default for -blockclusters, selecting block transactions from mempool clusters */
+static const bool DEFAULT_BLOCK_CLUSTERS = false;
+/** Minimum seconds between full rebuilds of a live template that fell behind the mempool */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 30;
+/** Mempool updates a live template queues before it gives up and rebuilds in full */
+static const size_t BLOCK_TEMPLATE_MAX_PENDING = 10000;
 
 struct CBlockTemplate
 {
@@ -145,6 +156,7 @@ private:
     unsigned int nBlockMaxWeight, nBlockMaxSize;
     bool fNeedSizeAccounting;
     CFeeRate blockMinFeeRate;
+    bool fUseClusters;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
@@ -165,8 +177,17 @@ private:
 
 public:
     BlockAssembler(const CChainParams& chainparams);
-    /** Construct a new block template with coinbase to scriptPubKeyIn */
-    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+    /**
+     * Construct a new block template with coinbase to scriptPubKeyIn. With
+     * fEmpty the block holds just the coinbase and the mempool is not looked
+     * at, which gets work on a new tip out without waiting for selection.
+     */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx, bool fEmpty = false);
+
+    unsigned int GetBlockMaxWeight() const { return nBlockMaxWeight; }
+    unsigned int GetBlockMaxSize() const { return nBlockMaxSize; }
+    bool NeedSizeAccounting() const { return fNeedSizeAccounting; }
+    const CFeeRate& GetBlockMinFeeRate() const { return blockMinFeeRate; }
 
 private:
     // utility functions
@@ -182,6 +203,10 @@ private:
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
       * statistics from the package selection (for logging statistics). */
     void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated);
+    /** Add transactions chunk by chunk from the mempool's linearized
+      * clusters, best chunk feerate first. Increments nPackagesSelected
+      * for every chunk added. */
+    void addClusterTxs(int &nPackagesSelected);
 
     // helper function for addPriorityTxs
     /** Test if tx will still "fit" in the block */
@@ -210,6 +235,110 @@ private:
     int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Keeps one assembled block template current as the mempool changes, so that
+ * template requests between blocks do not have to run
+ * BlockAssembler::CreateNewBlock (and TestBlockValidity) again.
+ *
+ * The template is built in full on the first request after a tip change.
+ * After that, transactions entering the mempool are appended to it when their
+ * in-mempool parents are already included and they fit, and transactions
+ * leaving the mempool are dropped from it along with their in-template
+ * descendants. The mempool signals only queue these updates; they are applied
+ * on the next request. A transaction that could not be appended (parents
+ * missing, block full) marks the template as behind the mempool, and such a
+ * template is rebuilt in full at most every BLOCK_TEMPLATE_REBUILD_INTERVAL
+ * seconds.
+ *
+ * Templates with and without witness transactions are kept apart, so that
+ * callers asking for either do not rebuild each other's.
+ */
+class BlockTemplateManager
+{
+private:
+    const CChainParams& chainparams;
+    CTxMemPool& pool;
+    BlockAssembler assembler;
+
+    /** A live template, with a placeholder coinbase output script */
+    struct LiveTemplate
+    {
+        std::unique_ptr<CBlockTemplate> pblocktemplate;
+        const CBlockIndex* pindexPrev;
+        bool fIncludeWitness;
+        // Whether the mempool holds transactions the template could not take
+        bool fBehind;
+        int64_t nTimeBuilt;
+
+        // Chain context and resource usage, accounted like BlockAssembler does
+        int nHeight;
+        int64_t nLockTimeCutoff;
+        CAmount nSubsidy;
+        CAmount nFees;
+        uint64_t nBlockWeight;
+        uint64_t nBlockSize;
+        uint64_t nBlockSigOpsCost;
+        std::set<uint256> setInBlock;
+
+        // Mempool updates not applied to the template yet
+        std::vector<uint256> vPendingAdded;
+        std::set<uint256> setPendingRemoved;
+
+        LiveTemplate();
+    };
+
+    CCriticalSection cs;
+    // Indexed by fMineWitnessTx
+    LiveTemplate templates[2];
+
+    // Background rebuilds, see RebuildInBackground()
+    CWaitableCriticalSection csRebuild;
+    CConditionVariable condRebuild;
+    bool fRebuildRequested[2];
+    bool fStopRebuild;
+    boost::thread threadRebuild;
+
+public:
+    BlockTemplateManager(const CChainParams& chainparams, CTxMemPool& pool);
+    ~BlockTemplateManager();
+
+    /**
+     * Return a copy of the live template whose coinbase pays to
+     * scriptPubKeyIn, bringing the template up to date first.
+     */
+    std::unique_ptr<CBlockTemplate> GetBlockTemplate(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+    /** Make the next request rebuild the templates in full */
+    void Invalidate();
+    /** Whether the live template builds on pindex, so that a request for it will not rebuild */
+    bool IsCurrent(const CBlockIndex* pindex, bool fMineWitnessTx);
+    /**
+     * Have the template for the current tip built on a background thread,
+     * unless it already is. NotifyTemplateRebuilt fires once it is ready.
+     */
+    void RebuildInBackground(bool fMineWitnessTx);
+
+    /** A background rebuild finished; the template now builds on the given block */
+    boost::signals2::signal<void (const CBlockIndex*)> NotifyTemplateRebuilt;
+
+private:
+    void TransactionAddedToMempool(CTransactionRef tx);
+    void TransactionRemovedFromMempool(CTransactionRef tx, MemPoolRemovalReason reason);
+
+    /** Assemble the template from scratch on top of chainActive.Tip() */
+    bool Rebuild(LiveTemplate& live, bool fMineWitnessTx);
+    void ThreadRebuild();
+    /** Drop queued removals (and their descendants) from the template */
+    void ApplyRemovals(LiveTemplate& live);
+    /** Append queued additions that fit; returns how many were appended */
+    int ApplyAdditions(LiveTemplate& live);
+    bool AppendTransaction(LiveTemplate& live, CTxMemPool::txiter iter);
+    /** Recompute the coinbase witness commitment after the transactions changed */
+    void UpdateCommitment(LiveTemplate& live);
+};
+
+/** The live block template shared by the mining RPCs, NULL until initialized */
+extern std::unique_ptr<BlockTemplateManager> g_blockTemplateManager;
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -105,6 +105,9 @@ class CTransaction;
 class CNodeStats;
 class CClientUIInterface;
 
+/** Bytes of a message to send; the buffer comes from the BufferPool */
+typedef std::vector<unsigned char, BufferPoolAllocator<unsigned char> > CNetMsgData;
+
 struct CSerializedNetMsg
 {
     CSerializedNetMsg() = default;
@@ -114,7 +117,7 @@ struct CSerializedNetMsg
     CSerializedNetMsg(const CSerializedNetMsg& msg) = delete;
     CSerializedNetMsg& operator=(const CSerializedNetMsg&) = delete;
 
-    std::vector<unsigned char> data;
+    CNetMsgData data;
     std::string command;
 };
 
@@ -527,11 +530,11 @@ private:
 public:
     bool in_data;                   // parsing header (false) or data (true)
 
-    CDataStream hdrbuf;             // partially received header
+    CPooledDataStream hdrbuf;       // partially received header
     CMessageHeader hdr;             // complete header
     unsigned int nHdrPos;
 
-    CDataStream vRecv;              // received message data
+    CPooledDataStream vRecv;        // received message data
     unsigned int nDataPos;
 
     int64_t nTime;                  // time (in microseconds) of message receipt.
@@ -576,7 +579,7 @@ public:
     size_t nSendSize; // total size of all vSendMsg entries
     size_t nSendOffset; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes;
-    std::deque<std::vector<unsigned char>> vSendMsg;
+    std::deque<CNetMsgData> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -694,7 +697,8 @@ public:
 
     // Counts getheaders requests sent to this peer
     std::atomic<int64_t> nPendingHeaderRequests;
-    std::set<uint256> orphan_work_set;
+    // Queued transactions whose scripts were checked along with an earlier one
+    std::set<uint256> setTxPreVerified;
 
     CNode(NodeId id, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn, SOCKET hSocketIn, const CAddress &addrIn, uint64_t nKeyedNetGroupIn, uint64_t nLocalHostNonceIn, const std::string &addrNameIn = "", bool fInboundIn = false);
     ~CNode();
@@ -8,14 +8,17 @@
 #define BITCOIN_NET_PROCESSING_H
 
 #include "net.h"
+#include "txorphanage.h"
 #include "validationinterface.h"
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
-/** Expiration time for orphan transactions in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/** Default for -maxorphanpeersize, the memory in kilobytes the orphans of one peer may take */
+static const unsigned int DEFAULT_MAX_ORPHAN_PEER_SIZE = 500;
+/** Maximum number of orphans of a peer tried again in one go once their parents arrived */
+static const unsigned int MAX_ORPHAN_RECONSIDER_BATCH = 16;
+/** Maximum number of queued tx messages from a peer whose scripts are checked together */
+static const unsigned int MAX_TX_PREVERIFY_BATCH = 64;
 /** Default number of orphan+recently-replaced txn to keep around for block reconstruction */
 static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Headers download timeout expressed in microseconds
@@ -41,6 +44,8 @@ static constexpr size_t MAX_ADDR_PROCESSING_TOKEN_BUCKET{MAX_ADDR_TO_SEND};
 void RegisterNodeSignals(CNodeSignals& nodeSignals);
 /** Unregister a network node */
 void UnregisterNodeSignals(CNodeSignals& nodeSignals);
+/** Statistics of the pool of transactions waiting for their parents */
+TxOrphanage::Stats GetOrphanPoolStats();
 
 class PeerLogicValidation : public CValidationInterface {
 private:
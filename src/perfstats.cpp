@@ -0,0 +1,127 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "perfstats.h"
+
+#include "tinyformat.h"
+
+#include <mutex>
+
+std::atomic<bool> fPerfStats(DEFAULT_PERFSTATS);
+
+CPerfHistogram::CPerfHistogram()
+{
+    Reset();
+}
+
+int CPerfHistogram::BucketIndex(int64_t nMicros)
+{
+    int i = 0;
+    while (i < BUCKETS - 1 && nMicros > ((int64_t)1 << i))
+        i++;
+    return i;
+}
+
+void CPerfHistogram::Record(int64_t nMicros)
+{
+    if (nMicros < 0)
+        nMicros = 0;
+    vBuckets[BucketIndex(nMicros)].fetch_add(1, std::memory_order_relaxed);
+    nTotalMicros.fetch_add(nMicros, std::memory_order_relaxed);
+    int64_t nMax = nMaxMicros.load(std::memory_order_relaxed);
+    while (nMicros > nMax && !nMaxMicros.compare_exchange_weak(nMax, nMicros, std::memory_order_relaxed)) {}
+    nCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+CPerfHistogram::Snapshot CPerfHistogram::GetSnapshot() const
+{
+    // The counters are read one at a time while timers may still record, so
+    // they can disagree by the few samples recorded meanwhile
+    Snapshot snapshot;
+    snapshot.nCount = nCount.load(std::memory_order_relaxed);
+    snapshot.nTotalMicros = nTotalMicros.load(std::memory_order_relaxed);
+    snapshot.nMaxMicros = nMaxMicros.load(std::memory_order_relaxed);
+    snapshot.vBuckets.resize(BUCKETS);
+    for (int i = 0; i < BUCKETS; i++)
+        snapshot.vBuckets[i] = vBuckets[i].load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void CPerfHistogram::Reset()
+{
+    nCount = 0;
+    nTotalMicros = 0;
+    nMaxMicros = 0;
+    for (int i = 0; i < BUCKETS; i++)
+        vBuckets[i] = 0;
+}
+
+namespace {
+
+/** Histograms are leaked so that timers in static destructors stay safe */
+struct CPerfRegistry {
+    std::mutex mutex;
+    std::map<std::string, CPerfHistogram*> mapHistograms;
+};
+
+CPerfRegistry& GetPerfRegistry()
+{
+    static CPerfRegistry* registry = new CPerfRegistry();
+    return *registry;
+}
+
+} // namespace
+
+CPerfHistogram& GetPerfHistogram(const std::string& strName)
+{
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    CPerfHistogram*& hist = registry.mapHistograms[strName];
+    if (hist == NULL)
+        hist = new CPerfHistogram();
+    return *hist;
+}
+
+std::map<std::string, CPerfHistogram::Snapshot> GetPerfStats()
+{
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    std::map<std::string, CPerfHistogram::Snapshot> mapStats;
+    for (const auto& entry : registry.mapHistograms) {
+        CPerfHistogram::Snapshot snapshot = entry.second->GetSnapshot();
+        if (snapshot.nCount > 0)
+            mapStats.emplace(entry.first, std::move(snapshot));
+    }
+    return mapStats;
+}
+
+void ResetPerfStats()
+{
+    CPerfRegistry& registry = GetPerfRegistry();
+    std::lock_guard<std::mutex> lock(registry.mutex);
+    for (const auto& entry : registry.mapHistograms)
+        entry.second->Reset();
+}
+
+std::string PerfStatsToPrometheus()
+{
+    std::string strRet;
+    strRet += "# HELP trumpow_duration_seconds Time spent in instrumented code paths\n";
+    strRet += "# TYPE trumpow_duration_seconds histogram\n";
+    for (const auto& entry : GetPerfStats()) {
+        const CPerfHistogram::Snapshot& snapshot = entry.second;
+        uint64_t nCumulative = 0;
+        for (int i = 0; i < CPerfHistogram::BUCKETS; i++) {
+            nCumulative += snapshot.vBuckets[i];
+            const int64_t nLimit = CPerfHistogram::BucketLimit(i);
+            const std::string strLimit = nLimit < 0 ? "+Inf" : strprintf("%.6f", nLimit * 0.000001);
+            strRet += strprintf("trumpow_duration_seconds_bucket{path=\"%s\",le=\"%s\"} %u\n", entry.first, strLimit, nCumulative);
+        }
+        strRet += strprintf("trumpow_duration_seconds_sum{path=\"%s\"} %.6f\n", entry.first, snapshot.nTotalMicros * 0.000001);
+        // The sum of the buckets rather than nCount, which a sample being
+        // recorded during the snapshot may have reached first
+        strRet += strprintf("trumpow_duration_seconds_count{path=\"%s\"} %u\n", entry.first, nCumulative);
+    }
+    return strRet;
+}
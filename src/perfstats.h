@@ -0,0 +1,97 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PERFSTATS_H
+#define BITCOIN_PERFSTATS_H
+
+#include "sync.h" // for PASTE2
+
+#include <stdint.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Default for -perfstats */
+static const bool DEFAULT_PERFSTATS = true;
+
+/** Whether timers record at all, set from -perfstats */
+extern std::atomic<bool> fPerfStats;
+
+/**
+ * Latency histogram of one instrumented code path. Durations are counted in
+ * power-of-two buckets of microseconds, so that recording one is a handful of
+ * relaxed atomic increments and never takes a lock.
+ */
+class CPerfHistogram
+{
+public:
+    /** Bucket i counts durations up to 2^i microseconds; the last one any longer */
+    static const int BUCKETS = 32;
+
+    struct Snapshot {
+        uint64_t nCount;
+        int64_t nTotalMicros;
+        int64_t nMaxMicros;
+        std::vector<uint64_t> vBuckets;
+    };
+
+    CPerfHistogram();
+
+    void Record(int64_t nMicros);
+    Snapshot GetSnapshot() const;
+    void Reset();
+
+    /** Upper bound in microseconds of bucket i, or -1 for the last, unbounded one */
+    static int64_t BucketLimit(int i) { return i < BUCKETS - 1 ? (int64_t)1 << i : -1; }
+    static int BucketIndex(int64_t nMicros);
+
+private:
+    std::atomic<uint64_t> nCount;
+    std::atomic<int64_t> nTotalMicros;
+    std::atomic<int64_t> nMaxMicros;
+    std::atomic<uint64_t> vBuckets[BUCKETS];
+};
+
+/** The histogram called strName, created on first use and never freed */
+CPerfHistogram& GetPerfHistogram(const std::string& strName);
+/** Snapshots of every histogram that has recorded something, by name */
+std::map<std::string, CPerfHistogram::Snapshot> GetPerfStats();
+void ResetPerfStats();
+/** All histograms in the Prometheus text exposition format */
+std::string PerfStatsToPrometheus();
+
+/** Records the time until it goes out of scope into a histogram */
+class CPerfTimer
+{
+public:
+    explicit CPerfTimer(CPerfHistogram& histIn) : hist(histIn), fActive(fPerfStats.load(std::memory_order_relaxed))
+    {
+        if (fActive)
+            start = std::chrono::steady_clock::now();
+    }
+
+    ~CPerfTimer()
+    {
+        if (fActive)
+            hist.Record(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+    }
+
+private:
+    CPerfHistogram& hist;
+    const bool fActive;
+    std::chrono::steady_clock::time_point start;
+
+    CPerfTimer(const CPerfTimer&);
+    CPerfTimer& operator=(const CPerfTimer&);
+};
+
+/** Time the rest of the enclosing scope into the histogram called name */
+#define PERF_TIMER(name) \
+    static CPerfHistogram& PASTE2(perfhistogram, __LINE__) = GetPerfHistogram(name); \
+    CPerfTimer PASTE2(perftimer, __LINE__)(PASTE2(perfhistogram, __LINE__))
+
+#endif // BITCOIN_PERFSTATS_H
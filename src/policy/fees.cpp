@@ -7,47 +7,70 @@
 #include "policy/policy.h"
 
 #include "amount.h"
+#include "clientversion.h"
+#include "hash.h"
 #include "primitives/transaction.h"
 #include "random.h"
 #include "streams.h"
 #include "txmempool.h"
 #include "util.h"
 
+#include <math.h>
+
+/** Rescale the moving averages once scale reaches this, some 10000 blocks at the default decay */
+static const double MAX_SCALE = 1e50;
+
 void TxConfirmStats::Initialize(std::vector<double>& defaultBuckets,
                                 unsigned int maxConfirms, double _decay)
 {
     decay = _decay;
+    scale = 1;
     for (unsigned int i = 0; i < defaultBuckets.size(); i++) {
         buckets.push_back(defaultBuckets[i]);
         bucketMap[defaultBuckets[i]] = i;
     }
     confAvg.resize(maxConfirms);
-    curBlockConf.resize(maxConfirms);
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         confAvg[i].resize(buckets.size());
-        curBlockConf[i].resize(buckets.size());
         unconfTxs[i].resize(buckets.size());
     }
 
     oldUnconfTxs.resize(buckets.size());
-    curBlockTxCt.resize(buckets.size());
     txCtAvg.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
     avg.resize(buckets.size());
 }
 
-// Zero out the data for the current block
-void TxConfirmStats::ClearCurrent(unsigned int nBlockHeight)
+void TxConfirmStats::NewBlock(unsigned int nBlockHeight, unsigned int nBlocks)
+{
+    // Past a full round of the circular buffer every slot has been left behind
+    unsigned int nSlots = std::min(nBlocks, (unsigned int)unconfTxs.size());
+    for (unsigned int h = nBlockHeight - nSlots + 1; h != nBlockHeight + 1; h++) {
+        std::vector<int>& slot = unconfTxs[h % unconfTxs.size()];
+        for (unsigned int j = 0; j < buckets.size(); j++) {
+            oldUnconfTxs[j] += slot[j];
+            slot[j] = 0;
+        }
+    }
+
+    // Decay the history by weighing everything recorded from now on more.
+    // After a long enough gap the history is all but gone: pow() then
+    // underflows to 0 and Rescale() zeroes the averages.
+    scale /= pow(decay, nBlocks);
+    if (!(scale < MAX_SCALE))
+        Rescale();
+}
+
+void TxConfirmStats::Rescale()
 {
+    double invScale = 1 / scale;
     for (unsigned int j = 0; j < buckets.size(); j++) {
-        oldUnconfTxs[j] += unconfTxs[nBlockHeight%unconfTxs.size()][j];
-        unconfTxs[nBlockHeight%unconfTxs.size()][j] = 0;
-        for (unsigned int i = 0; i < curBlockConf.size(); i++)
-            curBlockConf[i][j] = 0;
-        curBlockTxCt[j] = 0;
-        curBlockVal[j] = 0;
+        for (unsigned int i = 0; i < confAvg.size(); i++)
+            confAvg[i][j] *= invScale;
+        avg[j] *= invScale;
+        txCtAvg[j] *= invScale;
     }
+    scale = 1;
 }
 
 
@@ -57,27 +80,49 @@ void TxConfirmStats::Record(int blocksToConfirm, double val)
     if (blocksToConfirm < 1)
         return;
     unsigned int bucketindex = bucketMap.lower_bound(val)->second;
-    for (size_t i = blocksToConfirm; i <= curBlockConf.size(); i++) {
-        curBlockConf[i - 1][bucketindex]++;
+    for (size_t i = blocksToConfirm; i <= confAvg.size(); i++) {
+        confAvg[i - 1][bucketindex] += scale;
     }
-    curBlockTxCt[bucketindex]++;
-    curBlockVal[bucketindex] += val;
+    txCtAvg[bucketindex] += scale;
+    avg[bucketindex] += val * scale;
 }
 
-void TxConfirmStats::UpdateMovingAverages()
+double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
+                                         double successBreakPoint, bool requireGreater,
+                                         unsigned int nBlockHeight)
 {
-    for (unsigned int j = 0; j < buckets.size(); j++) {
-        for (unsigned int i = 0; i < confAvg.size(); i++)
-            confAvg[i][j] = confAvg[i][j] * decay + curBlockConf[i][j];
-        avg[j] = avg[j] * decay + curBlockVal[j];
-        txCtAvg[j] = txCtAvg[j] * decay + curBlockTxCt[j];
+    // Number of tx's still in mempool for confTarget or longer, per bucket
+    std::vector<int> extraTxs(oldUnconfTxs);
+    unsigned int bins = unconfTxs.size();
+    for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++) {
+        for (unsigned int j = 0; j < buckets.size(); j++)
+            extraTxs[j] += unconfTxs[(nBlockHeight - confct)%bins][j];
+    }
+    return EstimateMedianVal(confTarget, sufficientTxVal, successBreakPoint, requireGreater, extraTxs);
+}
+
+void TxConfirmStats::EstimateMedianVals(std::vector<double>& vMedians, double sufficientTxVal,
+                                        double successBreakPoint, bool requireGreater,
+                                        unsigned int nBlockHeight)
+{
+    // Going down from the highest target, each one counts the mempool
+    // transactions of one more block as unconfirmed
+    vMedians.assign(GetMaxConfirms(), -1);
+    std::vector<int> extraTxs(oldUnconfTxs);
+    unsigned int bins = unconfTxs.size();
+    for (unsigned int confTarget = GetMaxConfirms(); confTarget >= 1; confTarget--) {
+        if (confTarget < GetMaxConfirms()) {
+            for (unsigned int j = 0; j < buckets.size(); j++)
+                extraTxs[j] += unconfTxs[(nBlockHeight - confTarget)%bins][j];
+        }
+        vMedians[confTarget - 1] = EstimateMedianVal(confTarget, sufficientTxVal, successBreakPoint, requireGreater, extraTxs);
     }
 }
 
 // returns -1 on error conditions
 double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
                                          double successBreakPoint, bool requireGreater,
-                                         unsigned int nBlockHeight)
+                                         const std::vector<int>& extraTxs)
 {
     // Counters for a bucket (or range of buckets)
     double nConf = 0; // Number of tx's confirmed within the confTarget
@@ -104,16 +149,14 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
     unsigned int bestFarBucket = startbucket;
 
     bool foundAnswer = false;
-    unsigned int bins = unconfTxs.size();
+    double invScale = 1 / scale;
 
     // Start counting from highest(default) or lowest feerate transactions
     for (int bucket = startbucket; bucket >= 0 && bucket <= maxbucketindex; bucket += step) {
         curFarBucket = bucket;
-        nConf += confAvg[confTarget - 1][bucket];
-        totalNum += txCtAvg[bucket];
-        for (unsigned int confct = confTarget; confct < GetMaxConfirms(); confct++)
-            extraNum += unconfTxs[(nBlockHeight - confct)%bins][bucket];
-        extraNum += oldUnconfTxs[bucket];
+        nConf += confAvg[confTarget - 1][bucket] * invScale;
+        totalNum += txCtAvg[bucket] * invScale;
+        extraNum += extraTxs[bucket];
         // If we have enough transaction data points in this range of buckets,
         // we can test for success
         // (Only count the confirmed data points, so that each confirmation count
@@ -165,7 +208,7 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
         }
     }
 
-    LogPrint("estimatefee", "%3d: For conf success %s %4.2f need feerate %s: %12.5g from buckets %8g - %8g  Cur Bucket stats %6.2f%%  %8.1f/(%.1f+%d mempool)\n",
+    LogPrint(BCLog::ESTIMATEFEE, "%3d: For conf success %s %4.2f need feerate %s: %12.5g from buckets %8g - %8g  Cur Bucket stats %6.2f%%  %8.1f/(%.1f+%d mempool)\n",
              confTarget, requireGreater ? ">" : "<", successBreakPoint,
              requireGreater ? ">" : "<", median, buckets[minBucket], buckets[maxBucket],
              100 * nConf / (totalNum + extraNum), nConf, totalNum, extraNum);
@@ -175,11 +218,22 @@ double TxConfirmStats::EstimateMedianVal(int confTarget, double sufficientTxVal,
 
 void TxConfirmStats::Write(CAutoFile& fileout)
 {
+    // The file holds the plain moving averages
+    double invScale = 1 / scale;
+    std::vector<double> fileAvg(avg);
+    std::vector<double> fileTxCtAvg(txCtAvg);
+    std::vector<std::vector<double> > fileConfAvg(confAvg);
+    for (unsigned int j = 0; j < buckets.size(); j++) {
+        for (unsigned int i = 0; i < fileConfAvg.size(); i++)
+            fileConfAvg[i][j] *= invScale;
+        fileAvg[j] *= invScale;
+        fileTxCtAvg[j] *= invScale;
+    }
     fileout << decay;
     fileout << buckets;
-    fileout << avg;
-    fileout << txCtAvg;
-    fileout << confAvg;
+    fileout << fileAvg;
+    fileout << fileTxCtAvg;
+    fileout << fileConfAvg;
 }
 
 void TxConfirmStats::Read(CAutoFile& filein)
@@ -217,21 +271,15 @@ void TxConfirmStats::Read(CAutoFile& filein)
     // Now that we've processed the entire feerate estimate data file and not
     // thrown any errors, we can copy it to our data structures
     decay = fileDecay;
+    scale = 1;
     buckets = fileBuckets;
     avg = fileAvg;
     confAvg = fileConfAvg;
     txCtAvg = fileTxCtAvg;
     bucketMap.clear();
 
-    // Resize the current block variables which aren't stored in the data file
+    // Resize the mempool counts which aren't stored in the data file
     // to match the number of confirms and buckets
-    curBlockConf.resize(maxConfirms);
-    for (unsigned int i = 0; i < maxConfirms; i++) {
-        curBlockConf[i].resize(buckets.size());
-    }
-    curBlockTxCt.resize(buckets.size());
-    curBlockVal.resize(buckets.size());
-
     unconfTxs.resize(maxConfirms);
     for (unsigned int i = 0; i < maxConfirms; i++) {
         unconfTxs[i].resize(buckets.size());
@@ -241,7 +289,7 @@ void TxConfirmStats::Read(CAutoFile& filein)
     for (unsigned int i = 0; i < buckets.size(); i++)
         bucketMap[buckets[i]] = i;
 
-    LogPrint("estimatefee", "Reading estimates: %u buckets counting confirms up to %u blocks\n",
+    LogPrint(BCLog::ESTIMATEFEE, "Reading estimates: %u buckets counting confirms up to %u blocks\n",
              numBuckets, maxConfirms);
 }
 
@@ -260,7 +308,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
     if (nBestSeenHeight == 0)  // the BlockPolicyEstimator hasn't seen any blocks yet
         blocksAgo = 0;
     if (blocksAgo < 0) {
-        LogPrint("estimatefee", "Blockpolicy error, blocks ago is negative for mempool tx\n");
+        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, blocks ago is negative for mempool tx\n");
         return;  //This can't happen because we call this with our best seen height, no entries can have higher
     }
 
@@ -268,7 +316,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         if (oldUnconfTxs[bucketindex] > 0)
             oldUnconfTxs[bucketindex]--;
         else
-            LogPrint("estimatefee", "Blockpolicy error, mempool tx removed from >25 blocks,bucketIndex=%u already\n",
+            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from >25 blocks,bucketIndex=%u already\n",
                      bucketindex);
     }
     else {
@@ -276,7 +324,7 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
         if (unconfTxs[blockIndex][bucketindex] > 0)
             unconfTxs[blockIndex][bucketindex]--;
         else
-            LogPrint("estimatefee", "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
+            LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error, mempool tx removed from blockIndex=%u,bucketIndex=%u already\n",
                      blockIndex, bucketindex);
     }
 }
@@ -288,10 +336,12 @@ void TxConfirmStats::removeTx(unsigned int entryHeight, unsigned int nBestSeenHe
 // of no harm to try to remove them again.
 bool CBlockPolicyEstimator::removeTx(uint256 hash)
 {
-    std::map<uint256, TxStatsInfo>::iterator pos = mapMemPoolTxs.find(hash);
+    auto pos = mapMemPoolTxs.find(hash);
     if (pos != mapMemPoolTxs.end()) {
         feeStats.removeTx(pos->second.blockHeight, nBestSeenHeight, pos->second.bucketIndex);
-        mapMemPoolTxs.erase(hash);
+        mapMemPoolTxs.erase(pos);
+        // Unlike new arrivals, this may change the estimates before the next block
+        fEstimatesStale = true;
         return true;
     } else {
         return false;
@@ -299,7 +349,7 @@ bool CBlockPolicyEstimator::removeTx(uint256 hash)
 }
 
 CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
-    : nBestSeenHeight(0), trackedTxs(0), untrackedTxs(0)
+    : nBestSeenHeight(0), fEstimatesStale(false), nJournalSize(0), trackedTxs(0), untrackedTxs(0)
 {
     static_assert(MIN_FEERATE > 0, "Min feerate must be nonzero");
     minTrackedFee = _minRelayFee < CFeeRate(MIN_FEERATE) ? CFeeRate(MIN_FEERATE) : _minRelayFee;
@@ -309,6 +359,36 @@ CBlockPolicyEstimator::CBlockPolicyEstimator(const CFeeRate& _minRelayFee)
     }
     vfeelist.push_back(INF_FEERATE);
     feeStats.Initialize(vfeelist, MAX_BLOCK_CONFIRMS, DEFAULT_DECAY);
+    UpdateEstimates();
+}
+
+void CBlockPolicyEstimator::UpdateEstimates()
+{
+    feeStats.EstimateMedianVals(vEstimates, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    fEstimatesStale = false;
+
+    // Without an answer at any target, estimateSmartFee reports the highest
+    int nTarget = vEstimates.size();
+    vSmartTargets.resize(vEstimates.size());
+    for (int i = vEstimates.size(); i >= 1; i--) {
+        if (vEstimates[i - 1] >= 0)
+            nTarget = i;
+        vSmartTargets[i - 1] = nTarget;
+    }
+}
+
+void CBlockPolicyEstimator::NewBlock(unsigned int nBlockHeight)
+{
+    // Only a restart with an out of date estimates file leaves a gap
+    unsigned int nBlocks = nBestSeenHeight > 0 ? nBlockHeight - nBestSeenHeight : 1;
+    if (nBlocks > 1)
+        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy decaying estimates for %u blocks not seen\n", nBlocks - 1);
+
+    // Must update nBestSeenHeight in sync with NewBlock so that
+    // calls to removeTx (via processBlockTx) correctly calculate age
+    // of unconfirmed txs to remove from tracking.
+    nBestSeenHeight = nBlockHeight;
+    feeStats.NewBlock(nBlockHeight, nBlocks);
 }
 
 void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, bool validFeeEstimate)
@@ -316,7 +396,7 @@ void CBlockPolicyEstimator::processTransaction(const CTxMemPoolEntry& entry, boo
     unsigned int txHeight = entry.GetHeight();
     uint256 hash = entry.GetTx().GetHash();
     if (mapMemPoolTxs.count(hash)) {
-        LogPrint("estimatefee", "Blockpolicy error mempool tx %s already being tracked\n",
+        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error mempool tx %s already being tracked\n",
                  hash.ToString().c_str());
 	return;
     }
@@ -358,7 +438,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     if (blocksToConfirm <= 0) {
         // This can't happen because we don't process transactions from a block with a height
         // lower than our greatest seen height
-        LogPrint("estimatefee", "Blockpolicy error Transaction had negative blocksToConfirm\n");
+        LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy error Transaction had negative blocksToConfirm\n");
         return false;
     }
 
@@ -366,6 +446,7 @@ bool CBlockPolicyEstimator::processBlockTx(unsigned int nBlockHeight, const CTxM
     CFeeRate feeRate(entry->GetFee(), entry->GetTxSize());
 
     feeStats.Record(blocksToConfirm, (double)feeRate.GetFeePerK());
+    vJournal.back().vTxs.push_back(std::make_pair((unsigned int)blocksToConfirm, (double)feeRate.GetFeePerK()));
     return true;
 }
 
@@ -381,25 +462,27 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
         return;
     }
 
-    // Must update nBestSeenHeight in sync with ClearCurrent so that
-    // calls to removeTx (via processBlockTx) correctly calculate age
-    // of unconfirmed txs to remove from tracking.
-    nBestSeenHeight = nBlockHeight;
+    // Decay the history and update unconfirmed circular buffer
+    NewBlock(nBlockHeight);
 
-    // Clear the current block state and update unconfirmed circular buffer
-    feeStats.ClearCurrent(nBlockHeight);
+    // Past MAX_FEE_ESTIMATES_JOURNAL blocks the next write is a full one,
+    // which doesn't need the journal
+    if (vJournal.size() >= MAX_FEE_ESTIMATES_JOURNAL)
+        vJournal.erase(vJournal.begin());
+    vJournal.push_back(BlockRecord());
+    vJournal.back().nHeight = nBlockHeight;
+    nJournalSize++;
 
     unsigned int countedTxs = 0;
-    // Repopulate the current block states
+    // Add the block's transactions to the moving averages
     for (unsigned int i = 0; i < entries.size(); i++) {
         if (processBlockTx(nBlockHeight, entries[i]))
             countedTxs++;
     }
 
-    // Update all exponential averages with the current block state
-    feeStats.UpdateMovingAverages();
+    UpdateEstimates();
 
-    LogPrint("estimatefee", "Blockpolicy after updating estimates for %u of %u txs in block, since last block %u of %u tracked, new mempool map size %u\n",
+    LogPrint(BCLog::ESTIMATEFEE, "Blockpolicy after updating estimates for %u of %u txs in block, since last block %u of %u tracked, new mempool map size %u\n",
              countedTxs, entries.size(), trackedTxs, trackedTxs + untrackedTxs, mapMemPoolTxs.size());
 
     trackedTxs = 0;
@@ -410,10 +493,13 @@ CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget)
 {
     // Return failure if trying to analyze a target we're not tracking
     // It's not possible to get reasonable estimates for confTarget of 1
-    if (confTarget <= 1 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
+    if (confTarget <= 1 || (unsigned int)confTarget > vEstimates.size())
         return CFeeRate(0);
 
-    double median = feeStats.EstimateMedianVal(confTarget, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
+    if (fEstimatesStale)
+        UpdateEstimates();
+
+    double median = vEstimates[confTarget - 1];
 
     if (median < 0)
         return CFeeRate(0);
@@ -426,20 +512,22 @@ CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, int *answerFoun
     if (answerFoundAtTarget)
         *answerFoundAtTarget = confTarget;
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > feeStats.GetMaxConfirms())
+    if (confTarget <= 0 || (unsigned int)confTarget > vEstimates.size())
         return CFeeRate(0);
 
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget == 1)
         confTarget = 2;
 
-    double median = -1;
-    while (median < 0 && (unsigned int)confTarget <= feeStats.GetMaxConfirms()) {
-        median = feeStats.EstimateMedianVal(confTarget++, SUFFICIENT_FEETXS, MIN_SUCCESS_PCT, true, nBestSeenHeight);
-    }
+    if (fEstimatesStale)
+        UpdateEstimates();
+
+    // The lowest target from confTarget up with an estimate
+    confTarget = vSmartTargets[confTarget - 1];
+    double median = vEstimates[confTarget - 1];
 
     if (answerFoundAtTarget)
-        *answerFoundAtTarget = confTarget - 1;
+        *answerFoundAtTarget = confTarget;
 
     // If mempool is limiting txs , return at least the min feerate from the mempool
     CAmount minPoolFee = pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFeePerK();
@@ -474,6 +562,26 @@ void CBlockPolicyEstimator::Write(CAutoFile& fileout)
 {
     fileout << nBestSeenHeight;
     feeStats.Write(fileout);
+    vJournal.clear();
+    nJournalSize = 0;
+}
+
+static uint256 BlockRecordHash(unsigned int nHeight, const std::vector<std::pair<unsigned int, double> >& vTxs)
+{
+    CHashWriter ss(SER_DISK, CLIENT_VERSION);
+    ss << nHeight << vTxs;
+    return ss.GetHash();
+}
+
+void CBlockPolicyEstimator::WriteBlocks(CAutoFile& fileout)
+{
+    // Each block comes with a checksum, so that a block cut short by a
+    // crash while appending is told apart at the next read
+    for (const BlockRecord& record : vJournal) {
+        fileout << record.nHeight << record.vTxs;
+        fileout << BlockRecordHash(record.nHeight, record.vTxs);
+    }
+    vJournal.clear();
 }
 
 void CBlockPolicyEstimator::Read(CAutoFile& filein, int nFileVersion)
@@ -486,6 +594,31 @@ void CBlockPolicyEstimator::Read(CAutoFile& filein, int nFileVersion)
         TxConfirmStats priStats;
         priStats.Read(filein);
     }
+
+    // Replay the blocks appended since
+    vJournal.clear();
+    nJournalSize = 0;
+    try {
+        while (true) {
+            BlockRecord record;
+            uint256 hash;
+            filein >> record.nHeight >> record.vTxs >> hash;
+            if (hash != BlockRecordHash(record.nHeight, record.vTxs)) {
+                LogPrintf("%s: checksum mismatch in appended block %u, ignoring the rest\n", __func__, record.nHeight);
+                break;
+            }
+            nJournalSize++;
+            if (record.nHeight <= nBestSeenHeight)
+                continue;
+            NewBlock(record.nHeight);
+            for (const std::pair<unsigned int, double>& tx : record.vTxs)
+                feeStats.Record(tx.first, tx.second);
+        }
+    } catch (const std::ios_base::failure&) {
+        // End of file, or a block cut short
+    }
+    UpdateEstimates();
+    LogPrint(BCLog::ESTIMATEFEE, "Read estimates up to height %u, %u blocks appended\n", nBestSeenHeight, nJournalSize);
 }
 
 FeeFilterRounder::FeeFilterRounder(const CFeeRate& minIncrementalFee)
@@ -7,11 +7,14 @@
 #define BITCOIN_POLICYESTIMATOR_H
 
 #include "amount.h"
+#include "coins.h"
 #include "uint256.h"
 #include "random.h"
 
 #include <map>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 class CAutoFile;
@@ -58,6 +61,16 @@ class CTxMemPool;
  * the number of transactions we've seen in that feerate bucket when calculating
  * an estimate for any number of confirmations below the number of blocks
  * they've been outstanding.
+ *
+ * The estimates for every target are worked out once per block and looked
+ * up from then on. Transactions entering the mempool can't change them
+ * before the next block, while transactions leaving it other than in a block
+ * have them worked out again at the next lookup.
+ *
+ * The confirmations of each block are also kept as a journal, which
+ * fee_estimates.dat gets appended with every few minutes, and which is
+ * replayed on top of the last full write at startup. Blocks the estimator
+ * did not see decay the history all the same.
  */
 
 /**
@@ -75,29 +88,29 @@ private:
     std::vector<double> buckets;              // The upper-bound of the range for the bucket (inclusive)
     std::map<double, unsigned int> bucketMap; // Map of bucket upper-bound to index into all vectors by bucket
 
+    // The moving averages below are all kept multiplied by scale. Rather
+    // than decaying every one of them for each block, scale grows by
+    // 1/decay and new data points are added in multiplied by it, which
+    // weighs down the history just the same.
+
     // For each bucket X:
     // Count the total # of txs in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> txCtAvg;
-    // and calculate the total for the current block to update the moving average
-    std::vector<int> curBlockTxCt;
 
     // Count the total # of txs confirmed within Y blocks in each bucket
     // Track the historical moving average of theses totals over blocks
     std::vector<std::vector<double> > confAvg; // confAvg[Y][X]
-    // and calculate the totals for the current block to update the moving averages
-    std::vector<std::vector<int> > curBlockConf; // curBlockConf[Y][X]
 
     // Sum the total feerate of all tx's in each bucket
     // Track the historical moving average of this total over blocks
     std::vector<double> avg;
-    // and calculate the total for the current block to update the moving average
-    std::vector<double> curBlockVal;
 
     // Combine the conf counts with tx counts to calculate the confirmation % for each Y,X
     // Combine the total value with the tx counts to calculate the avg feerate per bucket
 
     double decay;
+    double scale;
 
     // Mempool counts of outstanding transactions
     // For each bucket X, track the number of transactions in the mempool
@@ -106,6 +119,12 @@ private:
     // transactions still unconfirmed after MAX_CONFIRMS for each bucket
     std::vector<int> oldUnconfTxs;
 
+    /** Divide the moving averages by scale, and start over from a scale of 1 */
+    void Rescale();
+
+    double EstimateMedianVal(int confTarget, double sufficientTxVal, double minSuccess,
+                             bool requireGreater, const std::vector<int>& extraTxs);
+
 public:
     /**
      * Initialize the data structures.  This is called by BlockPolicyEstimator's
@@ -116,11 +135,15 @@ public:
      */
     void Initialize(std::vector<double>& defaultBuckets, unsigned int maxConfirms, double decay);
 
-    /** Clear the state of the curBlock variables to start counting for the new block */
-    void ClearCurrent(unsigned int nBlockHeight);
+    /**
+     * Start counting for a new block, nBlocks after the last one: decay the
+     * history once for each of them, and move the mempool transactions
+     * entered at the heights left behind into the old unconfirmed counts.
+     */
+    void NewBlock(unsigned int nBlockHeight, unsigned int nBlocks);
 
     /**
-     * Record a new transaction data point in the current block stats
+     * Record a new transaction data point in the moving averages
      * @param blocksToConfirm the number of blocks it took this transaction to confirm
      * @param val the feerate of the transaction
      * @warning blocksToConfirm is 1-based and has to be >= 1
@@ -134,10 +157,6 @@ public:
     void removeTx(unsigned int entryHeight, unsigned int nBestSeenHeight,
                   unsigned int bucketIndex);
 
-    /** Update our estimates by decaying our historical moving average and updating
-        with the data gathered from the current block */
-    void UpdateMovingAverages();
-
     /**
      * Calculate a feerate estimate.  Find the lowest value bucket (or range of buckets
      * to make sure we have enough data points) whose transactions still have sufficient likelihood
@@ -152,6 +171,13 @@ public:
     double EstimateMedianVal(int confTarget, double sufficientTxVal,
                              double minSuccess, bool requireGreater, unsigned int nBlockHeight);
 
+    /**
+     * Calculate the feerate estimates for all targets, like EstimateMedianVal,
+     * in about the time of one. vMedians[Y - 1] is the estimate for target Y.
+     */
+    void EstimateMedianVals(std::vector<double>& vMedians, double sufficientTxVal,
+                            double minSuccess, bool requireGreater, unsigned int nBlockHeight);
+
     /** Return the max number of confirms we're tracking */
     unsigned int GetMaxConfirms() { return confAvg.size(); }
 
@@ -235,6 +261,9 @@ static const double INF_PRIORITY = 1e9 * MAX_MONEY;
  */
 static const double FEE_SPACING = 1.05;
 
+/** Blocks appended to fee_estimates.dat before it is written in full again */
+static const unsigned int MAX_FEE_ESTIMATES_JOURNAL = 144;
+
 /**
  *  We want to be able to estimate feerates that are needed on tx's to be included in
  * a certain number of blocks.  Every time a block is added to the best chain, this class records
@@ -285,7 +314,13 @@ public:
     /** Write estimation data to a file */
     void Write(CAutoFile& fileout);
 
-    /** Read estimation data from a file */
+    /** Append the blocks processed since the last write to a file written by Write */
+    void WriteBlocks(CAutoFile& fileout);
+
+    /** Number of blocks appended, or to be appended, since the last Write */
+    unsigned int GetJournalSize() const { return nJournalSize; }
+
+    /** Read estimation data from a file, along with any blocks appended to it */
     void Read(CAutoFile& filein, int nFileVersion);
 
 private:
@@ -299,11 +334,33 @@ private:
     };
 
     // map of txids to information about that transaction
-    std::map<uint256, TxStatsInfo> mapMemPoolTxs;
+    std::unordered_map<uint256, TxStatsInfo, SaltedTxidHasher> mapMemPoolTxs;
 
     /** Classes to track historical data on transaction confirmations */
     TxConfirmStats feeStats;
 
+    //! Estimate for each target, -1 where there is none
+    std::vector<double> vEstimates;
+    //! Lowest target at or above each target with an estimate, for estimateSmartFee
+    std::vector<int> vSmartTargets;
+    //! Set when a transaction left the mempool since the estimates were worked out
+    bool fEstimatesStale;
+
+    /** The confirmations recorded for one block, to be appended to the estimates file */
+    struct BlockRecord
+    {
+        unsigned int nHeight;
+        //! Blocks to confirm and feerate of each tracked transaction
+        std::vector<std::pair<unsigned int, double> > vTxs;
+    };
+    std::vector<BlockRecord> vJournal;
+    unsigned int nJournalSize;
+
+    /** Work out the estimates for every target after a block */
+    void UpdateEstimates();
+    /** Start a new block nBlockHeight, taking care of any blocks skipped since nBestSeenHeight */
+    void NewBlock(unsigned int nBlockHeight);
+
     unsigned int trackedTxs;
     unsigned int untrackedTxs;
 };
@@ -10,6 +10,7 @@
 #include "primitives/transaction.h"
 #include "validation.h"
 #include "httpserver.h"
+#include "perfstats.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
@@ -160,7 +161,7 @@ static bool rest_headers(HTTPRequest* req,
         }
     }
 
-    CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
+    CPooledDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
     const CChainParams& chainparams = Params();
     BOOST_FOREACH(const CBlockIndex *pindex, headers) {
         ssHeader << pindex->GetBlockHeader(chainparams.GetConsensus(pindex->nHeight));
@@ -227,7 +228,7 @@ static bool rest_block(HTTPRequest* req,
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    CPooledDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
     ssBlock << block;
 
     switch (rf) {
@@ -655,6 +656,15 @@ static bool rest_blockhash_by_height(HTTPRequest* req,
      }
  }
 
+static bool rest_metrics(HTTPRequest* req, const std::string& strURIPart)
+{
+    // Prometheus scrapes a fixed path, so there is no format suffix
+    if (!strURIPart.empty())
+        return RESTERR(req, HTTP_NOT_FOUND, "not found");
+    req->WriteHeader("Content-Type", "text/plain; version=0.0.4");
+    req->WriteReply(HTTP_OK, PerfStatsToPrometheus());
+    return true;
+}
 
 static const struct {
     const char* prefix;
@@ -669,6 +679,7 @@ static const struct {
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
       {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+      {"/rest/metrics", rest_metrics},
 };
 
 bool StartREST()
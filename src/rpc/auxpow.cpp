@@ -25,15 +25,19 @@
 
 #include <stdint.h>
 #include <memory>
+#include <set>
 #include <vector>
 
 #include <univalue.h>
 
 bool fUseNamecoinApi;
+bool fAuxEmptyTemplate = DEFAULT_AUX_EMPTY_TEMPLATE;
 
 static CCriticalSection cs_auxpowrpc;
 static CAuxBlockCache auxBlockCache;
 static std::vector<std::unique_ptr<CBlockTemplate>> vNewBlockTemplate;
+// Coinbase-only blocks handed out for the current tip (see -auxemptytemplate)
+static std::set<uint256> setEmptyAuxBlocks;
 
 void AuxMiningCheck()
 {
@@ -80,8 +84,13 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
     {
         LOCK(cs_main);
 
+        // A coinbase-only block is replaced as soon as the full template
+        // for its tip has been assembled
+        const bool fFillEmpty = pblock && setEmptyAuxBlocks.count(pblock->GetHash())
+            && g_blockTemplateManager && g_blockTemplateManager->IsCurrent(chainActive.Tip(), fMineWitnessTx);
+
         // Update block
-        if (!pblock || pindexPrev != chainActive.Tip()
+        if (!pblock || pindexPrev != chainActive.Tip() || fFillEmpty
             || (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast
                 && GetTime() - nStart > 60))
         {
@@ -90,12 +99,30 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
                 // Clear caches since they're obsolete now.
                 auxBlockCache.Reset();
                 vNewBlockTemplate.clear();
+                setEmptyAuxBlocks.clear();
                 pblock.reset();
             }
 
             // Create new block with nonce = 0 and extraNonce = 1
-            std::unique_ptr<CBlockTemplate> newBlock
-                = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx);
+            std::unique_ptr<CBlockTemplate> newBlock;
+            bool fEmpty = false;
+            if (fAuxEmptyTemplate && g_blockTemplateManager && pindexPrev != chainActive.Tip()
+                && !g_blockTemplateManager->IsCurrent(chainActive.Tip(), fMineWitnessTx))
+            {
+                // Hand out work on the new tip right away and fill the
+                // block in the background. On the same tip, a template that
+                // is not current is merely stale, and is brought up to date
+                // instead.
+                newBlock = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx, true);
+                g_blockTemplateManager->RebuildInBackground(fMineWitnessTx);
+                fEmpty = true;
+            }
+            else
+            {
+                newBlock = g_blockTemplateManager
+                    ? g_blockTemplateManager->GetBlockTemplate(scriptPubKey, fMineWitnessTx)
+                    : BlockAssembler(Params()).CreateNewBlock(scriptPubKey, fMineWitnessTx);
+            }
             if (!newBlock)
                 throw JSONRPCError(RPC_OUT_OF_MEMORY, "out of memory");
 
@@ -111,6 +138,8 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
             // Save
             pblock = std::make_shared<CBlock>(newBlock->block);
             auxBlockCache.Add(scriptID, pblock);
+            if (fEmpty)
+                setEmptyAuxBlocks.insert(pblock->GetHash());
             vNewBlockTemplate.push_back(std::move(newBlock));
         }
     }
@@ -136,10 +165,52 @@ static UniValue AuxMiningCreateBlock(const CScript& scriptPubKey)
     result.pushKV("bits", strprintf("%08x", pblock->nBits));
     result.pushKV("height", static_cast<int64_t> (pindexPrev->nHeight + 1));
     result.pushKV(fUseNamecoinApi ? "_target" : "target", HexStr(BEGIN(target), END(target)));
+    // Coinbase-only work is flagged so that a long poll on it returns once
+    // the full block is ready
+    result.pushKV("longpollid", pindexPrev->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast)
+                                + (setEmptyAuxBlocks.count(pblock->GetHash()) ? "e" : ""));
 
     return result;
 }
 
+/**
+ * Block until the work described by a longpollid from createauxblock is
+ * stale: the tip moved, the full block replacing coinbase-only work is
+ * ready, or a minute passed and the mempool changed.
+ */
+static void AuxMiningWaitForWork(const std::string& lpstr)
+{
+    // Format: <hashBestChain><nTransactionsUpdatedLast>[e]
+    if (lpstr.size() < 64)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid longpollid");
+    uint256 hashWatchedChain;
+    hashWatchedChain.SetHex(lpstr.substr(0, 64));
+    const unsigned int nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+    const bool fWaitForFull = lpstr[lpstr.size() - 1] == 'e' && g_blockTemplateManager;
+
+    boost::system_time checktxtime = boost::get_system_time() + boost::posix_time::minutes(1);
+    boost::unique_lock<boost::mutex> lock(csBestBlock);
+    while (IsRPCRunning())
+    {
+        const CBlockIndex* pindexTip = chainActive.TipSnapshot();
+        if (!pindexTip || pindexTip->GetBlockHash() != hashWatchedChain)
+            break;
+        // Aux work never holds witness transactions, see AuxMiningCreateBlock
+        if (fWaitForFull && g_blockTemplateManager->IsCurrent(pindexTip, false))
+            break;
+        if (!cvBlockChange.timed_wait(lock, checktxtime))
+        {
+            // Timeout: Check transactions for update
+            if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
+                break;
+            checktxtime += boost::posix_time::seconds(10);
+        }
+    }
+
+    if (!IsRPCRunning())
+        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
+}
+
 static UniValue AuxMiningSubmitBlock(const uint256 hash, const CAuxPow auxpow)
 {
     AuxMiningCheck();
@@ -164,12 +235,14 @@ static UniValue AuxMiningSubmitBlock(const uint256 hash, const CAuxPow auxpow)
 
 UniValue createauxblock(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() != 1)
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
         throw std::runtime_error(
-            "createauxblock <address>\n"
+            "createauxblock <address> ( \"longpollid\" )\n"
             "\ncreate a new block and return information required to merge-mine it.\n"
             "\nArguments:\n"
             "1. address      (string, required) specify coinbase transaction payout address\n"
+            "2. longpollid   (string, optional) longpollid of the last work received; wait until that\n"
+            "                work is outdated before returning new work\n"
             "\nResult:\n"
             "{\n"
             "  \"hash\"               (string) hash of the created block\n"
@@ -183,7 +256,8 @@ UniValue createauxblock(const JSONRPCRequest& request)
               ? "  \"_target\"            (string) target in reversed byte order\n"
               : "  \"target\"             (string) target in reversed byte order\n"
             )
-            + "}\n"
+            + "  \"longpollid\"         (string) id to wait for new work with\n"
+            "}\n"
             "\nExamples:\n"
             + HelpExampleCli("createauxblock", "\"address\"")
             + HelpExampleRpc("createauxblock", "\"address\"")
@@ -196,6 +270,8 @@ UniValue createauxblock(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_INVALID_PARAMETER,"Invalid coinbase payout address");
 
     const CScript scriptPubKey = GetScriptForDestination(coinbaseAddress.Get());
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        AuxMiningWaitForWork(request.params[1].get_str());
     return AuxMiningCreateBlock(scriptPubKey);
 }
 
@@ -252,7 +328,8 @@ UniValue getauxblock(const JSONRPCRequest& request)
             ? "  \"_target\"            (string) target in reversed byte order\n"
             : "  \"target\"             (string) target in reversed byte order\n"
           )
-          + "}\n"
+          + "  \"longpollid\"         (string) id to pass to createauxblock to wait for new work\n"
+          "}\n"
           "\nResult (with arguments):\n"
           "xxxxx        (boolean) whether the submitted block was correct\n"
           "\nExamples:\n"
@@ -302,7 +379,7 @@ static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
     { "mining",             "getauxblock",            &getauxblock,            true,  {"hash", "auxpow"} },
-    { "mining",             "createauxblock",         &createauxblock,         true,  {"address"} },
+    { "mining",             "createauxblock",         &createauxblock,         true,  {"address","longpollid"} },
     { "mining",             "submitauxblock",         &submitauxblock,         true,  {"hash", "auxpow"} },
 };
 
@@ -20,6 +20,7 @@
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "undo.h"
 #include "util.h"
@@ -117,14 +118,20 @@ UniValue AuxpowToJSON(const CAuxPow& auxpow)
     return result;
 }
 
-UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+/**
+ * Header fields of blockindex, with confirmations and the next block taken
+ * relative to pindexTip rather than chainActive. With the tip from
+ * chainActive.TipSnapshot() this needs no cs_main.
+ */
+UniValue blockheaderToJSON(const CBlockIndex* blockindex, const CBlockIndex* pindexTip)
 {
     UniValue result(UniValue::VOBJ);
     result.pushKV("hash", blockindex->GetBlockHash().GetHex());
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex))
-        confirmations = chainActive.Height() - blockindex->nHeight + 1;
+    const bool fOnChain = pindexTip && pindexTip->GetAncestor(blockindex->nHeight) == blockindex;
+    if (fOnChain)
+        confirmations = pindexTip->nHeight - blockindex->nHeight + 1;
     result.pushKV("confirmations", confirmations);
     result.pushKV("height", blockindex->nHeight);
     result.pushKV("version", blockindex->nVersion);
@@ -139,12 +146,16 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
 
     if (blockindex->pprev)
         result.pushKV("previousblockhash", blockindex->pprev->GetBlockHash().GetHex());
-    CBlockIndex *pnext = chainActive.Next(blockindex);
-    if (pnext)
-        result.pushKV("nextblockhash", pnext->GetBlockHash().GetHex());
+    if (fOnChain && blockindex != pindexTip)
+        result.pushKV("nextblockhash", pindexTip->GetAncestor(blockindex->nHeight + 1)->GetBlockHash().GetHex());
     return result;
 }
 
+UniValue blockheaderToJSON(const CBlockIndex* blockindex)
+{
+    return blockheaderToJSON(blockindex, chainActive.Tip());
+}
+
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
 {
     UniValue result(UniValue::VOBJ);
@@ -205,8 +216,8 @@ UniValue getblockcount(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockcount", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Height();
+    const CBlockIndex* pindexTip = chainActive.TipSnapshot();
+    return pindexTip ? pindexTip->nHeight : -1;
 }
 
 UniValue getbestblockhash(const JSONRPCRequest& request)
@@ -222,8 +233,7 @@ UniValue getbestblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getbestblockhash", "")
         );
 
-    LOCK(cs_main);
-    return chainActive.Tip()->GetBlockHash().GetHex();
+    return chainActive.TipSnapshot()->GetBlockHash().GetHex();
 }
 
 void RPCNotifyBlockChange(bool ibd, const CBlockIndex * pindex)
@@ -371,8 +381,8 @@ UniValue getdifficulty(const JSONRPCRequest& request)
             + HelpExampleRpc("getdifficulty", "")
         );
 
-    LOCK(cs_main);
-    return GetDifficulty();
+    const CBlockIndex* pindexTip = chainActive.TipSnapshot();
+    return pindexTip ? GetDifficulty(pindexTip) : 1.0;
 }
 
 std::string EntryDescriptionString()
@@ -686,14 +696,13 @@ UniValue getblockhash(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockhash", "1000")
         );
 
-    LOCK(cs_main);
+    const CBlockIndex* pindexTip = chainActive.TipSnapshot();
 
     int nHeight = request.params[0].get_int();
-    if (nHeight < 0 || nHeight > chainActive.Height())
+    if (nHeight < 0 || !pindexTip || nHeight > pindexTip->nHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
 
-    CBlockIndex* pblockindex = chainActive[nHeight];
-    return pblockindex->GetBlockHash().GetHex();
+    return pindexTip->GetAncestor(nHeight)->GetBlockHash().GetHex();
 }
 
 UniValue getblockheader(const JSONRPCRequest& request)
@@ -730,8 +739,6 @@ UniValue getblockheader(const JSONRPCRequest& request)
             + HelpExampleRpc("getblockheader", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
         );
 
-    LOCK(cs_main);
-
     std::string strHash = request.params[0].get_str();
     uint256 hash(uint256S(strHash));
 
@@ -739,20 +746,21 @@ UniValue getblockheader(const JSONRPCRequest& request)
     if (request.params.size() > 1)
         fVerbose = request.params[1].get_bool();
 
-    if (mapBlockIndex.count(hash) == 0)
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
 
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
     if (!fVerbose)
     {
+        // AuxPoW headers missing from the header store are read back from the block files
+        LOCK(cs_main);
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
         ssBlock << pblockindex->GetBlockHeader(Params().GetConsensus(pblockindex->nHeight));
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockheaderToJSON(pblockindex, chainActive.TipSnapshot());
 }
 
 static CBlock GetBlockChecked(const CBlockIndex* pblockindex)
@@ -869,7 +877,7 @@ UniValue getblock(const JSONRPCRequest& request)
 
     if (verbosity <= 0)
     {
-        CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+        CPooledDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
         ssBlock << block;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
@@ -973,7 +981,7 @@ UniValue pruneblockchain(const JSONRPCRequest& request)
     else if (height > chainHeight)
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Blockchain is shorter than the attempted prune height.");
     else if (height > chainHeight - MIN_BLOCKS_TO_KEEP) {
-        LogPrint("rpc", "Attempt to prune blocks close to the tip.  Retaining the minimum number of blocks.");
+        LogPrint(BCLog::RPC, "Attempt to prune blocks close to the tip.  Retaining the minimum number of blocks.");
         height = chainHeight - MIN_BLOCKS_TO_KEEP;
     }
 
@@ -1413,6 +1421,9 @@ UniValue mempoolInfoToJSON()
     size_t maxmempool = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
     ret.pushKV("maxmempool", (int64_t) maxmempool);
     ret.pushKV("mempoolminfee", ValueFromAmount(mempool.GetMinFee(maxmempool).GetFeePerK()));
+    ret.pushKV("loaded", mempool.IsLoaded());
+    if (!mempool.IsLoaded())
+        ret.pushKV("loadprogress", mempool.GetLoadProgress());
 
     return ret;
 }
@@ -1430,6 +1441,8 @@ UniValue getmempoolinfo(const JSONRPCRequest& request)
             "  \"usage\": xxxxx,              (numeric) Total memory usage for the mempool\n"
             "  \"maxmempool\": xxxxx,         (numeric) Maximum memory usage for the mempool\n"
             "  \"mempoolminfee\": xxxxx       (numeric) Minimum fee for tx to be accepted\n"
+            "  \"loaded\": true|false,        (boolean) Whether the transactions saved at the last shutdown are back in the mempool\n"
+            "  \"loadprogress\": xxxxx        (numeric, optional) While not loaded, the fraction of mempool.dat processed so far\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmempoolinfo", "")
@@ -1875,6 +1888,110 @@ static UniValue getblockstats(const JSONRPCRequest& request)
     return ret;
 }
 
+static UniValue DBStatsToJSON(const std::string& strName, const CDBWrapper& db)
+{
+    const CDBOptions& dbOptions = db.GetDBOptions();
+    CDBWrapper::Stats stats = db.GetStats();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("name", strName);
+    ret.pushKV("path", db.GetPath().string());
+
+    UniValue profile(UniValue::VOBJ);
+    profile.pushKV("name", dbOptions.strProfile);
+    profile.pushKV("compression", db.IsCompressed());
+    profile.pushKV("maxopenfiles", dbOptions.nMaxOpenFiles);
+    profile.pushKV("blocksize", (uint64_t)dbOptions.nBlockSize);
+    profile.pushKV("bloombits", dbOptions.nBloomBits);
+    profile.pushKV("writebuffer", dbOptions.nWriteBufferPercent);
+    ret.pushKV("profile", profile);
+
+    ret.pushKV("usage", stats.nMemoryUsage);
+    ret.pushKV("batches", stats.nBatchesWritten);
+    ret.pushKV("syncs", stats.nSyncsWritten);
+    ret.pushKV("bytes", stats.nBytesWritten);
+
+    UniValue levels(UniValue::VARR);
+    double dSize = 0, dTime = 0, dRead = 0, dWritten = 0;
+    BOOST_FOREACH(const CDBWrapper::LevelStats& level, stats.vLevels) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("level", level.nLevel);
+        entry.pushKV("files", level.nFiles);
+        entry.pushKV("size", level.dSize);
+        entry.pushKV("compactiontime", level.dCompactionTime);
+        entry.pushKV("compactionread", level.dCompactionRead);
+        entry.pushKV("compactionwritten", level.dCompactionWritten);
+        levels.push_back(entry);
+        dSize += level.dSize;
+        dTime += level.dCompactionTime;
+        dRead += level.dCompactionRead;
+        dWritten += level.dCompactionWritten;
+    }
+    ret.pushKV("levels", levels);
+    ret.pushKV("size", dSize);
+    ret.pushKV("compactiontime", dTime);
+    ret.pushKV("compactionread", dRead);
+    ret.pushKV("compactionwritten", dWritten);
+    ret.pushKV("leveldbstats", stats.strLevelDBStats);
+    return ret;
+}
+
+UniValue getdbstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getdbstats\n"
+            "\nReturns the settings and statistics of the LevelDB databases.\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"name\": \"xxxx\",              (string) The database: chainstate, blocktree or indexes\n"
+            "    \"path\": \"xxxx\",              (string) Its directory\n"
+            "    \"profile\": {                  (json object) The settings it was opened with, see -dboption\n"
+            "      \"name\": \"xxxx\",            (string) The profile\n"
+            "      \"compression\": true|false,  (boolean) Whether blocks are compressed: never if LevelDB was built without Snappy\n"
+            "      \"maxopenfiles\": n,          (numeric) Table files kept open\n"
+            "      \"blocksize\": n,             (numeric) Approximate size of a table block in bytes\n"
+            "      \"bloombits\": n,             (numeric) Bloom filter bits per key\n"
+            "      \"writebuffer\": n            (numeric) Write buffer size in percent of the cache\n"
+            "    },\n"
+            "    \"usage\": n,                   (numeric) Memory taken by the block cache and write buffers\n"
+            "    \"batches\": n,                 (numeric) Batches written since startup\n"
+            "    \"syncs\": n,                   (numeric) Of which synced to disk\n"
+            "    \"bytes\": n,                   (numeric) Approximate bytes written since startup\n"
+            "    \"levels\": [                   (json array) The levels that have files or had compactions\n"
+            "      {\n"
+            "        \"level\": n,               (numeric) The level\n"
+            "        \"files\": n,               (numeric) Table files\n"
+            "        \"size\": n,                (numeric) Size of the table files in MiB\n"
+            "        \"compactiontime\": n,      (numeric) Seconds spent compacting into the level\n"
+            "        \"compactionread\": n,      (numeric) MiB read by those compactions\n"
+            "        \"compactionwritten\": n    (numeric) MiB written by those compactions\n"
+            "      }, ...\n"
+            "    ],\n"
+            "    \"size\": n,                    (numeric) Size of all table files in MiB\n"
+            "    \"compactiontime\": n,          (numeric) Seconds spent compacting in all levels\n"
+            "    \"compactionread\": n,          (numeric) MiB read by all compactions\n"
+            "    \"compactionwritten\": n,       (numeric) MiB written by all compactions\n"
+            "    \"leveldbstats\": \"xxxx\"       (string) LevelDB's own summary\n"
+            "  }, ...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getdbstats", "")
+            + HelpExampleRpc("getdbstats", "")
+        );
+
+    LOCK(cs_main);
+    UniValue ret(UniValue::VARR);
+    if (pcoinsdbview)
+        ret.push_back(DBStatsToJSON("chainstate", pcoinsdbview->GetDB()));
+    if (pblocktree)
+        ret.push_back(DBStatsToJSON("blocktree", *pblocktree));
+    if (pindexdb)
+        ret.push_back(DBStatsToJSON("indexes", *pindexdb));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafe argNames
   //  --------------------- ------------------------  -----------------------  ------ ----------
@@ -1886,6 +2003,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
+    { "blockchain",         "getdbstats",             &getdbstats,             true,  {} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
@@ -130,6 +130,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getmempooldescendants", 1, "verbose" },
     { "bumpfee", 1, "options" },
     { "setmaxconnections", 0, "maxconnectioncount" },
+    { "getperfstats", 0, "reset" },
     { "rescan", 0, "height" },
     { "getaddressutxos", 1, "amount" },
     { "getaddressutxos", 2, "includechaininfo" },
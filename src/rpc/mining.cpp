@@ -269,6 +269,15 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"templatevalidation\": {     (json object) Time spent checking the last block template, in milliseconds\n"
+            "     \"header\": xxx,           (numeric) contextual header checks\n"
+            "     \"checkblock\": xxx,       (numeric) context-free block and transaction checks\n"
+            "     \"contextual\": xxx,       (numeric) contextual block checks\n"
+            "     \"connect\": xxx,          (numeric) connecting the inputs to the UTXO set\n"
+            "     \"verify\": xxx,           (numeric) waiting for the script checks not answered by the caches\n"
+            "     \"total\": xxx,            (numeric) the whole check\n"
+            "     \"inputs\": n              (numeric) inputs spent by the template\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
@@ -288,6 +297,16 @@ UniValue getmininginfo(const JSONRPCRequest& request)
     obj.pushKV("networkhashps",    getnetworkhashps(request));
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
+
+    UniValue validation(UniValue::VOBJ);
+    validation.pushKV("header",     0.001 * lastBlockValidityTimings.nHeader);
+    validation.pushKV("checkblock", 0.001 * lastBlockValidityTimings.nCheckBlock);
+    validation.pushKV("contextual", 0.001 * lastBlockValidityTimings.nContextual);
+    validation.pushKV("connect",    0.001 * lastBlockValidityTimings.nConnect);
+    validation.pushKV("verify",     0.001 * lastBlockValidityTimings.nVerify);
+    validation.pushKV("total",      0.001 * lastBlockValidityTimings.nTotal);
+    validation.pushKV("inputs",     lastBlockValidityTimings.nInputs);
+    obj.pushKV("templatevalidation", validation);
     return obj;
 }
 
@@ -320,6 +339,9 @@ UniValue prioritisetransaction(const JSONRPCRequest& request)
     CAmount nAmount = request.params[2].get_int64();
 
     mempool.PrioritiseTransaction(hash, request.params[0].get_str(), request.params[1].get_real(), nAmount);
+    // Fees in the live template are stale now
+    if (g_blockTemplateManager)
+        g_blockTemplateManager->Invalidate();
     return true;
 }
 
@@ -586,7 +608,9 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fMineWitnessTx);
+        pblocktemplate = g_blockTemplateManager
+            ? g_blockTemplateManager->GetBlockTemplate(scriptDummy, fMineWitnessTx)
+            : BlockAssembler(Params()).CreateNewBlock(scriptDummy, fMineWitnessTx);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
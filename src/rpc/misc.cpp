@@ -12,6 +12,7 @@
 #include <txmempool.h>
 #include <consensus/consensus.h>
 #include "netbase.h"
+#include "perfstats.h"
 #include "rpc/server.h"
 #include "timedata.h"
 #include "util.h"
@@ -449,14 +450,14 @@ UniValue getaddressdeltas(const JSONRPCRequest& request)
     UniValue result(UniValue::VOBJ);
 
     if (includeChainInfo && start > 0 && end > 0) {
-        LOCK(cs_main);
+        const CBlockIndex* pindexTip = chainActive.TipSnapshot();
 
-        if (start > chainActive.Height() || end > chainActive.Height()) {
+        if (!pindexTip || start > pindexTip->nHeight || end > pindexTip->nHeight) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
         }
 
-        CBlockIndex* startIndex = chainActive[start];
-        CBlockIndex* endIndex = chainActive[end];
+        const CBlockIndex* startIndex = pindexTip->GetAncestor(start);
+        const CBlockIndex* endIndex = pindexTip->GetAncestor(end);
 
         UniValue startInfo(UniValue::VOBJ);
         UniValue endInfo(UniValue::VOBJ);
@@ -622,9 +623,9 @@ UniValue getaddressutxos(const JSONRPCRequest& request)
         UniValue result(UniValue::VOBJ);
         result.pushKV("utxos", utxos);
 
-        LOCK(cs_main);
-        result.pushKV("hash", chainActive.Tip()->GetBlockHash().GetHex());
-        result.pushKV("height", (int)chainActive.Height());
+        const CBlockIndex* pindexTip = chainActive.TipSnapshot();
+        result.pushKV("hash", pindexTip->GetBlockHash().GetHex());
+        result.pushKV("height", pindexTip->nHeight);
         return result;
     } else {
         return utxos;
@@ -752,9 +753,6 @@ UniValue getblockhashes(const JSONRPCRequest& request)
 
     std::vector<std::pair<uint256, unsigned int> > blockHashes;
 
-    if (fActiveOnly)
-        LOCK(cs_main);
-
     if (!GetTimestampIndex(high, low, fActiveOnly, blockHashes)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for block hashes");
     }
@@ -1131,6 +1129,110 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getlockstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw runtime_error(
+            "getlockstats\n"
+            "Returns how often each lock was found held by another thread, and how long\n"
+            "threads waited for it, since startup. Uncontended locks are not listed.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                 (json object) The lock, e.g. \"cs_main\"\n"
+            "    \"contentions\": n,        (numeric) Number of acquisitions that had to wait\n"
+            "    \"wait_ms\": x.xxx,        (numeric) Total time spent waiting, in milliseconds\n"
+            "    \"max_wait_ms\": x.xxx,    (numeric) Longest single wait, in milliseconds\n"
+            "    \"sites\": {              (json object) Where the lock was taken when it had to wait\n"
+            "      \"file:line\": n,        (numeric) Number of acquisitions there that had to wait\n"
+            "      ...\n"
+            "    }\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlockstats", "")
+            + HelpExampleRpc("getlockstats", "")
+        );
+
+    // Sites only record pointers to their literals; names and locations are formatted here
+    std::map<std::string, LockContentionStats> mapStats;
+    std::map<std::string, UniValue> mapSites;
+    BOOST_FOREACH(const LockContentionStats& site, GetLockContentionStats()) {
+        LockContentionStats& stats = mapStats[site.pszName];
+        stats.nContended += site.nContended;
+        stats.nWaitMicros += site.nWaitMicros;
+        stats.nMaxWaitMicros = std::max(stats.nMaxWaitMicros, site.nMaxWaitMicros);
+        UniValue& sites = mapSites.emplace(site.pszName, UniValue(UniValue::VOBJ)).first->second;
+        sites.pushKV(strprintf("%s:%d", site.pszFile, site.nLine), (uint64_t)site.nContended);
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    for (std::map<std::string, LockContentionStats>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("contentions", (uint64_t)it->second.nContended);
+        entry.pushKV("wait_ms", it->second.nWaitMicros * 0.001);
+        entry.pushKV("max_wait_ms", it->second.nMaxWaitMicros * 0.001);
+        entry.pushKV("sites", mapSites[it->first]);
+        obj.pushKV(it->first, entry);
+    }
+    return obj;
+}
+
+UniValue getperfstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw runtime_error(
+            "getperfstats ( reset )\n"
+            "Returns how long instrumented code paths took since startup, or since the\n"
+            "last reset: block connection, script checks, mempool acceptance, flushing,\n"
+            "block templates, and the handling of each network message type.\n"
+            "Paths that have not run are not listed. See -perfstats.\n"
+            "\nArguments:\n"
+            "1. reset            (boolean, optional, default=false) Clear the statistics after returning them\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"name\": {                 (json object) The code path, e.g. \"connectblock\" or \"processmessage.tx\"\n"
+            "    \"count\": n,              (numeric) Number of times it ran\n"
+            "    \"total_ms\": x.xxx,       (numeric) Total time spent in it, in milliseconds\n"
+            "    \"mean_ms\": x.xxx,        (numeric) Average time per run, in milliseconds\n"
+            "    \"max_ms\": x.xxx,         (numeric) Longest run, in milliseconds\n"
+            "    \"histogram\": {           (json object) Runs per duration range, by its upper bound in milliseconds; empty ranges are left out\n"
+            "      \"x.xxx\": n,            (numeric) Runs longer than the previous bound and at most this long\n"
+            "      ...\n"
+            "      \"inf\": n               (numeric) Runs longer than the last bound\n"
+            "    }\n"
+            "  }, ...\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getperfstats", "")
+            + HelpExampleRpc("getperfstats", "true")
+        );
+
+    const bool fReset = request.params.size() > 0 && request.params[0].get_bool();
+
+    UniValue obj(UniValue::VOBJ);
+    std::map<std::string, CPerfHistogram::Snapshot> mapStats = GetPerfStats();
+    if (fReset)
+        ResetPerfStats();
+    for (std::map<std::string, CPerfHistogram::Snapshot>::const_iterator it = mapStats.begin(); it != mapStats.end(); ++it) {
+        const CPerfHistogram::Snapshot& snapshot = it->second;
+        UniValue entry(UniValue::VOBJ);
+        entry.pushKV("count", snapshot.nCount);
+        entry.pushKV("total_ms", snapshot.nTotalMicros * 0.001);
+        entry.pushKV("mean_ms", snapshot.nTotalMicros * 0.001 / snapshot.nCount);
+        entry.pushKV("max_ms", snapshot.nMaxMicros * 0.001);
+        UniValue histogram(UniValue::VOBJ);
+        for (int i = 0; i < CPerfHistogram::BUCKETS; i++) {
+            if (snapshot.vBuckets[i] == 0)
+                continue;
+            const int64_t nLimit = CPerfHistogram::BucketLimit(i);
+            histogram.pushKV(nLimit < 0 ? std::string("inf") : strprintf("%.3f", nLimit * 0.001), snapshot.vBuckets[i]);
+        }
+        entry.pushKV("histogram", histogram);
+        obj.pushKV(it->first, entry);
+    }
+    return obj;
+}
+
 UniValue echo(const JSONRPCRequest& request)
 {
     if (request.fHelp)
@@ -1166,7 +1268,8 @@ UniValue getindexinfo(const JSONRPCRequest& request)
             + HelpExampleRpc("getindexinfo", "txindex")
         );
 
-    LOCK(cs_main);
+    const CBlockIndex* pindexTip = chainActive.TipSnapshot();
+    const int nTipHeight = pindexTip ? pindexTip->nHeight : -1;
 
     UniValue result(UniValue::VOBJ);
     const std::string index_name =
@@ -1180,7 +1283,7 @@ UniValue getindexinfo(const JSONRPCRequest& request)
         // NOTE: If you have real "is synced" signals from each index, use them here.
         // For now, we treat "enabled" as "synced" to satisfy mempool/clients expecting the field.
         index.pushKV("synced", enabled);
-        index.pushKV("best_block_height", enabled ? (int)chainActive.Height() : 0);
+        index.pushKV("best_block_height", enabled ? nTipHeight : 0);
         return index;
     };
 
@@ -1225,6 +1328,8 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "control",            "getinfo",                &getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          &getmemoryinfo,          true,  {} },
+    { "control",            "getlockstats",           &getlockstats,           true,  {} },
+    { "control",            "getperfstats",           &getperfstats,           true,  {"reset"} },
     { "util",               "validateaddress",        &validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         &createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          &verifymessage,          true,  {"address","signature","message"} },
@@ -413,6 +413,47 @@ UniValue getnettotals(const JSONRPCRequest& request)
     return obj;
 }
 
+UniValue getorphanpoolinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 0)
+        throw runtime_error(
+            "getorphanpoolinfo\n"
+            "\nReturns information about the transactions kept while waiting for their parents.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"size\": n,              (numeric) Current number of orphan transactions\n"
+            "  \"usage\": n,             (numeric) Memory taken by the orphan transactions, in bytes\n"
+            "  \"peers\": n,             (numeric) Number of peers whose orphans are kept\n"
+            "  \"outpoints\": n,         (numeric) Number of distinct outpoints spent by the orphans\n"
+            "  \"added\": n,             (numeric) Orphans added since startup\n"
+            "  \"resolved\": n,          (numeric) Orphans accepted to the mempool once their parents arrived\n"
+            "  \"rejected\": n,          (numeric) Orphans found invalid once their parents arrived\n"
+            "  \"expired\": n,           (numeric) Orphans dropped for waiting too long\n"
+            "  \"evicted\": n,           (numeric) Orphans pushed out by the per-peer budgets (-maxorphanpeersize) or -maxorphantx\n"
+            "  \"removedforblock\": n,   (numeric) Orphans spending the same inputs as a transaction in a block\n"
+            "  \"removedforpeer\": n     (numeric) Orphans from peers that disconnected\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getorphanpoolinfo", "")
+            + HelpExampleRpc("getorphanpoolinfo", "")
+       );
+
+    TxOrphanage::Stats stats = GetOrphanPoolStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("size", (uint64_t)stats.nOrphans);
+    obj.pushKV("usage", (uint64_t)stats.nUsage);
+    obj.pushKV("peers", (uint64_t)stats.nPeers);
+    obj.pushKV("outpoints", (uint64_t)stats.nOutpoints);
+    obj.pushKV("added", stats.nAdded);
+    obj.pushKV("resolved", stats.nResolved);
+    obj.pushKV("rejected", stats.nRejected);
+    obj.pushKV("expired", stats.nExpired);
+    obj.pushKV("evicted", stats.nEvicted);
+    obj.pushKV("removedforblock", stats.nRemovedForBlock);
+    obj.pushKV("removedforpeer", stats.nRemovedForPeer);
+    return obj;
+}
+
 static UniValue GetNetworksInfo()
 {
     UniValue networks(UniValue::VARR);
@@ -660,6 +701,7 @@ static const CRPCCommand commands[] =
     { "network",            "disconnectnode",         &disconnectnode,         true,  {"address"} },
     { "network",            "getaddednodeinfo",       &getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           &getnettotals,           true,  {} },
+    { "network",            "getorphanpoolinfo",      &getorphanpoolinfo,      true,  {} },
     { "network",            "getnetworkinfo",         &getnetworkinfo,         true,  {} },
     { "network",            "setban",                 &setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             &listbanned,             true,  {} },
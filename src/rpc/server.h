@@ -23,6 +23,7 @@
 
 static const unsigned int DEFAULT_RPC_SERIALIZE_VERSION = 1;
 static const bool DEFAULT_USE_NAMECOIN_API = false;
+static const bool DEFAULT_AUX_EMPTY_TEMPLATE = false;
 
 class CRPCCommand;
 
@@ -214,5 +215,6 @@ void RPCNotifyBlockChange(bool ibd, const CBlockIndex *);
 int RPCSerializationFlags();
 
 extern bool fUseNamecoinApi;
+extern bool fAuxEmptyTemplate;
 
 #endif // BITCOIN_RPCSERVER_H
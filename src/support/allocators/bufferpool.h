@@ -0,0 +1,191 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_BUFFERPOOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_BUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <limits>
+#include <mutex>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Process wide pool of byte buffers for serialization: network messages,
+ * database keys and values, blocks. Sizes are rounded up to a power of two,
+ * and a freed buffer is kept for the next request of its size instead of
+ * going back to malloc. Buffers are neither zeroed when handed out nor when
+ * given back, so nothing secret belongs in them: key material keeps using
+ * zero_after_free_allocator or secure_allocator.
+ *
+ * At most MAX_FREE_BYTES are kept, and buffers larger than MAX_BUFFER_SIZE
+ * are not pooled at all.
+ */
+class BufferPool
+{
+public:
+    static const size_t MIN_BUFFER_SIZE = 64;
+    static const size_t MAX_BUFFER_SIZE = 8 << 20;
+    static const size_t MAX_FREE_BYTES = 32 << 20;
+
+    struct Stats {
+        uint64_t nHits;       //!< Requests served from a free buffer
+        uint64_t nMisses;     //!< Requests that went to malloc
+        uint64_t nUnpooled;   //!< Requests too large to pool
+        size_t nFreeBytes;    //!< Held in free buffers
+    };
+
+    /** The pool is never destroyed, so buffers may outlive static destructors */
+    static BufferPool& Get()
+    {
+        static BufferPool* pool = new BufferPool();
+        return *pool;
+    }
+
+    void* Allocate(size_t nBytes)
+    {
+        const int nClass = SizeClass(nBytes);
+        if (nClass < 0) {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stats.nUnpooled++;
+            }
+            return ::operator new(nBytes);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            std::vector<void*>& vFree = vFreeLists[nClass];
+            if (!vFree.empty()) {
+                void* p = vFree.back();
+                vFree.pop_back();
+                stats.nFreeBytes -= ClassSize(nClass);
+                stats.nHits++;
+                return p;
+            }
+            stats.nMisses++;
+        }
+        return ::operator new(ClassSize(nClass));
+    }
+
+    void Deallocate(void* p, size_t nBytes)
+    {
+        const int nClass = SizeClass(nBytes);
+        if (nClass >= 0) {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (stats.nFreeBytes + ClassSize(nClass) <= MAX_FREE_BYTES) {
+                vFreeLists[nClass].push_back(p);
+                stats.nFreeBytes += ClassSize(nClass);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+    Stats GetStats()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return stats;
+    }
+
+    /** Give all free buffers back to malloc */
+    void Release()
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < vFreeLists.size(); i++) {
+            for (size_t j = 0; j < vFreeLists[i].size(); j++)
+                ::operator delete(vFreeLists[i][j]);
+            vFreeLists[i].clear();
+        }
+        stats.nFreeBytes = 0;
+    }
+
+    /** Size of the buffer actually handed out for a request of nBytes, or 0 if it is not pooled */
+    static size_t BufferSize(size_t nBytes)
+    {
+        const int nClass = SizeClass(nBytes);
+        return nClass < 0 ? 0 : ClassSize(nClass);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::vector<void*> > vFreeLists;
+    Stats stats;
+
+    BufferPool() : vFreeLists(SizeClass(MAX_BUFFER_SIZE) + 1)
+    {
+        stats.nHits = stats.nMisses = stats.nUnpooled = 0;
+        stats.nFreeBytes = 0;
+    }
+
+    static int SizeClass(size_t nBytes)
+    {
+        if (nBytes > MAX_BUFFER_SIZE)
+            return -1;
+        int nClass = 0;
+        for (size_t nSize = MIN_BUFFER_SIZE; nSize < nBytes; nSize <<= 1)
+            nClass++;
+        return nClass;
+    }
+
+    static size_t ClassSize(int nClass) { return MIN_BUFFER_SIZE << nClass; }
+
+    BufferPool(const BufferPool&);
+    BufferPool& operator=(const BufferPool&);
+};
+
+/** Allocator handing out buffers from the BufferPool */
+template <typename T>
+class BufferPoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef BufferPoolAllocator<U> other;
+    };
+
+    BufferPoolAllocator() {}
+    template <typename U>
+    BufferPoolAllocator(const BufferPoolAllocator<U>& other) {}
+
+    T* allocate(size_type n, const void* hint = 0)
+    {
+        return static_cast<T*>(BufferPool::Get().Allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_type n)
+    {
+        if (p != NULL)
+            BufferPool::Get().Deallocate(p, n * sizeof(T));
+    }
+
+    T* address(T& x) const { return &x; }
+    const T* address(const T& x) const { return &x; }
+    size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new ((void*)p) U(std::forward<Args>(args)...); }
+    template <typename U>
+    void destroy(U* p) { p->~U(); }
+};
+
+template <typename T, typename U>
+bool operator==(const BufferPoolAllocator<T>& a, const BufferPoolAllocator<U>& b) { return true; }
+template <typename T, typename U>
+bool operator!=(const BufferPoolAllocator<T>& a, const BufferPoolAllocator<U>& b) { return false; }
+
+// Byte-vector for data that is not secret, backed by the BufferPool.
+typedef std::vector<char, BufferPoolAllocator<char> > CPooledSerializeData;
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_BUFFERPOOL_H
@@ -0,0 +1,232 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include "memusage.h"
+
+#include <stddef.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <new>
+#include <utility>
+#include <vector>
+
+/**
+ * Memory resource for node based containers. Blocks of up to MAX_BLOCK_SIZE
+ * bytes are carved out of large chunks, and a freed block goes onto a free
+ * list for the next allocation of the same size. This saves malloc's
+ * per-allocation overhead and keeps the nodes of the containers sharing the
+ * resource packed together. Larger or over-aligned requests, like the bucket
+ * arrays of hashed containers, go to operator new.
+ *
+ * A chunk none of whose blocks are in use is given back once such chunks
+ * make up an eighth of those held, which takes a pass over the free lists.
+ * Not thread safe: all containers using one resource must be guarded by the
+ * same lock.
+ */
+class PoolResource
+{
+public:
+    static const size_t BLOCK_ALIGN = sizeof(void*);
+    static const size_t MAX_BLOCK_SIZE = 512;
+    static const size_t CHUNK_SIZE = 256 * 1024;
+
+    PoolResource() : pCurrent(NULL), pEnd(NULL), pChunk(NULL), nInUse(0), nLargeUsage(0), nEmptyChunks(0), vFreeLists(MAX_BLOCK_SIZE / BLOCK_ALIGN + 1, NULL) {}
+
+    ~PoolResource()
+    {
+        for (size_t i = 0; i < vChunks.size(); i++)
+            ::operator delete(vChunks[i].p);
+    }
+
+    void* Allocate(size_t nBytes, size_t nAlign)
+    {
+        if (nBytes > MAX_BLOCK_SIZE || nAlign > BLOCK_ALIGN) {
+            nLargeUsage += memusage::MallocUsage(nBytes);
+            return ::operator new(nBytes);
+        }
+        const size_t nClass = SizeClass(nBytes);
+        nInUse += nClass * BLOCK_ALIGN;
+        void* p;
+        if (vFreeLists[nClass] != NULL) {
+            p = vFreeLists[nClass];
+            vFreeLists[nClass] = vFreeLists[nClass]->next;
+        } else {
+            if ((size_t)(pEnd - pCurrent) < nClass * BLOCK_ALIGN)
+                NewChunk();
+            p = pCurrent;
+            pCurrent += nClass * BLOCK_ALIGN;
+        }
+        Chunk& chunk = ChunkOf(p);
+        if (chunk.nInUse == 0 && chunk.p != pChunk)
+            nEmptyChunks--;
+        chunk.nInUse += nClass * BLOCK_ALIGN;
+        return p;
+    }
+
+    void Deallocate(void* p, size_t nBytes, size_t nAlign)
+    {
+        if (nBytes > MAX_BLOCK_SIZE || nAlign > BLOCK_ALIGN) {
+            nLargeUsage -= memusage::MallocUsage(nBytes);
+            ::operator delete(p);
+            return;
+        }
+        const size_t nClass = SizeClass(nBytes);
+        nInUse -= nClass * BLOCK_ALIGN;
+        Push(p, nClass);
+        Chunk& chunk = ChunkOf(p);
+        chunk.nInUse -= nClass * BLOCK_ALIGN;
+        if (chunk.nInUse == 0 && chunk.p != pChunk && ++nEmptyChunks * 8 >= vChunks.size())
+            ReleaseEmptyChunks();
+    }
+
+    /**
+     * Memory taken by the blocks and large allocations currently handed out.
+     * Free blocks are left out: they are reused before the resource grows,
+     * and chunks left empty are given back, so a budget on this bounds the
+     * chunks as well, up to fragmentation.
+     */
+    size_t DynamicMemoryUsage() const { return nInUse + nLargeUsage; }
+    /** Memory held in chunks, whether in use or free */
+    size_t ChunkMemoryUsage() const { return vChunks.size() * memusage::MallocUsage(CHUNK_SIZE); }
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    struct Chunk {
+        char* p;
+        size_t nInUse; //!< Bytes of the chunk's blocks handed out
+    };
+
+    char* pCurrent;
+    char* pEnd;
+    char* pChunk; //!< The chunk pCurrent carves blocks out of, never given back
+    size_t nInUse;
+    size_t nLargeUsage;
+    size_t nEmptyChunks; //!< Chunks other than pChunk with no block in use
+    std::vector<FreeBlock*> vFreeLists;
+    std::vector<Chunk> vChunks; //!< Sorted by address
+
+    static size_t SizeClass(size_t nBytes)
+    {
+        if (nBytes < sizeof(FreeBlock))
+            nBytes = sizeof(FreeBlock);
+        return (nBytes + BLOCK_ALIGN - 1) / BLOCK_ALIGN;
+    }
+
+    static bool ChunkStartsAfter(const char* p, const Chunk& chunk) { return std::less<const char*>()(p, chunk.p); }
+
+    /** The chunk a block was carved out of */
+    Chunk& ChunkOf(const void* p)
+    {
+        return *(std::upper_bound(vChunks.begin(), vChunks.end(), static_cast<const char*>(p), ChunkStartsAfter) - 1);
+    }
+
+    bool IsReleasable(const Chunk& chunk) const { return chunk.nInUse == 0 && chunk.p != pChunk; }
+
+    void Push(void* p, size_t nClass)
+    {
+        FreeBlock* block = new (p) FreeBlock;
+        block->next = vFreeLists[nClass];
+        vFreeLists[nClass] = block;
+    }
+
+    void NewChunk()
+    {
+        // Keep the tail of the old chunk for blocks that still fit
+        const size_t nTail = (pEnd - pCurrent) / BLOCK_ALIGN;
+        if (nTail >= SizeClass(0))
+            Push(pCurrent, nTail);
+        char* p = static_cast<char*>(::operator new(CHUNK_SIZE));
+        if (pChunk != NULL && ChunkOf(pChunk).nInUse == 0)
+            nEmptyChunks++;
+        pCurrent = pChunk = p;
+        pEnd = pCurrent + CHUNK_SIZE;
+        Chunk chunk = {pChunk, 0};
+        vChunks.insert(std::upper_bound(vChunks.begin(), vChunks.end(), static_cast<const char*>(pChunk), ChunkStartsAfter), chunk);
+    }
+
+    /** Take the free blocks of empty chunks off the free lists, then give the chunks back */
+    void ReleaseEmptyChunks()
+    {
+        for (size_t i = 0; i < vFreeLists.size(); i++) {
+            FreeBlock** pnext = &vFreeLists[i];
+            while (*pnext != NULL) {
+                if (IsReleasable(ChunkOf(*pnext)))
+                    *pnext = (*pnext)->next;
+                else
+                    pnext = &(*pnext)->next;
+            }
+        }
+        size_t nKept = 0;
+        for (size_t i = 0; i < vChunks.size(); i++) {
+            if (IsReleasable(vChunks[i]))
+                ::operator delete(vChunks[i].p);
+            else
+                vChunks[nKept++] = vChunks[i];
+        }
+        vChunks.resize(nKept);
+        nEmptyChunks = 0;
+    }
+
+    PoolResource(const PoolResource&);
+    PoolResource& operator=(const PoolResource&);
+};
+
+/** Allocator handing out memory from a PoolResource, which must outlive it */
+template <typename T>
+class PoolAllocator
+{
+public:
+    typedef T value_type;
+    typedef T* pointer;
+    typedef const T* const_pointer;
+    typedef T& reference;
+    typedef const T& const_reference;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+
+    template <typename U>
+    struct rebind {
+        typedef PoolAllocator<U> other;
+    };
+
+    explicit PoolAllocator(PoolResource* resourceIn) : resource(resourceIn) {}
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U>& other) : resource(other.resource) {}
+
+    T* allocate(size_type n, const void* hint = 0)
+    {
+        return static_cast<T*>(resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T* p, size_type n)
+    {
+        resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    T* address(T& x) const { return &x; }
+    const T* address(const T& x) const { return &x; }
+    size_type max_size() const { return std::numeric_limits<size_type>::max() / sizeof(T); }
+
+    template <typename U, typename... Args>
+    void construct(U* p, Args&&... args) { ::new ((void*)p) U(std::forward<Args>(args)...); }
+    template <typename U>
+    void destroy(U* p) { p->~U(); }
+
+    PoolResource* resource;
+};
+
+template <typename T, typename U>
+bool operator==(const PoolAllocator<T>& a, const PoolAllocator<U>& b) { return a.resource == b.resource; }
+template <typename T, typename U>
+bool operator!=(const PoolAllocator<T>& a, const PoolAllocator<U>& b) { return a.resource != b.resource; }
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -7,15 +7,93 @@
 #include "util.h"
 #include "utilstrencodings.h"
 
+#include <algorithm>
 #include <stdio.h>
 
+#include <atomic>
 #include <thread>
 #include <unordered_map>
 #include <utility>
 #include <vector>
 #include <set>
 #include <map>
-#include <mutex>
+
+namespace {
+/**
+ * Contention at one LOCK() site. Sites claim a slot the first time they have
+ * to wait, and are told apart by the addresses of their string literals.
+ */
+struct LockContentionSite {
+    std::atomic<const char*> pszName;
+    //! Set once pszFile and nLine are filled in by the thread that claimed the slot
+    std::atomic<bool> fReady;
+    const char* pszFile;
+    int nLine;
+    std::atomic<uint64_t> nContended;
+    std::atomic<int64_t> nWaitMicros;
+    std::atomic<int64_t> nMaxWaitMicros;
+};
+
+/** Sites beyond this many are not counted */
+const size_t LOCK_CONTENTION_SITES = 4096;
+
+// Zero-initialized static storage, usable before and after static construction
+LockContentionSite g_lockContentionSites[LOCK_CONTENTION_SITES];
+
+LockContentionSite* GetLockContentionSite(const char* pszName, const char* pszFile, int nLine)
+{
+    size_t nSlot = ((size_t)pszName * 31 + (size_t)pszFile) * 31 + nLine;
+    for (size_t i = 0; i < LOCK_CONTENTION_SITES; i++) {
+        LockContentionSite& site = g_lockContentionSites[(nSlot + i) % LOCK_CONTENTION_SITES];
+        const char* pszSiteName = site.pszName.load();
+        if (pszSiteName == NULL) {
+            if (site.pszName.compare_exchange_strong(pszSiteName, pszName)) {
+                site.pszFile = pszFile;
+                site.nLine = nLine;
+                site.fReady = true;
+                return &site;
+            }
+            // Lost the slot to another site (pszSiteName now holds its name)
+        }
+        if (pszSiteName != pszName)
+            continue;
+        while (!site.fReady)
+            std::this_thread::yield();
+        if (site.pszFile == pszFile && site.nLine == nLine)
+            return &site;
+    }
+    return NULL;
+}
+} // namespace
+
+void RecordLockContention(const char* pszName, const char* pszFile, int nLine, int64_t nWaitMicros)
+{
+    LockContentionSite* site = GetLockContentionSite(pszName, pszFile, nLine);
+    if (!site)
+        return;
+    site->nContended++;
+    site->nWaitMicros += nWaitMicros;
+    int64_t nMax = site->nMaxWaitMicros.load();
+    while (nWaitMicros > nMax && !site->nMaxWaitMicros.compare_exchange_weak(nMax, nWaitMicros)) {}
+}
+
+std::vector<LockContentionStats> GetLockContentionStats()
+{
+    std::vector<LockContentionStats> vStats;
+    for (const LockContentionSite& site : g_lockContentionSites) {
+        if (!site.fReady)
+            continue;
+        LockContentionStats stats;
+        stats.pszName = site.pszName;
+        stats.pszFile = site.pszFile;
+        stats.nLine = site.nLine;
+        stats.nContended = site.nContended;
+        stats.nWaitMicros = site.nWaitMicros;
+        stats.nMaxWaitMicros = site.nMaxWaitMicros;
+        vStats.push_back(stats);
+    }
+    return vStats;
+}
 
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine)
@@ -7,11 +7,17 @@
 #define BITCOIN_SYNC_H
 
 #include "threadsafety.h"
+#include "utiltime.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/recursive_mutex.hpp>
+#include <boost/thread/shared_mutex.hpp>
 
 
 ////////////////////////////////////////////////
@@ -34,6 +40,15 @@ LOCK2(mutex1, mutex2);
 TRY_LOCK(mutex, name);
     boost::unique_lock<boost::recursive_mutex> name(mutex, boost::try_to_lock_t);
 
+CSharedCriticalSection shared;
+    boost::shared_mutex shared;
+
+READ_LOCK(shared);
+    boost::shared_lock<boost::shared_mutex> sharedblock(shared);
+
+WRITE_LOCK(shared);
+    boost::unique_lock<boost::shared_mutex> criticalblock(shared);
+
 ENTER_CRITICAL_SECTION(mutex); // no RAII
     mutex.lock();
 
@@ -108,6 +123,18 @@ typedef CCriticalSection CDynamicCriticalSection;
 /** Wrapped boost mutex: supports waiting but not recursive locking */
 typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 
+/**
+ * Wrapped boost shared_mutex: any number of readers or one writer, not
+ * recursive. Readers take it with READ_LOCK, writers with WRITE_LOCK.
+ */
+class CSharedCriticalSection : public AnnotatedMixin<boost::shared_mutex>
+{
+public:
+    ~CSharedCriticalSection() {
+        DeleteLock((void*)this);
+    }
+};
+
 /** Just a typedef for boost::condition_variable, can be wrapped later if desired */
 typedef boost::condition_variable CConditionVariable;
 
@@ -115,6 +142,32 @@ typedef boost::condition_variable CConditionVariable;
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
 #endif
 
+/** How often, and for how long, threads had to wait for a lock at one LOCK() site */
+struct LockContentionStats
+{
+    //! The lock as passed to LOCK() and friends (e.g. "cs_main"), and where it was taken
+    const char* pszName;
+    const char* pszFile;
+    int nLine;
+    //! Acquisitions that found the lock taken
+    uint64_t nContended;
+    //! Total time spent waiting in those acquisitions
+    int64_t nWaitMicros;
+    //! Longest single wait
+    int64_t nMaxWaitMicros;
+
+    LockContentionStats() : pszName(NULL), pszFile(NULL), nLine(0), nContended(0), nWaitMicros(0), nMaxWaitMicros(0) {}
+};
+
+/**
+ * Account a wait of nWaitMicros on the lock pszName taken at pszFile:nLine.
+ * Takes no lock; the strings must outlive the process, like the literals
+ * LOCK() passes.
+ */
+void RecordLockContention(const char* pszName, const char* pszFile, int nLine, int64_t nWaitMicros);
+/** Contention of every site that ever had to wait */
+std::vector<LockContentionStats> GetLockContentionStats();
+
 /** Wrapper around boost::unique_lock<Mutex> */
 template <typename Mutex>
 class SCOPED_LOCKABLE CMutexLock
@@ -125,14 +178,14 @@ private:
     void Enter(const char* pszName, const char* pszFile, int nLine)
     {
         EnterCritical(pszName, pszFile, nLine, (void*)(lock.mutex()));
-#ifdef DEBUG_LOCKCONTENTION
         if (!lock.try_lock()) {
+#ifdef DEBUG_LOCKCONTENTION
             PrintLockContention(pszName, pszFile, nLine);
 #endif
+            int64_t nStart = GetTimeMicros();
             lock.lock();
-#ifdef DEBUG_LOCKCONTENTION
+            RecordLockContention(pszName, pszFile, nLine, GetTimeMicros() - nStart);
         }
-#endif
     }
 
     bool TryEnter(const char* pszName, const char* pszFile, int nLine)
@@ -178,12 +231,33 @@ public:
 
 typedef CMutexLock<CCriticalSection> CCriticalBlock;
 
+/** Shared (reader) lock on a CSharedCriticalSection, counting contention like CMutexLock */
+class SCOPED_LOCKABLE CSharedCriticalBlock
+{
+private:
+    boost::shared_lock<CSharedCriticalSection> lock;
+
+public:
+    CSharedCriticalBlock(CSharedCriticalSection& mutexIn, const char* pszName, const char* pszFile, int nLine) SHARED_LOCK_FUNCTION(mutexIn) : lock(mutexIn, boost::defer_lock)
+    {
+        if (!lock.try_lock()) {
+            int64_t nStart = GetTimeMicros();
+            lock.lock();
+            RecordLockContention(pszName, pszFile, nLine, GetTimeMicros() - nStart);
+        }
+    }
+
+    ~CSharedCriticalBlock() UNLOCK_FUNCTION() {}
+};
+
 #define PASTE(x, y) x ## y
 #define PASTE2(x, y) PASTE(x, y)
 
 #define LOCK(cs) CCriticalBlock PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
 #define LOCK2(cs1, cs2) CCriticalBlock criticalblock1(cs1, #cs1, __FILE__, __LINE__), criticalblock2(cs2, #cs2, __FILE__, __LINE__)
 #define TRY_LOCK(cs, name) CCriticalBlock name(cs, #cs, __FILE__, __LINE__, true)
+#define READ_LOCK(cs) CSharedCriticalBlock PASTE2(sharedblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
+#define WRITE_LOCK(cs) CMutexLock<CSharedCriticalSection> PASTE2(criticalblock, __COUNTER__)(cs, #cs, __FILE__, __LINE__)
 
 #define ENTER_CRITICAL_SECTION(cs)                            \
     {                                                         \
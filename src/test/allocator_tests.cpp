@@ -4,6 +4,7 @@
 
 #include "util.h"
 
+#include "support/allocators/bufferpool.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
@@ -231,4 +232,56 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live)
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+// The BufferPool is process wide as well, so only differences are checked
+BOOST_AUTO_TEST_CASE(bufferpool_tests)
+{
+    const size_t nMin = BufferPool::MIN_BUFFER_SIZE;
+    const size_t nMax = BufferPool::MAX_BUFFER_SIZE;
+    BOOST_CHECK_EQUAL(BufferPool::BufferSize(0), nMin);
+    BOOST_CHECK_EQUAL(BufferPool::BufferSize(nMin + 1), 2 * nMin);
+    BOOST_CHECK_EQUAL(BufferPool::BufferSize(1000), 1024U);
+    BOOST_CHECK_EQUAL(BufferPool::BufferSize(nMax), nMax);
+    BOOST_CHECK_EQUAL(BufferPool::BufferSize(nMax + 1), 0U);
+
+    BufferPool& pool = BufferPool::Get();
+    pool.Release();
+    BufferPool::Stats initial = pool.GetStats();
+    BOOST_CHECK_EQUAL(initial.nFreeBytes, 0U);
+
+    // A freed buffer serves the next request of its size class
+    void* p = pool.Allocate(1000);
+    pool.Deallocate(p, 1000);
+    BOOST_CHECK_EQUAL(pool.GetStats().nFreeBytes, 1024U);
+    BOOST_CHECK(pool.Allocate(700) == p);
+    pool.Deallocate(p, 700);
+    BufferPool::Stats stats = pool.GetStats();
+    BOOST_CHECK_EQUAL(stats.nMisses, initial.nMisses + 1);
+    BOOST_CHECK_EQUAL(stats.nHits, initial.nHits + 1);
+
+    // So does one freed by a vector
+    const char* pData;
+    {
+        CPooledSerializeData vch(5000, 'x');
+        pData = vch.data();
+    }
+    CPooledSerializeData vch(4500);
+    BOOST_CHECK(vch.data() == pData);
+
+    // Too large to pool
+    p = pool.Allocate(nMax + 1);
+    pool.Deallocate(p, nMax + 1);
+    BOOST_CHECK_EQUAL(pool.GetStats().nUnpooled, initial.nUnpooled + 1);
+
+    // Free buffers are capped
+    std::vector<void*> vLarge;
+    for (size_t i = 0; i < BufferPool::MAX_FREE_BYTES / nMax + 2; i++)
+        vLarge.push_back(pool.Allocate(nMax));
+    for (size_t i = 0; i < vLarge.size(); i++)
+        pool.Deallocate(vLarge[i], nMax);
+    BOOST_CHECK(pool.GetStats().nFreeBytes <= BufferPool::MAX_FREE_BYTES);
+
+    pool.Release();
+    BOOST_CHECK_EQUAL(pool.GetStats().nFreeBytes, 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
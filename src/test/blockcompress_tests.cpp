@@ -0,0 +1,204 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcompress.h"
+
+#include "chainparams.h"
+#include "consensus/validation.h"
+#include "crypto/common.h"
+#include "miner.h"
+#include "pow.h"
+#include "script/script.h"
+#include "txdb.h"
+#include "undo.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcompress_tests, TestingSetup)
+
+static bool RoundTrip(const std::vector<char>& vchRecord)
+{
+    std::vector<char> vchFrame, vchOut;
+    if (!CompressRecord(vchRecord.data(), vchRecord.size(), vchFrame))
+        return false;
+    BOOST_CHECK(vchFrame.size() < vchRecord.size());
+    BOOST_CHECK(DecompressRecord(vchFrame.data(), vchFrame.size(), vchOut, vchRecord.size()));
+    BOOST_CHECK(vchOut == vchRecord);
+    return true;
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_roundtrip)
+{
+    // Too short to make up for the size in front of the frame
+    BOOST_CHECK(!RoundTrip(std::vector<char>()));
+    BOOST_CHECK(!RoundTrip(std::vector<char>(12, 'a')));
+
+    BOOST_CHECK(RoundTrip(std::vector<char>(32, 'a')));
+    BOOST_CHECK(RoundTrip(std::vector<char>(1 << 20, 'a')));
+
+    // Random data does not compress
+    std::vector<char> vchRandom(1 << 16);
+    for (char& ch : vchRandom)
+        ch = InsecureRandBits(8);
+    BOOST_CHECK(!RoundTrip(vchRandom));
+
+    // Random data repeated, with long literal runs and matches, from near
+    // and as far back as a match may reach
+    std::vector<char> vchRecord;
+    for (int i = 0; i < 20; i++) {
+        const size_t nOffset = InsecureRandRange(vchRandom.size() - 1000);
+        const size_t nLength = 1 + InsecureRandRange(1000);
+        vchRecord.insert(vchRecord.end(), vchRandom.begin() + nOffset, vchRandom.begin() + nOffset + nLength);
+        vchRecord.insert(vchRecord.end(), vchRecord.end() - nLength, vchRecord.end());
+    }
+    vchRecord.insert(vchRecord.end(), vchRecord.begin(), vchRecord.end());
+    BOOST_CHECK(RoundTrip(vchRecord));
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_corrupt)
+{
+    const std::vector<char> vchRecord(1000, 'a');
+    std::vector<char> vchFrame, vchOut;
+    BOOST_REQUIRE(CompressRecord(vchRecord.data(), vchRecord.size(), vchFrame));
+
+    // Larger than allowed
+    BOOST_CHECK(!DecompressRecord(vchFrame.data(), vchFrame.size(), vchOut, vchRecord.size() - 1));
+    // Truncated
+    BOOST_CHECK(!DecompressRecord(vchFrame.data(), 3, vchOut, vchRecord.size()));
+    for (size_t nSize = 4; nSize < vchFrame.size(); nSize++)
+        BOOST_CHECK(!DecompressRecord(vchFrame.data(), nSize, vchOut, vchRecord.size()));
+
+    // Any single corrupted byte either fails or yields a record of the
+    // right size, never a read or write out of bounds
+    for (size_t i = 0; i < vchFrame.size(); i++) {
+        std::vector<char> vchCorrupt(vchFrame);
+        vchCorrupt[i] ^= 0x5a;
+        if (DecompressRecord(vchCorrupt.data(), vchCorrupt.size(), vchOut, 1 << 20))
+            BOOST_CHECK_EQUAL(vchOut.size(), (size_t)ReadLE32((const unsigned char*)vchCorrupt.data()));
+    }
+
+    // A match before the start of the record
+    const char vchBadOffset[] = {1, 0, 0, 0, 0x10, 'a', 2, 0};
+    BOOST_CHECK(!DecompressRecord(vchBadOffset, sizeof(vchBadOffset), vchOut, 100));
+}
+
+/** A script that compresses well, for a block to pay its coinbase to */
+static CScript RepeatedScript()
+{
+    return CScript() << std::vector<unsigned char>(1000, 0x5a) << OP_DROP << OP_TRUE;
+}
+
+/** The size written in front of the record at pos */
+static unsigned int ReadSizeField(const CDiskBlockPos& pos, const char* prefix)
+{
+    CDiskBlockPos posSize(pos.nFile, pos.nPos - 4);
+    CAutoFile file(prefix == std::string("blk") ? OpenBlockFile(posSize, true) : OpenUndoFile(posSize, true), SER_DISK, CLIENT_VERSION);
+    unsigned int nSizeField = 0;
+    file >> nSizeField;
+    return nSizeField;
+}
+
+BOOST_AUTO_TEST_CASE(blockcompress_disk)
+{
+    const Consensus::Params& consensus = Params().GetConsensus(0);
+    CBlock block = Params().GenesisBlock();
+    CMutableTransaction coinbase(*block.vtx[0]);
+    coinbase.vout[0].scriptPubKey = RepeatedScript();
+    block.vtx[0] = MakeTransactionRef(coinbase);
+
+    // Stored raw without -compressblocks, as a frame with it
+    CDiskBlockPos posRaw(1, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, posRaw, Params().MessageStart()));
+    BOOST_CHECK_EQUAL(ReadSizeField(posRaw, "blk"), ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    bool fCompressedRecords = false;
+    BOOST_CHECK(!pblocktree->ReadFlag("compressedrecords", fCompressedRecords));
+    fCompressBlocks = true;
+    CDiskBlockPos posCompressed(1, posRaw.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(WriteBlockToDisk(block, posCompressed, Params().MessageStart()));
+    fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
+    const unsigned int nSizeField = ReadSizeField(posCompressed, "blk");
+    BOOST_CHECK(nSizeField & DISK_RECORD_COMPRESSED);
+    BOOST_CHECK((nSizeField & ~DISK_RECORD_COMPRESSED) < ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    // The block tree tells the block files hold compressed records
+    BOOST_CHECK(pblocktree->ReadFlag("compressedrecords", fCompressedRecords));
+    BOOST_CHECK(fCompressedRecords);
+
+    // Both read back the same, through the mapping and through stdio
+    for (int i = 0; i < 2; i++) {
+        fMmapBlocks = i == 0;
+        CBlock blockRaw, blockCompressed;
+        BOOST_CHECK(ReadBlockFromDisk(blockRaw, posRaw, consensus, false));
+        BOOST_CHECK(ReadBlockFromDisk(blockCompressed, posCompressed, consensus, false));
+        BOOST_CHECK(blockRaw.GetHash() == block.GetHash());
+        BOOST_CHECK(blockCompressed.GetHash() == block.GetHash());
+        BOOST_CHECK(blockCompressed.vtx[0]->vout[0].scriptPubKey == RepeatedScript());
+    }
+    fMmapBlocks = DEFAULT_MMAP_BLOCKS;
+}
+
+BOOST_FIXTURE_TEST_CASE(blockcompress_recompress, TestChain240Setup)
+{
+    const CChainParams& chainparams = Params();
+
+    // A block that compresses well, stored raw in the first block file
+    const CBlock blockRepeated = CreateAndProcessBlock(std::vector<CMutableTransaction>(), RepeatedScript());
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == blockRepeated.GetHash());
+    const CDiskBlockPos posRepeated = chainActive.Tip()->GetBlockPos();
+    BOOST_CHECK(!(ReadSizeField(posRepeated, "blk") & DISK_RECORD_COMPRESSED));
+    // That file is still appended to
+    BOOST_CHECK(!RecompressBlockFile(0, chainparams));
+
+    // Import the next block into a second file, stored compressed, the way a
+    // reindex does, which finishes with the first
+    std::unique_ptr<CBlockTemplate> pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(RepeatedScript(), true);
+    CBlock& block = pblocktemplate->block;
+    unsigned int nExtraNonce = 0;
+    IncrementExtraNonce(&block, chainActive.Tip(), nExtraNonce);
+    while (!CheckProofOfWork(block.GetPoWHash(), block.nBits, chainparams.GetConsensus(0)))
+        ++block.nNonce;
+    fCompressBlocks = true;
+    CDiskBlockPos pos(1, 0);
+    BOOST_REQUIRE(WriteBlockToDisk(block, pos, chainparams.MessageStart()));
+    CDiskBlockPos posImport(1, 0);
+    BOOST_CHECK(LoadExternalBlockFile(chainparams, fsbridge::fopen(GetBlockPosFilename(posImport, "blk"), "rb"), &posImport));
+    CValidationState state;
+    BOOST_CHECK(ActivateBestChain(state, chainparams));
+    BOOST_REQUIRE(chainActive.Tip()->GetBlockHash() == block.GetHash());
+    BOOST_CHECK_EQUAL(chainActive.Tip()->nFile, 1);
+    fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
+    // The file is counted with the frame as stored, not the block's full size
+    BOOST_CHECK_EQUAL(GetBlockFileInfo(1)->nSize, pos.nPos + (ReadSizeField(pos, "blk") & ~DISK_RECORD_COMPRESSED) + 8);
+
+    bool fPending;
+    BOOST_CHECK(!pblocktree->ReadRecompressedFile(0, fPending));
+    BOOST_CHECK(RecompressBlockFile(0, chainparams));
+    BOOST_CHECK(pblocktree->ReadRecompressedFile(0, fPending));
+    BOOST_CHECK(!fPending);
+    BOOST_CHECK(!fs::exists(GetBlockPosFilename(CDiskBlockPos(0, 0), "blk").string() + ".new"));
+    BOOST_CHECK(ReadSizeField(chainActive[chainActive.Height() - 1]->GetBlockPos(), "blk") & DISK_RECORD_COMPRESSED);
+
+    // Every block and its undo data are still where the index says
+    for (int i = 0; i < 2; i++) {
+        fMmapBlocks = i == 0;
+        for (const CBlockIndex* pindex = chainActive.Tip(); pindex; pindex = pindex->pprev) {
+            CBlock blockRead;
+            BOOST_CHECK(ReadBlockFromDisk(blockRead, pindex, chainparams.GetConsensus(pindex->nHeight)));
+            if (pindex->pprev) {
+                CBlockUndo blockundo;
+                BOOST_CHECK(UndoReadFromDisk(blockundo, pindex->GetUndoPos(), pindex->pprev->GetBlockHash()));
+            }
+        }
+    }
+    fMmapBlocks = DEFAULT_MMAP_BLOCKS;
+
+    // Nothing is left to compress
+    BOOST_CHECK(!RecompressBlockFile(0, chainparams));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
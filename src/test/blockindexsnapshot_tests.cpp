@@ -0,0 +1,207 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockindexsnapshot.h"
+
+#include "chain.h"
+#include "coins.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+/** A block index of its own, to load into alongside mapBlockIndex */
+struct TestBlockIndex
+{
+    std::map<uint256, std::unique_ptr<CBlockIndex> > mapIndex;
+
+    CBlockIndex* Insert(const uint256& hash)
+    {
+        if (hash.IsNull())
+            return NULL;
+        std::unique_ptr<CBlockIndex>& pindex = mapIndex[hash];
+        if (!pindex) {
+            pindex.reset(new CBlockIndex());
+            pindex->phashBlock = &mapIndex.find(hash)->first;
+        }
+        return pindex.get();
+    }
+
+    std::function<CBlockIndex*(const uint256&)> Inserter()
+    {
+        return std::bind(&TestBlockIndex::Insert, this, std::placeholders::_1);
+    }
+};
+
+/** A state of the databases, told apart from others by nId */
+static BlockIndexSnapshotState TestSnapshotState(uint64_t nId)
+{
+    BlockIndexSnapshotState state;
+    state.nId = nId;
+    state.nLastBlockFile = 3;
+    state.nBlocks = 240;
+    state.nSize = 1 << 20;
+    state.nHeightLast = 240;
+    state.hashBestChain = uint256S("0x42");
+    return state;
+}
+
+/** Whether index holds the same entries as mapBlockIndex */
+static bool MatchesBlockIndex(const TestBlockIndex& index)
+{
+    if (index.mapIndex.size() != mapBlockIndex.size())
+        return false;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex) {
+        std::map<uint256, std::unique_ptr<CBlockIndex> >::const_iterator it = index.mapIndex.find(item.first);
+        if (it == index.mapIndex.end())
+            return false;
+        const CBlockIndex& a = *item.second;
+        const CBlockIndex& b = *it->second;
+        if ((a.pprev ? a.pprev->GetBlockHash() : uint256()) != (b.pprev ? b.pprev->GetBlockHash() : uint256()))
+            return false;
+        if (a.nHeight != b.nHeight || a.nStatus != b.nStatus || a.nTx != b.nTx ||
+            a.nFile != b.nFile || a.nDataPos != b.nDataPos || a.nUndoPos != b.nUndoPos)
+            return false;
+        if (a.nVersion != b.nVersion || a.hashMerkleRoot != b.hashMerkleRoot ||
+            a.nTime != b.nTime || a.nBits != b.nBits || a.nNonce != b.nNonce)
+            return false;
+    }
+    return true;
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockindexsnapshot_tests, TestChain240Setup)
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_database)
+{
+    // Decoded over as many threads as there are cores
+    FlushStateToDisk();
+    TestBlockIndex index;
+    BOOST_CHECK(pblocktree->LoadBlockIndexGuts(index.Inserter()));
+    BOOST_CHECK(MatchesBlockIndex(index));
+}
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_roundtrip)
+{
+    const fs::path path = GetDataDir() / "index.snapshot";
+    std::vector<const CBlockIndex*> vIndex;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vIndex.push_back(item.second);
+    BOOST_CHECK(WriteBlockIndexSnapshot(path, vIndex, TestSnapshotState(42)));
+    BOOST_CHECK(!fs::exists(path.string() + ".new"));
+
+    TestBlockIndex index;
+    std::vector<CBlockIndex*> vLoaded;
+    BOOST_CHECK(LoadBlockIndexSnapshot(path, TestSnapshotState(42), index.Inserter(), vLoaded));
+    BOOST_CHECK(MatchesBlockIndex(index));
+    BOOST_REQUIRE_EQUAL(vLoaded.size(), mapBlockIndex.size());
+    for (size_t i = 1; i < vLoaded.size(); i++)
+        BOOST_CHECK(vLoaded[i - 1]->nHeight <= vLoaded[i]->nHeight);
+
+    // Not the snapshot asked for
+    TestBlockIndex indexOther;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, TestSnapshotState(43), indexOther.Inserter(), vLoaded));
+    BOOST_CHECK(indexOther.mapIndex.empty());
+    BlockIndexSnapshotState stateOther = TestSnapshotState(42);
+    stateOther.nSize++;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, stateOther, indexOther.Inserter(), vLoaded));
+    BOOST_CHECK(indexOther.mapIndex.empty());
+    BOOST_CHECK(!LoadBlockIndexSnapshot(GetDataDir() / "missing.snapshot", TestSnapshotState(42), indexOther.Inserter(), vLoaded));
+    BOOST_CHECK(indexOther.mapIndex.empty());
+}
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_corrupt)
+{
+    const fs::path path = GetDataDir() / "index.snapshot";
+    std::vector<const CBlockIndex*> vIndex;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vIndex.push_back(item.second);
+    BOOST_REQUIRE(WriteBlockIndexSnapshot(path, vIndex, TestSnapshotState(42)));
+    const uintmax_t nSize = fs::file_size(path);
+
+    // Any changed byte, of the header, the entries or the checksum, is caught
+    for (uintmax_t nPos : {(uintmax_t)0, (uintmax_t)20, nSize / 2, nSize - 1}) {
+        FILE* file = fsbridge::fopen(path, "rb+");
+        BOOST_REQUIRE(file);
+        fseek(file, nPos, SEEK_SET);
+        int ch = fgetc(file);
+        fseek(file, nPos, SEEK_SET);
+        fputc(ch ^ 0x5a, file);
+        fclose(file);
+
+        TestBlockIndex index;
+        std::vector<CBlockIndex*> vLoaded;
+        BOOST_CHECK(!LoadBlockIndexSnapshot(path, TestSnapshotState(42), index.Inserter(), vLoaded));
+        BOOST_CHECK(index.mapIndex.empty());
+
+        file = fsbridge::fopen(path, "rb+");
+        fseek(file, nPos, SEEK_SET);
+        fputc(ch, file);
+        fclose(file);
+    }
+
+    // Truncated
+    fs::resize_file(path, nSize - 1);
+    TestBlockIndex index;
+    std::vector<CBlockIndex*> vLoaded;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, TestSnapshotState(42), index.Inserter(), vLoaded));
+    BOOST_CHECK(index.mapIndex.empty());
+}
+
+BOOST_AUTO_TEST_CASE(blockindexsnapshot_changed_database)
+{
+    FlushStateToDisk();
+    const bool fBlockIndexSnapshotOld = fBlockIndexSnapshot;
+    fBlockIndexSnapshot = true;
+    DumpBlockIndexSnapshot();
+    fBlockIndexSnapshot = fBlockIndexSnapshotOld;
+    const fs::path path = GetDataDir() / "blocks" / "index.snapshot";
+    uint64_t nId;
+    BOOST_REQUIRE(pblocktree->ReadIndexSnapshot(nId));
+
+    TestBlockIndex index;
+    std::vector<CBlockIndex*> vLoaded;
+    BOOST_CHECK(LoadBlockIndexSnapshot(path, GetBlockIndexSnapshotState(nId), index.Inserter(), vLoaded));
+    BOOST_CHECK(MatchesBlockIndex(index));
+
+    // A block stored by a binary that knows nothing of the marker leaves it in place
+    int nFile;
+    CBlockFileInfo info;
+    BOOST_REQUIRE(pblocktree->ReadLastBlockFile(nFile));
+    BOOST_REQUIRE(pblocktree->ReadBlockFileInfo(nFile, info));
+    CBlockFileInfo infoChanged(info);
+    infoChanged.AddBlock(info.nHeightLast + 1, info.nTimeLast);
+    infoChanged.nSize += 1000;
+    std::vector<std::pair<int, const CBlockFileInfo*> > vFiles(1, std::make_pair(nFile, &infoChanged));
+    BOOST_REQUIRE(pblocktree->WriteBatchSync(vFiles, nFile, std::vector<const CBlockIndex*>()));
+    uint64_t nIdAfter;
+    BOOST_CHECK(pblocktree->ReadIndexSnapshot(nIdAfter) && nIdAfter == nId);
+    TestBlockIndex indexChanged;
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, GetBlockIndexSnapshotState(nId), indexChanged.Inserter(), vLoaded));
+    BOOST_CHECK(indexChanged.mapIndex.empty());
+
+    vFiles[0].second = &info;
+    BOOST_REQUIRE(pblocktree->WriteBatchSync(vFiles, nFile, std::vector<const CBlockIndex*>()));
+    BOOST_CHECK(LoadBlockIndexSnapshot(path, GetBlockIndexSnapshotState(nId), index.Inserter(), vLoaded));
+
+    // So does a chainstate moved to another block
+    CCoinsMap mapCoins;
+    BOOST_REQUIRE(pcoinsdbview->BatchWrite(mapCoins, chainActive.Tip()->pprev->GetBlockHash()));
+    BOOST_CHECK(!LoadBlockIndexSnapshot(path, GetBlockIndexSnapshotState(nId), indexChanged.Inserter(), vLoaded));
+    BOOST_CHECK(indexChanged.mapIndex.empty());
+
+    BOOST_REQUIRE(pcoinsdbview->BatchWrite(mapCoins, chainActive.Tip()->GetBlockHash()));
+    BOOST_CHECK(LoadBlockIndexSnapshot(path, GetBlockIndexSnapshotState(nId), index.Inserter(), vLoaded));
+
+    BOOST_CHECK(pblocktree->EraseIndexSnapshot());
+    fs::remove(path);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -320,6 +320,61 @@ BOOST_AUTO_TEST_CASE(iterator_string_ordering)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_options)
+{
+    const char* argv[] = {"ignored", "-dboption=indexes.compression=1", "-dboption=chainstate.maxopenfiles=1000", "-dboption=chainstate.writebuffer=10"};
+    ParseParameters(ARRAYLEN(argv), (char**)argv);
+    std::string strError;
+    BOOST_CHECK(CheckDBOptions(strError));
+
+    CDBOptions chainstate = GetDBProfile("chainstate");
+    BOOST_CHECK_EQUAL(chainstate.strProfile, "chainstate");
+    BOOST_CHECK(!chainstate.fCompression);
+    BOOST_CHECK_EQUAL(chainstate.nMaxOpenFiles, 1000);
+    BOOST_CHECK_EQUAL(chainstate.nWriteBufferPercent, 10);
+    BOOST_CHECK_EQUAL(chainstate.nBlockSize, 4096U);
+    CDBOptions indexes = GetDBProfile("indexes");
+    BOOST_CHECK(indexes.fCompression);
+    BOOST_CHECK_EQUAL(indexes.nBlockSize, 32768U);
+    BOOST_CHECK_EQUAL(indexes.nMaxOpenFiles, 256);
+    CDBOptions blocktree = GetDBProfile("blocktree");
+    BOOST_CHECK_EQUAL(blocktree.nMaxOpenFiles, 64);
+    BOOST_CHECK_EQUAL(blocktree.nWriteBufferPercent, 25);
+
+    const char* vBad[] = {"chainstate.compression=2", "chainstate.maxopenfiles=10", "chainstate.writebuffer=50",
+                          "wallet.compression=1", "chainstate.nosuch=1", "chainstate.blocksize", "chainstate.bloombits=x"};
+    for (unsigned int i = 0; i < ARRAYLEN(vBad); i++) {
+        std::string strArg = std::string("-dboption=") + vBad[i];
+        const char* argvBad[] = {"ignored", strArg.c_str()};
+        ParseParameters(ARRAYLEN(argvBad), (char**)argvBad);
+        BOOST_CHECK(!CheckDBOptions(strError));
+        BOOST_CHECK(strError.find(vBad[i]) != std::string::npos);
+    }
 
+    // A database opened with a profile reports it along with its writes
+    ParseParameters(1, (char**)argv);
+    fs::path ph = fs::temp_directory_path() / fs::unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, false, GetDBProfile("indexes"));
+    BOOST_CHECK_EQUAL(dbw.GetDBOptions().strProfile, "indexes");
+    BOOST_CHECK(!dbw.GetDBOptions().fCompression);
+    for (int i = 0; i < 10; i++) {
+        CDBBatch batch(dbw);
+        for (int j = 0; j < 100; j++)
+            batch.Write(std::make_pair('k', i * 100 + j), InsecureRand256());
+        BOOST_CHECK(dbw.WriteBatch(batch, i == 9));
+    }
+    CDBWrapper::Stats stats = dbw.GetStats();
+    BOOST_CHECK_EQUAL(stats.nBatchesWritten, 10U);
+    BOOST_CHECK_EQUAL(stats.nSyncsWritten, 1U);
+    BOOST_CHECK(stats.nBytesWritten > 1000 * 32U);
+    BOOST_CHECK(stats.nMemoryUsage > 0);
+    BOOST_CHECK(stats.strLevelDBStats.find("Compactions") != std::string::npos);
+
+    // Compression asked for is not used by a LevelDB built without Snappy
+    BOOST_CHECK(!dbw.IsCompressed());
+    CDBWrapper dbwCompressed(fs::temp_directory_path() / fs::unique_path(), (1 << 20), true, false, false, indexes);
+    BOOST_CHECK(dbwCompressed.GetDBOptions().fCompression);
+    BOOST_CHECK(!dbwCompressed.IsCompressed());
+}
 
 BOOST_AUTO_TEST_SUITE_END()
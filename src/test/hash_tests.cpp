@@ -128,6 +128,17 @@ BOOST_AUTO_TEST_CASE(siphash)
     tx.nVersion = 1;
     ss << tx;
     BOOST_CHECK_EQUAL(SipHashUint256(1, 2, ss.GetHash()), 0x79751e980c2a0a35ULL);
+
+    // SipHashUint256Extra matches hashing the 36 bytes one at a time
+    const uint256 val = ss.GetHash();
+    const uint32_t extra = 0x87654321;
+    CSipHasher hasher4(1, 2);
+    hasher4.Write(val.begin(), 32);
+    for (int i = 0; i < 4; i++) {
+        unsigned char c = (extra >> (8 * i)) & 0xff;
+        hasher4.Write(&c, 1);
+    }
+    BOOST_CHECK_EQUAL(SipHashUint256Extra(1, 2, val, extra), hasher4.Finalize());
 }
 
 BOOST_AUTO_TEST_SUITE_END()
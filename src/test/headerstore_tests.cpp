@@ -0,0 +1,141 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "headerstore.h"
+
+#include "auxpow.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "primitives/transaction.h"
+#include "script/script.h"
+#include "util.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(headerstore_tests, TestingSetup)
+
+/** An auxpow header, told apart from others by n */
+static CBlockHeader AuxpowHeader(int n)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(1);
+    mtx.vin[0].scriptSig = CScript() << n;
+    mtx.vout.resize(1);
+    CBlockHeader header;
+    header.nTime = n;
+    header.SetAuxpow(new CAuxPow(MakeTransactionRef(mtx)));
+    return header;
+}
+
+static bool Matches(CAuxpowHeaderStore& store, int nHeight, const CBlockHeader& header)
+{
+    CBlockHeader headerRead;
+    if (!store.Read(nHeight, header.GetHash(), headerRead))
+        return false;
+    return headerRead.GetHash() == header.GetHash() && headerRead.auxpow &&
+        headerRead.auxpow->tx->GetHash() == header.auxpow->tx->GetHash();
+}
+
+BOOST_AUTO_TEST_CASE(headerstore_readwrite)
+{
+    const fs::path dir = GetDataDir() / "auxpow";
+    std::vector<CBlockHeader> vHeaders;
+    {
+        // Few ranges kept, so that reads go to the files as well
+        CAuxpowHeaderStore store(dir, 1);
+        BOOST_CHECK_EQUAL(store.Height(), 0);
+        CBlockHeader headerPlain;
+        BOOST_CHECK(store.Write(0, headerPlain));
+        vHeaders.push_back(headerPlain);
+        for (int i = 1; i < 4500; i++) {
+            vHeaders.push_back(AuxpowHeader(i));
+            BOOST_CHECK(store.Write(i, vHeaders.back()));
+        }
+        BOOST_CHECK_EQUAL(store.Height(), 4500);
+        // Heights are written one after the other
+        BOOST_CHECK(!store.Write(4501, AuxpowHeader(4501)));
+
+        // Nothing is stored for a header without auxpow
+        CBlockHeader headerRead;
+        BOOST_CHECK(!store.Read(0, headerPlain.GetHash(), headerRead));
+        for (int i = 1; i < 4500; i += 7)
+            BOOST_CHECK(Matches(store, i, vHeaders[i]));
+        for (int i = 4499; i > 0; i -= 13)
+            BOOST_CHECK(Matches(store, i, vHeaders[i]));
+        // Only the header of the block asked for
+        BOOST_CHECK(!store.Read(5, vHeaders[6].GetHash(), headerRead));
+        BOOST_CHECK(!store.Read(4500, vHeaders[1].GetHash(), headerRead));
+
+        // A reorganization overwrites what was at a height
+        vHeaders[2001] = AuxpowHeader(100001);
+        BOOST_CHECK(store.Write(2001, vHeaders[2001]));
+        BOOST_CHECK(!store.Read(2001, AuxpowHeader(2001).GetHash(), headerRead));
+        BOOST_CHECK(Matches(store, 2001, vHeaders[2001]));
+        BOOST_CHECK_EQUAL(store.Height(), 4500);
+    }
+
+    // All of it is there after reopening
+    CAuxpowHeaderStore store(dir, AUXPOW_HEADER_STORE_RANGES);
+    BOOST_CHECK_EQUAL(store.Height(), 4500);
+    for (int i = 1; i < 4500; i++)
+        BOOST_CHECK(Matches(store, i, vHeaders[i]));
+}
+
+BOOST_AUTO_TEST_CASE(headerstore_truncated)
+{
+    const fs::path dir = GetDataDir() / "auxpow";
+    std::vector<CBlockHeader> vHeaders;
+    {
+        CAuxpowHeaderStore store(dir, 1);
+        for (int i = 0; i < 10; i++) {
+            vHeaders.push_back(AuxpowHeader(i));
+            BOOST_CHECK(store.Write(i, vHeaders.back()));
+        }
+    }
+
+    // As if the last header had not made it to disk before a crash
+    fs::resize_file(dir / "headers.dat", fs::file_size(dir / "headers.dat") - 1);
+    {
+        CAuxpowHeaderStore store(dir, 1);
+        BOOST_CHECK_EQUAL(store.Height(), 10);
+        BOOST_CHECK(Matches(store, 8, vHeaders[8]));
+        CBlockHeader headerRead;
+        BOOST_CHECK(!store.Read(9, vHeaders[9].GetHash(), headerRead));
+        // Written again, it is found
+        BOOST_CHECK(store.Write(9, vHeaders[9]));
+        BOOST_CHECK(Matches(store, 9, vHeaders[9]));
+    }
+
+    // And an entry cut short
+    fs::resize_file(dir / "index.dat", fs::file_size(dir / "index.dat") - 1);
+    CAuxpowHeaderStore store(dir, 1);
+    BOOST_CHECK_EQUAL(store.Height(), 9);
+    BOOST_CHECK(Matches(store, 8, vHeaders[8]));
+}
+
+BOOST_FIXTURE_TEST_CASE(headerstore_chain, TestChain240Setup)
+{
+    pauxpowheaders = new CAuxpowHeaderStore(GetDataDir() / "auxpow", AUXPOW_HEADER_STORE_RANGES);
+
+    // Catches up with the active chain from the scheduler
+    ExtendAuxpowHeaderStore();
+    BOOST_CHECK_EQUAL(pauxpowheaders->Height(), chainActive.Height() + 1);
+
+    // And is kept up with it as blocks are connected
+    CreateAndProcessBlock(std::vector<CMutableTransaction>(), CScript() << OP_TRUE);
+    BOOST_CHECK_EQUAL(pauxpowheaders->Height(), chainActive.Height() + 1);
+
+    // Headers without auxpow still come from the block index
+    const CBlockIndex* pindex = chainActive.Tip();
+    BOOST_CHECK(pindex->GetBlockHeader(Params().GetConsensus(pindex->nHeight)).GetHash() == pindex->GetBlockHash());
+
+    delete pauxpowheaders;
+    pauxpowheaders = NULL;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,114 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "mappedfile.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "validation.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(mappedfile_tests, TestingSetup)
+
+static void AppendFile(const fs::path& path, const std::string& str)
+{
+    FILE* file = fsbridge::fopen(path, "ab");
+    BOOST_REQUIRE(file != NULL);
+    fwrite(str.data(), 1, str.size(), file);
+    fclose(file);
+}
+
+static std::string MappedString(const std::shared_ptr<const CMappedFile>& mapping)
+{
+    return std::string(mapping->data(), mapping->size());
+}
+
+BOOST_AUTO_TEST_CASE(mappedfile_open)
+{
+    const fs::path path = pathTemp / "mapped";
+    BOOST_CHECK(!CMappedFile::Open(path));
+    AppendFile(path, "");
+    BOOST_CHECK(!CMappedFile::Open(path));
+
+    AppendFile(path, "abc");
+    std::shared_ptr<const CMappedFile> mapping = CMappedFile::Open(path);
+    BOOST_REQUIRE(mapping);
+    BOOST_CHECK_EQUAL(MappedString(mapping), "abc");
+    // Hints past the end are ignored
+    mapping->WillRead(0, 100);
+    mapping->WillRead(100, 100);
+}
+
+BOOST_AUTO_TEST_CASE(mappedfile_cache)
+{
+    const fs::path pathA = pathTemp / "a", pathB = pathTemp / "b", pathC = pathTemp / "c";
+    AppendFile(pathA, "abc");
+    AppendFile(pathB, "b");
+    AppendFile(pathC, "c");
+
+    CMappedFileCache cache(2);
+    std::shared_ptr<const CMappedFile> mappingA = cache.Get(pathA, 0);
+    BOOST_REQUIRE(mappingA);
+    BOOST_CHECK_EQUAL(cache.Get(pathA, 3), mappingA);
+    BOOST_CHECK(!cache.Get(pathA, 4));
+    BOOST_CHECK(!cache.Get(pathTemp / "missing", 0));
+
+    // Growing the file takes a new mapping, the old one stays readable
+    AppendFile(pathA, "def");
+    std::shared_ptr<const CMappedFile> mappingA2 = cache.Get(pathA, 6);
+    BOOST_REQUIRE(mappingA2);
+    BOOST_CHECK(mappingA2 != mappingA);
+    BOOST_CHECK_EQUAL(MappedString(mappingA2), "abcdef");
+    BOOST_CHECK_EQUAL(MappedString(mappingA), "abc");
+
+    // The least recently used mapping goes first
+    BOOST_CHECK(cache.Get(pathB, 0));
+    BOOST_CHECK_EQUAL(cache.Get(pathA, 0), mappingA2);
+    BOOST_CHECK(cache.Get(pathC, 0));
+    BOOST_CHECK_EQUAL(cache.Get(pathA, 0), mappingA2);
+
+    cache.Erase(pathA);
+    std::shared_ptr<const CMappedFile> mappingA3 = cache.Get(pathA, 0);
+    BOOST_CHECK(mappingA3 != mappingA2);
+    BOOST_CHECK_EQUAL(MappedString(mappingA3), "abcdef");
+    BOOST_CHECK_EQUAL(MappedString(mappingA2), "abcdef");
+}
+
+BOOST_AUTO_TEST_CASE(mappedfile_readblock)
+{
+    const Consensus::Params& consensus = Params().GetConsensus(0);
+
+    // The genesis block, through the mapping and through stdio
+    CBlock blockMapped, blockRead;
+    fMmapBlocks = true;
+    BOOST_CHECK(ReadBlockFromDisk(blockMapped, chainActive.Genesis(), consensus));
+    fMmapBlocks = false;
+    BOOST_CHECK(ReadBlockFromDisk(blockRead, chainActive.Genesis(), consensus));
+    BOOST_CHECK(blockMapped.GetHash() == Params().GenesisBlock().GetHash());
+    BOOST_CHECK(blockRead.GetHash() == blockMapped.GetHash());
+
+    // A file appended to after it was mapped
+    fMmapBlocks = true;
+    CBlock block = Params().GenesisBlock();
+    CDiskBlockPos pos1(1, 0);
+    BOOST_CHECK(WriteBlockToDisk(block, pos1, Params().MessageStart()));
+    BOOST_CHECK(ReadBlockFromDisk(blockMapped, pos1, consensus, false));
+    BOOST_CHECK(blockMapped.GetHash() == block.GetHash());
+
+    block.nTime++;
+    CDiskBlockPos pos2(1, pos1.nPos + ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION));
+    BOOST_CHECK(WriteBlockToDisk(block, pos2, Params().MessageStart()));
+    BOOST_CHECK(ReadBlockFromDisk(blockMapped, pos2, consensus, false));
+    BOOST_CHECK(blockMapped.GetHash() == block.GetHash());
+    BOOST_CHECK(ReadBlockFromDisk(blockMapped, pos1, consensus, false));
+    BOOST_CHECK(blockMapped.GetHash() == Params().GenesisBlock().GetHash());
+
+    fMmapBlocks = DEFAULT_MMAP_BLOCKS;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -436,6 +436,9 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     CTxMemPool pool(CFeeRate(COIN / 1000));
     TestMemPoolEntryHelper entry;
     entry.dPriority = 10.0;
+    // The fixed cost of the pool's own bookkeeping, which the fractions
+    // below leave alone
+    const size_t nEmptyUsage = pool.DynamicMemoryUsage();
 
     CMutableTransaction tx1 = CMutableTransaction();
     tx1.vin.resize(1);
@@ -457,7 +460,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     BOOST_CHECK(pool.exists(tx1.GetHash()));
     BOOST_CHECK(pool.exists(tx2.GetHash()));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // should remove the lower-feerate transaction
+    pool.TrimToSize(nEmptyUsage + (pool.DynamicMemoryUsage() - nEmptyUsage) * 3 / 4); // should remove the lower-feerate transaction
     BOOST_CHECK(pool.exists(tx1.GetHash()));
     BOOST_CHECK(!pool.exists(tx2.GetHash()));
 
@@ -471,7 +474,7 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     tx3.vout[0].nValue = 10 * COIN;
     pool.addUnchecked(tx3.GetHash(), entry.Fee(COIN / 50).FromTx(tx3, &pool));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() * 3 / 4); // tx3 should pay for tx2 (CPFP)
+    pool.TrimToSize(nEmptyUsage + (pool.DynamicMemoryUsage() - nEmptyUsage) * 3 / 4); // tx3 should pay for tx2 (CPFP)
     BOOST_CHECK(!pool.exists(tx1.GetHash()));
     BOOST_CHECK(pool.exists(tx2.GetHash()));
     BOOST_CHECK(pool.exists(tx3.GetHash()));
@@ -547,7 +550,9 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
         pool.addUnchecked(tx5.GetHash(), entry.Fee(COIN / 1000).FromTx(tx5, &pool));
     pool.addUnchecked(tx7.GetHash(), entry.Fee(COIN / 1000 * 9).FromTx(tx7, &pool));
 
-    pool.TrimToSize(pool.DynamicMemoryUsage() / 2); // should maximize mempool size by only removing 5/7
+    // tx4 and tx6 take half of the entries' usage, which the capacity kept
+    // by vTxHashes pushes a little over an exact half
+    pool.TrimToSize(nEmptyUsage + (pool.DynamicMemoryUsage() - nEmptyUsage) * 3 / 5); // should maximize mempool size by only removing 5/7
     BOOST_CHECK(pool.exists(tx4.GetHash()));
     BOOST_CHECK(!pool.exists(tx5.GetHash()));
     BOOST_CHECK(pool.exists(tx6.GetHash()));
@@ -585,4 +590,146 @@ BOOST_AUTO_TEST_CASE(MempoolSizeLimitTest)
     SetMockTime(0);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolClusterTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+
+    // A low fee parent with a high fee child and an unrelated transaction
+    CMutableTransaction tx1 = CMutableTransaction();
+    tx1.vin.resize(1);
+    tx1.vin[0].scriptSig = CScript() << OP_1;
+    tx1.vout.resize(1);
+    tx1.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx1.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx1.GetHash(), entry.Fee(1000LL).FromTx(tx1));
+
+    CMutableTransaction tx2 = CMutableTransaction();
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(tx1.GetHash(), 0);
+    tx2.vin[0].scriptSig = CScript() << OP_2;
+    tx2.vout.resize(1);
+    tx2.vout[0].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+    tx2.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx2.GetHash(), entry.Fee(100000LL).FromTx(tx2));
+
+    CMutableTransaction tx3 = CMutableTransaction();
+    tx3.vin.resize(1);
+    tx3.vin[0].scriptSig = CScript() << OP_3;
+    tx3.vout.resize(1);
+    tx3.vout[0].scriptPubKey = CScript() << OP_3 << OP_EQUAL;
+    tx3.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx3.GetHash(), entry.Fee(20000LL).FromTx(tx3));
+
+    std::vector<CTxMemPool::ClusterRef> vClusters;
+    pool.GetClusters(vClusters);
+    BOOST_CHECK_EQUAL(vClusters.size(), 2);
+
+    // The child pays for its parent, so both make up a single chunk
+    CTxMemPool::ClusterRef cluster = pool.GetCluster(pool.mapTx.find(tx2.GetHash()));
+    BOOST_CHECK(cluster == pool.GetCluster(pool.mapTx.find(tx1.GetHash())));
+    BOOST_CHECK_EQUAL(cluster->vTxs.size(), 2);
+    BOOST_CHECK(cluster->vTxs[0]->GetTx().GetHash() == tx1.GetHash());
+    BOOST_CHECK_EQUAL(cluster->vChunks.size(), 1);
+    BOOST_CHECK_EQUAL(cluster->vChunks[0].nEnd, 2);
+    BOOST_CHECK_EQUAL(cluster->vChunks[0].nFee, 101000LL);
+    BOOST_CHECK_EQUAL(pool.GetCluster(pool.mapTx.find(tx3.GetHash()))->vTxs.size(), 1);
+
+    // A second child that does not pay its way ends up in a chunk of its own
+    CMutableTransaction tx4 = CMutableTransaction();
+    tx4.vin.resize(1);
+    tx4.vin[0].prevout = COutPoint(tx2.GetHash(), 0);
+    tx4.vin[0].scriptSig = CScript() << OP_4;
+    tx4.vout.resize(1);
+    tx4.vout[0].scriptPubKey = CScript() << OP_4 << OP_EQUAL;
+    tx4.vout[0].nValue = 10 * COIN;
+    pool.addUnchecked(tx4.GetHash(), entry.Fee(0LL).FromTx(tx4));
+    cluster = pool.GetCluster(pool.mapTx.find(tx1.GetHash()));
+    BOOST_CHECK_EQUAL(cluster->vTxs.size(), 3);
+    BOOST_CHECK_EQUAL(cluster->vChunks.size(), 2);
+    BOOST_CHECK(cluster->vTxs[2]->GetTx().GetHash() == tx4.GetHash());
+
+    // Prioritising the last child pulls it into the first chunk
+    pool.PrioritiseTransaction(tx4.GetHash(), tx4.GetHash().ToString(), 0., 1000000LL);
+    cluster = pool.GetCluster(pool.mapTx.find(tx1.GetHash()));
+    BOOST_CHECK_EQUAL(cluster->vChunks.size(), 1);
+    BOOST_CHECK_EQUAL(cluster->vChunks[0].nFee, 1101000LL);
+
+    // Taking out the middle transaction splits the cluster
+    pool.removeRecursive(tx2);
+    BOOST_CHECK_EQUAL(pool.size(), 2);
+    pool.GetClusters(vClusters);
+    BOOST_CHECK_EQUAL(vClusters.size(), 2);
+    BOOST_CHECK_EQUAL(pool.GetCluster(pool.mapTx.find(tx1.GetHash()))->vTxs.size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(MempoolMemoryUsageTest)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    const size_t nEmptyUsage = pool.DynamicMemoryUsage();
+
+    std::vector<CMutableTransaction> vTxs(50);
+    for (size_t i = 0; i < vTxs.size(); i++) {
+        vTxs[i].vin.resize(1);
+        vTxs[i].vin[0].scriptSig = CScript() << OP_1;
+        // Chain every other transaction to the one before it
+        if (i % 2)
+            vTxs[i].vin[0].prevout = COutPoint(vTxs[i - 1].GetHash(), 0);
+        else
+            vTxs[i].vin[0].prevout = COutPoint(uint256(), i);
+        vTxs[i].vout.resize(1);
+        vTxs[i].vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        vTxs[i].vout[0].nValue = COIN;
+    }
+
+    size_t nLastUsage = nEmptyUsage;
+    for (size_t i = 0; i < vTxs.size(); i++) {
+        pool.addUnchecked(vTxs[i].GetHash(), entry.Fee(1000LL).FromTx(vTxs[i]));
+        // Every entry costs at least its transaction and its node
+        BOOST_CHECK(pool.DynamicMemoryUsage() > nLastUsage + sizeof(CTxMemPoolEntry));
+        nLastUsage = pool.DynamicMemoryUsage();
+    }
+
+    // Removing everything gives back exactly what the entries took, except
+    // for the capacity vTxHashes keeps
+    for (size_t i = 0; i < vTxs.size(); i += 2)
+        pool.removeRecursive(vTxs[i]);
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage() - memusage::DynamicUsage(pool.vTxHashes), nEmptyUsage);
+
+    // Freed nodes are reused, so refilling matches the first fill
+    for (size_t i = 0; i < vTxs.size(); i++)
+        pool.addUnchecked(vTxs[i].GetHash(), entry.Fee(1000LL).FromTx(vTxs[i]));
+    BOOST_CHECK_EQUAL(pool.DynamicMemoryUsage(), nLastUsage);
+}
+
+BOOST_AUTO_TEST_CASE(PoolResourceTest)
+{
+    PoolResource resource;
+    std::vector<void*> vBlocks;
+    for (size_t i = 0; i < 5 * PoolResource::CHUNK_SIZE / 64; i++)
+        vBlocks.push_back(resource.Allocate(64, 8));
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), vBlocks.size() * 64);
+    BOOST_CHECK(resource.ChunkMemoryUsage() >= 5 * PoolResource::CHUNK_SIZE);
+
+    // Chunks left with blocks in use are kept
+    for (size_t i = 0; i < vBlocks.size(); i += 2)
+        resource.Deallocate(vBlocks[i], 64, 8);
+    BOOST_CHECK(resource.ChunkMemoryUsage() >= 5 * PoolResource::CHUNK_SIZE);
+
+    // Emptied ones are given back, but for the one blocks are carved out of
+    for (size_t i = 1; i < vBlocks.size(); i += 2)
+        resource.Deallocate(vBlocks[i], 64, 8);
+    BOOST_CHECK_EQUAL(resource.DynamicMemoryUsage(), 0U);
+    BOOST_CHECK_EQUAL(resource.ChunkMemoryUsage(), memusage::MallocUsage(PoolResource::CHUNK_SIZE));
+
+    // Their blocks are off the free lists, so refilling takes new chunks
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        vBlocks[i] = resource.Allocate(64, 8);
+    BOOST_CHECK(resource.ChunkMemoryUsage() >= 5 * PoolResource::CHUNK_SIZE);
+    for (size_t i = 0; i < vBlocks.size(); i++)
+        resource.Deallocate(vBlocks[i], 64, 8);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,6 +8,7 @@
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "key.h"
 #include "validation.h"
 #include "miner.h"
 #include "policy/policy.h"
@@ -20,6 +21,7 @@
 
 #include "test/test_bitcoin.h"
 
+#include <atomic>
 #include <memory>
 
 #include <boost/test/unit_test.hpp>
@@ -497,4 +499,130 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity)
     fCheckpointsEnabled = true;
 }
 
+static CMutableTransaction SignedSpend(const CKey& key, const CTransaction& txFrom, CAmount nFee)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txFrom.vout[0].nValue - nFee;
+    tx.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txFrom.vout[0].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+static bool ToMemPool(const CMutableTransaction& tx)
+{
+    LOCK(cs_main);
+    CValidationState state;
+    return AcceptToMemoryPool(mempool, state, MakeTransactionRef(tx), false, NULL, NULL, true, 0);
+}
+
+BOOST_FIXTURE_TEST_CASE(BlockTemplateManager_incremental, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    BlockTemplateManager manager(Params(), mempool);
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = manager.GetBlockTemplate(scriptPubKey, false);
+    BOOST_CHECK(pblocktemplate);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    const CAmount nSubsidy = pblocktemplate->block.vtx[0]->vout[0].nValue;
+
+    // Transactions entering the mempool are appended, parents first
+    CMutableTransaction parent = SignedSpend(coinbaseKey, coinbaseTxns[0], COIN);
+    CMutableTransaction child = SignedSpend(coinbaseKey, parent, COIN);
+    BOOST_CHECK(ToMemPool(parent));
+    BOOST_CHECK(ToMemPool(child));
+    pblocktemplate = manager.GetBlockTemplate(scriptPubKey, false);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplate->block.vtx[1]->GetHash() == parent.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == child.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->vTxFees[0], -2 * COIN);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, nSubsidy + 2 * COIN);
+    BOOST_CHECK(pblocktemplate->block.vtx[0]->vout[0].scriptPubKey == scriptPubKey);
+
+    // Every caller gets its own coinbase on the same transactions
+    std::unique_ptr<CBlockTemplate> pblocktemplateOther = manager.GetBlockTemplate(CScript() << OP_TRUE, false);
+    BOOST_CHECK_EQUAL(pblocktemplateOther->block.vtx.size(), 3U);
+    BOOST_CHECK(pblocktemplateOther->block.vtx[0]->vout[0].scriptPubKey == CScript() << OP_TRUE);
+    BOOST_CHECK(pblocktemplate->block.vtx[0]->vout[0].scriptPubKey == scriptPubKey);
+
+    // The template stays a valid block
+    {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK(TestBlockValidity(state, Params(), pblocktemplate->block, chainActive.Tip(), false, false));
+    }
+
+    // Leaving the mempool takes descendants out of the template as well
+    {
+        LOCK(mempool.cs);
+        mempool.removeRecursive(parent, MemPoolRemovalReason::REPLACED);
+    }
+    pblocktemplate = manager.GetBlockTemplate(scriptPubKey, false);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1U);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, nSubsidy);
+
+    // A new tip makes the next request start over from the mempool
+    BOOST_CHECK(ToMemPool(parent));
+    std::vector<CMutableTransaction> noTxns;
+    CreateAndProcessBlock(noTxns, scriptPubKey);
+    pblocktemplate = manager.GetBlockTemplate(scriptPubKey, false);
+    BOOST_CHECK(pblocktemplate->block.hashPrevBlock == chainActive.Tip()->GetBlockHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+
+    // Callers with and without witness transactions keep templates of their
+    // own: a full build puts the older coins first, appends keep arrival order
+    CMutableTransaction newer = SignedSpend(coinbaseKey, coinbaseTxns[2], COIN);
+    CMutableTransaction older = SignedSpend(coinbaseKey, coinbaseTxns[1], COIN);
+    BOOST_CHECK(ToMemPool(newer));
+    BOOST_CHECK(ToMemPool(older));
+    BOOST_CHECK(!manager.IsCurrent(chainActive.Tip(), true));
+    pblocktemplateOther = manager.GetBlockTemplate(scriptPubKey, true);
+    BOOST_REQUIRE_EQUAL(pblocktemplateOther->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplateOther->block.vtx[2]->GetHash() == older.GetHash());
+    BOOST_CHECK(pblocktemplateOther->block.vtx[3]->GetHash() == newer.GetHash());
+    BOOST_CHECK(manager.IsCurrent(chainActive.Tip(), false));
+    pblocktemplate = manager.GetBlockTemplate(scriptPubKey, false);
+    BOOST_REQUIRE_EQUAL(pblocktemplate->block.vtx.size(), 4U);
+    BOOST_CHECK(pblocktemplate->block.vtx[2]->GetHash() == newer.GetHash());
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetHash() == older.GetHash());
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, pblocktemplateOther->block.vtx[0]->vout[0].nValue);
+
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(BlockTemplateManager_background, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    BOOST_CHECK(ToMemPool(SignedSpend(coinbaseKey, coinbaseTxns[0], COIN)));
+
+    // A coinbase-only block leaves the mempool alone
+    std::unique_ptr<CBlockTemplate> pblocktemplateEmpty = BlockAssembler(Params()).CreateNewBlock(scriptPubKey, false, true);
+    BOOST_CHECK_EQUAL(pblocktemplateEmpty->block.vtx.size(), 1U);
+
+    BlockTemplateManager manager(Params(), mempool);
+    std::atomic<const CBlockIndex*> pindexNotified(NULL);
+    manager.NotifyTemplateRebuilt.connect([&](const CBlockIndex* pindex) { pindexNotified = pindex; });
+    BOOST_CHECK(!manager.IsCurrent(chainActive.Tip(), false));
+    manager.RebuildInBackground(false);
+    for (int i = 0; i < 1000 && !pindexNotified; i++)
+        MilliSleep(10);
+    BOOST_CHECK(pindexNotified == chainActive.Tip());
+    BOOST_CHECK(manager.IsCurrent(chainActive.Tip(), false));
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate = manager.GetBlockTemplate(scriptPubKey, false);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 2U);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx[0]->vout[0].nValue, pblocktemplateEmpty->block.vtx[0]->vout[0].nValue + COIN);
+
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,92 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "perfstats.h"
+
+#include "test/test_bitcoin.h"
+
+#include <limits>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(perfstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(perfstats_buckets)
+{
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(0), 0);
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(1), 0);
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(2), 1);
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(3), 2);
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(4), 2);
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(1000), 10);
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(std::numeric_limits<int64_t>::max()), CPerfHistogram::BUCKETS - 1);
+    for (int i = 0; i < CPerfHistogram::BUCKETS - 1; i++) {
+        BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(CPerfHistogram::BucketLimit(i)), i);
+        BOOST_CHECK_EQUAL(CPerfHistogram::BucketIndex(CPerfHistogram::BucketLimit(i) + 1), i + 1);
+    }
+    BOOST_CHECK_EQUAL(CPerfHistogram::BucketLimit(CPerfHistogram::BUCKETS - 1), -1);
+}
+
+BOOST_AUTO_TEST_CASE(perfstats_histogram)
+{
+    CPerfHistogram hist;
+    hist.Record(1);
+    hist.Record(3);
+    hist.Record(4);
+    hist.Record(1000);
+    hist.Record(-5);
+
+    CPerfHistogram::Snapshot snapshot = hist.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.nCount, 5U);
+    BOOST_CHECK_EQUAL(snapshot.nTotalMicros, 1008);
+    BOOST_CHECK_EQUAL(snapshot.nMaxMicros, 1000);
+    BOOST_CHECK_EQUAL(snapshot.vBuckets[0], 2U);
+    BOOST_CHECK_EQUAL(snapshot.vBuckets[2], 2U);
+    BOOST_CHECK_EQUAL(snapshot.vBuckets[10], 1U);
+
+    hist.Reset();
+    snapshot = hist.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.nCount, 0U);
+    BOOST_CHECK_EQUAL(snapshot.nMaxMicros, 0);
+    BOOST_CHECK_EQUAL(snapshot.vBuckets[0], 0U);
+}
+
+BOOST_AUTO_TEST_CASE(perfstats_registry)
+{
+    CPerfHistogram& hist = GetPerfHistogram("perfstats_tests.registry");
+    BOOST_CHECK_EQUAL(&hist, &GetPerfHistogram("perfstats_tests.registry"));
+
+    // Unused histograms are not reported
+    ResetPerfStats();
+    BOOST_CHECK(!GetPerfStats().count("perfstats_tests.registry"));
+
+    {
+        CPerfTimer timer(hist);
+    }
+    {
+        PERF_TIMER("perfstats_tests.registry");
+    }
+    std::map<std::string, CPerfHistogram::Snapshot> mapStats = GetPerfStats();
+    BOOST_CHECK(mapStats.count("perfstats_tests.registry"));
+    BOOST_CHECK_EQUAL(mapStats["perfstats_tests.registry"].nCount, 2U);
+
+    // Nothing is recorded while disabled
+    fPerfStats = false;
+    {
+        CPerfTimer timer(hist);
+    }
+    fPerfStats = true;
+    BOOST_CHECK_EQUAL(hist.GetSnapshot().nCount, 2U);
+
+    const std::string strMetrics = PerfStatsToPrometheus();
+    BOOST_CHECK(strMetrics.find("# TYPE trumpow_duration_seconds histogram\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("trumpow_duration_seconds_bucket{path=\"perfstats_tests.registry\",le=\"0.000001\"} ") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("trumpow_duration_seconds_bucket{path=\"perfstats_tests.registry\",le=\"+Inf\"} 2\n") != std::string::npos);
+    BOOST_CHECK(strMetrics.find("trumpow_duration_seconds_count{path=\"perfstats_tests.registry\"} 2\n") != std::string::npos);
+
+    ResetPerfStats();
+    BOOST_CHECK(!GetPerfStats().count("perfstats_tests.registry"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -3,14 +3,20 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "clientversion.h"
 #include "policy/policy.h"
 #include "policy/fees.h"
+#include "streams.h"
 #include "txmempool.h"
 #include "uint256.h"
 #include "util.h"
 
 #include "test/test_bitcoin.h"
 
+#include <cstdlib>
+#include <stdio.h>
+#include <unistd.h>
+
 #include <boost/test/unit_test.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(policyestimator_tests, BasicTestingSetup)
@@ -190,4 +196,126 @@ BOOST_AUTO_TEST_CASE(BlockPolicyEstimates)
     }
 }
 
+// Confirm transactions of ten feerates, 10 at a time, the higher feerates
+// sooner. What is left unconfirmed at the end drops out of the mempool.
+static void MineBlocks(CBlockPolicyEstimator& estimator, unsigned int& nHeight, unsigned int nBlocks)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 0LL;
+    std::vector<CTxMemPoolEntry> vEntries[10];
+    for (unsigned int n = 0; n < nBlocks; n++) {
+        std::vector<const CTxMemPoolEntry*> block;
+        for (int j = 0; j < 10; j++) {
+            // Feerate j waits 10 - j blocks
+            if (nHeight % (10 - j) == 0) {
+                for (size_t k = 0; k < vEntries[j].size(); k++)
+                    block.push_back(&vEntries[j][k]);
+            }
+        }
+        estimator.processBlock(++nHeight, block);
+        for (int j = 0; j < 10; j++) {
+            if ((nHeight - 1) % (10 - j) != 0)
+                continue;
+            vEntries[j].clear();
+            for (int k = 0; k < 10; k++) {
+                tx.vin[0].prevout.n = 10000 * nHeight + 100 * j + k;
+                vEntries[j].push_back(entry.Fee(100000 * (j + 1)).Height(nHeight).FromTx(tx));
+            }
+            for (size_t k = 0; k < vEntries[j].size(); k++)
+                estimator.processTransaction(vEntries[j][k], true);
+        }
+    }
+    for (int j = 0; j < 10; j++) {
+        for (size_t k = 0; k < vEntries[j].size(); k++)
+            estimator.removeTx(vEntries[j][k].GetTx().GetHash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesFile)
+{
+    CTxMemPool pool(CFeeRate(100000));
+    CBlockPolicyEstimator estimator(CFeeRate(100000));
+    unsigned int nHeight = 0;
+    MineBlocks(estimator, nHeight, 100);
+
+    // A full write, and blocks appended to it twice
+    CAutoFile file(tmpfile(), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    estimator.Write(file);
+    BOOST_CHECK_EQUAL(estimator.GetJournalSize(), 0U);
+    MineBlocks(estimator, nHeight, 30);
+    estimator.WriteBlocks(file);
+    MineBlocks(estimator, nHeight, 20);
+    estimator.WriteBlocks(file);
+    BOOST_CHECK_EQUAL(estimator.GetJournalSize(), 50U);
+
+    // Reading it back replays the appended blocks
+    CBlockPolicyEstimator estimator2(CFeeRate(100000));
+    rewind(file.Get());
+    estimator2.Read(file, CLIENT_VERSION);
+    BOOST_CHECK_EQUAL(estimator2.GetJournalSize(), 50U);
+    // Same history, and nothing in the mempool either, after the next block
+    std::vector<const CTxMemPoolEntry*> block;
+    estimator.processBlock(++nHeight, block);
+    estimator2.processBlock(nHeight, block);
+    int nFound = 0;
+    for (int i = 1; i <= (int)MAX_BLOCK_CONFIRMS; i++) {
+        CAmount nFee = estimator.estimateFee(i).GetFeePerK();
+        if (nFee > 0)
+            nFound++;
+        BOOST_CHECK(std::abs(estimator2.estimateFee(i).GetFeePerK() - nFee) <= 1);
+        int nTarget, nTarget2;
+        BOOST_CHECK(std::abs(estimator2.estimateSmartFee(i, &nTarget2, pool).GetFeePerK() - estimator.estimateSmartFee(i, &nTarget, pool).GetFeePerK()) <= 1);
+        BOOST_CHECK_EQUAL(nTarget, nTarget2);
+    }
+    BOOST_CHECK(nFound > 5);
+
+    // A block cut short at the end of the file is left out, while the empty
+    // block since is read
+    CBlockPolicyEstimator estimator3(CFeeRate(100000));
+    MineBlocks(estimator, nHeight, 1);
+    estimator.WriteBlocks(file);
+    BOOST_CHECK_EQUAL(estimator.GetJournalSize(), 52U);
+    fflush(file.Get());
+    long nSize = ftell(file.Get());
+    BOOST_REQUIRE(ftruncate(fileno(file.Get()), nSize - 1) == 0);
+    rewind(file.Get());
+    estimator3.Read(file, CLIENT_VERSION);
+    BOOST_CHECK_EQUAL(estimator3.GetJournalSize(), 51U);
+    for (int i = 1; i <= (int)MAX_BLOCK_CONFIRMS; i++)
+        BOOST_CHECK(std::abs(estimator3.estimateFee(i).GetFeePerK() - estimator2.estimateFee(i).GetFeePerK()) <= 1);
+}
+
+BOOST_AUTO_TEST_CASE(BlockPolicyEstimatesDecayGap)
+{
+    CBlockPolicyEstimator estimator(CFeeRate(100000));
+    CBlockPolicyEstimator estimator2(CFeeRate(100000));
+    unsigned int nHeight = 0, nHeight2 = 0;
+    MineBlocks(estimator, nHeight, 100);
+    MineBlocks(estimator2, nHeight2, 100);
+
+    // Empty blocks one by one decay the history as much as a jump over them
+    std::vector<const CTxMemPoolEntry*> block;
+    for (int i = 0; i < 50; i++)
+        estimator.processBlock(++nHeight, block);
+    nHeight2 += 50;
+    estimator2.processBlock(nHeight2, block);
+    int nFound = 0;
+    for (int i = 1; i <= (int)MAX_BLOCK_CONFIRMS; i++) {
+        if (estimator.estimateFee(i).GetFeePerK() > 0)
+            nFound++;
+        BOOST_CHECK(std::abs(estimator2.estimateFee(i).GetFeePerK() - estimator.estimateFee(i).GetFeePerK()) <= 1);
+    }
+    BOOST_CHECK(nFound > 5);
+
+    // So much later that nothing is left of the history
+    nHeight2 += 100000;
+    estimator2.processBlock(nHeight2, block);
+    for (int i = 1; i <= (int)MAX_BLOCK_CONFIRMS; i++)
+        BOOST_CHECK(estimator2.estimateFee(i) == CFeeRate(0));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,7 +5,10 @@
 #include <sync.h>
 #include <test/test_bitcoin.h>
 
+#include <atomic>
+
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_FIXTURE_TEST_SUITE(sync_tests, BasicTestingSetup)
 
@@ -38,4 +41,59 @@ BOOST_AUTO_TEST_CASE(potential_deadlock_detected)
     #endif
 }
 
+BOOST_AUTO_TEST_CASE(lock_contention_stats)
+{
+    CCriticalSection cs_contention_test;
+    std::atomic<bool> fStarted(false);
+    boost::thread thread;
+    {
+        LOCK(cs_contention_test);
+        thread = boost::thread([&] {
+            fStarted = true;
+            LOCK(cs_contention_test);
+        });
+        while (!fStarted)
+            MilliSleep(1);
+        MilliSleep(50);
+    }
+    thread.join();
+
+    // Counted at the site in the thread that waited
+    std::vector<LockContentionStats> vSites;
+    for (const LockContentionStats& site : GetLockContentionStats()) {
+        if (std::string(site.pszName) == "cs_contention_test")
+            vSites.push_back(site);
+    }
+    BOOST_REQUIRE_EQUAL(vSites.size(), 1U);
+    const LockContentionStats& stats = vSites[0];
+    BOOST_CHECK(std::string(stats.pszFile).find("sync_tests.cpp") != std::string::npos);
+    BOOST_CHECK(stats.nLine > 0);
+    BOOST_CHECK_EQUAL(stats.nContended, 1U);
+    BOOST_CHECK(stats.nWaitMicros > 0);
+    BOOST_CHECK_EQUAL(stats.nMaxWaitMicros, stats.nWaitMicros);
+}
+
+BOOST_AUTO_TEST_CASE(shared_lock)
+{
+    CSharedCriticalSection cs_shared_test;
+    int nValue = 0;
+    {
+        READ_LOCK(cs_shared_test);
+        // A second reader gets in while the first one still holds the lock
+        std::atomic<bool> fRead(false);
+        boost::thread reader([&] {
+            READ_LOCK(cs_shared_test);
+            fRead = nValue == 0;
+        });
+        BOOST_CHECK(reader.try_join_for(boost::chrono::seconds(10)));
+        BOOST_CHECK(fRead);
+    }
+    {
+        WRITE_LOCK(cs_shared_test);
+        nValue = 1;
+    }
+    READ_LOCK(cs_shared_test);
+    BOOST_CHECK_EQUAL(nValue, 1);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
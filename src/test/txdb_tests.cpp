@@ -0,0 +1,325 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "coins.h"
+#include "hash.h"
+#include "key.h"
+#include "random.h"
+#include "script/sign.h"
+#include "script/standard.h"
+#include "txdb.h"
+#include "util.h"
+#include "validation.h"
+
+#include "test/test_bitcoin.h"
+
+#include <map>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txdb_tests, TestingSetup)
+
+static const char DB_HEAD_BLOCKS = 'H';
+static const char DB_ADDRESSINDEX = 'a';
+static const char DB_BLOCKHASHINDEX = 'z';
+static const char DB_SPENTINDEX = 'p';
+
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    // What a background write leaves behind when it stops after some chunks
+    void WriteHeadBlocks(const uint256& hashNew, const uint256& hashOld)
+    {
+        std::vector<uint256> vhashHeadBlocks;
+        vhashHeadBlocks.push_back(hashNew);
+        vhashHeadBlocks.push_back(hashOld);
+        db.Write(DB_HEAD_BLOCKS, vhashHeadBlocks);
+    }
+};
+
+static std::map<uint256, CCoins> ReadCoins(const CCoinsView& view)
+{
+    std::map<uint256, CCoins> mapCoins;
+    std::unique_ptr<CCoinsViewCursor> pcursor(view.Cursor());
+    for (; pcursor->Valid(); pcursor->Next()) {
+        uint256 txid;
+        CCoins coins;
+        BOOST_REQUIRE(pcursor->GetKey(txid) && pcursor->GetValue(coins));
+        mapCoins[txid] = coins;
+    }
+    return mapCoins;
+}
+
+static CCoins RandomCoins()
+{
+    CCoins coins;
+    coins.nHeight = 1;
+    coins.vout.resize(1 + InsecureRandRange(4));
+    for (size_t i = 0; i < coins.vout.size(); i++) {
+        coins.vout[i].nValue = 1 + InsecureRandRange(COIN);
+        coins.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return coins;
+}
+
+BOOST_AUTO_TEST_CASE(background_flush)
+{
+    CCoinsViewDBTest dbview;
+    std::map<uint256, CCoins> mapExpected;
+    CCoinsViewCache cache(&dbview);
+    for (int i = 0; i < 1000; i++) {
+        const uint256 txid = GetRandHash();
+        mapExpected[txid] = *cache.ModifyCoins(txid) = RandomCoins();
+    }
+    const uint256 hashFirst = GetRandHash();
+    cache.SetBestBlock(hashFirst);
+
+    // Without a best block in the database the write is not handed off
+    dbview.ScheduleBackgroundFlush(cache.DynamicMemoryUsage());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(dbview.GetPendingUsage(), 0U);
+    BOOST_CHECK(dbview.GetBestBlock() == hashFirst);
+    BOOST_CHECK(ReadCoins(dbview) == mapExpected);
+
+    // Spend some, change some, add some
+    std::vector<uint256> vPruned;
+    for (std::map<uint256, CCoins>::iterator it = mapExpected.begin(); it != mapExpected.end();) {
+        if (InsecureRandBool()) {
+            cache.ModifyCoins(it->first)->Clear();
+            vPruned.push_back(it->first);
+            mapExpected.erase(it++);
+        } else {
+            *cache.ModifyCoins(it->first) = it->second = RandomCoins();
+            ++it;
+        }
+    }
+    for (int i = 0; i < 1000; i++) {
+        const uint256 txid = GetRandHash();
+        mapExpected[txid] = *cache.ModifyCoins(txid) = RandomCoins();
+    }
+    const uint256 hashSecond = GetRandHash();
+    cache.SetBestBlock(hashSecond);
+
+    // Many small chunks
+    ForceSetArg("-dbbatchsize", "1000");
+    dbview.ScheduleBackgroundFlush(cache.DynamicMemoryUsage());
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+
+    // Whether committed yet or not, the new entries are what is read
+    BOOST_CHECK(dbview.GetBestBlock() == hashSecond);
+    for (std::map<uint256, CCoins>::const_iterator it = mapExpected.begin(); it != mapExpected.end(); ++it) {
+        CCoins coins;
+        BOOST_CHECK(dbview.GetCoins(it->first, coins));
+        BOOST_CHECK(coins == it->second);
+    }
+    for (size_t i = 0; i < vPruned.size(); i++)
+        BOOST_CHECK(!dbview.HaveCoins(vPruned[i]));
+
+    BOOST_CHECK(dbview.Sync());
+    BOOST_CHECK(!dbview.HasFlushFailed());
+    BOOST_CHECK_EQUAL(dbview.GetPendingUsage(), 0U);
+    BOOST_CHECK(dbview.GetHeadBlocks().empty());
+    BOOST_CHECK(dbview.GetBestBlock() == hashSecond);
+    BOOST_CHECK(ReadCoins(dbview) == mapExpected);
+
+    ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+}
+
+static CMutableTransaction CreateSpend(const CTransaction& txPrev, uint32_t n, const CKey& key, unsigned int nOutputs)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    CMutableTransaction tx;
+    tx.nVersion = 1;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), n);
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = txPrev.vout[n].nValue / (nOutputs + 1);
+        tx.vout[i].scriptPubKey = scriptPubKey;
+    }
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(txPrev.vout[n].scriptPubKey, tx, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(key.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    tx.vin[0].scriptSig << vchSig;
+    return tx;
+}
+
+BOOST_FIXTURE_TEST_CASE(replay_blocks, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    FlushStateToDisk();
+    const uint256 hashOld = chainActive.Tip()->GetBlockHash();
+    const std::map<uint256, CCoins> mapOld = ReadCoins(*pcoinsdbview);
+
+    // A few blocks spending outputs created before and in between
+    std::vector<CMutableTransaction> txns;
+    txns.push_back(CreateSpend(coinbaseTxns[0], 0, coinbaseKey, 2));
+    CreateAndProcessBlock(txns, scriptPubKey);
+    const CTransaction txFirst(txns[0]);
+    txns.clear();
+    txns.push_back(CreateSpend(txFirst, 0, coinbaseKey, 2));
+    txns.push_back(CreateSpend(coinbaseTxns[1], 0, coinbaseKey, 1));
+    CreateAndProcessBlock(txns, scriptPubKey);
+    const CTransaction txSecond(txns[0]);
+    txns.clear();
+    txns.push_back(CreateSpend(txSecond, 0, coinbaseKey, 1));
+    txns.push_back(CreateSpend(txSecond, 1, coinbaseKey, 1));
+    CreateAndProcessBlock(txns, scriptPubKey);
+    BOOST_CHECK_EQUAL(chainActive.Height(), (int)coinbaseTxns.size() + 3);
+
+    FlushStateToDisk();
+    const uint256 hashNew = chainActive.Tip()->GetBlockHash();
+    const std::map<uint256, CCoins> mapNew = ReadCoins(*pcoinsdbview);
+    BOOST_CHECK(!mapNew.count(txSecond.GetHash()));
+
+    std::set<uint256> setTxids;
+    for (std::map<uint256, CCoins>::const_iterator it = mapOld.begin(); it != mapOld.end(); ++it)
+        setTxids.insert(it->first);
+    for (std::map<uint256, CCoins>::const_iterator it = mapNew.begin(); it != mapNew.end(); ++it)
+        setTxids.insert(it->first);
+
+    // Every entry as of the old or the new best block, in any mixture
+    for (int nMix = 0; nMix < 4; nMix++) {
+        CCoinsViewDBTest dbview;
+        CCoinsViewCache cache(&dbview);
+        int i = 0;
+        for (std::set<uint256>::const_iterator it = setTxids.begin(); it != setTxids.end(); ++it, ++i) {
+            bool fNew = nMix == 1 || (nMix == 2 && i % 2) || (nMix == 3 && InsecureRandBool());
+            const std::map<uint256, CCoins>& mapFrom = fNew ? mapNew : mapOld;
+            std::map<uint256, CCoins>::const_iterator itFrom = mapFrom.find(*it);
+            if (itFrom != mapFrom.end())
+                *cache.ModifyCoins(*it) = itFrom->second;
+        }
+        cache.SetBestBlock(hashOld);
+        BOOST_CHECK(cache.Flush());
+        dbview.WriteHeadBlocks(hashNew, hashOld);
+
+        BOOST_CHECK(ReplayBlocks(Params(), &dbview));
+        BOOST_CHECK(dbview.GetHeadBlocks().empty());
+        BOOST_CHECK(dbview.GetBestBlock() == hashNew);
+        BOOST_CHECK(ReadCoins(dbview) == mapNew);
+    }
+
+    // Head blocks on another branch are refused
+    CCoinsViewDBTest dbview;
+    dbview.WriteHeadBlocks(hashOld, hashNew);
+    BOOST_CHECK(!ReplayBlocks(Params(), &dbview));
+}
+
+static uint160 RandomAddressHash()
+{
+    const uint256 hash = GetRandHash();
+    return Hash160(hash.begin(), hash.end());
+}
+
+BOOST_AUTO_TEST_CASE(index_db_queue)
+{
+    CIndexDB indexdb(1 << 20, true);
+    const uint160 addressHash = RandomAddressHash();
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddress;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    uint256 hashBlock;
+    for (int nHeight = 1; nHeight <= 100; nHeight++) {
+        hashBlock = GetRandHash();
+        vAddress.push_back(std::make_pair(CAddressIndexKey(1, addressHash, nHeight, 0, GetRandHash(), 0, false), nHeight * COIN));
+        BOOST_CHECK(indexdb.WriteAddressIndex(std::vector<std::pair<CAddressIndexKey, CAmount> >(1, vAddress.back())));
+        vSpent.push_back(std::make_pair(CSpentIndexKey(GetRandHash(), 0), CSpentIndexValue(GetRandHash(), 0, nHeight, COIN, 1, addressHash)));
+        BOOST_CHECK(indexdb.UpdateSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >(1, vSpent.back())));
+        BOOST_CHECK(indexdb.WriteTimestampBlockIndex(CTimestampBlockIndexKey(hashBlock), CTimestampBlockIndexValue(nHeight)));
+    }
+
+    // Whether written yet or not, the entries are what is read
+    unsigned int nLogicalTime = 0;
+    BOOST_CHECK(indexdb.ReadTimestampBlockIndex(hashBlock, nLogicalTime));
+    BOOST_CHECK_EQUAL(nLogicalTime, 100U);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead;
+    BOOST_CHECK(indexdb.ReadAddressIndex(addressHash, 1, vRead));
+    BOOST_REQUIRE_EQUAL(vRead.size(), vAddress.size());
+    for (size_t i = 0; i < vRead.size(); i++) {
+        BOOST_CHECK(vRead[i].first.txhash == vAddress[i].first.txhash);
+        BOOST_CHECK_EQUAL(vRead[i].second, vAddress[i].second);
+    }
+    for (size_t i = 0; i < vSpent.size(); i++) {
+        CSpentIndexValue value;
+        BOOST_CHECK(indexdb.ReadSpentIndex(vSpent[i].first, value));
+        BOOST_CHECK(value.txid == vSpent[i].second.txid);
+        BOOST_CHECK_EQUAL(value.blockHeight, vSpent[i].second.blockHeight);
+    }
+
+    // A null value erases
+    vSpent[0].second.SetNull();
+    BOOST_CHECK(indexdb.UpdateSpentIndex(std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >(1, vSpent[0])));
+    CSpentIndexValue value;
+    const uint64_t nSyncs = indexdb.GetStats().nSyncsWritten;
+    BOOST_CHECK(!indexdb.ReadSpentIndex(vSpent[0].first, value));
+    // Reads only wait for the queue; Sync makes the writes durable
+    BOOST_CHECK_EQUAL(indexdb.GetStats().nSyncsWritten, nSyncs);
+
+    BOOST_CHECK(indexdb.Sync());
+    BOOST_CHECK_EQUAL(indexdb.GetStats().nSyncsWritten, nSyncs + 1);
+    BOOST_CHECK(!indexdb.HasWriteFailed());
+    nLogicalTime = 0;
+    BOOST_CHECK(indexdb.ReadTimestampBlockIndex(hashBlock, nLogicalTime));
+    BOOST_CHECK_EQUAL(nLogicalTime, 100U);
+}
+
+BOOST_AUTO_TEST_CASE(index_db_migration)
+{
+    // Index entries as older versions left them in the block tree database
+    CBlockTreeDB blocktree(1 << 20, true);
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vAddress;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > vSpent;
+    std::vector<uint256> vBlocks;
+    const uint160 addressHash = RandomAddressHash();
+    for (int i = 0; i < 500; i++) {
+        vAddress.push_back(std::make_pair(CAddressIndexKey(2, addressHash, i, 0, GetRandHash(), 0, false), i * COIN));
+        BOOST_CHECK(blocktree.Write(std::make_pair(DB_ADDRESSINDEX, vAddress.back().first), vAddress.back().second));
+        vSpent.push_back(std::make_pair(CSpentIndexKey(GetRandHash(), i), CSpentIndexValue(GetRandHash(), 0, i, COIN, 2, addressHash)));
+        BOOST_CHECK(blocktree.Write(std::make_pair(DB_SPENTINDEX, vSpent.back().first), vSpent.back().second));
+        vBlocks.push_back(GetRandHash());
+        BOOST_CHECK(blocktree.Write(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(vBlocks.back())), CTimestampBlockIndexValue(i)));
+    }
+    BOOST_CHECK(blocktree.WriteFlag("addressindex", true));
+
+    // Many small chunks
+    ForceSetArg("-dbbatchsize", "1000");
+    CIndexDB indexdb(1 << 20, true);
+    BOOST_CHECK(indexdb.MigrateFromBlockTree(blocktree));
+    ForceSetArg("-dbbatchsize", std::to_string(nDefaultDbBatchSize));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > vRead;
+    BOOST_CHECK(indexdb.ReadAddressIndex(addressHash, 2, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), vAddress.size());
+    for (size_t i = 0; i < vSpent.size(); i++) {
+        CSpentIndexValue value;
+        BOOST_CHECK(indexdb.ReadSpentIndex(vSpent[i].first, value));
+        BOOST_CHECK(value.txid == vSpent[i].second.txid);
+        unsigned int nLogicalTime = 0;
+        BOOST_CHECK(indexdb.ReadTimestampBlockIndex(vBlocks[i], nLogicalTime));
+        BOOST_CHECK_EQUAL(nLogicalTime, i);
+    }
+
+    // Nothing is left behind but the flags
+    for (size_t i = 0; i < vSpent.size(); i++) {
+        BOOST_CHECK(!blocktree.Exists(std::make_pair(DB_ADDRESSINDEX, vAddress[i].first)));
+        BOOST_CHECK(!blocktree.Exists(std::make_pair(DB_SPENTINDEX, vSpent[i].first)));
+        BOOST_CHECK(!blocktree.Exists(std::make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(vBlocks[i]))));
+    }
+    bool fValue = false;
+    BOOST_CHECK(blocktree.ReadFlag("addressindex", fValue) && fValue);
+
+    // Running it again moves nothing
+    BOOST_CHECK(indexdb.MigrateFromBlockTree(blocktree));
+    vRead.clear();
+    BOOST_CHECK(indexdb.ReadAddressIndex(addressHash, 2, vRead));
+    BOOST_CHECK_EQUAL(vRead.size(), vAddress.size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,181 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "core_memusage.h"
+#include "primitives/transaction.h"
+#include "random.h"
+#include "txorphanage.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(txorphanage_tests, BasicTestingSetup)
+
+static CTransactionRef MakeOrphan(const COutPoint& prevout, unsigned int nOutputs = 1)
+{
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig << OP_1;
+    tx.vout.resize(nOutputs);
+    for (unsigned int i = 0; i < nOutputs; i++) {
+        tx.vout[i].nValue = 1 * CENT;
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return MakeTransactionRef(tx);
+}
+
+static size_t OrphanUsage(const CTransactionRef& tx)
+{
+    return memusage::DynamicUsage(tx) + RecursiveDynamicUsage(*tx);
+}
+
+BOOST_AUTO_TEST_CASE(peer_budget)
+{
+    TxOrphanage orphanage;
+    std::vector<CTransactionRef> vNoisy;
+    for (int i = 0; i < 10; i++)
+        vNoisy.push_back(MakeOrphan(COutPoint(GetRandHash(), 0)));
+    CTransactionRef txQuiet = MakeOrphan(COutPoint(GetRandHash(), 0));
+    // Equal sized orphans, a budget of four of them
+    const size_t nBudget = 4 * OrphanUsage(vNoisy[0]);
+
+    BOOST_CHECK(orphanage.AddTx(txQuiet, 1, nBudget));
+    for (size_t i = 0; i < vNoisy.size(); i++)
+        BOOST_CHECK(orphanage.AddTx(vNoisy[i], 0, nBudget));
+    BOOST_CHECK(!orphanage.AddTx(vNoisy.back(), 0, nBudget));
+
+    // The noisy peer only pushed out its own, oldest first
+    BOOST_CHECK(orphanage.HaveTx(txQuiet->GetHash()));
+    for (size_t i = 0; i < vNoisy.size(); i++)
+        BOOST_CHECK_EQUAL(orphanage.HaveTx(vNoisy[i]->GetHash()), i >= vNoisy.size() - 4);
+    TxOrphanage::Stats stats = orphanage.GetStats();
+    BOOST_CHECK_EQUAL(stats.nOrphans, 5U);
+    BOOST_CHECK_EQUAL(stats.nPeers, 2U);
+    BOOST_CHECK_EQUAL(stats.nOutpoints, 5U);
+    BOOST_CHECK_EQUAL(stats.nUsage, 5 * OrphanUsage(txQuiet));
+    BOOST_CHECK_EQUAL(stats.nAdded, 11U);
+    BOOST_CHECK_EQUAL(stats.nEvicted, 6U);
+
+    // An orphan larger than the whole budget is not kept
+    CTransactionRef txLarge = MakeOrphan(COutPoint(GetRandHash(), 0), 100);
+    BOOST_CHECK(!orphanage.AddTx(txLarge, 2, nBudget));
+    BOOST_CHECK(!orphanage.HaveTx(txLarge->GetHash()));
+
+    orphanage.EraseForPeer(0);
+    stats = orphanage.GetStats();
+    BOOST_CHECK_EQUAL(stats.nOrphans, 1U);
+    BOOST_CHECK_EQUAL(stats.nPeers, 1U);
+    BOOST_CHECK_EQUAL(stats.nUsage, OrphanUsage(txQuiet));
+    BOOST_CHECK_EQUAL(stats.nRemovedForPeer, 4U);
+}
+
+BOOST_AUTO_TEST_CASE(limit_evicts_largest_peer)
+{
+    TxOrphanage orphanage;
+    const size_t nBudget = 1000000;
+    CTransactionRef txSmall = MakeOrphan(COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(orphanage.AddTx(txSmall, 1, nBudget));
+    std::vector<CTransactionRef> vLarge;
+    for (int i = 0; i < 3; i++) {
+        vLarge.push_back(MakeOrphan(COutPoint(GetRandHash(), 0), 10));
+        BOOST_CHECK(orphanage.AddTx(vLarge.back(), 0, nBudget));
+    }
+
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(2), 2U);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 2U);
+    BOOST_CHECK(orphanage.HaveTx(txSmall->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(vLarge[2]->GetHash()));
+    BOOST_CHECK_EQUAL(orphanage.GetStats().nEvicted, 2U);
+
+    // Once peer 1 takes more memory than peer 0 it loses its oldest instead
+    CTransactionRef txSmall2 = MakeOrphan(COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(orphanage.AddTx(txSmall2, 1, nBudget));
+    for (int i = 0; i < 3; i++)
+        BOOST_CHECK(orphanage.AddTx(MakeOrphan(COutPoint(GetRandHash(), 0)), 1, nBudget));
+    BOOST_REQUIRE(5 * OrphanUsage(txSmall) > OrphanUsage(vLarge[2]));
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(5), 1U);
+    BOOST_CHECK(!orphanage.HaveTx(txSmall->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(txSmall2->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(vLarge[2]->GetHash()));
+
+    BOOST_CHECK_EQUAL(orphanage.LimitOrphans(0), 5U);
+    TxOrphanage::Stats stats = orphanage.GetStats();
+    BOOST_CHECK_EQUAL(stats.nOrphans, 0U);
+    BOOST_CHECK_EQUAL(stats.nUsage, 0U);
+    BOOST_CHECK_EQUAL(stats.nPeers, 0U);
+    BOOST_CHECK_EQUAL(stats.nOutpoints, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(work_sets)
+{
+    TxOrphanage orphanage;
+    const size_t nBudget = 1000000;
+    CTransactionRef txParent = MakeOrphan(COutPoint(GetRandHash(), 0), 3);
+    CTransactionRef txChild0 = MakeOrphan(COutPoint(txParent->GetHash(), 0));
+    CTransactionRef txChild1 = MakeOrphan(COutPoint(txParent->GetHash(), 1));
+    CTransactionRef txChild2 = MakeOrphan(COutPoint(txParent->GetHash(), 2));
+    CTransactionRef txUnrelated = MakeOrphan(COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(orphanage.AddTx(txChild0, 0, nBudget));
+    BOOST_CHECK(orphanage.AddTx(txChild1, 0, nBudget));
+    BOOST_CHECK(orphanage.AddTx(txChild2, 1, nBudget));
+    BOOST_CHECK(orphanage.AddTx(txUnrelated, 0, nBudget));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(0));
+
+    // The children go to the peers that sent them
+    orphanage.AddChildrenToWorkSet(*txParent);
+    BOOST_CHECK(orphanage.HaveTxToReconsider(0));
+    BOOST_CHECK(orphanage.HaveTxToReconsider(1));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(2));
+    std::vector<CTransactionRef> vtx = orphanage.GetTxToReconsider(0, 1);
+    BOOST_CHECK_EQUAL(vtx.size(), 1U);
+    vtx = orphanage.GetTxToReconsider(0, 16);
+    BOOST_CHECK_EQUAL(vtx.size(), 1U);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(0));
+    vtx = orphanage.GetTxToReconsider(1, 16);
+    BOOST_CHECK_EQUAL(vtx.size(), 1U);
+    BOOST_CHECK(vtx[0] == txChild2);
+
+    // Taking an orphan off the work set leaves it in the pool until erased
+    BOOST_CHECK_EQUAL(orphanage.Size(), 4U);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(txChild0->GetHash(), true), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(txChild2->GetHash(), false), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(txChild2->GetHash(), false), 0);
+
+    // A pending orphan that is erased leaves the work set too
+    orphanage.AddChildrenToWorkSet(*txParent);
+    BOOST_CHECK(orphanage.HaveTxToReconsider(0));
+    orphanage.EraseTx(txChild1->GetHash(), true);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(0));
+
+    TxOrphanage::Stats stats = orphanage.GetStats();
+    BOOST_CHECK_EQUAL(stats.nOrphans, 1U);
+    BOOST_CHECK_EQUAL(stats.nResolved, 2U);
+    BOOST_CHECK_EQUAL(stats.nRejected, 1U);
+}
+
+BOOST_AUTO_TEST_CASE(erase_for_block)
+{
+    TxOrphanage orphanage;
+    const size_t nBudget = 1000000;
+    const COutPoint prevout(GetRandHash(), 0);
+    CTransactionRef txOrphan = MakeOrphan(prevout);
+    CTransactionRef txOther = MakeOrphan(COutPoint(GetRandHash(), 0));
+    BOOST_CHECK(orphanage.AddTx(txOrphan, 0, nBudget));
+    BOOST_CHECK(orphanage.AddTx(txOther, 0, nBudget));
+
+    // A block transaction spending the same input conflicts with the orphan
+    CTransactionRef txBlock = MakeOrphan(prevout, 2);
+    BOOST_CHECK_EQUAL(orphanage.EraseForBlockTx(*txBlock), 1);
+    BOOST_CHECK(!orphanage.HaveTx(txOrphan->GetHash()));
+    BOOST_CHECK(orphanage.HaveTx(txOther->GetHash()));
+    BOOST_CHECK_EQUAL(orphanage.EraseForBlockTx(*txBlock), 0);
+
+    TxOrphanage::Stats stats = orphanage.GetStats();
+    BOOST_CHECK_EQUAL(stats.nRemovedForBlock, 1U);
+    BOOST_CHECK_EQUAL(stats.nOutpoints, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
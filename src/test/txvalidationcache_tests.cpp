@@ -7,6 +7,7 @@
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
+#include "policy/policy.h"
 #include "pubkey.h"
 #include "txmempool.h"
 #include "random.h"
@@ -15,6 +16,7 @@
 #include "utiltime.h"
 
 #include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
 
 BOOST_AUTO_TEST_SUITE(tx_validationcache_tests)
 
@@ -85,4 +87,227 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain240Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(script_execution_cache, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.nVersion = 1;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = COIN;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    const CTransaction tx(spend);
+
+    LOCK(cs_main);
+    CCoinsViewCache view(pcoinsTip);
+    PrecomputedTransactionData txdata(tx);
+    CValidationState state;
+    const unsigned int flags = SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_DERSIG;
+
+    // Nothing cached yet: the script checks are handed out
+    std::vector<CScriptCheck> vChecks;
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Running them inline records the success ...
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, true, txdata));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, true, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+
+    // ... for these flags only
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags | SCRIPT_VERIFY_LOW_S, true, true, txdata, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Connecting a block consults the cache without storing in it
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, view, true, flags, false, false, txdata, &vChecks));
+    BOOST_CHECK(vChecks.empty());
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_snapshot_reload, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    std::vector<CMutableTransaction> spends(3);
+    for (size_t i = 0; i < spends.size(); i++) {
+        spends[i].nVersion = 1;
+        spends[i].vin.resize(1);
+        spends[i].vin[0].prevout.hash = coinbaseTxns[i].GetHash();
+        spends[i].vin[0].prevout.n = 0;
+        spends[i].vout.resize(1);
+        spends[i].vout[0].nValue = COIN;
+        spends[i].vout[0].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spends[i], 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spends[i].vin[0].scriptSig << vchSig;
+        BOOST_CHECK(ToMemPool(spends[i]));
+    }
+    DumpMempool();
+
+    // Whether the scripts of spends[0] are known to pass the mempool flags
+    const CTransaction tx(spends[0]);
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    PrecomputedTransactionData txdata(tx);
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+
+    // Reloaded without trusting the snapshot, the transactions are verified
+    // in full, which does not record the mempool flags
+    mempool.clear();
+    mempool.SetIsLoaded(false);
+    ForceSetArg("-trustmempoolsnapshot", "0");
+    BOOST_CHECK(LoadMempool());
+    ForceSetArg("-trustmempoolsnapshot", "1");
+    BOOST_CHECK_EQUAL(mempool.size(), spends.size());
+    BOOST_CHECK_EQUAL(mempool.GetLoadProgress(), 1.0);
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks));
+        BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    }
+
+    // Nor are script results taken from a snapshot that does not match its
+    // checksum
+    const fs::path path = GetDataDir() / "mempool.dat";
+    FILE* file = fsbridge::fopen(path, "rb+");
+    BOOST_REQUIRE(file);
+    fseek(file, -1, SEEK_END);
+    int ch = fgetc(file);
+    fseek(file, -1, SEEK_END);
+    fputc(ch ^ 0x5a, file);
+    fclose(file);
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), spends.size());
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        vChecks.clear();
+        BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks));
+        BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    }
+    file = fsbridge::fopen(path, "rb+");
+    BOOST_REQUIRE(file);
+    fseek(file, -1, SEEK_END);
+    fputc(ch, file);
+    fclose(file);
+
+    // Reloaded at the tip the snapshot was written at, they get back in with
+    // their script results taken from the snapshot
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), spends.size());
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        vChecks.clear();
+        BOOST_CHECK(CheckInputs(tx, state, view, true, flags, true, false, txdata, &vChecks));
+        BOOST_CHECK(vChecks.empty());
+    }
+
+    // And no script runs at all: transactions put in the pool unchecked,
+    // whose signatures do not verify, are reloaded all the same
+    mempool.clear();
+    TestMemPoolEntryHelper entry;
+    for (size_t i = 0; i < spends.size(); i++) {
+        CMutableTransaction spend = spends[i];
+        std::vector<unsigned char> vchSig;
+        BOOST_CHECK(coinbaseKey.Sign(uint256S("01"), vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[0].scriptSig = CScript() << vchSig;
+        mempool.addUnchecked(spend.GetHash(), entry.Time(GetTime()).FromTx(spend));
+    }
+    DumpMempool();
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), spends.size());
+    mempool.clear();
+}
+
+BOOST_FIXTURE_TEST_CASE(mempool_preverify, TestChain240Setup)
+{
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    CKey otherKey;
+    otherKey.MakeNewKey(true);
+
+    // Three good spends, one signed with the wrong key and one paying no fee
+    std::vector<CTransactionRef> vtx;
+    for (int i = 0; i < 5; i++) {
+        CMutableTransaction spend;
+        spend.nVersion = 1;
+        spend.vin.resize(1);
+        spend.vin[0].prevout.hash = coinbaseTxns[i].GetHash();
+        spend.vin[0].prevout.n = 0;
+        spend.vout.resize(1);
+        spend.vout[0].nValue = i < 4 ? COIN : coinbaseTxns[i].vout[0].nValue;
+        spend.vout[0].scriptPubKey = scriptPubKey;
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+        BOOST_CHECK((i != 3 ? coinbaseKey : otherKey).Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL);
+        spend.vin[0].scriptSig << vchSig;
+        vtx.push_back(MakeTransactionRef(spend));
+    }
+
+    const unsigned int flags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    const int nScriptCheckThreadsOld = nScriptCheckThreads;
+    boost::thread_group threadGroup;
+
+    // Without script check threads there is nothing to run them on
+    nScriptCheckThreads = 0;
+    PreVerifyTransactions(mempool, vtx);
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        PrecomputedTransactionData txdata(*vtx[0]);
+        CValidationState state;
+        std::vector<CScriptCheck> vChecks;
+        BOOST_CHECK(CheckInputs(*vtx[0], state, view, true, flags, true, true, txdata, &vChecks));
+        BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    }
+
+    nScriptCheckThreads = 3;
+    for (int i = 0; i < nScriptCheckThreads - 1; i++)
+        threadGroup.create_thread(&ThreadMempoolScriptCheck);
+    PreVerifyTransactions(mempool, vtx);
+    threadGroup.interrupt_all();
+    threadGroup.join_all();
+    nScriptCheckThreads = nScriptCheckThreadsOld;
+
+    // The good spends have their results cached; the bad one does not, nor
+    // does the one that fails the fee checks before its scripts are run
+    {
+        LOCK(cs_main);
+        CCoinsViewCache view(pcoinsTip);
+        for (size_t i = 0; i < vtx.size(); i++) {
+            PrecomputedTransactionData txdata(*vtx[i]);
+            CValidationState state;
+            std::vector<CScriptCheck> vChecks;
+            BOOST_CHECK(CheckInputs(*vtx[i], state, view, true, flags, true, true, txdata, &vChecks));
+            BOOST_CHECK_EQUAL(vChecks.size(), i < 3 ? 0U : 1U);
+        }
+    }
+
+    // Committing them to the pool gives the same verdicts as checking in place
+    for (size_t i = 0; i < 4; i++) {
+        LOCK(cs_main);
+        CValidationState state;
+        BOOST_CHECK_EQUAL(AcceptToMemoryPool(mempool, state, vtx[i], false, NULL), i < 3);
+    }
+    BOOST_CHECK_EQUAL(mempool.size(), 3U);
+    mempool.clear();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -5,6 +5,7 @@
 #include "util.h"
 
 #include "clientversion.h"
+#include "logbuffer.h"
 #include "primitives/transaction.h"
 #include "sync.h"
 #include "utilstrencodings.h"
@@ -14,6 +15,9 @@
 #include <stdint.h>
 #include <vector>
 
+#include <boost/algorithm/string.hpp>
+#include <boost/thread.hpp>
+
 #include <boost/test/unit_test.hpp>
 
 extern std::map<std::string, std::string> mapArgs;
@@ -565,4 +569,113 @@ BOOST_AUTO_TEST_CASE(test_ParseFixedPoint)
     BOOST_CHECK(!ParseFixedPoint("1.", 8, &amount));
 }
 
+BOOST_AUTO_TEST_CASE(util_LogCategories)
+{
+    uint32_t flag = 0;
+    std::string str = "net";
+    BOOST_CHECK(GetLogCategory(&flag, &str));
+    BOOST_CHECK_EQUAL(flag, (uint32_t)BCLog::NET);
+    str = "";
+    BOOST_CHECK(GetLogCategory(&flag, &str));
+    BOOST_CHECK_EQUAL(flag, (uint32_t)BCLog::ALL);
+    str = "1";
+    BOOST_CHECK(GetLogCategory(&flag, &str));
+    BOOST_CHECK_EQUAL(flag, (uint32_t)BCLog::ALL);
+    str = "0";
+    BOOST_CHECK(GetLogCategory(&flag, &str));
+    BOOST_CHECK_EQUAL(flag, (uint32_t)BCLog::NONE);
+    str = "nosuchcategory";
+    BOOST_CHECK(!GetLogCategory(&flag, &str));
+
+    // Every listed category parses, to a distinct flag
+    std::vector<std::string> categories;
+    boost::split(categories, ListLogCategories(), boost::is_any_of(","));
+    uint32_t seen = 0;
+    for (std::string& category : categories) {
+        boost::trim(category);
+        BOOST_CHECK(GetLogCategory(&flag, &category));
+        BOOST_CHECK_EQUAL(seen & flag, 0U);
+        seen |= flag;
+    }
+
+    const uint32_t old = logCategories;
+    logCategories = BCLog::NET | BCLog::MEMPOOL;
+    BOOST_CHECK(LogAcceptCategory(BCLog::NET));
+    BOOST_CHECK(LogAcceptCategory(BCLog::MEMPOOL));
+    BOOST_CHECK(!LogAcceptCategory(BCLog::DB));
+    logCategories = old;
+}
+
+BOOST_AUTO_TEST_CASE(util_LogBuffer)
+{
+    std::string str;
+    int64_t nTime;
+
+    // Lines come out in order, with their time
+    CLogBuffer buffer(4, 1000);
+    BOOST_CHECK(!buffer.Pop(str, nTime));
+    BOOST_CHECK(buffer.Push("a\n", 1));
+    BOOST_CHECK(buffer.Push("bb\n", 2));
+    BOOST_CHECK_EQUAL(buffer.GetQueuedBytes(), 5U);
+    BOOST_CHECK(buffer.Pop(str, nTime));
+    BOOST_CHECK_EQUAL(str, "a\n");
+    BOOST_CHECK_EQUAL(nTime, 1);
+    BOOST_CHECK(buffer.Pop(str, nTime));
+    BOOST_CHECK_EQUAL(str, "bb\n");
+    BOOST_CHECK_EQUAL(nTime, 2);
+    BOOST_CHECK(!buffer.Pop(str, nTime));
+    BOOST_CHECK_EQUAL(buffer.GetQueuedBytes(), 0U);
+    BOOST_CHECK_EQUAL(buffer.GetDropped(), 0U);
+
+    // A full buffer drops lines instead of blocking
+    for (int i = 0; i < 4; i++)
+        BOOST_CHECK(buffer.Push(std::string(1, 'a' + i), i));
+    BOOST_CHECK(!buffer.Push("e", 4));
+    BOOST_CHECK_EQUAL(buffer.GetDropped(), 1U);
+    BOOST_CHECK(buffer.Pop(str, nTime));
+    BOOST_CHECK_EQUAL(str, "a");
+    BOOST_CHECK(buffer.Push("e", 4));
+    for (int i = 1; i < 5; i++) {
+        BOOST_CHECK(buffer.Pop(str, nTime));
+        BOOST_CHECK_EQUAL(str, std::string(1, 'a' + i));
+    }
+
+    // So does one over the byte limit
+    BOOST_CHECK(buffer.Push(std::string(600, 'x'), 0));
+    BOOST_CHECK(!buffer.Push(std::string(600, 'y'), 0));
+    BOOST_CHECK_EQUAL(buffer.GetDropped(), 2U);
+    BOOST_CHECK_EQUAL(buffer.GetQueuedBytes(), 600U);
+    BOOST_CHECK(buffer.Pop(str, nTime));
+    BOOST_CHECK(!buffer.Pop(str, nTime));
+
+    // Concurrent producers: every line is either read or counted as dropped
+    CLogBuffer shared(64, 1 << 20);
+    const int nThreads = 4, nLines = 10000;
+    boost::thread_group threads;
+    for (int t = 0; t < nThreads; t++) {
+        threads.create_thread([&shared, t] {
+            for (int i = 0; i < nLines; i++)
+                shared.Push(strprintf("%d %d", t, i), i);
+        });
+    }
+    uint64_t nRead = 0;
+    std::vector<int> vLast(nThreads, -1);
+    bool fOrdered = true;
+    while (nRead + shared.GetDropped() < (uint64_t)nThreads * nLines) {
+        if (!shared.Pop(str, nTime))
+            continue;
+        int t, i;
+        BOOST_CHECK_EQUAL(sscanf(str.c_str(), "%d %d", &t, &i), 2);
+        BOOST_CHECK_EQUAL(nTime, i);
+        // Each producer's lines stay in order
+        fOrdered &= i > vLast[t];
+        vLast[t] = i;
+        nRead++;
+    }
+    threads.join_all();
+    BOOST_CHECK(fOrdered);
+    BOOST_CHECK(!shared.Pop(str, nTime));
+    BOOST_CHECK_EQUAL(shared.GetQueuedBytes(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
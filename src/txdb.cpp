@@ -9,10 +9,14 @@
 #include "hash.h"
 #include "pow.h"
 #include "uint256.h"
+#include "util.h"
 
 #include <stdint.h>
 #include <validation.h>
 
+#include <atomic>
+
+#include <boost/bind/bind.hpp>
 #include <boost/thread.hpp>
 
 static const char DB_COINS = 'c';
@@ -21,9 +25,12 @@ static const char DB_TXINDEX = 't';
 static const char DB_BLOCK_INDEX = 'b';
 
 static const char DB_BEST_BLOCK = 'B';
+static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_RECOMPRESSED_FILE = 'Z';
+static const char DB_INDEX_SNAPSHOT = 'S';
 
 static const char DB_ADDRESSINDEX = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
@@ -32,26 +39,96 @@ static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
 
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true) 
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe, true, GetDBProfile("chainstate")),
+    nPendingUsage(0), fFlushPending(false), fFlushFailed(false), fBackgroundNext(false), fStopFlush(false)
 {
 }
 
+CCoinsViewDB::~CCoinsViewDB()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        fStopFlush = true;
+    }
+    condFlush.notify_all();
+    // The writer finishes what it was handed before it exits
+    if (threadFlush.joinable())
+        threadFlush.join();
+}
+
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end()) {
+            if (it->second.coins.IsPruned())
+                return false;
+            coins = it->second.coins;
+            return true;
+        }
+    }
     return db.Read(std::make_pair(DB_COINS, txid), coins);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        CCoinsMap::const_iterator it = mapPending.find(txid);
+        if (it != mapPending.end())
+            return !it->second.coins.IsPruned();
+    }
     return db.Exists(std::make_pair(DB_COINS, txid));
 }
 
-uint256 CCoinsViewDB::GetBestBlock() const {
+uint256 CCoinsViewDB::ReadBestBlock() const {
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
     return hashBestChain;
 }
 
+uint256 CCoinsViewDB::GetBestBlock() const {
+    {
+        boost::unique_lock<boost::mutex> lock(csFlush);
+        if (fFlushPending)
+            return hashPendingBlock;
+    }
+    return ReadBestBlock();
+}
+
+std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
+    std::vector<uint256> vhashHeadBlocks;
+    if (!db.Read(DB_HEAD_BLOCKS, vhashHeadBlocks))
+        return std::vector<uint256>();
+    return vhashHeadBlocks;
+}
+
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (fFlushPending)
+        condFlush.wait(lock);
+    if (fFlushFailed)
+        return false;
+
+    bool fBackground = fBackgroundNext;
+    fBackgroundNext = false;
+    uint256 hashBase = ReadBestBlock();
+    // Without a best block to go back to, a partial write could not be replayed
+    if (fBackground && !hashBlock.IsNull() && !hashBase.IsNull()) {
+        mapPending.swap(mapCoins);
+        mapCoins.clear();
+        hashPendingBlock = hashBlock;
+        hashPendingBase = hashBase;
+        fFlushPending = true;
+        if (!threadFlush.joinable())
+            threadFlush = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, "coinsflush",
+                                                    boost::function<void()>(boost::bind(&CCoinsViewDB::ThreadFlush, this))));
+        lock.unlock();
+        condFlush.notify_all();
+        return true;
+    }
+    lock.unlock();
+
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -67,14 +144,107 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
         CCoinsMap::iterator itOld = it++;
         mapCoins.erase(itOld);
     }
-    if (!hashBlock.IsNull())
+    if (!hashBlock.IsNull()) {
         batch.Write(DB_BEST_BLOCK, hashBlock);
+        batch.Erase(DB_HEAD_BLOCKS);
+    }
 
-    LogPrint("coindb", "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
+    LogPrint(BCLog::COINDB, "Committing %u changed transactions (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return db.WriteBatch(batch);
 }
 
-CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
+void CCoinsViewDB::ThreadFlush()
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (true) {
+        while (!fFlushPending && !fStopFlush)
+            condFlush.wait(lock);
+        if (!fFlushPending)
+            return;
+
+        const size_t nBatchSize = (size_t)std::max<int64_t>(1, GetArg("-dbbatchsize", nDefaultDbBatchSize));
+        const size_t nTotal = mapPending.size();
+        const size_t nTotalUsage = nPendingUsage;
+        size_t changed = 0;
+        unsigned int nChunks = 0;
+        int64_t nStart = GetTimeMillis();
+        try {
+            while (true) {
+                // Serialize a chunk while holding the lock, write it without
+                CDBBatch batch(db);
+                CCoinsMap::iterator it = mapPending.begin();
+                for (; it != mapPending.end() && batch.SizeEstimate() < nBatchSize; ++it) {
+                    if (it->second.flags & CCoinsCacheEntry::DIRTY) {
+                        if (it->second.coins.IsPruned())
+                            batch.Erase(std::make_pair(DB_COINS, it->first));
+                        else
+                            batch.Write(std::make_pair(DB_COINS, it->first), it->second.coins);
+                        changed++;
+                    }
+                }
+                bool fLast = it == mapPending.end();
+                if (fLast) {
+                    batch.Write(DB_BEST_BLOCK, hashPendingBlock);
+                    batch.Erase(DB_HEAD_BLOCKS);
+                } else if (nChunks == 0) {
+                    std::vector<uint256> vhashHeadBlocks;
+                    vhashHeadBlocks.push_back(hashPendingBlock);
+                    vhashHeadBlocks.push_back(hashPendingBase);
+                    batch.Write(DB_HEAD_BLOCKS, vhashHeadBlocks);
+                }
+                lock.unlock();
+                db.WriteBatch(batch);
+                lock.lock();
+                // Only this thread changes mapPending while a flush is pending
+                mapPending.erase(mapPending.begin(), it);
+                nPendingUsage = nTotal ? nTotalUsage / nTotal * mapPending.size() : 0;
+                nChunks++;
+                if (fLast)
+                    break;
+            }
+            LogPrint(BCLog::COINDB, "Committed %u changed transactions (out of %u) to coin database in %u chunks, %dms\n",
+                (unsigned int)changed, (unsigned int)nTotal, nChunks, GetTimeMillis() - nStart);
+        } catch (const std::runtime_error& e) {
+            if (!lock.owns_lock())
+                lock.lock();
+            LogPrintf("%s: error writing to coin database: %s\n", __func__, e.what());
+            fFlushFailed = true;
+        }
+        fFlushPending = false;
+        condFlush.notify_all();
+    }
+}
+
+void CCoinsViewDB::ScheduleBackgroundFlush(size_t nUsage)
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (fFlushPending)
+        condFlush.wait(lock);
+    fBackgroundNext = true;
+    nPendingUsage = nUsage;
+}
+
+bool CCoinsViewDB::Sync() const
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    while (fFlushPending)
+        condFlush.wait(lock);
+    return !fFlushFailed;
+}
+
+bool CCoinsViewDB::HasFlushFailed() const
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    return fFlushFailed;
+}
+
+size_t CCoinsViewDB::GetPendingUsage() const
+{
+    boost::unique_lock<boost::mutex> lock(csFlush);
+    return fFlushPending ? nPendingUsage : 0;
+}
+
+CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe, false, GetDBProfile("blocktree")) {
 }
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
@@ -99,6 +269,8 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
+    // The cursor only sees what is in the database
+    Sync();
     CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper*>(&db)->NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
@@ -180,81 +352,321 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
+bool CBlockTreeDB::WriteRecompressedFile(int nFile, const CBlockFileInfo& info, const std::vector<const CBlockIndex*>& blockinfo, const std::vector<std::pair<uint256, CDiskTxPos> >& txinfo) {
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_BLOCK_FILES, nFile), info);
+    for (std::vector<const CBlockIndex*>::const_iterator it=blockinfo.begin(); it != blockinfo.end(); it++) {
+        batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()), CDiskBlockIndex(*it));
+    }
+    for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=txinfo.begin(); it!=txinfo.end(); it++)
+        batch.Write(std::make_pair(DB_TXINDEX, it->first), it->second);
+    batch.Write(std::make_pair(DB_RECOMPRESSED_FILE, nFile), 'p');
+    return WriteBatch(batch, true);
+}
+
+bool CBlockTreeDB::WriteRecompressedFileMoved(int nFile) {
+    return Write(std::make_pair(DB_RECOMPRESSED_FILE, nFile), 'd', true);
+}
+
+bool CBlockTreeDB::ReadRecompressedFile(int nFile, bool& fPending) {
+    char ch;
+    if (!Read(std::make_pair(DB_RECOMPRESSED_FILE, nFile), ch))
+        return false;
+    fPending = ch == 'p';
+    return true;
+}
+
+bool CBlockTreeDB::WriteIndexSnapshot(uint64_t nId) {
+    return Write(DB_INDEX_SNAPSHOT, nId, true);
+}
+
+bool CBlockTreeDB::ReadIndexSnapshot(uint64_t& nId) {
+    return Read(DB_INDEX_SNAPSHOT, nId);
+}
+
+bool CBlockTreeDB::EraseIndexSnapshot() {
+    return Erase(DB_INDEX_SNAPSHOT, true);
+}
+
 bool CBlockTreeDB::LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
 {
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
     pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
 
+    // Records are read in batches. Deserializing them and hashing their
+    // headers is spread over threads, inserting them into mapBlockIndex is not.
+    const std::vector<unsigned char>& obfuscateKey = dbwrapper_private::GetObfuscateKey(*this);
+    const int nThreads = std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<char> vchBatch;
+    std::vector<size_t> vOffsets;
+    std::vector<CDiskBlockIndex> vDiskIndex;
+    std::vector<uint256> vHashes;
+
     // Load mapBlockIndex
-    while (pcursor->Valid()) {
+    bool fMore = true;
+    while (fMore) {
         boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
-                // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-                pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
-                pindexNew->nHeight        = diskindex.nHeight;
-                pindexNew->nFile          = diskindex.nFile;
-                pindexNew->nDataPos       = diskindex.nDataPos;
-                pindexNew->nUndoPos       = diskindex.nUndoPos;
-                pindexNew->nVersion       = diskindex.nVersion;
-                pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-                pindexNew->nTime          = diskindex.nTime;
-                pindexNew->nBits          = diskindex.nBits;
-                pindexNew->nNonce         = diskindex.nNonce;
-                pindexNew->nStatus        = diskindex.nStatus;
-                pindexNew->nTx            = diskindex.nTx;
-
-                /* Bitcoin checks the PoW here.  We don't do this because
-                   the CDiskBlockIndex does not contain the auxpow.
-                   This check isn't important, since the data on disk should
-                   already be valid and can be trusted.  */
+        vchBatch.clear();
+        vOffsets.assign(1, 0);
+        fMore = false;
+        while (pcursor->Valid()) {
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX)
+                break;
+            pcursor->AppendValue(vchBatch);
+            vOffsets.push_back(vchBatch.size());
+            pcursor->Next();
+            if (vOffsets.size() > BLOCK_INDEX_LOAD_BATCH) {
+                fMore = true;
+                break;
+            }
+        }
 
-                pcursor->Next();
-            } else {
-                return error("LoadBlockIndex() : failed to read value");
+        const size_t nRecords = vOffsets.size() - 1;
+        vDiskIndex.assign(nRecords, CDiskBlockIndex());
+        vHashes.resize(nRecords);
+        std::atomic<bool> fFailed(false);
+        auto decode = [&](int nThread) {
+            for (size_t i = nThread; i < nRecords; i += nThreads) {
+                try {
+                    CPooledDataStream ssValue(vchBatch.data() + vOffsets[i], vchBatch.data() + vOffsets[i + 1], SER_DISK, CLIENT_VERSION);
+                    ssValue.Xor(obfuscateKey);
+                    ssValue >> vDiskIndex[i];
+                } catch (const std::exception&) {
+                    fFailed = true;
+                    return;
+                }
+                vHashes[i] = vDiskIndex[i].GetBlockHash();
             }
+        };
+        if (nThreads > 1 && nRecords > 1) {
+            boost::thread_group threads;
+            for (int nThread = 1; nThread < nThreads; nThread++)
+                threads.create_thread(boost::bind<void>(decode, nThread));
+            decode(0);
+            threads.join_all();
         } else {
-            break;
+            decode(0);
+        }
+        if (fFailed)
+            return error("LoadBlockIndex() : failed to read value");
+
+        for (size_t i = 0; i < nRecords; i++) {
+            const CDiskBlockIndex& diskindex = vDiskIndex[i];
+            // Construct block index object
+            CBlockIndex* pindexNew = insertBlockIndex(vHashes[i]);
+            pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight        = diskindex.nHeight;
+            pindexNew->nFile          = diskindex.nFile;
+            pindexNew->nDataPos       = diskindex.nDataPos;
+            pindexNew->nUndoPos       = diskindex.nUndoPos;
+            pindexNew->nVersion       = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            pindexNew->nTime          = diskindex.nTime;
+            pindexNew->nBits          = diskindex.nBits;
+            pindexNew->nNonce         = diskindex.nNonce;
+            pindexNew->nStatus        = diskindex.nStatus;
+            pindexNew->nTx            = diskindex.nTx;
+
+            /* Bitcoin checks the PoW here.  We don't do this because
+               the CDiskBlockIndex does not contain the auxpow.
+               This check isn't important, since the data on disk should
+               already be valid and can be trusted.  */
         }
     }
 
     return true;
 }
 
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+CIndexDB::CIndexDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "indexes", nCacheSize, fMemory, fWipe, false, GetDBProfile("indexes")),
+    nQueuedBytes(0), fWriting(false), fWriteFailed(false), fStopWrite(false)
+{
+}
+
+CIndexDB::~CIndexDB()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        fStopWrite = true;
+    }
+    condQueue.notify_all();
+    // The writer empties the queue before it exits
+    if (threadWrite.joinable())
+        threadWrite.join();
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+bool CIndexDB::QueueBatch(CDBBatch* batch, const uint256& hashBlock)
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    while (nQueuedBytes > MAX_INDEX_WRITE_QUEUE && !fWriteFailed)
+        condQueue.wait(lock);
+    if (fWriteFailed) {
+        delete batch;
+        return false;
+    }
+    queueWrites.push_back(QueuedWrite());
+    queueWrites.back().batch.reset(batch);
+    queueWrites.back().hashBlock = hashBlock;
+    nQueuedBytes += batch->SizeEstimate();
+    if (!threadWrite.joinable())
+        threadWrite = boost::thread(boost::bind(&TraceThread<boost::function<void()> >, "indexwrite",
+                                                boost::function<void()>(boost::bind(&CIndexDB::ThreadWrite, this))));
+    condQueue.notify_all();
+    return true;
+}
+
+void CIndexDB::ThreadWrite()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    while (true) {
+        while (queueWrites.empty() && !fStopWrite)
+            condQueue.wait(lock);
+        if (queueWrites.empty())
+            return;
+
+        QueuedWrite write;
+        write.batch.swap(queueWrites.front().batch);
+        write.hashBlock = queueWrites.front().hashBlock;
+        queueWrites.pop_front();
+        fWriting = true;
+        lock.unlock();
+        bool fOk = true;
+        try {
+            WriteBatch(*write.batch);
+        } catch (const std::runtime_error& e) {
+            LogPrintf("%s: error writing to index database: %s\n", __func__, e.what());
+            fOk = false;
+        }
+        lock.lock();
+        fWriting = false;
+        nQueuedBytes -= write.batch->SizeEstimate();
+        if (!write.hashBlock.IsNull())
+            mapQueuedTimestamps.erase(write.hashBlock);
+        if (!fOk) {
+            // Later writes may depend on this one, so drop them all
+            fWriteFailed = true;
+            queueWrites.clear();
+            mapQueuedTimestamps.clear();
+            nQueuedBytes = 0;
+        }
+        condQueue.notify_all();
+    }
+}
+
+bool CIndexDB::WaitForQueue()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    while (!queueWrites.empty() || fWriting)
+        condQueue.wait(lock);
+    return !fWriteFailed;
+}
+
+bool CIndexDB::Sync()
+{
+    if (!WaitForQueue())
+        return false;
+    // The queued batches are written without syncing. A synced write after
+    // them makes them durable too, as it syncs the log they went into.
     CDBBatch batch(*this);
+    try {
+        return WriteBatch(batch, true);
+    } catch (const std::runtime_error& e) {
+        return error("%s: error syncing the index database: %s", __func__, e.what());
+    }
+}
+
+bool CIndexDB::HasWriteFailed()
+{
+    boost::unique_lock<boost::mutex> lock(csQueue);
+    return fWriteFailed;
+}
+
+/** Move the entries of one index from the block tree database, committing to the index database first so that an interrupted move can be resumed */
+template <typename K, typename V>
+static bool MoveIndexEntries(CBlockTreeDB& blocktree, CIndexDB& indexdb, char chPrefix, const char* pszName)
+{
+    const size_t nBatchSize = (size_t)std::max<int64_t>(1, GetArg("-dbbatchsize", nDefaultDbBatchSize));
+    std::unique_ptr<CDBIterator> pcursor(blocktree.NewIterator());
+    CDBBatch batchIndex(indexdb);
+    CDBBatch batchTree(blocktree);
+    uint64_t nMoved = 0;
+    pcursor->Seek(chPrefix);
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        bool fDone = !pcursor->Valid() || !pcursor->GetKey(key) || key.first != chPrefix;
+        if (!fDone) {
+            V value;
+            if (!pcursor->GetValue(value))
+                return error("%s: failed to read %s entry", __func__, pszName);
+            batchIndex.Write(key, value);
+            batchTree.Erase(key);
+            nMoved++;
+            pcursor->Next();
+        }
+        if (batchIndex.SizeEstimate() > nBatchSize || (fDone && nMoved > 0)) {
+            indexdb.WriteBatch(batchIndex, true);
+            blocktree.WriteBatch(batchTree);
+            batchIndex.Clear();
+            batchTree.Clear();
+            LogPrintf("Moved %u %s entries to the index database\n", nMoved, pszName);
+        }
+        if (fDone)
+            break;
+    }
+    if (nMoved > 0)
+        blocktree.CompactRange(chPrefix, (char)(chPrefix + 1));
+    return true;
+}
+
+bool CIndexDB::MigrateFromBlockTree(CBlockTreeDB& blocktree)
+{
+    try {
+        return MoveIndexEntries<CAddressIndexKey, CAmount>(blocktree, *this, DB_ADDRESSINDEX, "address index") &&
+               MoveIndexEntries<CAddressUnspentKey, CAddressUnspentValue>(blocktree, *this, DB_ADDRESSUNSPENTINDEX, "address unspent index") &&
+               MoveIndexEntries<CTimestampIndexKey, int>(blocktree, *this, DB_TIMESTAMPINDEX, "timestamp index") &&
+               MoveIndexEntries<CTimestampBlockIndexKey, CTimestampBlockIndexValue>(blocktree, *this, DB_BLOCKHASHINDEX, "block timestamp index") &&
+               MoveIndexEntries<CSpentIndexKey, CSpentIndexValue>(blocktree, *this, DB_SPENTINDEX, "spent index");
+    } catch (const std::runtime_error& e) {
+        return error("%s: %s", __func__, e.what());
+    }
+}
+
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    if (!WaitForQueue())
+        return false;
+    return Read(std::make_pair(DB_SPENTINDEX, key), value);
+}
+
+bool CIndexDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    CDBBatch* batch = new CDBBatch(*this);
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_SPENTINDEX, it->first));
+            batch->Erase(std::make_pair(DB_SPENTINDEX, it->first));
         } else {
-            batch.Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
+            batch->Write(std::make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return QueueBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
+bool CIndexDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    CDBBatch* batch = new CDBBatch(*this);
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
-            batch.Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
+            batch->Erase(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
         } else {
-            batch.Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
+            batch->Write(std::make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
+    return QueueBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
                                            std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+    if (!WaitForQueue())
+        return false;
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -279,23 +691,25 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+bool CIndexDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    CDBBatch* batch = new CDBBatch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
-    return WriteBatch(batch);
+        batch->Write(std::make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    return QueueBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
-    CDBBatch batch(*this);
+bool CIndexDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    CDBBatch* batch = new CDBBatch(*this);
     for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
-    return WriteBatch(batch);
+        batch->Erase(std::make_pair(DB_ADDRESSINDEX, it->first));
+    return QueueBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
                                     std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
                                     int start, int end) {
+    if (!WaitForQueue())
+        return false;
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -327,13 +741,15 @@ bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
-    return WriteBatch(batch);
+bool CIndexDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+    CDBBatch* batch = new CDBBatch(*this);
+    batch->Write(std::make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    return QueueBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+bool CIndexDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+    if (!WaitForQueue())
+        return false;
 
     std::unique_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -360,13 +776,25 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
-    CDBBatch batch(*this);
-    batch.Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
-    return WriteBatch(batch);
+bool CIndexDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
+    CDBBatch* batch = new CDBBatch(*this);
+    batch->Write(std::make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        mapQueuedTimestamps[blockhashIndex.blockHash] = logicalts.ltimestamp;
+    }
+    return QueueBatch(batch, blockhashIndex.blockHash);
 }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+bool CIndexDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+    {
+        boost::unique_lock<boost::mutex> lock(csQueue);
+        std::map<uint256, unsigned int>::const_iterator it = mapQueuedTimestamps.find(hash);
+        if (it != mapQueuedTimestamps.end()) {
+            ltimestamp = it->second;
+            return true;
+        }
+    }
 
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
@@ -10,15 +10,19 @@
 #include "dbwrapper.h"
 #include "chain.h"
 
+#include <deque>
 #include <functional>
 #include <index/addressindex.h>
 #include <index/spentindex.h>
 #include <index/timestampindex.h>
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread.hpp>
+
 class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
@@ -31,6 +35,8 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 200 * DB_PEAK_USAGE_FACTOR;
 static constexpr int MIN_BLOCK_COINSDB_USAGE = 50 * DB_PEAK_USAGE_FACTOR;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
+//! -dbbatchsize default (bytes)
+static const int64_t nDefaultDbBatchSize = 16 << 20;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -43,6 +49,16 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to index DB specific cache, if any of the insight indexes is on (MiB)
+static const int64_t nMaxIndexDBCache = 1024;
+//! Memory allocated to index DB specific cache, if none of the insight indexes is on (MiB)
+static const int64_t nMinIndexDBCache = 1;
+//! Block index records read from the database before they are decoded together
+static const size_t BLOCK_INDEX_LOAD_BATCH = 16384;
+//! Maximum number of threads decoding block index records
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
+//! Max bytes of index writes queued for the index DB write thread
+static const size_t MAX_INDEX_WRITE_QUEUE = 64 << 20;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -69,19 +85,62 @@ struct CDiskTxPos : public CDiskBlockPos
     }
 };
 
-/** CCoinsView backed by the coin database (chainstate/) */
+/**
+ * CCoinsView backed by the coin database (chainstate/)
+ *
+ * A BatchWrite can be handed to a background thread, which commits the
+ * entries in chunks of -dbbatchsize bytes while validation goes on, and
+ * frees them as each chunk is written. Until then the entries are still
+ * served from memory. Before the first chunk the pair (new best block, old
+ * best block) is recorded in the database; the last chunk moves the best
+ * block and removes that record. A node that stops in between finds the
+ * record on startup, and ReplayBlocks brings the coins to the new best block.
+ */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    mutable boost::mutex csFlush;
+    mutable boost::condition_variable condFlush;
+    boost::thread threadFlush;
+    //! Entries handed to the background writer and not committed yet
+    CCoinsMap mapPending;
+    uint256 hashPendingBlock;
+    uint256 hashPendingBase;
+    size_t nPendingUsage;
+    bool fFlushPending;
+    bool fFlushFailed;
+    bool fBackgroundNext;
+    bool fStopFlush;
+
+    uint256 ReadBestBlock() const;
+    void ThreadFlush();
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CCoinsViewDB();
 
     bool GetCoins(const uint256 &txid, CCoins &coins) const;
     bool HaveCoins(const uint256 &txid) const;
     uint256 GetBestBlock() const;
+    std::vector<uint256> GetHeadBlocks() const;
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock);
     CCoinsViewCursor *Cursor() const;
+
+    /**
+     * Let the background writer commit the next BatchWrite. The caller makes
+     * sure its best block descends from the one in the database, so the write
+     * can be completed by ReplayBlocks if it is cut short. nUsage is the
+     * memory taken by the entries, for GetPendingUsage.
+     */
+    void ScheduleBackgroundFlush(size_t nUsage);
+    /** Wait for the background writer. Returns false if it failed to write. */
+    bool Sync() const;
+    bool HasFlushFailed() const;
+    /** Estimated memory taken by entries the background writer has yet to commit */
+    size_t GetPendingUsage() const;
+
+    const CDBWrapper& GetDB() const { return db; }
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
@@ -124,7 +183,65 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
+    /**
+     * Point the index at the rewritten files of a recompressed block file,
+     * recording that they still have to be moved into place
+     */
+    bool WriteRecompressedFile(int nFile, const CBlockFileInfo& info, const std::vector<const CBlockIndex*>& blockinfo, const std::vector<std::pair<uint256, CDiskTxPos> >& txinfo);
+    bool WriteRecompressedFileMoved(int nFile);
+    /** Whether block file nFile was recompressed, and if so whether its files are yet to be moved */
+    bool ReadRecompressedFile(int nFile, bool& fPending);
+    /** The id of the block index snapshot that matches the database, written along with it */
+    bool WriteIndexSnapshot(uint64_t nId);
+    bool ReadIndexSnapshot(uint64_t& nId);
+    bool EraseIndexSnapshot();
     bool LoadBlockIndexGuts(std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+};
+
+/**
+ * Access to the address, spent and timestamp indexes (indexes/)
+ *
+ * Writes are queued to a thread of their own, so connecting a block does not
+ * wait for them. Reads wait for the queue to be written first.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+    ~CIndexDB();
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+
+    struct QueuedWrite {
+        std::unique_ptr<CDBBatch> batch;
+        //! Block whose logical timestamp the batch writes, if any
+        uint256 hashBlock;
+    };
+
+    boost::mutex csQueue;
+    boost::condition_variable condQueue;
+    boost::thread threadWrite;
+    std::deque<QueuedWrite> queueWrites;
+    //! Logical timestamps queued but not written yet, so connecting the next block need not wait
+    std::map<uint256, unsigned int> mapQueuedTimestamps;
+    //! Approximate size of the queued batches
+    size_t nQueuedBytes;
+    //! The writer took a batch off the queue and has not written it yet
+    bool fWriting;
+    bool fWriteFailed;
+    bool fStopWrite;
+
+    bool QueueBatch(CDBBatch* batch, const uint256& hashBlock = uint256());
+    void ThreadWrite();
+public:
+    /** Move the index entries that older versions kept in the block tree database */
+    bool MigrateFromBlockTree(CBlockTreeDB& blocktree);
+    /** Wait for the queued writes, for reads to see them. Returns false if one of them failed. */
+    bool WaitForQueue();
+    /** Wait for the queued writes and make them durable. Returns false if one of them failed. */
+    bool Sync();
+    bool HasWriteFailed();
 
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
@@ -24,9 +24,9 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
                                  int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                                  CAmount _inChainInputValue,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp):
-    tx(_tx), nFee(_nFee), nTime(_nTime), entryPriority(_entryPriority), entryHeight(_entryHeight),
-    inChainInputValue(_inChainInputValue),
-    spendsCoinbase(_spendsCoinbase), sigOpCost(_sigOpsCost), lockPoints(lp)
+    tx(_tx), nFee(_nFee), nTime(_nTime), entryPriority(_entryPriority),
+    inChainInputValue(_inChainInputValue), sigOpCost(_sigOpsCost), lockPoints(lp),
+    entryHeight(_entryHeight), spendsCoinbase(_spendsCoinbase)
 {
     nTxWeight = GetTransactionWeight(*tx);
     nModSize = tx->CalculateModifiedSize(GetTxSize());
@@ -73,6 +73,11 @@ size_t CTxMemPoolEntry::GetTxSize() const
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
 }
 
+static size_t LinksUsage(const CTxMemPool::linkEntries& links)
+{
+    return memusage::MallocUsage(links.allocated_memory());
+}
+
 // Update the given tx for any in-mempool descendants.
 // Assumes that setMemPoolChildren is correct for the given tx and all
 // descendants.
@@ -85,7 +90,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
+        const linkEntries &setChildren = GetMemPoolChildren(cit);
         BOOST_FOREACH(const txiter childEntry, setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
@@ -214,7 +219,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
+        const linkEntries & setMemPoolParents = GetMemPoolParents(stageit);
         BOOST_FOREACH(const txiter &phash, setMemPoolParents) {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
@@ -232,7 +237,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
+    const linkEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     BOOST_FOREACH(txiter piter, parentIters) {
         UpdateChild(piter, it, add);
@@ -261,7 +266,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const linkEntries &setMemPoolChildren = GetMemPoolChildren(it);
     BOOST_FOREACH(txiter updateIt, setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -346,7 +351,16 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
 }
 
 CTxMemPool::CTxMemPool(const CFeeRate& _minReasonableRelayFee) :
-    nTransactionsUpdated(0)
+    nTransactionsUpdated(0),
+    fLoaded(false),
+    dLoadProgress(0),
+    mapTx(indexed_transaction_set::ctor_args_list(), PoolAllocator<CTxMemPoolEntry>(&poolResource)),
+    mapLinks(CompareIteratorByHash(), txlinksMap::allocator_type(&poolResource)),
+    mapAddress(CMempoolAddressDeltaKeyCompare(), addressDeltaMap::allocator_type(&poolResource)),
+    mapAddressInserted(std::less<uint256>(), addressDeltaMapInserted::allocator_type(&poolResource)),
+    mapSpent(CSpentIndexKeyCompare(), mapSpentIndex::allocator_type(&poolResource)),
+    mapSpentInserted(std::less<uint256>(), mapSpentIndexInserted::allocator_type(&poolResource)),
+    mapNextTx(decltype(mapNextTx)::allocator_type(&poolResource))
 {
     _clear(); //lock free clear
 
@@ -396,7 +410,8 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    mapLinks.insert(std::make_pair(newit, TxLinks()));
+    setClusterDirty.insert(newit);
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -465,7 +480,9 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
+    cachedInnerUsage -= LinksUsage(mapLinks[it].parents) + LinksUsage(mapLinks[it].children);
+    InvalidateCluster(it);
+    setClusterDirty.erase(it);
     mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
@@ -478,7 +495,8 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
  {
      LOCK(cs);
      const CTransaction& tx = entry.GetTx();
-     std::vector<CMempoolAddressDeltaKey> inserted;
+     std::vector<addressDeltaMap::iterator> inserted;
+     std::pair<addressDeltaMap::iterator, bool> ret;
  
      uint256 txhash = tx.GetHash();
      for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -488,14 +506,16 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
              std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
              CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
              CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-             mapAddress.insert(std::make_pair(key, delta));
-             inserted.push_back(key);
+             ret = mapAddress.insert(std::make_pair(key, delta));
+             if (ret.second)
+                 inserted.push_back(ret.first);
          } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
              std::vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
              CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
              CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-             mapAddress.insert(std::make_pair(key, delta));
-             inserted.push_back(key);
+             ret = mapAddress.insert(std::make_pair(key, delta));
+             if (ret.second)
+                 inserted.push_back(ret.first);
          }
      }
   
@@ -504,18 +524,20 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
          if (out.scriptPubKey.IsPayToScriptHash()) {
              std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
              CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-             mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-             inserted.push_back(key);
+             ret = mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+             if (ret.second)
+                 inserted.push_back(ret.first);
          } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
              std::vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-             std::pair<addressDeltaMap::iterator,bool> ret;
              CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-             mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-             inserted.push_back(key);
+             ret = mapAddress.insert(std::make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+             if (ret.second)
+                 inserted.push_back(ret.first);
          }
      }
  
-     mapAddressInserted.insert(std::make_pair(txhash, inserted));
+     if (mapAddressInserted.insert(std::make_pair(txhash, inserted)).second)
+         nIndexUsage += memusage::DynamicUsage(inserted);
  }
   
  bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
@@ -538,10 +560,11 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
      addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
  
      if (it != mapAddressInserted.end()) {
-         std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-         for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+         const std::vector<addressDeltaMap::iterator>& entries = (*it).second;
+         for (std::vector<addressDeltaMap::iterator>::const_iterator mit = entries.begin(); mit != entries.end(); mit++) {
              mapAddress.erase(*mit);
          }
+         nIndexUsage -= memusage::DynamicUsage(entries);
          mapAddressInserted.erase(it);
      }
  
@@ -553,7 +576,7 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
      LOCK(cs);
   
      const CTransaction& tx = entry.GetTx();
-     std::vector<CSpentIndexKey> inserted;
+     std::vector<mapSpentIndex::iterator> inserted;
  
      uint256 txhash = tx.GetHash();
      for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -576,12 +599,14 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
          CSpentIndexKey key = CSpentIndexKey(input.prevout.hash, input.prevout.n);
          CSpentIndexValue value = CSpentIndexValue(txhash, j, -1, prevout.nValue, addressType, addressHash);
  
-         mapSpent.insert(std::make_pair(key, value));
-         inserted.push_back(key);
+         std::pair<mapSpentIndex::iterator, bool> ret = mapSpent.insert(std::make_pair(key, value));
+         if (ret.second)
+             inserted.push_back(ret.first);
   
      }
  
-     mapSpentInserted.insert(std::make_pair(txhash, inserted));
+     if (mapSpentInserted.insert(std::make_pair(txhash, inserted)).second)
+         nIndexUsage += memusage::DynamicUsage(inserted);
  }
   
  bool CTxMemPool::getSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
@@ -603,10 +628,11 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
      mapSpentIndexInserted::iterator it = mapSpentInserted.find(txhash);
  
      if (it != mapSpentInserted.end()) {
-         std::vector<CSpentIndexKey> keys = (*it).second;
-         for (std::vector<CSpentIndexKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
+         const std::vector<mapSpentIndex::iterator>& entries = (*it).second;
+         for (std::vector<mapSpentIndex::iterator>::const_iterator mit = entries.begin(); mit != entries.end(); mit++) {
              mapSpent.erase(*mit);
          }
+         nIndexUsage -= memusage::DynamicUsage(entries);
          mapSpentInserted.erase(it);
      }
  
@@ -633,7 +659,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit, setEntries &setDescendants
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const linkEntries &setChildren = GetMemPoolChildren(it);
         BOOST_FOREACH(const txiter &childiter, setChildren) {
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
@@ -764,8 +790,15 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
+    setClusterDirty.clear();
+    nClusterUsage = 0;
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapAddressInserted.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
+    nIndexUsage = 0;
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -788,7 +821,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
     if (GetRand(std::numeric_limits<uint32_t>::max()) >= nCheckFrequency)
         return;
 
-    LogPrint("mempool", "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
+    LogPrint(BCLog::MEMPOOL, "Checking mempool with %u transactions and %u inputs\n", (unsigned int)mapTx.size(), (unsigned int)mapNextTx.size());
 
     uint64_t checkTotal = 0;
     uint64_t innerUsage = 0;
@@ -807,7 +840,10 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         txlinksMap::const_iterator linksiter = mapLinks.find(it);
         assert(linksiter != mapLinks.end());
         const TxLinks &links = linksiter->second;
-        innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
+        innerUsage += LinksUsage(links.parents) + LinksUsage(links.children);
+        // Every transaction is either in an up to date cluster or waiting for one
+        assert(links.cluster ? std::count(links.cluster->vTxs.begin(), links.cluster->vTxs.end(), it) == 1 && !setClusterDirty.count(it)
+                             : setClusterDirty.count(it) == 1);
         bool fDependsWait = false;
         setEntries setParentCheck;
         int64_t parentSizes = 0;
@@ -834,7 +870,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(setParentCheck == setEntries(GetMemPoolParents(it)));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -867,7 +903,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(setChildrenCheck == setEntries(GetMemPoolChildren(it)));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= childSizes + it->GetTxSize());
@@ -1070,6 +1106,26 @@ CTxMemPool::ReadFeeEstimates(CAutoFile& filein)
     return true;
 }
 
+bool
+CTxMemPool::AppendFeeEstimates(CAutoFile& fileout) const
+{
+    try {
+        LOCK(cs);
+        minerPolicyEstimator->WriteBlocks(fileout);
+    }
+    catch (const std::exception&) {
+        LogPrintf("CTxMemPool::AppendFeeEstimates(): unable to append policy estimator data (non-fatal)\n");
+        return false;
+    }
+    return true;
+}
+
+unsigned int CTxMemPool::GetFeeEstimatesJournalSize() const
+{
+    LOCK(cs);
+    return minerPolicyEstimator->GetJournalSize();
+}
+
 void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string strHash, double dPriorityDelta, const CAmount& nFeeDelta)
 {
     {
@@ -1079,6 +1135,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256 hash, const std::string str
         deltas.second += nFeeDelta;
         txiter it = mapTx.find(hash);
         if (it != mapTx.end()) {
+            InvalidateCluster(it);
             mapTx.modify(it, update_fee_delta(deltas.second));
             // Now update all ancestors' modified fees with descendants
             setEntries setAncestors;
@@ -1146,8 +1203,8 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) const {
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 15 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 15 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    // The nodes of mapTx, mapLinks, mapNextTx and the insight indexes all come from poolResource
+    return poolResource.DynamicMemoryUsage() + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(setClusterDirty) + nClusterUsage + cachedInnerUsage + nIndexUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
@@ -1186,25 +1243,33 @@ bool CTxMemPool::addUnchecked(const uint256&hash, const CTxMemPoolEntry &entry,
 
 void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    InvalidateCluster(entry);
+    InvalidateCluster(child);
+    linkEntries& children = mapLinks[entry].children;
+    cachedInnerUsage -= LinksUsage(children);
+    if (add) {
+        children.insert(child);
+    } else {
+        children.erase(child);
     }
+    cachedInnerUsage += LinksUsage(children);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    InvalidateCluster(entry);
+    InvalidateCluster(parent);
+    linkEntries& parents = mapLinks[entry].parents;
+    cachedInnerUsage -= LinksUsage(parents);
+    if (add) {
+        parents.insert(parent);
+    } else {
+        parents.erase(parent);
     }
+    cachedInnerUsage += LinksUsage(parents);
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPool::linkEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1212,7 +1277,7 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
     return it->second.parents;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPool::linkEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
     txlinksMap::const_iterator it = mapLinks.find(entry);
@@ -1220,6 +1285,225 @@ const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) cons
     return it->second.children;
 }
 
+static size_t ClusterUsage(const CTxMemPool::Cluster& cluster)
+{
+    return memusage::MallocUsage(sizeof(CTxMemPool::Cluster) + 2 * sizeof(int)) + memusage::DynamicUsage(cluster.vTxs) + memusage::DynamicUsage(cluster.vChunks);
+}
+
+void CTxMemPool::InvalidateCluster(txiter entry)
+{
+    txlinksMap::iterator lit = mapLinks.find(entry);
+    if (lit == mapLinks.end() || !lit->second.cluster)
+        return;
+    // Hold on to it, resetting the members' references would free it
+    ClusterRef cluster = lit->second.cluster;
+    nClusterUsage -= ClusterUsage(*cluster);
+    BOOST_FOREACH(txiter it, cluster->vTxs) {
+        mapLinks[it].cluster.reset();
+        setClusterDirty.insert(it);
+    }
+}
+
+namespace {
+struct ChunkBuilder {
+    std::vector<CTxMemPool::Cluster::Chunk>& vChunks;
+    explicit ChunkBuilder(std::vector<CTxMemPool::Cluster::Chunk>& vChunksIn) : vChunks(vChunksIn) {}
+
+    static bool Better(const CTxMemPool::Cluster::Chunk& a, const CTxMemPool::Cluster::Chunk& b)
+    {
+        // Same comparison as CompareTxMemPoolEntryByAncestorFee
+        return (double)a.nFee * b.nSize > (double)b.nFee * a.nSize;
+    }
+
+    /** Append a transaction, merging chunks until their feerates do not increase */
+    void Add(CAmount nFee, int64_t nSize)
+    {
+        CTxMemPool::Cluster::Chunk chunk;
+        chunk.nEnd = vChunks.empty() ? 1 : vChunks.back().nEnd + 1;
+        chunk.nFee = nFee;
+        chunk.nSize = nSize;
+        vChunks.push_back(chunk);
+        while (vChunks.size() > 1 && Better(vChunks.back(), vChunks[vChunks.size() - 2])) {
+            CTxMemPool::Cluster::Chunk& prev = vChunks[vChunks.size() - 2];
+            prev.nEnd = vChunks.back().nEnd;
+            prev.nFee += vChunks.back().nFee;
+            prev.nSize += vChunks.back().nSize;
+            vChunks.pop_back();
+        }
+    }
+};
+}
+
+CTxMemPool::ClusterRef CTxMemPool::LinearizeCluster(const std::vector<txiter>& vTxs, const txlinksMap& mapLinks)
+{
+    std::shared_ptr<Cluster> cluster = std::make_shared<Cluster>();
+    const size_t n = vTxs.size();
+    cluster->vTxs.reserve(n);
+    ChunkBuilder chunks(cluster->vChunks);
+
+    // Local indices and in-cluster parents
+    std::map<txiter, size_t, CompareIteratorByHash> mapIndex;
+    for (size_t i = 0; i < n; i++)
+        mapIndex[vTxs[i]] = i;
+    std::vector<std::vector<size_t> > vParents(n), vChildren(n);
+    std::vector<CAmount> vFee(n);
+    std::vector<int64_t> vSize(n);
+    for (size_t i = 0; i < n; i++) {
+        vFee[i] = vTxs[i]->GetModifiedFee();
+        vSize[i] = vTxs[i]->GetTxSize();
+        BOOST_FOREACH(txiter parent, mapLinks.find(vTxs[i])->second.parents) {
+            size_t p = mapIndex[parent];
+            vParents[i].push_back(p);
+            vChildren[p].push_back(i);
+        }
+    }
+
+    // A topological order, taking the best feerate among the transactions
+    // whose parents are all placed. It is the whole linearization for
+    // clusters too large for the quadratic pass below.
+    std::vector<size_t> vTopo;
+    vTopo.reserve(n);
+    {
+        std::vector<size_t> vMissing(n);
+        std::vector<std::pair<double, size_t> > heap;
+        for (size_t i = 0; i < n; i++) {
+            vMissing[i] = vParents[i].size();
+            if (vMissing[i] == 0)
+                heap.push_back(std::make_pair((double)vFee[i] / vSize[i], i));
+        }
+        std::make_heap(heap.begin(), heap.end());
+        while (!heap.empty()) {
+            std::pop_heap(heap.begin(), heap.end());
+            size_t i = heap.back().second;
+            heap.pop_back();
+            vTopo.push_back(i);
+            BOOST_FOREACH(size_t c, vChildren[i]) {
+                if (--vMissing[c] == 0) {
+                    heap.push_back(std::make_pair((double)vFee[c] / vSize[c], c));
+                    std::push_heap(heap.begin(), heap.end());
+                }
+            }
+        }
+        assert(vTopo.size() == n);
+    }
+
+    if (n > MAX_CLUSTER_LINEARIZATION_SIZE) {
+        BOOST_FOREACH(size_t i, vTopo) {
+            cluster->vTxs.push_back(vTxs[i]);
+            chunks.Add(vFee[i], vSize[i]);
+        }
+        return cluster;
+    }
+
+    // Ancestor sets within the cluster, listed in topological order
+    std::vector<size_t> vPos(n);
+    for (size_t k = 0; k < n; k++)
+        vPos[vTopo[k]] = k;
+    std::vector<std::vector<size_t> > vAncestors(n), vDescendants(n);
+    std::vector<char> vMark(n, 0);
+    BOOST_FOREACH(size_t i, vTopo) {
+        std::vector<size_t>& anc = vAncestors[i];
+        BOOST_FOREACH(size_t p, vParents[i]) {
+            BOOST_FOREACH(size_t a, vAncestors[p]) {
+                if (!vMark[a]) {
+                    vMark[a] = 1;
+                    anc.push_back(a);
+                }
+            }
+        }
+        BOOST_FOREACH(size_t a, anc)
+            vMark[a] = 0;
+        anc.push_back(i);
+        std::sort(anc.begin(), anc.end(), [&vPos](size_t a, size_t b) { return vPos[a] < vPos[b]; });
+        BOOST_FOREACH(size_t a, anc)
+            vDescendants[a].push_back(i);
+    }
+
+    // Repeatedly take the remaining ancestor set with the best feerate
+    std::vector<CAmount> vAncFee(n, 0);
+    std::vector<int64_t> vAncSize(n, 0);
+    for (size_t i = 0; i < n; i++) {
+        BOOST_FOREACH(size_t a, vAncestors[i]) {
+            vAncFee[i] += vFee[a];
+            vAncSize[i] += vSize[a];
+        }
+    }
+    std::vector<char> vDone(n, 0);
+    while (cluster->vTxs.size() < n) {
+        size_t best = n;
+        BOOST_FOREACH(size_t i, vTopo) {
+            if (vDone[i])
+                continue;
+            if (best == n || (double)vAncFee[i] * vAncSize[best] > (double)vAncFee[best] * vAncSize[i])
+                best = i;
+        }
+        BOOST_FOREACH(size_t a, vAncestors[best]) {
+            if (vDone[a])
+                continue;
+            vDone[a] = 1;
+            cluster->vTxs.push_back(vTxs[a]);
+            chunks.Add(vFee[a], vSize[a]);
+            BOOST_FOREACH(size_t d, vDescendants[a]) {
+                vAncFee[d] -= vFee[a];
+                vAncSize[d] -= vSize[a];
+            }
+        }
+    }
+    return cluster;
+}
+
+void CTxMemPool::UpdateClusters()
+{
+    AssertLockHeld(cs);
+    while (!setClusterDirty.empty()) {
+        // Everything connected to a dirty transaction is dirty too: any
+        // change to the links invalidates the clusters on both ends
+        std::vector<txiter> vTxs;
+        setEntries setSeen;
+        std::vector<txiter> vStack(1, *setClusterDirty.begin());
+        setSeen.insert(vStack.back());
+        while (!vStack.empty()) {
+            txiter it = vStack.back();
+            vStack.pop_back();
+            vTxs.push_back(it);
+            setClusterDirty.erase(it);
+            const TxLinks& links = mapLinks[it];
+            assert(!links.cluster);
+            BOOST_FOREACH(txiter parent, links.parents) {
+                if (setSeen.insert(parent).second)
+                    vStack.push_back(parent);
+            }
+            BOOST_FOREACH(txiter child, links.children) {
+                if (setSeen.insert(child).second)
+                    vStack.push_back(child);
+            }
+        }
+
+        ClusterRef cluster = LinearizeCluster(vTxs, mapLinks);
+        nClusterUsage += ClusterUsage(*cluster);
+        BOOST_FOREACH(txiter it, vTxs)
+            mapLinks[it].cluster = cluster;
+    }
+}
+
+void CTxMemPool::GetClusters(std::vector<ClusterRef>& vClusters)
+{
+    LOCK(cs);
+    UpdateClusters();
+    vClusters.clear();
+    for (txlinksMap::const_iterator it = mapLinks.begin(); it != mapLinks.end(); ++it) {
+        if (it->second.cluster->vTxs.front() == it->first)
+            vClusters.push_back(it->second.cluster);
+    }
+}
+
+CTxMemPool::ClusterRef CTxMemPool::GetCluster(txiter entry)
+{
+    LOCK(cs);
+    UpdateClusters();
+    return mapLinks[entry].cluster;
+}
+
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
     LOCK(cs);
     if (!blockSinceLastRollingFeeBump || rollingMinimumFeeRate == 0)
@@ -1294,7 +1578,7 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRe
     }
 
     if (maxFeeRateRemoved > CFeeRate(0))
-        LogPrint("mempool", "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
+        LogPrint(BCLog::MEMPOOL, "Removed %u txn, rolling minimum fee bumped to %s\n", nTxnRemoved, maxFeeRateRemoved.ToString());
 }
 
 bool CTxMemPool::TransactionWithinChainLimit(const uint256& txid, size_t chainLimit) const {
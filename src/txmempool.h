@@ -7,6 +7,7 @@
 #ifndef BITCOIN_TXMEMPOOL_H
 #define BITCOIN_TXMEMPOOL_H
 
+#include <algorithm>
 #include <memory>
 #include <set>
 #include <map>
@@ -17,7 +18,9 @@
 #include "amount.h"
 #include "coins.h"
 #include "indirectmap.h"
+#include "prevector.h"
 #include "primitives/transaction.h"
+#include "support/allocators/pool.h"
 #include "sync.h"
 #include "random.h"
 
@@ -62,6 +65,9 @@ inline bool AllowFree(double dPriority)
 /** Fake height value used in CCoins to signify they are only in the memory pool (since 0.8) */
 static const unsigned int MEMPOOL_HEIGHT = 0x7FFFFFFF;
 
+/** Clusters larger than this are linearized in a single topological pass instead of by ancestor sets */
+static const unsigned int MAX_CLUSTER_LINEARIZATION_SIZE = 500;
+
 struct LockPoints
 {
     // Will be set to the blockchain height and median time past
@@ -99,19 +105,21 @@ class CTxMemPool;
 class CTxMemPoolEntry
 {
 private:
+    // Ordered to keep padding out of the entry, which every mempool
+    // transaction pays for
     CTransactionRef tx;
     CAmount nFee;              //!< Cached to avoid expensive parent-transaction lookups
-    size_t nTxWeight;          //!< ... and avoid recomputing tx weight (also used for GetTxSize())
-    size_t nModSize;           //!< ... and modified size for priority
-    size_t nUsageSize;         //!< ... and total memory usage
     int64_t nTime;             //!< Local time when entering the mempool
     double entryPriority;      //!< Priority when entering the mempool
-    unsigned int entryHeight;  //!< Chain height when entering the mempool
     CAmount inChainInputValue; //!< Sum of all txin values that are already in blockchain
-    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
+    uint32_t nTxWeight;        //!< Cached to avoid recomputing tx weight (also used for GetTxSize())
+    uint32_t nModSize;         //!< ... and modified size for priority
+    uint32_t nUsageSize;       //!< ... and total memory usage
+    unsigned int entryHeight;  //!< Chain height when entering the mempool
+    bool spendsCoinbase;       //!< keep track of transactions that spend a coinbase
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -446,6 +454,10 @@ enum class MemPoolRemovalReason {
 class CTxMemPool
 {
 private:
+    //! Holds the nodes of mapTx, mapLinks, mapNextTx and the insight index
+    //! maps; declared first so it outlives them
+    PoolResource poolResource;
+
     uint32_t nCheckFrequency; //!< Value n means that n times in 2^32 we check.
     unsigned int nTransactionsUpdated; //!< Used by getblocktemplate to trigger CreateNewBlock() invocation
     CBlockPolicyEstimator* minerPolicyEstimator;
@@ -453,6 +465,9 @@ private:
     uint64_t totalTxSize;      //!< sum of all mempool tx's virtual sizes. Differs from serialized tx size since witness data is discounted. Defined in BIP 141.
     uint64_t cachedInnerUsage; //!< sum of dynamic memory usage of all the map elements (NOT the maps themselves)
 
+    bool fLoaded;           //!< Whether LoadMempool() has finished
+    double dLoadProgress;   //!< How far LoadMempool() has got through mempool.dat
+
     mutable int64_t lastRollingFeeUpdate;
     mutable bool blockSinceLastRollingFeeBump;
     mutable double rollingMinimumFeeRate; //!< minimum fee to get into the pool, decreases exponentially
@@ -492,7 +507,8 @@ public:
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByAncestorFee
             >
-        >
+        >,
+        PoolAllocator<CTxMemPoolEntry>
     > indexed_transaction_set;
 
     mutable CCriticalSection cs;
@@ -508,38 +524,127 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const;
-    const setEntries & GetMemPoolChildren(txiter entry) const;
+    /**
+     * The in-mempool parents or children of a transaction: a vector kept in
+     * setEntries order. Almost all transactions have no more than two, which
+     * are stored inline without any allocation.
+     */
+    class linkEntries
+    {
+    private:
+        typedef prevector<2, txiter> base;
+        base v;
+
+    public:
+        typedef base::const_iterator const_iterator;
+        typedef const_iterator iterator;
+
+        const_iterator begin() const { return v.begin(); }
+        const_iterator end() const { return v.end(); }
+        size_t size() const { return v.size(); }
+        bool empty() const { return v.empty(); }
+        size_t count(txiter it) const { return std::binary_search(v.begin(), v.end(), it, CompareIteratorByHash()); }
+        size_t allocated_memory() const { return v.allocated_memory(); }
+
+        bool insert(txiter it)
+        {
+            base::iterator pos = std::lower_bound(v.begin(), v.end(), it, CompareIteratorByHash());
+            if (pos != v.end() && !CompareIteratorByHash()(it, *pos))
+                return false;
+            v.insert(pos, it);
+            return true;
+        }
+
+        size_t erase(txiter it)
+        {
+            base::iterator pos = std::lower_bound(v.begin(), v.end(), it, CompareIteratorByHash());
+            if (pos == v.end() || CompareIteratorByHash()(it, *pos))
+                return 0;
+            v.erase(pos);
+            return 1;
+        }
+
+        operator setEntries() const { return setEntries(v.begin(), v.end()); }
+    };
+
+    const linkEntries & GetMemPoolParents(txiter entry) const;
+    const linkEntries & GetMemPoolChildren(txiter entry) const;
+
+    /**
+     * A maximal set of mempool transactions connected through spends, in
+     * the order they are best mined in (parents always first). The order is
+     * cut into chunks of non-increasing feerate which a miner takes whole or
+     * not at all, so merging the chunks of all clusters by feerate gives the
+     * order of a block.
+     */
+    struct Cluster {
+        struct Chunk {
+            size_t nEnd;     //!< one past the chunk's last transaction in vTxs
+            CAmount nFee;    //!< modified fees of the chunk
+            int64_t nSize;   //!< virtual size of the chunk
+        };
+        std::vector<txiter> vTxs;
+        std::vector<Chunk> vChunks;
+    };
+    typedef std::shared_ptr<const Cluster> ClusterRef;
+
+    /** Linearize the clusters changed since the last call and return them all */
+    void GetClusters(std::vector<ClusterRef>& vClusters);
+    /** The cluster entry belongs to, brought up to date */
+    ClusterRef GetCluster(txiter entry);
+
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        linkEntries parents;
+        linkEntries children;
+        //! Null while the transaction is in setClusterDirty
+        ClusterRef cluster;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
+    typedef std::map<txiter, TxLinks, CompareIteratorByHash, PoolAllocator<std::pair<const txiter, TxLinks> > > txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
+    //! Transactions whose cluster changed and has to be linearized again
+    setEntries setClusterDirty;
+    //! Dynamic memory usage of the clusters in mapLinks
+    size_t nClusterUsage;
+
+    // The insight indexes keep every key once, in mapAddress and mapSpent;
+    // the per-transaction lists used for removal point into those maps.
+    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare,
+                     PoolAllocator<std::pair<const CMempoolAddressDeltaKey, CMempoolAddressDelta> > > addressDeltaMap;
     addressDeltaMap mapAddress;
 
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
+    typedef std::map<uint256, std::vector<addressDeltaMap::iterator>, std::less<uint256>,
+                     PoolAllocator<std::pair<const uint256, std::vector<addressDeltaMap::iterator> > > > addressDeltaMapInserted;
     addressDeltaMapInserted mapAddressInserted;
 
-    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
+    typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare,
+                     PoolAllocator<std::pair<const CSpentIndexKey, CSpentIndexValue> > > mapSpentIndex;
     mapSpentIndex mapSpent;
 
-    typedef std::map<uint256, std::vector<CSpentIndexKey> > mapSpentIndexInserted;
+    typedef std::map<uint256, std::vector<mapSpentIndex::iterator>, std::less<uint256>,
+                     PoolAllocator<std::pair<const uint256, std::vector<mapSpentIndex::iterator> > > > mapSpentIndexInserted;
     mapSpentIndexInserted mapSpentInserted;
 
+    //! Dynamic memory usage of the vectors in mapAddressInserted and mapSpentInserted
+    size_t nIndexUsage;
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    /** Drop the linearization of entry's cluster, which a change is about to make stale */
+    void InvalidateCluster(txiter entry);
+    /** Build the clusters of everything in setClusterDirty */
+    void UpdateClusters();
+    static ClusterRef LinearizeCluster(const std::vector<txiter>& vTxs, const txlinksMap& mapLinks);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const;
 
 public:
-    indirectmap<COutPoint, const CTransaction*> mapNextTx;
+    indirectmap<COutPoint, const CTransaction*, PoolAllocator<std::pair<const COutPoint* const, const CTransaction*> > > mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -652,6 +757,30 @@ public:
     /** Returns false if the transaction is in the mempool and not within the chain limit specified. */
     bool TransactionWithinChainLimit(const uint256& txid, size_t chainLimit) const;
 
+    bool IsLoaded() const
+    {
+        LOCK(cs);
+        return fLoaded;
+    }
+
+    void SetIsLoaded(bool fLoadedIn)
+    {
+        LOCK(cs);
+        fLoaded = fLoadedIn;
+    }
+
+    double GetLoadProgress() const
+    {
+        LOCK(cs);
+        return dLoadProgress;
+    }
+
+    void SetLoadProgress(double dProgress)
+    {
+        LOCK(cs);
+        dLoadProgress = dProgress;
+    }
+
     unsigned long size()
     {
         LOCK(cs);
@@ -695,6 +824,10 @@ public:
     /** Write/Read estimates to disk */
     bool WriteFeeEstimates(CAutoFile& fileout) const;
     bool ReadFeeEstimates(CAutoFile& filein);
+    /** Append the blocks processed since the last write to a file written by WriteFeeEstimates */
+    bool AppendFeeEstimates(CAutoFile& fileout) const;
+    /** Number of blocks appended to the estimates file since it was last written in full */
+    unsigned int GetFeeEstimatesJournalSize() const;
 
     size_t DynamicMemoryUsage() const;
 
@@ -0,0 +1,242 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "txorphanage.h"
+
+#include "core_memusage.h"
+#include "policy/policy.h"
+#include "util.h"
+#include "utiltime.h"
+
+#include <string.h>
+
+TxOrphanage::TxOrphanage() : nUsage(0), nSequence(0), nNextSweep(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool TxOrphanage::AddTx(const CTransactionRef& tx, NodeId peer, size_t nMaxPeerUsage)
+{
+    LOCK(cs);
+    const uint256& hash = tx->GetHash();
+    if (mapOrphans.count(hash))
+        return false;
+
+    // Ignore big transactions, to avoid a
+    // send-big-orphans memory exhaustion attack. If a peer has a legitimate
+    // large transaction with a missing parent then we assume
+    // it will rebroadcast it later, after the parent transaction(s)
+    // have been mined or received.
+    // 100 orphans, each of which is at most 99,999 bytes big is
+    // at most 10 megabytes of orphans and somewhat more byprev index (in the worst case):
+    unsigned int sz = GetTransactionWeight(*tx);
+    const size_t nTxUsage = memusage::DynamicUsage(tx) + RecursiveDynamicUsage(*tx);
+    if (sz >= MAX_STANDARD_TX_WEIGHT || nTxUsage > nMaxPeerUsage)
+    {
+        LogPrint(BCLog::MEMPOOL, "ignoring large orphan tx (size: %u, hash: %s)\n", sz, hash.ToString());
+        return false;
+    }
+
+    // The peer's entry goes away with its last orphan
+    std::map<NodeId, PeerInfo>::iterator itPeer;
+    while ((itPeer = mapPeers.find(peer)) != mapPeers.end() && itPeer->second.nUsage + nTxUsage > nMaxPeerUsage)
+        EvictOldest(itPeer->second);
+    PeerInfo& info = mapPeers[peer];
+
+    auto ret = mapOrphans.emplace(hash, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME, nTxUsage, nSequence++});
+    assert(ret.second);
+    for (const CTxIn& txin : tx->vin) {
+        mapOrphansByPrev[txin.prevout].insert(ret.first);
+    }
+    info.mapBySequence.emplace(ret.first->second.nSequence, ret.first);
+    info.nUsage += nTxUsage;
+    nUsage += nTxUsage;
+    stats.nAdded++;
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u peer=%d peerusage %u)\n", hash.ToString(),
+             mapOrphans.size(), mapOrphansByPrev.size(), peer, info.nUsage);
+    return true;
+}
+
+bool TxOrphanage::HaveTx(const uint256& hash) const
+{
+    LOCK(cs);
+    return mapOrphans.count(hash);
+}
+
+int TxOrphanage::EraseTxInternal(const uint256& hash)
+{
+    AssertLockHeld(cs);
+    OrphanMap::iterator it = mapOrphans.find(hash);
+    if (it == mapOrphans.end())
+        return 0;
+    for (const CTxIn& txin : it->second.tx->vin)
+    {
+        auto itPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itPrev == mapOrphansByPrev.end())
+            continue;
+        itPrev->second.erase(it);
+        if (itPrev->second.empty())
+            mapOrphansByPrev.erase(itPrev);
+    }
+
+    std::map<NodeId, PeerInfo>::iterator itPeer = mapPeers.find(it->second.fromPeer);
+    assert(itPeer != mapPeers.end());
+    PeerInfo& info = itPeer->second;
+    info.mapBySequence.erase(it->second.nSequence);
+    info.setWork.erase(hash);
+    info.nUsage -= it->second.nUsage;
+    if (info.mapBySequence.empty())
+        mapPeers.erase(itPeer);
+    nUsage -= it->second.nUsage;
+
+    mapOrphans.erase(it);
+    return 1;
+}
+
+void TxOrphanage::EvictOldest(PeerInfo& info)
+{
+    AssertLockHeld(cs);
+    const uint256 hash = info.mapBySequence.begin()->second->first;
+    LogPrint(BCLog::MEMPOOL, "evicting orphan tx %s\n", hash.ToString());
+    // info is gone once its last orphan is
+    EraseTxInternal(hash);
+    stats.nEvicted++;
+}
+
+int TxOrphanage::EraseTx(const uint256& hash, bool fResolved)
+{
+    LOCK(cs);
+    int nErased = EraseTxInternal(hash);
+    if (fResolved)
+        stats.nResolved += nErased;
+    else
+        stats.nRejected += nErased;
+    return nErased;
+}
+
+void TxOrphanage::EraseForPeer(NodeId peer)
+{
+    LOCK(cs);
+    std::map<NodeId, PeerInfo>::iterator itPeer = mapPeers.find(peer);
+    if (itPeer == mapPeers.end())
+        return;
+    std::vector<uint256> vErase;
+    for (const auto& elem : itPeer->second.mapBySequence)
+        vErase.push_back(elem.second->first);
+    for (const uint256& hash : vErase)
+        EraseTxInternal(hash);
+    stats.nRemovedForPeer += vErase.size();
+    LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", vErase.size(), peer);
+}
+
+int TxOrphanage::EraseForBlockTx(const CTransaction& tx)
+{
+    LOCK(cs);
+    std::vector<uint256> vOrphanErase;
+    for (const CTxIn& txin : tx.vin) {
+        auto itByPrev = mapOrphansByPrev.find(txin.prevout);
+        if (itByPrev == mapOrphansByPrev.end()) continue;
+        for (auto mi = itByPrev->second.begin(); mi != itByPrev->second.end(); ++mi) {
+            vOrphanErase.push_back((*mi)->first);
+        }
+    }
+
+    int nErased = 0;
+    for (const uint256& orphanHash : vOrphanErase) {
+        nErased += EraseTxInternal(orphanHash);
+    }
+    stats.nRemovedForBlock += nErased;
+    return nErased;
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int nMaxOrphans)
+{
+    LOCK(cs);
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (nNextSweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime = nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        OrphanMap::iterator iter = mapOrphans.begin();
+        while (iter != mapOrphans.end())
+        {
+            OrphanMap::iterator maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow) {
+                nErased += EraseTxInternal(maybeErase->first);
+            } else {
+                nMinExpTime = std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+            }
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to batch the linear scan.
+        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        stats.nExpired += nErased;
+        if (nErased > 0) LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n", nErased);
+    }
+    while (mapOrphans.size() > nMaxOrphans)
+    {
+        // Evict from the peer taking the most memory
+        std::map<NodeId, PeerInfo>::iterator itLargest = mapPeers.begin();
+        for (std::map<NodeId, PeerInfo>::iterator it = mapPeers.begin(); it != mapPeers.end(); ++it) {
+            if (it->second.nUsage > itLargest->second.nUsage)
+                itLargest = it;
+        }
+        EvictOldest(itLargest->second);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void TxOrphanage::AddChildrenToWorkSet(const CTransaction& tx)
+{
+    LOCK(cs);
+    const uint256& hash = tx.GetHash();
+    for (unsigned int i = 0; i < tx.vout.size(); i++) {
+        auto itByPrev = mapOrphansByPrev.find(COutPoint(hash, i));
+        if (itByPrev == mapOrphansByPrev.end()) continue;
+        for (const auto& elem : itByPrev->second) {
+            mapPeers[elem->second.fromPeer].setWork.insert(elem->first);
+        }
+    }
+}
+
+bool TxOrphanage::HaveTxToReconsider(NodeId peer) const
+{
+    LOCK(cs);
+    std::map<NodeId, PeerInfo>::const_iterator it = mapPeers.find(peer);
+    return it != mapPeers.end() && !it->second.setWork.empty();
+}
+
+std::vector<CTransactionRef> TxOrphanage::GetTxToReconsider(NodeId peer, size_t nMax)
+{
+    LOCK(cs);
+    std::vector<CTransactionRef> vtx;
+    std::map<NodeId, PeerInfo>::iterator it = mapPeers.find(peer);
+    if (it == mapPeers.end())
+        return vtx;
+    std::set<uint256>& setWork = it->second.setWork;
+    while (!setWork.empty() && vtx.size() < nMax) {
+        vtx.push_back(mapOrphans.at(*setWork.begin()).tx);
+        setWork.erase(setWork.begin());
+    }
+    return vtx;
+}
+
+size_t TxOrphanage::Size() const
+{
+    LOCK(cs);
+    return mapOrphans.size();
+}
+
+TxOrphanage::Stats TxOrphanage::GetStats() const
+{
+    LOCK(cs);
+    Stats ret = stats;
+    ret.nOrphans = mapOrphans.size();
+    ret.nUsage = nUsage;
+    ret.nPeers = mapPeers.size();
+    ret.nOutpoints = mapOrphansByPrev.size();
+    return ret;
+}
@@ -0,0 +1,139 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include "coins.h"
+#include "net.h" // For NodeId
+#include "primitives/transaction.h"
+#include "sync.h"
+#include "uint256.h"
+
+#include <map>
+#include <set>
+#include <unordered_map>
+#include <vector>
+
+#include <stdint.h>
+
+/** Expiration time for orphan transactions in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum time between orphan transactions expire time checks in seconds */
+static const int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+
+/**
+ * Transactions whose inputs are not all known yet, kept until their parents
+ * show up.
+ *
+ * Every orphan is charged to the peer that sent it. A peer has a memory
+ * budget: an orphan that would take it over its budget evicts the oldest
+ * orphans of that same peer, and when the pool as a whole is over its limit,
+ * the peer taking the most memory loses its oldest orphan. A peer flooding
+ * orphans thus only ever pushes out its own.
+ *
+ * An index from outpoints to the orphans spending them finds the children of
+ * a new transaction directly. They go into the work set of the peer that sent
+ * them, which ProcessMessages goes through in batches on that peer's turn.
+ *
+ * All methods take an internal lock, so the orphanage does not need cs_main.
+ */
+class TxOrphanage
+{
+public:
+    struct Stats {
+        size_t nOrphans;
+        size_t nUsage;
+        size_t nPeers;
+        size_t nOutpoints;
+        uint64_t nAdded;
+        //! Accepted to the mempool once their parents arrived
+        uint64_t nResolved;
+        //! Found invalid once their parents arrived
+        uint64_t nRejected;
+        uint64_t nExpired;
+        //! Pushed out by the per-peer budgets or the limit on the whole pool
+        uint64_t nEvicted;
+        //! Spending the same inputs as a transaction in a block
+        uint64_t nRemovedForBlock;
+        //! Sent by a peer that disconnected
+        uint64_t nRemovedForPeer;
+    };
+
+    TxOrphanage();
+
+    /**
+     * Add an orphan sent by peer, evicting the peer's oldest orphans to keep
+     * it within nMaxPeerUsage bytes. Returns false if the orphan is known
+     * already, or too large to keep.
+     */
+    bool AddTx(const CTransactionRef& tx, NodeId peer, size_t nMaxPeerUsage);
+    bool HaveTx(const uint256& hash) const;
+
+    /** Drop an orphan after its parents arrived, counting it as resolved or rejected */
+    int EraseTx(const uint256& hash, bool fResolved);
+    /** Drop the orphans sent by a peer that disconnected */
+    void EraseForPeer(NodeId peer);
+    /** Drop the orphans spending any of the inputs of tx, which made it into a block */
+    int EraseForBlockTx(const CTransaction& tx);
+    /**
+     * Drop expired orphans, then evict from the peers taking the most memory
+     * until at most nMaxOrphans are left. Returns the number evicted.
+     */
+    unsigned int LimitOrphans(unsigned int nMaxOrphans);
+
+    /** Queue the orphans spending outputs of tx for another try, on the turn of the peers that sent them */
+    void AddChildrenToWorkSet(const CTransaction& tx);
+    bool HaveTxToReconsider(NodeId peer) const;
+    /** Take up to nMax orphans off the work set of peer */
+    std::vector<CTransactionRef> GetTxToReconsider(NodeId peer, size_t nMax);
+
+    size_t Size() const;
+    Stats GetStats() const;
+
+protected:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        //! Memory charged to fromPeer
+        size_t nUsage;
+        //! Order of arrival, to find the oldest orphans of a peer
+        uint64_t nSequence;
+    };
+    typedef std::map<uint256, OrphanTx> OrphanMap;
+
+    struct IteratorComparator
+    {
+        template<typename I>
+        bool operator()(const I& a, const I& b) const
+        {
+            return &(*a) < &(*b);
+        }
+    };
+
+    struct PeerInfo {
+        size_t nUsage;
+        //! The orphans of the peer, oldest first
+        std::map<uint64_t, OrphanMap::iterator> mapBySequence;
+        //! Orphans of the peer whose parents have arrived since they were added
+        std::set<uint256> setWork;
+
+        PeerInfo() : nUsage(0) {}
+    };
+
+    mutable CCriticalSection cs;
+    OrphanMap mapOrphans;
+    std::unordered_map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>, SaltedOutpointHasher> mapOrphansByPrev;
+    std::map<NodeId, PeerInfo> mapPeers;
+    size_t nUsage;
+    uint64_t nSequence;
+    int64_t nNextSweep;
+    Stats stats;
+
+    int EraseTxInternal(const uint256& hash);
+    void EvictOldest(PeerInfo& peer);
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
@@ -12,6 +12,7 @@
 
 #include "chainparamsbase.h"
 #include "fs.h"
+#include "logbuffer.h"
 #include "random.h"
 #include "serialize.h"
 #include "sync.h"
@@ -123,6 +124,9 @@ bool fLogIPs = DEFAULT_LOGIPS;
 std::atomic<bool> fReopenDebugLog(false);
 CTranslationInterface translationInterface;
 
+/** Log categories bitfield. */
+std::atomic<uint32_t> logCategories(0);
+
 /** Init OpenSSL library multithreading support */
 static CCriticalSection** ppmutexOpenSSL;
 void locking_callback(int mode, int i, const char* file, int line) NO_THREAD_SAFETY_ANALYSIS
@@ -200,6 +204,31 @@ static FILE* fileout = NULL;
 static boost::mutex* mutexDebugLog = NULL;
 static list<string> *vMsgsBeforeOpenLog;
 
+/** Lines and bytes of them the background writer may fall behind by */
+static const size_t LOG_BUFFER_SLOTS = 1 << 14;
+static const size_t LOG_BUFFER_BYTES = 16 << 20;
+/** How long the background writer sleeps when it may have missed a wakeup */
+static const int LOG_WRITER_IDLE_MILLIS = 100;
+
+/**
+ * The background writer and its queue. Like fileout, these are leaked on
+ * exit: a thread that raced StopLogWriter() may still push a line, which is
+ * then lost rather than crashing.
+ */
+static CLogBuffer* logBuffer = NULL;
+static boost::thread* threadLogWriter = NULL;
+static std::atomic<bool> fLogAsync(false);
+static std::atomic<bool> fLogWriterIdle(false);
+static std::atomic<bool> fStopLogWriter(false);
+static boost::mutex mutexLogWriter;
+static boost::condition_variable condLogWriter;
+
+/**
+ * fStartedNewLine suppresses printing of the timestamp when multiple calls
+ * are made that don't end in a newline.
+ */
+static std::atomic_bool fStartedNewLine(true);
+
 static int FileWriteStr(const std::string &str, FILE *fp)
 {
     return fwrite(str.data(), 1, str.size(), fp);
@@ -222,64 +251,91 @@ void OpenDebugLog()
     fs::path pathDebug = GetDataDir() / "debug.log";
     fileout = fsbridge::fopen(pathDebug, "a");
     if (fileout) {
-        setbuf(fileout, NULL); // unbuffered
         // dump buffered messages from before we opened the log
         while (!vMsgsBeforeOpenLog->empty()) {
             FileWriteStr(vMsgsBeforeOpenLog->front(), fileout);
             vMsgsBeforeOpenLog->pop_front();
         }
+        fflush(fileout);
     }
 
     delete vMsgsBeforeOpenLog;
     vMsgsBeforeOpenLog = NULL;
 }
 
-bool LogAcceptCategory(const char* category)
+struct CLogCategoryDesc
 {
-    if (category != NULL)
-    {
-        if (!fDebug)
-            return false;
-
-        // Give each thread quick access to -debug settings.
-        // This helps prevent issues debugging global destructors,
-        // where mapMultiArgs might be deleted before another
-        // global destructor calls LogPrint()
-        static boost::thread_specific_ptr<set<string> > ptrCategory;
-        if (ptrCategory.get() == NULL)
-        {
-            if (mapMultiArgs.count("-debug")) {
-                const vector<string>& categories = mapMultiArgs.at("-debug");
-                ptrCategory.reset(new set<string>(categories.begin(), categories.end()));
-                // thread_specific_ptr automatically deletes the set when the thread ends.
-            } else
-                ptrCategory.reset(new set<string>());
+    uint32_t flag;
+    std::string category;
+};
+
+const CLogCategoryDesc LogCategories[] =
+{
+    {BCLog::NONE, "0"},
+    {BCLog::NET, "net"},
+    {BCLog::TOR, "tor"},
+    {BCLog::MEMPOOL, "mempool"},
+    {BCLog::HTTP, "http"},
+    {BCLog::BENCH, "bench"},
+    {BCLog::ZMQ, "zmq"},
+    {BCLog::DB, "db"},
+    {BCLog::RPC, "rpc"},
+    {BCLog::ESTIMATEFEE, "estimatefee"},
+    {BCLog::ADDRMAN, "addrman"},
+    {BCLog::SELECTCOINS, "selectcoins"},
+    {BCLog::REINDEX, "reindex"},
+    {BCLog::CMPCTBLOCK, "cmpctblock"},
+    {BCLog::RAND, "rand"},
+    {BCLog::PRUNE, "prune"},
+    {BCLog::PROXY, "proxy"},
+    {BCLog::MEMPOOLREJ, "mempoolrej"},
+    {BCLog::LIBEVENT, "libevent"},
+    {BCLog::COINDB, "coindb"},
+    {BCLog::QT, "qt"},
+    {BCLog::LEVELDB, "leveldb"},
+    {BCLog::ALL, "1"},
+    {BCLog::ALL, "all"},
+};
+
+bool GetLogCategory(uint32_t* f, const std::string* str)
+{
+    if (f && str) {
+        if (*str == "") {
+            *f = BCLog::ALL;
+            return true;
         }
-        const set<string>& setCategories = *ptrCategory.get();
+        for (const CLogCategoryDesc& desc : LogCategories) {
+            if (desc.category == *str) {
+                *f = desc.flag;
+                return true;
+            }
+        }
+    }
+    return false;
+}
 
-        // if not debugging everything and not debugging specific category, LogPrint does nothing.
-        if (setCategories.count(string("")) == 0 &&
-            setCategories.count(string("1")) == 0 &&
-            setCategories.count(string(category)) == 0)
-            return false;
+std::string ListLogCategories()
+{
+    std::string ret;
+    for (const CLogCategoryDesc& desc : LogCategories) {
+        // Omit the special cases.
+        if (desc.flag != BCLog::NONE && desc.flag != BCLog::ALL) {
+            if (!ret.empty())
+                ret += ", ";
+            ret += desc.category;
+        }
     }
-    return true;
+    return ret;
 }
 
-/**
- * fStartedNewLine is a state variable held by the calling context that will
- * suppress printing of the timestamp when multiple calls are made that don't
- * end in a newline. Initialize it to true, and hold it, in the calling context.
- */
-static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fStartedNewLine)
+static std::string LogTimestampStr(const std::string &str, int64_t nTimeMicros)
 {
     string strStamped;
 
     if (!fLogTimestamps)
         return str;
 
-    if (*fStartedNewLine) {
-        int64_t nTimeMicros = GetLogTimeMicros();
+    if (fStartedNewLine) {
         strStamped = DateTimeStrFormat("%Y-%m-%d %H:%M:%S", nTimeMicros/1000000);
         if (fLogTimeMicros)
             strStamped += strprintf(".%06d", nTimeMicros%1000000);
@@ -288,31 +344,118 @@ static std::string LogTimestampStr(const std::string &str, std::atomic_bool *fSt
         strStamped = str;
 
     if (!str.empty() && str[str.size()-1] == '\n')
-        *fStartedNewLine = true;
+        fStartedNewLine = true;
     else
-        *fStartedNewLine = false;
+        fStartedNewLine = false;
 
     return strStamped;
 }
 
+/** Append to the open debug.log; mutexDebugLog must be held */
+static int WriteDebugLog(const std::string &str)
+{
+    // reopen the log file, if requested
+    if (fReopenDebugLog) {
+        fReopenDebugLog = false;
+        fs::path pathDebug = GetDataDir() / "debug.log";
+        fsbridge::freopen(pathDebug, "a", fileout);
+    }
+    if (fileout == NULL)
+        return 0;
+    return FileWriteStr(str, fileout);
+}
+
+static void LogWriterThread()
+{
+    RenameThread("trumpow-logwriter");
+    std::string str;
+    int64_t nTimeMicros;
+    uint64_t nDroppedLogged = 0;
+    while (true) {
+        // Read before draining, so that whatever was queued before the stop
+        // request still gets written
+        const bool fStop = fStopLogWriter;
+        bool fWrote = false;
+        {
+            boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
+            while (logBuffer->Pop(str, nTimeMicros)) {
+                WriteDebugLog(LogTimestampStr(str, nTimeMicros));
+                fWrote = true;
+            }
+            const uint64_t nDropped = logBuffer->GetDropped();
+            if (nDropped != nDroppedLogged) {
+                WriteDebugLog(LogTimestampStr(strprintf("Log writer fell behind, %u messages dropped\n", nDropped - nDroppedLogged), GetLogTimeMicros()));
+                nDroppedLogged = nDropped;
+                fWrote = true;
+            }
+            if (fWrote && fileout != NULL)
+                fflush(fileout);
+        }
+        if (fStop)
+            break;
+        if (!fWrote) {
+            boost::unique_lock<boost::mutex> lock(mutexLogWriter);
+            fLogWriterIdle = true;
+            // A line pushed just before fLogWriterIdle was set goes without
+            // a notification, hence the timeout
+            condLogWriter.timed_wait(lock, boost::posix_time::milliseconds(LOG_WRITER_IDLE_MILLIS));
+            fLogWriterIdle = false;
+        }
+    }
+}
+
+void StartLogWriter()
+{
+    boost::call_once(&DebugPrintInit, debugPrintInitFlag);
+    assert(threadLogWriter == NULL);
+    if (logBuffer == NULL)
+        logBuffer = new CLogBuffer(LOG_BUFFER_SLOTS, LOG_BUFFER_BYTES);
+    fStopLogWriter = false;
+    threadLogWriter = new boost::thread(&LogWriterThread);
+    fLogAsync = true;
+}
+
+void StopLogWriter()
+{
+    if (threadLogWriter == NULL)
+        return;
+    fLogAsync = false;
+    {
+        boost::unique_lock<boost::mutex> lock(mutexLogWriter);
+        fStopLogWriter = true;
+    }
+    condLogWriter.notify_one();
+    threadLogWriter->join();
+    delete threadLogWriter;
+    threadLogWriter = NULL;
+}
+
 int LogPrintStr(const std::string &str)
 {
     int ret = 0; // Returns total number of characters written
-    static std::atomic_bool fStartedNewLine(true);
-
-    string strTimestamped = LogTimestampStr(str, &fStartedNewLine);
 
     if (fPrintToConsole)
     {
+        string strTimestamped = LogTimestampStr(str, GetLogTimeMicros());
         // print to console
         ret = fwrite(strTimestamped.data(), 1, strTimestamped.size(), stdout);
         fflush(stdout);
     }
     else if (fPrintToDebugLog)
     {
+        // hand the line to the background writer, if there is one
+        if (fLogAsync) {
+            ret = str.size();
+            if (logBuffer->Push(std::string(str), GetLogTimeMicros()) && fLogWriterIdle)
+                condLogWriter.notify_one();
+            return ret;
+        }
+
         boost::call_once(&DebugPrintInit, debugPrintInitFlag);
         boost::mutex::scoped_lock scoped_lock(*mutexDebugLog);
 
+        string strTimestamped = LogTimestampStr(str, GetLogTimeMicros());
+
         // buffer if we haven't opened the log yet
         if (fileout == NULL) {
             assert(vMsgsBeforeOpenLog);
@@ -321,15 +464,8 @@ int LogPrintStr(const std::string &str)
         }
         else
         {
-            // reopen the log file, if requested
-            if (fReopenDebugLog) {
-                fReopenDebugLog = false;
-                fs::path pathDebug = GetDataDir() / "debug.log";
-                if (fsbridge::freopen(pathDebug,"a",fileout) != NULL)
-                    setbuf(fileout, NULL); // unbuffered
-            }
-
-            ret = FileWriteStr(strTimestamped, fileout);
+            ret = WriteDebugLog(strTimestamped);
+            fflush(fileout);
         }
     }
     return ret;
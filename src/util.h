@@ -36,6 +36,7 @@ int64_t GetStartupTime();
 static const bool DEFAULT_LOGTIMEMICROS = false;
 static const bool DEFAULT_LOGIPS        = false;
 static const bool DEFAULT_LOGTIMESTAMPS = true;
+static const bool DEFAULT_LOGASYNC      = true;
 
 /** Signals for translation. */
 class CTranslationInterface
@@ -56,6 +57,9 @@ extern bool fLogIPs;
 extern std::atomic<bool> fReopenDebugLog;
 extern CTranslationInterface translationInterface;
 
+/** Bitmask of the categories LogPrint() accepts, set from -debug */
+extern std::atomic<uint32_t> logCategories;
+
 extern const char * const BITCOIN_CONF_FILENAME;
 extern const char * const BITCOIN_PID_FILENAME;
 
@@ -72,11 +76,58 @@ inline std::string _(const char* psz)
 void SetupEnvironment();
 bool SetupNetworking();
 
+namespace BCLog {
+    enum LogFlags : uint32_t {
+        NONE        = 0,
+        NET         = (1 <<  0),
+        TOR         = (1 <<  1),
+        MEMPOOL     = (1 <<  2),
+        HTTP        = (1 <<  3),
+        BENCH       = (1 <<  4),
+        ZMQ         = (1 <<  5),
+        DB          = (1 <<  6),
+        RPC         = (1 <<  7),
+        ESTIMATEFEE = (1 <<  8),
+        ADDRMAN     = (1 <<  9),
+        SELECTCOINS = (1 << 10),
+        REINDEX     = (1 << 11),
+        CMPCTBLOCK  = (1 << 12),
+        RAND        = (1 << 13),
+        PRUNE       = (1 << 14),
+        PROXY       = (1 << 15),
+        MEMPOOLREJ  = (1 << 16),
+        LIBEVENT    = (1 << 17),
+        COINDB      = (1 << 18),
+        QT          = (1 << 19),
+        LEVELDB     = (1 << 20),
+        ALL         = ~(uint32_t)0,
+    };
+}
+
 /** Return true if log accepts specified category */
-bool LogAcceptCategory(const char* category);
+static inline bool LogAcceptCategory(uint32_t category)
+{
+    return (logCategories.load(std::memory_order_relaxed) & category) != 0;
+}
+
+/** Returns a string with the log categories, separated by ", " */
+std::string ListLogCategories();
+
+/** Return true if str parses as a log category and set the flag */
+bool GetLogCategory(uint32_t* f, const std::string* str);
+
 /** Send a string to the log output */
 int LogPrintStr(const std::string &str);
 
+/**
+ * Write debug.log from a background thread, so that logging only costs the
+ * caller a copy of the line. Lines are dropped, and their number logged,
+ * rather than blocking the caller when the writer falls behind.
+ */
+void StartLogWriter();
+/** Write out what is queued and return to writing from the calling thread */
+void StopLogWriter();
+
 #define LogPrint(category, ...) do { \
     if (LogAcceptCategory((category))) { \
         LogPrintStr(tfm::format(__VA_ARGS__)); \
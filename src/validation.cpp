@@ -7,16 +7,22 @@
 #include "validation.h"
 
 #include "arith_uint256.h"
+#include "blockcompress.h"
+#include "blockindexsnapshot.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "checkqueue.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "cuckoocache.h"
 #include "trumpow.h"
 #include "trumpow-fees.h"
 #include "hash.h"
+#include "headerstore.h"
 #include "init.h"
+#include "mappedfile.h"
+#include "perfstats.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
 #include "pow.h"
@@ -60,6 +66,7 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+CSharedCriticalSection cs_mapBlockIndex;
 CChain chainActive;
 CBlockIndex *pindexBestHeader = NULL;
 CWaitableCriticalSection csBestBlock;
@@ -68,6 +75,10 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 bool fReindex = false;
 bool fTxIndex = false;
+bool fMmapBlocks = DEFAULT_MMAP_BLOCKS;
+bool fCompressBlocks = DEFAULT_COMPRESS_BLOCKS;
+bool fBlockIndexSnapshot = DEFAULT_BLOCK_INDEX_SNAPSHOT;
+bool fAuxpowHeaderStore = DEFAULT_AUXPOW_HEADER_STORE;
 bool fAddressIndex = false;
 bool fTimestampIndex = false;
 bool fSpentIndex = false;
@@ -84,6 +95,9 @@ bool fEnableReplacement = DEFAULT_ENABLE_REPLACEMENT;
 
 uint256 hashAssumeValid;
 
+/** Block files mapped for ReadBlockFromDisk */
+static CMappedFileCache mappedBlockFiles(MAX_MAPPED_BLOCK_FILES);
+
 //mlumin 5/2021: Changing this variable to a fee rate, because that's what it is, not a fee. Confusion bad.
 CFeeRate minRelayTxFeeRate = CFeeRate(DEFAULT_MIN_RELAY_TX_FEE);
 CAmount maxTxFee = DEFAULT_TRANSACTION_MAXFEE;
@@ -243,7 +257,10 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewDB *pcoinsdbview = NULL;
 CBlockTreeDB *pblocktree = NULL;
+CIndexDB *pindexdb = NULL;
+CAuxpowHeaderStore *pauxpowheaders = NULL;
 
 enum FlushStateMode {
     FLUSH_STATE_NONE,
@@ -577,7 +594,7 @@ bool CheckTransaction(const CTransaction& tx, CValidationState &state, bool fChe
 void LimitMempoolSize(CTxMemPool& pool, size_t limit, unsigned long age) {
     int expired = pool.Expire(GetTime() - age);
     if (expired != 0)
-        LogPrint("mempool", "Expired %i transactions from the memory pool\n", expired);
+        LogPrint(BCLog::MEMPOOL, "Expired %i transactions from the memory pool\n", expired);
 
     std::vector<uint256> vNoSpendsRemaining;
     pool.TrimToSize(limit, &vNoSpendsRemaining);
@@ -606,9 +623,22 @@ static bool IsCurrentForFeeEstimation()
     return true;
 }
 
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev, const CChainParams& chainparams);
+
+/** The script flags a transaction has to pass to enter the mempool */
+static unsigned int GetMempoolScriptFlags()
+{
+    unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
+    return scriptVerifyFlags;
+}
+
 bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree,
                               bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache)
+                              bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<uint256>& vHashTxnToUncache,
+                              bool fTrustedScripts)
 {
     const CTransaction& tx = *ptx;
     const uint256 hash = tx.GetHash();
@@ -813,7 +843,7 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             // At default rate it would take over a month to fill 1GB
             if (dFreeCount + nSize >= GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000)
                 return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "rate limited free transaction");
-            LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
+            LogPrint(BCLog::MEMPOOL, "Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
             dFreeCount += nSize;
         }
 
@@ -977,46 +1007,50 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
             }
         }
 
-        unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags = GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+        unsigned int scriptVerifyFlags = GetMempoolScriptFlags();
 
         // Check against previous transactions
         // This is done last to help prevent CPU exhaustion denial-of-service attacks.
         PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, txdata)) {
+        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
             // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
             // need to turn both off, and compare against just turning off CLEANSTACK
             // to see if the failure is specifically due to witness validation.
             CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, txdata)) {
+            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
                 // Only the witness is missing, so the transaction itself may be fine.
                 state.SetCorruptionPossible();
             }
             return false; // state filled in by CheckInputs
         }
 
-        // Check again against just the consensus-critical mandatory script
-        // verification flags, in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
+        // Check again against the consensus rules the next block is held to,
+        // in case of bugs in the standard flags that cause transactions to
+        // pass as valid when they're actually invalid. For instance the
+        // STRICTENC flag was incorrectly allowing certain CHECKSIG NOT
+        // scripts to pass, even though they were invalid.
         //
         // There is a similar check in CreateNewBlock() to prevent creating
         // invalid blocks, however allowing such transactions into the mempool
-        // can be exploited as a DoS attack.
-        if (!CheckInputs(tx, state, view, true, MANDATORY_SCRIPT_VERIFY_FLAGS, true, txdata))
+        // can be exploited as a DoS attack. Using the next block's flags here
+        // also records the result in the script execution cache, which lets
+        // that check (and connecting the block) skip the scripts entirely.
+        //
+        // A transaction from a trusted mempool.dat went through this check
+        // when it entered the pool that was dumped, so it is not run again;
+        // connecting the block runs the scripts instead.
+        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), Params());
+        if (!fTrustedScripts && !CheckInputs(tx, state, view, true, currentBlockScriptVerifyFlags, true, true, txdata))
         {
-            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against MANDATORY but not STANDARD flags %s, %s",
+            return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against next-block but not STANDARD flags %s, %s",
                 __func__, hash.ToString(), FormatStateMessage(state));
         }
 
         // Remove conflicting transactions from the mempool
         BOOST_FOREACH(const CTxMemPool::txiter it, allConflicting)
         {
-            LogPrint("mempool", "replacing tx %s with %s for %s BTC additional fees, %d delta bytes\n",
+            LogPrint(BCLog::MEMPOOL, "replacing tx %s with %s for %s BTC additional fees, %d delta bytes\n",
                     it->GetTx().GetHash().ToString(),
                     hash.ToString(),
                     FormatMoney(nModifiedFees - nConflictingFees),
@@ -1059,10 +1093,11 @@ bool AcceptToMemoryPoolWorker(CTxMemPool& pool, CValidationState& state, const C
 
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
+                        bool fOverrideMempoolLimit, const CAmount nAbsurdFee, bool fTrustedScripts)
 {
+    PERF_TIMER("acceptmempool");
     std::vector<uint256> vHashTxToUncache;
-    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache);
+    bool res = AcceptToMemoryPoolWorker(pool, state, tx, fLimitFree, pfMissingInputs, nAcceptTime, plTxnReplaced, fOverrideMempoolLimit, nAbsurdFee, vHashTxToUncache, fTrustedScripts);
     if (!res) {
         BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
             pcoinsTip->Uncache(hashTx);
@@ -1085,7 +1120,7 @@ bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const
     if (!fTimestampIndex)
         return error("Timestamp index not enabled");
 
-    if (!pblocktree->ReadTimestampIndex(high, low, fActiveOnly, hashes))
+    if (!pindexdb->ReadTimestampIndex(high, low, fActiveOnly, hashes))
         return error("Unable to get hashes for timestamps");
 
     return true;
@@ -1099,7 +1134,7 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
     if (mempool.getSpentIndex(key, value))
         return true;
 
-    if (!pblocktree->ReadSpentIndex(key, value))
+    if (!pindexdb->ReadSpentIndex(key, value))
         return false;
 
     return true;
@@ -1107,13 +1142,19 @@ bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value)
 
 bool HashOnchainActive(const uint256 &hash)
 {
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
-
-    if (!chainActive.Contains(pblockindex)) {
+    CBlockIndex* pblockindex = LookupBlockIndex(hash);
+    if (!pblockindex)
         return false;
-    }
 
-    return true;
+    const CBlockIndex* pindexTip = chainActive.TipSnapshot();
+    return pindexTip && pindexTip->GetAncestor(pblockindex->nHeight) == pblockindex;
+}
+
+CBlockIndex* LookupBlockIndex(const uint256& hash)
+{
+    READ_LOCK(cs_mapBlockIndex);
+    BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+    return mi == mapBlockIndex.end() ? NULL : mi->second;
 }
 
 bool GetAddressIndex(uint160 addressHash, int type,
@@ -1122,7 +1163,7 @@ bool GetAddressIndex(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressIndex(addressHash, type, addressIndex, start, end))
+    if (!pindexdb->ReadAddressIndex(addressHash, type, addressIndex, start, end))
         return error("unable to get txids for address");
 
     return true;
@@ -1134,12 +1175,50 @@ bool GetAddressUnspent(uint160 addressHash, int type,
     if (!fAddressIndex)
         return error("address index not enabled");
 
-    if (!pblocktree->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
+    if (!pindexdb->ReadAddressUnspentIndex(addressHash, type, unspentOutputs))
         return error("unable to get txids for address");
 
     return true;
 }
 
+namespace {
+
+void DecompressDiskRecord(const char* pbegin, size_t nSize, std::vector<char>& vchRecord)
+{
+    if (!DecompressRecord(pbegin, nSize, vchRecord, MAX_SIZE))
+        throw std::ios_base::failure("DecompressDiskRecord(): corrupt compressed record");
+}
+
+/** The position of the size in front of the record at pos */
+CDiskBlockPos GetSizeFieldPos(const CDiskBlockPos& pos)
+{
+    if (pos.nPos < sizeof(uint32_t))
+        throw std::ios_base::failure("GetSizeFieldPos(): no record at " + pos.ToString());
+    return CDiskBlockPos(pos.nFile, pos.nPos - sizeof(uint32_t));
+}
+
+/**
+ * Read the size in front of a record from filein. If the record is stored
+ * compressed, read and decompress it into vchRecord and return true.
+ * Otherwise leave filein at the record.
+ */
+bool ReadCompressedRecord(CAutoFile& filein, std::vector<char>& vchRecord)
+{
+    unsigned int nSizeField;
+    filein >> nSizeField;
+    if (!(nSizeField & DISK_RECORD_COMPRESSED))
+        return false;
+    const unsigned int nSize = nSizeField & ~DISK_RECORD_COMPRESSED;
+    if (nSize > MAX_SIZE)
+        throw std::ios_base::failure("ReadCompressedRecord(): size too large");
+    std::vector<char> vchFrame(nSize);
+    filein.read(vchFrame.data(), vchFrame.size());
+    DecompressDiskRecord(vchFrame.data(), vchFrame.size(), vchRecord);
+    return true;
+}
+
+} // anon namespace
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock */
 bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus::Params& consensusParams, uint256 &hashBlock, bool fAllowSlow)
 {
@@ -1167,14 +1246,22 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
-            CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
-            if (file.IsNull())
-                return error("%s: OpenBlockFile failed", __func__);
             CBlockHeader header;
             try {
-                file >> header;
-                fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
-                file >> txOut;
+                CAutoFile file(OpenBlockFile(GetSizeFieldPos(postx), true), SER_DISK, CLIENT_VERSION);
+                if (file.IsNull())
+                    return error("%s: OpenBlockFile failed", __func__);
+                std::vector<char> vchRecord;
+                if (ReadCompressedRecord(file, vchRecord)) {
+                    CSpanReader reader(SER_DISK, CLIENT_VERSION, vchRecord.data(), vchRecord.data() + vchRecord.size());
+                    reader >> header;
+                    reader.ignore(postx.nTxOffset);
+                    reader >> txOut;
+                } else {
+                    file >> header;
+                    fseek(file.Get(), postx.nTxOffset, SEEK_CUR);
+                    file >> txOut;
+                }
             } catch (const std::exception& e) {
                 return error("%s: Deserialize or I/O error - %s", __func__, e.what());
             }
@@ -1223,27 +1310,146 @@ bool GetTransaction(const uint256 &hash, CTransactionRef &txOut, const Consensus
 // CBlock and CBlockIndex
 //
 
-bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+namespace {
+
+/**
+ * Whether the block files hold compressed records, which versions without
+ * -compressblocks cannot read. The block tree records it before the first
+ * one is written.
+ */
+std::atomic<bool> fHaveCompressedRecords(false);
+
+bool MarkCompressedRecords()
+{
+    if (fHaveCompressedRecords)
+        return true;
+    if (!pblocktree->WriteFlag("compressedrecords", true) || !pblocktree->Sync())
+        return error("%s: failed to write to block index database", __func__);
+    LogPrintf("Writing compressed block records: versions without -compressblocks can no longer read the block files\n");
+    fHaveCompressedRecords = true;
+    return true;
+}
+
+/**
+ * A block or undo record as written to disk after its size: the object
+ * itself, or with -compressblocks a compressed frame of its serialization if
+ * that is smaller.
+ */
+template<typename T>
+class CDiskRecord
+{
+public:
+    explicit CDiskRecord(const T& objIn, bool fCompress = fCompressBlocks) : obj(objIn)
+    {
+        nSizeField = ::GetSerializeSize(obj, SER_DISK, CLIENT_VERSION);
+        if (fCompress) {
+            CPooledDataStream ss(SER_DISK, CLIENT_VERSION);
+            ss << obj;
+            if (CompressRecord(ss.data(), ss.size(), vchFrame))
+                nSizeField = vchFrame.size() | DISK_RECORD_COMPRESSED;
+        }
+    }
+
+    /** The size written in front of the record, with the flag of a compressed frame */
+    unsigned int GetSizeField() const { return nSizeField; }
+    /** Bytes the record takes on disk, without its message start and size */
+    unsigned int GetDiskSize() const { return nSizeField & ~DISK_RECORD_COMPRESSED; }
+
+    template<typename Stream>
+    void Serialize(Stream& s) const
+    {
+        if (nSizeField & DISK_RECORD_COMPRESSED)
+            s.write(vchFrame.data(), vchFrame.size());
+        else
+            s << obj;
+    }
+
+private:
+    const T& obj;
+    unsigned int nSizeField;
+    std::vector<char> vchFrame;
+};
+
+/** Read a record from filein, which is at the size in front of it */
+template<typename T>
+void ReadDiskRecord(CAutoFile& filein, T& obj)
+{
+    std::vector<char> vchRecord;
+    if (ReadCompressedRecord(filein, vchRecord)) {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, vchRecord.data(), vchRecord.data() + vchRecord.size());
+        reader >> obj;
+    } else {
+        filein >> obj;
+    }
+}
+
+bool WriteBlockRecordToDisk(const CDiskRecord<CBlock>& record, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("WriteBlockToDisk: OpenBlockFile failed");
+    if ((record.GetSizeField() & DISK_RECORD_COMPRESSED) && !MarkCompressedRecords())
+        return false;
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << record.GetSizeField();
 
     // Write block
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("WriteBlockToDisk: ftell failed");
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    fileout << record;
 
     return true;
 }
 
+} // anon namespace
+
+bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
+{
+    return WriteBlockRecordToDisk(CDiskRecord<CBlock>(block), pos, messageStart);
+}
+
+/**
+ * Deserialize a block or its header straight from the mapped block file,
+ * within the size recorded in front of the block. Returns false if the file
+ * cannot be mapped, for the caller to read it through stdio instead.
+ */
+template<typename T>
+static bool ReadFromMappedBlockFile(T& block, const CDiskBlockPos& pos)
+{
+    if (pos.IsNull() || pos.nPos < sizeof(uint32_t))
+        return false;
+    const fs::path path = GetBlockPosFilename(pos, "blk");
+    std::shared_ptr<const CMappedFile> mapping = mappedBlockFiles.Get(path, pos.nPos);
+    if (!mapping)
+        return false;
+    const unsigned int nSizeField = ReadLE32((const unsigned char*)mapping->data() + pos.nPos - sizeof(uint32_t));
+    const unsigned int nSize = nSizeField & ~DISK_RECORD_COMPRESSED;
+    if (nSize > MAX_BLOCK_SERIALIZED_SIZE)
+        return false;
+    if ((uint64_t)pos.nPos + nSize > mapping->size()) {
+        // Written since the file was mapped
+        mapping = mappedBlockFiles.Get(path, pos.nPos + nSize);
+        if (!mapping)
+            return false;
+    }
+    mapping->WillRead(pos.nPos, nSize);
+    const char* pbegin = mapping->data() + pos.nPos;
+    if (nSizeField & DISK_RECORD_COMPRESSED) {
+        std::vector<char> vchRecord;
+        DecompressDiskRecord(pbegin, nSize, vchRecord);
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, vchRecord.data(), vchRecord.data() + vchRecord.size());
+        reader >> block;
+    } else {
+        CSpanReader reader(SER_DISK, CLIENT_VERSION, pbegin, pbegin + nSize);
+        reader >> block;
+    }
+    return true;
+}
+
 /* Generic implementation of block reading that can handle
    both a block and its header.  */
 
@@ -1252,14 +1458,15 @@ static bool ReadBlockOrHeader(T& block, const CDiskBlockPos& pos, const Consensu
 {
     block.SetNull();
 
-    // Open history file to read
-    CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
-
     // Read block
     try {
-        filein >> block;
+        if (!fMmapBlocks || !ReadFromMappedBlockFile(block, pos)) {
+            // Open history file to read
+            CAutoFile filein(OpenBlockFile(GetSizeFieldPos(pos), true), SER_DISK, CLIENT_VERSION);
+            if (filein.IsNull())
+                return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
+            ReadDiskRecord(filein, block);
+        }
     }
     catch (const std::exception& e) {
         return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pos.ToString());
@@ -1293,6 +1500,11 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return ReadBlockOrHeader(block, pindex, consensusParams, fCheckPOW);
 }
 
+bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW)
+{
+    return ReadBlockOrHeader(block, pos, consensusParams, fCheckPOW);
+}
+
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW)
 {
     return ReadBlockOrHeader(block, pindex, consensusParams, fCheckPOW);
@@ -1539,8 +1751,40 @@ bool CheckTxInputs(const CChainParams& params, const CTransaction& tx, CValidati
 }
 }// namespace Consensus
 
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
+/**
+ * Transactions whose scripts all passed with a given set of flags, so that
+ * validating a block template or a block made of mempool transactions does
+ * not have to run them again. Entries are SHA256(nonce || wtxid || flags).
+ */
+static CuckooCache::cache<uint256, SignatureCacheHasher> scriptExecutionCache;
+static uint256 scriptExecutionCacheNonce(GetRandHash());
+
+static uint256 ScriptExecutionCacheEntry(const CTransaction& tx, unsigned int flags)
+{
+    // The wtxid commits to the outpoints spent, and through their txids to
+    // the scripts and amounts of the coins spent, so a cached success with
+    // the same flags covers every input.
+    uint256 hashCacheEntry;
+    // Only the first 19 bytes of the nonce are used, to keep the whole
+    // preimage within a single SHA256 block
+    static_assert(55 - sizeof(flags) - 32 >= 128/8, "Want at least 128 bits of nonce for script execution cache");
+    CSHA256().Write(scriptExecutionCacheNonce.begin(), 55 - sizeof(flags) - 32).Write(tx.GetWitnessHash().begin(), 32).Write((unsigned char*)&flags, sizeof(flags)).Finalize(hashCacheEntry.begin());
+    return hashCacheEntry;
+}
+
+void InitScriptExecutionCache()
+{
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE)), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20) / 2;
+    size_t nElems = scriptExecutionCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for script execution cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
+
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks)
 {
+    PERF_TIMER("checkinputs");
     if (!tx.IsCoinBase())
     {
         if (!Consensus::CheckTxInputs(Params(), tx, state, inputs, GetSpendHeight(inputs)))
@@ -1559,13 +1803,18 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
         // Of course, if an assumed valid block is invalid due to false scriptSigs
         // this optimization would allow an invalid chain to be accepted.
         if (fScriptChecks) {
+            const uint256 hashCacheEntry = ScriptExecutionCacheEntry(tx, flags);
+            AssertLockHeld(cs_main); // CuckooCache is not thread safe on its own
+            if (scriptExecutionCache.contains(hashCacheEntry, !cacheFullScriptStore))
+                return true;
+
             for (unsigned int i = 0; i < tx.vin.size(); i++) {
                 const COutPoint &prevout = tx.vin[i].prevout;
                 const CCoins* coins = inputs.AccessCoins(prevout.hash);
                 assert(coins);
 
                 // Verify signature
-                CScriptCheck check(*coins, tx, i, flags, cacheStore, &txdata);
+                CScriptCheck check(*coins, tx, i, flags, cacheSigStore, &txdata);
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1578,7 +1827,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                         // avoid splitting the network between upgraded and
                         // non-upgraded nodes.
                         CScriptCheck check2(*coins, tx, i,
-                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheStore, &txdata);
+                                flags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS, cacheSigStore, &txdata);
                         if (check2())
                             return state.Invalid(false, REJECT_NONSTANDARD, strprintf("non-mandatory-script-verify-flag (%s)", ScriptErrorString(check.GetScriptError())));
                     }
@@ -1592,6 +1841,11 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
                     return state.DoS(100,false, REJECT_INVALID, strprintf("mandatory-script-verify-flag-failed (%s)", ScriptErrorString(check.GetScriptError())));
                 }
             }
+
+            if (cacheFullScriptStore && !pvChecks) {
+                // Every script ran, and passed, right here
+                scriptExecutionCache.insert(hashCacheEntry);
+            }
         }
     }
 
@@ -1600,15 +1854,14 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
-    // Open history file to read
-    CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (filein.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
     // Read block
     uint256 hashChecksum;
     try {
-        filein >> blockundo;
+        // Open history file to read
+        CAutoFile filein(OpenUndoFile(GetSizeFieldPos(pos), true), SER_DISK, CLIENT_VERSION);
+        if (filein.IsNull())
+            return error("%s: OpenUndoFile failed", __func__);
+        ReadDiskRecord(filein, blockundo);
         filein >> hashChecksum;
     }
     catch (const std::exception& e) {
@@ -1627,23 +1880,24 @@ bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uin
 
 namespace {
 
-bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
+bool UndoWriteToDisk(const CDiskRecord<CBlockUndo>& record, const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
     // Open history file to append
     CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
     if (fileout.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
+    if ((record.GetSizeField() & DISK_RECORD_COMPRESSED) && !MarkCompressedRecords())
+        return false;
 
     // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
+    fileout << FLATDATA(messageStart) << record.GetSizeField();
 
     // Write undo data
     long fileOutPos = ftell(fileout.Get());
     if (fileOutPos < 0)
         return error("%s: ftell failed", __func__);
     pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
+    fileout << record;
 
     // calculate & write checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
@@ -1864,10 +2118,10 @@ bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockI
     view.SetBestBlock(pindex->pprev->GetBlockHash());
 
     if (fAddressIndex) {
-        if (!pblocktree->EraseAddressIndex(addressIndex)) {
+        if (!pindexdb->EraseAddressIndex(addressIndex)) {
             return error("DisconnectBlock(): Failed to delete address index");
         }
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
+        if (!pindexdb->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return error("DisconnectBlock(): Failed to write address unspent index");
         }
     }
@@ -1912,6 +2166,158 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * The scripts of one transaction, checked as a unit on the mempool script
+ * check queue against one or more sets of flags in turn, so that the later
+ * sets find the signatures cached. The outcome of each set goes to its own
+ * flag instead of the queue, which would stop checking the other
+ * transactions on a failure.
+ */
+class CTxScriptCheck
+{
+private:
+    std::vector<CScriptCheck> vChecks;
+    //! For each set of flags, where its checks end in vChecks and its outcome
+    std::vector<std::pair<size_t, char*> > vSets;
+
+public:
+    void Add(std::vector<CScriptCheck>& vChecksIn, char* pfOk) {
+        for (size_t i = 0; i < vChecksIn.size(); i++) {
+            vChecks.push_back(CScriptCheck());
+            vChecks.back().swap(vChecksIn[i]);
+        }
+        vSets.push_back(std::make_pair(vChecks.size(), pfOk));
+    }
+
+    bool empty() const { return vSets.empty(); }
+
+    bool operator()() {
+        size_t i = 0;
+        for (size_t nSet = 0; nSet < vSets.size(); nSet++) {
+            *vSets[nSet].second = true;
+            for (; i < vSets[nSet].first; i++) {
+                if (!vChecks[i]()) {
+                    *vSets[nSet].second = false;
+                    break;
+                }
+            }
+            i = vSets[nSet].first;
+        }
+        return true;
+    }
+
+    void swap(CTxScriptCheck& check) {
+        vChecks.swap(check.vChecks);
+        vSets.swap(check.vSets);
+    }
+};
+
+static CCheckQueue<CTxScriptCheck> mempoolcheckqueue(8);
+
+void ThreadMempoolScriptCheck() {
+    RenameThread("trumpow-txcheck");
+    mempoolcheckqueue.Thread();
+}
+
+void PreVerifyTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx)
+{
+    if (!nScriptCheckThreads || vtx.empty())
+        return;
+
+    int64_t nTimeStart = GetTimeMicros();
+    std::vector<PrecomputedTransactionData> txdata;
+    txdata.reserve(vtx.size());
+    // One unit for each transaction, and for each of the mempool and the
+    // next-block flags it gets checked against, the cache entry it earns and
+    // the outcome
+    std::vector<CTxScriptCheck> vUnits;
+    std::vector<uint256> vEntries;
+    std::vector<char> vOk(2 * vtx.size(), false);
+    std::vector<uint256> vHashTxToUncache;
+    {
+        // Gather the coins spent and set up the script checks, which copy
+        // what they need of them
+        LOCK2(cs_main, pool.cs);
+        if (!chainActive.Tip())
+            return;
+        unsigned int flags[2] = { GetMempoolScriptFlags(), GetBlockScriptFlags(chainActive.Tip(), Params()) };
+        const bool witnessEnabled = IsWitnessEnabled(chainActive.Tip(), Params().GetConsensus(chainActive.Height()));
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        BOOST_FOREACH(const CTransactionRef& ptx, vtx) {
+            const CTransaction& tx = *ptx;
+            CValidationState state;
+            std::string reason;
+            // The cheap checks AcceptToMemoryPool starts with keep junk off the queue
+            if (tx.IsCoinBase() || !CheckTransaction(tx, state) || pool.exists(tx.GetHash()) ||
+                (tx.HasWitness() && !witnessEnabled) || (fRequireStandard && !IsStandardTx(tx, reason, witnessEnabled)) ||
+                !CheckFinalTx(tx, STANDARD_LOCKTIME_VERIFY_FLAGS))
+                continue;
+
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (!pcoinsTip->HaveCoinsInCache(txin.prevout.hash))
+                    vHashTxToUncache.push_back(txin.prevout.hash);
+            }
+            if (!view.HaveInputs(tx))
+                continue;
+
+            // And so do the policy checks AcceptToMemoryPool runs before the
+            // scripts: a transaction failing them never gets that far
+            if (fRequireStandard && (!AreInputsStandard(tx, view) || (tx.HasWitness() && !IsWitnessStandard(tx, view))))
+                continue;
+            const int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+            if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+                continue;
+            const unsigned int nSize = GetVirtualTransactionSize(tx, nSigOpsCost);
+            CAmount nModifiedFees = view.GetValueIn(tx) - tx.GetValueOut();
+            double nPriorityDummy = 0;
+            pool.ApplyDeltas(tx.GetHash(), nPriorityDummy, nModifiedFees);
+            if (nModifiedFees < pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize) ||
+                nModifiedFees < GetTrumpowMinRelayFee(tx, nSize, false))
+                continue;
+
+            txdata.emplace_back(tx);
+            CTxScriptCheck unit;
+            for (int i = 0; i < 2; i++) {
+                if (i == 1 && flags[1] == flags[0])
+                    break;
+                std::vector<CScriptCheck> vChecks;
+                if (!CheckInputs(tx, state, view, true, flags[i], true, true, txdata.back(), &vChecks))
+                    break;
+                // Nothing handed out when the result is cached already
+                if (vChecks.empty())
+                    continue;
+                vEntries.push_back(ScriptExecutionCacheEntry(tx, flags[i]));
+                unit.Add(vChecks, &vOk[vEntries.size() - 1]);
+            }
+            if (!unit.empty()) {
+                vUnits.push_back(CTxScriptCheck());
+                vUnits.back().swap(unit);
+            }
+        }
+    }
+
+    const size_t nUnits = vUnits.size();
+    if (nUnits) {
+        CCheckQueueControl<CTxScriptCheck> control(&mempoolcheckqueue);
+        control.Add(vUnits);
+        control.Wait();
+    }
+
+    // The entries hold whatever the tip is by now: they only say that the
+    // scripts pass with those flags. The coins pulled in for the checks are
+    // dropped again, as AcceptToMemoryPool does for transactions it rejects.
+    LOCK(cs_main);
+    for (size_t i = 0; i < vEntries.size(); i++) {
+        if (vOk[i])
+            scriptExecutionCache.insert(vEntries[i]);
+    }
+    BOOST_FOREACH(const uint256& hashTx, vHashTxToUncache)
+        pcoinsTip->Uncache(hashTx);
+    LogPrint(BCLog::BENCH, "    - Pre-verify scripts of %u out of %u transactions: %.2fms\n", nUnits, vtx.size(), (GetTimeMicros() - nTimeStart) * 0.001);
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -1965,10 +2371,49 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 
+/** Script verification flags for a block building on pindexPrev */
+static unsigned int GetBlockScriptFlags(const CBlockIndex* pindexPrev, const CChainParams& chainparams)
+{
+    AssertLockHeld(cs_main);
+
+    const int nHeight = pindexPrev->nHeight + 1;
+    const Consensus::Params& consensus = chainparams.GetConsensus(nHeight);
+
+    // BIP16 didn't become active until Apr 1 2012
+    // Trumpow: BIP16 has been enabled since inception
+    bool fStrictPayToScriptHash = true;
+
+    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
+
+    // Start enforcing the DERSIG (BIP66) rule
+    if (nHeight >= chainparams.GetConsensus(0).BIP66Height) {
+        flags |= SCRIPT_VERIFY_DERSIG;
+    }
+
+    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
+    if (nHeight >= chainparams.GetConsensus(0).BIP65Height) {
+        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
+    }
+
+    // Start enforcing BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    if (VersionBitsState(pindexPrev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
+        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    }
+
+    // Start enforcing WITNESS rules using versionbits logic.
+    if (IsWitnessEnabled(pindexPrev, consensus)) {
+        flags |= SCRIPT_VERIFY_WITNESS;
+        flags |= SCRIPT_VERIFY_NULLDUMMY;
+    }
+
+    return flags;
+}
+
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex,
-                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck)
+                  CCoinsViewCache& view, const CChainParams& chainparams, bool fJustCheck, BlockValidityTimings* pTimings)
 {
     AssertLockHeld(cs_main);
+    PERF_TIMER("connectblock");
 
     const Consensus::Params& consensus = Params().GetConsensus(pindex->nHeight);
     int64_t nTimeStart = GetTimeMicros();
@@ -1986,7 +2431,9 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     // is enforced in ContextualCheckBlockHeader(); we wouldn't want to
     // re-enforce that rule here (at least until we make it impossible for
     // GetAdjustedTime() to go backward).
-    if (!CheckBlock(block, state, !fJustCheck, !fJustCheck)) {
+    // TestBlockValidity(), the only caller passing fJustCheck, has just run
+    // CheckBlock() with at least the checks it would get here.
+    if (!fJustCheck && !CheckBlock(block, state, true, true)) {
         if (state.CorruptionPossible()) {
             LogPrintf("%s: Attempt to connect corrupted block %s.\n", __func__, block.GetHash().ToString());
             // We don't write down blocks to disk if they may have been
@@ -2036,7 +2483,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
-    LogPrint("bench", "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
+    LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs]\n", 0.001 * (nTime1 - nTimeStart), nTimeCheck * 0.000001);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
     // unless those are already completely spent.
@@ -2072,37 +2519,16 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         }
     }
 
-    // BIP16 didn't become active until Apr 1 2012
-    // Trumpow: BIP16 has been enabled since inception
-    bool fStrictPayToScriptHash = true;
-
-    unsigned int flags = fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE;
-
-    // Start enforcing the DERSIG (BIP66) rule
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP66Height) {
-        flags |= SCRIPT_VERIFY_DERSIG;
-    }
-
-    // Start enforcing CHECKLOCKTIMEVERIFY, (BIP65) for block.nVersion=4 blocks
-    if (pindex->nHeight >= chainparams.GetConsensus(0).BIP65Height) {
-        flags |= SCRIPT_VERIFY_CHECKLOCKTIMEVERIFY;
-    }
+    unsigned int flags = GetBlockScriptFlags(pindex->pprev, chainparams);
 
-    // Start enforcing BIP68 (sequence locks) and BIP112 (CHECKSEQUENCEVERIFY) using versionbits logic.
+    // Start enforcing BIP68 (sequence locks) along with BIP112 (CHECKSEQUENCEVERIFY)
     int nLockTimeFlags = 0;
-    if (VersionBitsState(pindex->pprev, consensus, Consensus::DEPLOYMENT_CSV, versionbitscache) == THRESHOLD_ACTIVE) {
-        flags |= SCRIPT_VERIFY_CHECKSEQUENCEVERIFY;
+    if (flags & SCRIPT_VERIFY_CHECKSEQUENCEVERIFY) {
         nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
     }
 
-    // Start enforcing WITNESS rules using versionbits logic.
-    if (IsWitnessEnabled(pindex->pprev, consensus)) {
-        flags |= SCRIPT_VERIFY_WITNESS;
-        flags |= SCRIPT_VERIFY_NULLDUMMY;
-    }
-
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
-    LogPrint("bench", "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
+    LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs]\n", 0.001 * (nTime2 - nTime1), nTimeForks * 0.000001);
 
     CBlockUndo blockundo;
 
@@ -2149,7 +2575,8 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
                                  REJECT_INVALID, "bad-txns-nonfinal");
             }
 
-            if (fAddressIndex || fSpentIndex)
+            // The index entries are only written for blocks actually connected
+            if (!fJustCheck && (fAddressIndex || fSpentIndex))
             {
                 for (size_t j = 0; j < tx.vin.size(); j++) {
 
@@ -2208,13 +2635,13 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : NULL))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
         }
 
-        if (fAddressIndex) {
+        if (!fJustCheck && fAddressIndex) {
             for (unsigned int k = 0; k < tx.vout.size(); k++) {
                 const CTxOut &out = tx.vout[k];
                 if (out.scriptPubKey.IsPayToScriptHash()) {
@@ -2268,7 +2695,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
         pos.nTxOffset += ::GetSerializeSize(tx, SER_DISK, CLIENT_VERSION);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
-    LogPrint("bench", "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
+    LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs]\n", (unsigned)block.vtx.size(), 0.001 * (nTime3 - nTime2), 0.001 * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : 0.001 * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * 0.000001);
 
     CAmount blockReward = nFees + GetTrumpowBlockSubsidy(pindex->nHeight, chainparams.GetConsensus(pindex->nHeight), hashPrevBlock);
     if (block.vtx[0]->GetValueOut() > blockReward)
@@ -2280,7 +2707,12 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     if (!control.Wait())
         return state.DoS(100, false);
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
-    LogPrint("bench", "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
+    LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs]\n", nInputs - 1, 0.001 * (nTime4 - nTime2), nInputs <= 1 ? 0 : 0.001 * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * 0.000001);
+    if (pTimings) {
+        pTimings->nConnect = nTime3 - nTime1;
+        pTimings->nVerify = nTime4 - nTime3;
+        pTimings->nInputs = nInputs - 1;
+    }
 
     if (fJustCheck)
         return true;
@@ -2290,9 +2722,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     {
         if (pindex->GetUndoPos().IsNull()) {
             CDiskBlockPos _pos;
-            if (!FindUndoPos(state, pindex->nFile, _pos, ::GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION) + 40))
+            const CDiskRecord<CBlockUndo> record(blockundo);
+            if (!FindUndoPos(state, pindex->nFile, _pos, record.GetDiskSize() + 40))
                 return error("ConnectBlock(): FindUndoPos failed");
-            if (!UndoWriteToDisk(blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
+            if (!UndoWriteToDisk(record, blockundo, _pos, pindex->pprev->GetBlockHash(), chainparams.MessageStart()))
                 return AbortNode(state, "Failed to write undo data");
 
             // update nUndoPos in block index
@@ -2309,17 +2742,17 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             return AbortNode(state, "Failed to write transaction index");
 
     if (fAddressIndex) {
-        if (!pblocktree->WriteAddressIndex(addressIndex)) {
+        if (!pindexdb->WriteAddressIndex(addressIndex)) {
             return AbortNode(state, "Failed to write address index");
         }
 
-        if (!pblocktree->UpdateAddressUnspentIndex(addressUnspentIndex)) {
+        if (!pindexdb->UpdateAddressUnspentIndex(addressUnspentIndex)) {
             return AbortNode(state, "Failed to write address unspent index");
         }
     }
 
     if (fSpentIndex)
-        if (!pblocktree->UpdateSpentIndex(spentIndex))
+        if (!pindexdb->UpdateSpentIndex(spentIndex))
             return AbortNode(state, "Failed to write transaction index");
 
     if (fTimestampIndex) {
@@ -2328,7 +2761,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
         // retrieve logical timestamp of the previous block
         if (pindex->pprev)
-            if (!pblocktree->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
+            if (!pindexdb->ReadTimestampBlockIndex(pindex->pprev->GetBlockHash(), prevLogicalTS))
                 LogPrintf("%s: Failed to read previous block's logical timestamp\n", __func__);
 
         if (logicalTS <= prevLogicalTS) {
@@ -2336,10 +2769,10 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
             LogPrintf("%s: Previous logical timestamp is newer Actual[%d] prevLogical[%d] Logical[%d]\n", __func__, pindex->nTime, prevLogicalTS, logicalTS);
         }
 
-        if (!pblocktree->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
+        if (!pindexdb->WriteTimestampIndex(CTimestampIndexKey(logicalTS, pindex->GetBlockHash())))
             return AbortNode(state, "Failed to write timestamp index");
 
-        if (!pblocktree->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
+        if (!pindexdb->WriteTimestampBlockIndex(CTimestampBlockIndexKey(pindex->GetBlockHash()), CTimestampBlockIndexValue(logicalTS)))
             return AbortNode(state, "Failed to write blockhash index");
     }
 
@@ -2347,7 +2780,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
-    LogPrint("bench", "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
+    LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs]\n", 0.001 * (nTime5 - nTime4), nTimeIndex * 0.000001);
 
     // Watch for changes to the previous coinbase transaction.
     static uint256 hashPrevBestCoinBase;
@@ -2356,7 +2789,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
-    LogPrint("bench", "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
+    LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs]\n", 0.001 * (nTime6 - nTime5), nTimeCallbacks * 0.000001);
 
     return true;
 }
@@ -2368,6 +2801,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
  * or always and in all cases if we're in prune mode and are deleting files.
  */
 bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int nManualPruneHeight) {
+    PERF_TIMER("flushstatetodisk");
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     const CChainParams& chainparams = Params();
     LOCK2(cs_main, cs_LastBlockFile);
@@ -2377,6 +2811,10 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
     std::set<int> setFilesToPrune;
     bool fFlushForPrune = false;
     try {
+    if (pcoinsdbview->HasFlushFailed())
+        return AbortNode(state, "Failed to write to coin database");
+    if (pindexdb->HasWriteFailed())
+        return AbortNode(state, "Failed to write to index database");
     if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
         if (nManualPruneHeight > 0) {
             FindFilesToPruneManual(setFilesToPrune, nManualPruneHeight);
@@ -2404,7 +2842,8 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
         nLastSetChain = nNow;
     }
     int64_t nMempoolSizeMax = GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-    int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+    // Entries the background writer still holds count against the cache
+    int64_t cacheSize = (pcoinsTip->DynamicMemoryUsage() + pcoinsdbview->GetPendingUsage()) * DB_PEAK_USAGE_FACTOR;
     int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
     // The cache is large and we're within 10% and 200 MiB or 50% and 50MiB of the limit, but we have time now (not in the middle of a block processing).
     bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::min(std::max(nTotalSpace / 2, nTotalSpace - MIN_BLOCK_COINSDB_USAGE * 1024 * 1024),
@@ -2422,6 +2861,13 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
         // Depend on nMinDiskSpace to ensure we can write block index
         if (!CheckDiskSpace(0))
             return state.Error("out of disk space");
+        // A chainstate write still in progress may need the blocks it is
+        // writing to be replayed, so let it finish before pruning any
+        if (fFlushForPrune && !pcoinsdbview->Sync())
+            return AbortNode(state, "Failed to write to coin database");
+        // The block index must not get ahead of the indexes of its blocks
+        if (!pindexdb->Sync())
+            return AbortNode(state, "Failed to write to index database");
         // First make sure all block and undo data is flushed to disk.
         FlushBlockFile();
         // Then update all block file information (which may refer to block and undo files).
@@ -2457,6 +2903,16 @@ bool static FlushStateToDisk(CValidationState &state, FlushStateMode mode, int n
         if (!CheckDiskSpace(128 * 2 * 2 * pcoinsTip->GetCacheSize()))
             return state.Error("out of disk space");
         // Flush the chainstate (which may refer to block index entries).
+        // Unless we are shutting down or pruning, the write goes to the
+        // background when a cut short write could be completed by replaying
+        // the blocks on top of the best block in the database.
+        if (!pcoinsdbview->Sync())
+            return AbortNode(state, "Failed to write to coin database");
+        if (mode != FLUSH_STATE_ALWAYS && !fFlushForPrune) {
+            BlockMap::iterator it = mapBlockIndex.find(pcoinsdbview->GetBestBlock());
+            if (it != mapBlockIndex.end() && chainActive.Contains(it->second))
+                pcoinsdbview->ScheduleBackgroundFlush(pcoinsTip->DynamicMemoryUsage());
+        }
         if (!pcoinsTip->Flush())
             return AbortNode(state, "Failed to write to coin database");
         nLastFlush = nNow;
@@ -2564,7 +3020,7 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         bool flushed = view.Flush();
         assert(flushed);
     }
-    LogPrint("bench", "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
+    LogPrint(BCLog::BENCH, "- Disconnect block: %.2fms\n", (GetTimeMicros() - nStart) * 0.001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
@@ -2625,6 +3081,7 @@ struct ConnectTrace {
 bool static ConnectTip(CValidationState& state, const CChainParams& chainparams, CBlockIndex* pindexNew, const std::shared_ptr<const CBlock>& pblock, ConnectTrace& connectTrace)
 {
     assert(pindexNew->pprev == chainActive.Tip());
+    PERF_TIMER("connecttip");
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
     if (!pblock) {
@@ -2639,7 +3096,7 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
-    LogPrint("bench", "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
+    LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * 0.001, nTimeReadFromDisk * 0.000001);
     {
         CCoinsViewCache view(pcoinsTip);
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2650,25 +3107,29 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
             return error("ConnectTip(): ConnectBlock %s failed", pindexNew->GetBlockHash().ToString());
         }
         nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
-        LogPrint("bench", "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
+        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs]\n", (nTime3 - nTime2) * 0.001, nTimeConnectTotal * 0.000001);
         bool flushed = view.Flush();
         assert(flushed);
     }
     int64_t nTime4 = GetTimeMicros(); nTimeFlush += nTime4 - nTime3;
-    LogPrint("bench", "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
+    LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs]\n", (nTime4 - nTime3) * 0.001, nTimeFlush * 0.000001);
     // Write the chain state to disk, if necessary.
     if (!FlushStateToDisk(state, FLUSH_STATE_IF_NEEDED))
         return false;
     int64_t nTime5 = GetTimeMicros(); nTimeChainState += nTime5 - nTime4;
-    LogPrint("bench", "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
+    LogPrint(BCLog::BENCH, "  - Writing chainstate: %.2fms [%.2fs]\n", (nTime5 - nTime4) * 0.001, nTimeChainState * 0.000001);
     // Remove conflicting transactions from the mempool.;
     mempool.removeForBlock(blockConnecting.vtx, pindexNew->nHeight);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
+    // Overwrites what a reorganization left at this height; a store still
+    // catching up is extended from the scheduler instead
+    if (pauxpowheaders && pindexNew->nHeight <= pauxpowheaders->Height())
+        pauxpowheaders->Write(pindexNew->nHeight, blockConnecting);
 
     int64_t nTime6 = GetTimeMicros(); nTimePostConnect += nTime6 - nTime5; nTimeTotal += nTime6 - nTime1;
-    LogPrint("bench", "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
-    LogPrint("bench", "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
+    LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs]\n", (nTime6 - nTime5) * 0.001, nTimePostConnect * 0.000001);
+    LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs]\n", (nTime6 - nTime1) * 0.001, nTimeTotal * 0.000001);
     return true;
 }
 
@@ -3079,18 +3540,22 @@ CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
     pindexNew->nSequenceId = 0;
-    BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
-    pindexNew->phashBlock = &((*mi).first);
-    BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
-    if (miPrev != mapBlockIndex.end())
     {
-        pindexNew->pprev = (*miPrev).second;
-        pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
-        pindexNew->BuildSkip();
+        // Lock-free readers must never see the entry half linked
+        WRITE_LOCK(cs_mapBlockIndex);
+        BlockMap::iterator mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
+        pindexNew->phashBlock = &((*mi).first);
+        BlockMap::iterator miPrev = mapBlockIndex.find(block.hashPrevBlock);
+        if (miPrev != mapBlockIndex.end())
+        {
+            pindexNew->pprev = (*miPrev).second;
+            pindexNew->nHeight = pindexNew->pprev->nHeight + 1;
+            pindexNew->BuildSkip();
+        }
+        pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
+        pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
+        pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     }
-    pindexNew->nTimeMax = (pindexNew->pprev ? std::max(pindexNew->pprev->nTimeMax, pindexNew->nTime) : pindexNew->nTime);
-    pindexNew->nChainWork = (pindexNew->pprev ? pindexNew->pprev->nChainWork : 0) + GetBlockProof(*pindexNew);
-    pindexNew->RaiseValidity(BLOCK_VALID_TREE);
     if (pindexBestHeader == NULL || pindexBestHeader->nChainWork < pindexNew->nChainWork)
         pindexBestHeader = pindexNew;
 
@@ -3597,8 +4062,11 @@ bool ProcessNewBlockHeaders(const std::vector<CBlockHeader>& headers, CValidatio
     return true;
 }
 
-/** Store block on disk. If dbp is non-NULL, the file is known to already reside on disk */
-static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, bool* fNewBlock)
+/**
+ * Store block on disk. If dbp is non-NULL, the file is known to already reside
+ * on disk, as a record of nDiskSize bytes after its size.
+ */
+static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidationState& state, const CChainParams& chainparams, CBlockIndex** ppindex, bool fRequested, const CDiskBlockPos* dbp, unsigned int nDiskSize, bool* fNewBlock)
 {
     const CBlock& block = *pblock;
 
@@ -3656,15 +4124,20 @@ static bool AcceptBlock(const std::shared_ptr<const CBlock>& pblock, CValidation
 
     // Write block to history file
     try {
-        unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
         CDiskBlockPos blockPos;
-        if (dbp != NULL)
+        if (dbp != NULL) {
+            // A block being reindexed is on disk already, as it is, which
+            // may be a compressed frame
             blockPos = *dbp;
-        if (!FindBlockPos(state, blockPos, nBlockSize+8, nHeight, block.GetBlockTime(), dbp != NULL))
-            return error("AcceptBlock(): FindBlockPos failed");
-        if (dbp == NULL)
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!FindBlockPos(state, blockPos, nDiskSize+8, nHeight, block.GetBlockTime(), true))
+                return error("AcceptBlock(): FindBlockPos failed");
+        } else {
+            const CDiskRecord<CBlock> record(block);
+            if (!FindBlockPos(state, blockPos, record.GetDiskSize()+8, nHeight, block.GetBlockTime()))
+                return error("AcceptBlock(): FindBlockPos failed");
+            if (!WriteBlockRecordToDisk(record, blockPos, chainparams.MessageStart()))
                 AbortNode(state, "Failed to write block");
+        }
         if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
             return error("AcceptBlock(): ReceivedBlockTransactions failed");
     } catch (const std::runtime_error& e) {
@@ -3703,7 +4176,7 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
 
         if (ret) {
             // Store to disk
-            ret = AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, NULL, fNewBlock);
+            ret = AcceptBlock(pblock, state, chainparams, &pindex, fForceProcessing, NULL, 0, fNewBlock);
         }
         CheckBlockIndex(chainparams.GetConsensus(chainActive.Height()));
         if (!ret) {
@@ -3721,7 +4194,7 @@ bool ProcessNewBlock(const CChainParams& chainparams, const std::shared_ptr<cons
     return true;
 }
 
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot)
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW, bool fCheckMerkleRoot, BlockValidityTimings* pTimings)
 {
     AssertLockHeld(cs_main);
     assert(pindexPrev && pindexPrev == chainActive.Tip());
@@ -3730,17 +4203,26 @@ bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams,
     indexDummy.pprev = pindexPrev;
     indexDummy.nHeight = pindexPrev->nHeight + 1;
 
+    BlockValidityTimings timings;
+    int64_t nTimeStart = GetTimeMicros();
+
     // NOTE: CheckBlockHeader is called by CheckBlock
     if (!ContextualCheckBlockHeader(block, state, pindexPrev, GetAdjustedTime()))
         return error("%s: Consensus::ContextualCheckBlockHeader: %s", __func__, FormatStateMessage(state));
+    int64_t nTime1 = GetTimeMicros(); timings.nHeader = nTime1 - nTimeStart;
     if (!CheckBlock(block, state, fCheckPOW, fCheckMerkleRoot))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
+    int64_t nTime2 = GetTimeMicros(); timings.nCheckBlock = nTime2 - nTime1;
     if (!ContextualCheckBlock(block, state, pindexPrev))
         return error("%s: Consensus::ContextualCheckBlock: %s", __func__, FormatStateMessage(state));
-    if (!ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true))
+    int64_t nTime3 = GetTimeMicros(); timings.nContextual = nTime3 - nTime2;
+    if (!ConnectBlock(block, state, &indexDummy, viewNew, chainparams, true, &timings))
         return false;
     assert(state.IsValid());
+    timings.nTotal = GetTimeMicros() - nTimeStart;
 
+    if (pTimings)
+        *pTimings = timings;
     return true;
 }
 
@@ -3799,6 +4281,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        mappedBlockFiles.Erase(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3876,12 +4359,297 @@ void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight
         }
     }
 
-    LogPrint("prune", "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
+    LogPrint(BCLog::PRUNE, "Prune: target=%dMiB actual=%dMiB diff=%dMiB max_prune_height=%d removed %d blk/rev pairs\n",
            nPruneTarget/1024/1024, nCurrentUsage/1024/1024,
            ((int64_t)nPruneTarget - (int64_t)nCurrentUsage)/1024/1024,
            nLastBlockWeCanPrune, count);
 }
 
+namespace {
+
+/** A block or its undo data in a block file being recompressed */
+struct CRecompressEntry
+{
+    CBlockIndex* pindex;
+    bool fUndo;
+    unsigned int nPos;
+    unsigned int nPosNew;
+
+    CRecompressEntry(CBlockIndex* pindexIn, bool fUndoIn) : pindex(pindexIn), fUndo(fUndoIn), nPos(fUndoIn ? pindexIn->nUndoPos : pindexIn->nDataPos), nPosNew(0) {}
+
+    bool operator<(const CRecompressEntry& other) const { return nPos < other.nPos; }
+};
+
+fs::path GetRecompressedFilename(int nFile, const char* prefix)
+{
+    return GetBlockPosFilename(CDiskBlockPos(nFile, 0), prefix).string() + ".new";
+}
+
+void RemoveRecompressedFiles(int nFile)
+{
+    fs::remove(GetRecompressedFilename(nFile, "blk"));
+    fs::remove(GetRecompressedFilename(nFile, "rev"));
+}
+
+/** Move the rewritten files of a recompressed block file over the old ones */
+bool MoveRecompressedFiles(int nFile)
+{
+    const char* prefixes[] = {"blk", "rev"};
+    for (const char* prefix : prefixes) {
+        const fs::path pathNew = GetRecompressedFilename(nFile, prefix);
+        if (fs::exists(pathNew) && !RenameOver(pathNew, GetBlockPosFilename(CDiskBlockPos(nFile, 0), prefix)))
+            return false;
+    }
+    mappedBlockFiles.Erase(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    return pblocktree->WriteRecompressedFileMoved(nFile);
+}
+
+/**
+ * Copy the record at nPos in filein, and the nTrailer bytes after it, to the
+ * end of fileout, compressed if it was not yet and that makes it smaller.
+ * Returns whether it was compressed here; nPosOut is set to its new position.
+ * If pvchRecord is given, the record is returned in it decompressed.
+ */
+bool CopyRecompressed(CAutoFile& filein, unsigned int nPos, unsigned int nTrailer, CAutoFile& fileout, const CMessageHeader::MessageStartChars& messageStart, unsigned int& nPosOut, std::vector<char>* pvchRecord)
+{
+    if (nPos < sizeof(uint32_t) || fseek(filein.Get(), nPos - sizeof(uint32_t), SEEK_SET))
+        throw std::ios_base::failure("CopyRecompressed(): fseek failed");
+    unsigned int nSizeField;
+    filein >> nSizeField;
+    const unsigned int nSize = nSizeField & ~DISK_RECORD_COMPRESSED;
+    if (nSize > MAX_SIZE)
+        throw std::ios_base::failure("CopyRecompressed(): size too large");
+    std::vector<char> vchStored(nSize + nTrailer), vchFrame;
+    filein.read(vchStored.data(), vchStored.size());
+
+    bool fCompressed = false;
+    if (nSizeField & DISK_RECORD_COMPRESSED) {
+        if (pvchRecord)
+            DecompressDiskRecord(vchStored.data(), nSize, *pvchRecord);
+    } else {
+        if (CompressRecord(vchStored.data(), nSize, vchFrame)) {
+            nSizeField = vchFrame.size() | DISK_RECORD_COMPRESSED;
+            fCompressed = true;
+        }
+        if (pvchRecord)
+            pvchRecord->assign(vchStored.begin(), vchStored.begin() + nSize);
+    }
+
+    if (fCompressed && !MarkCompressedRecords())
+        throw std::ios_base::failure("CopyRecompressed(): cannot mark the block files compressed");
+    fileout << FLATDATA(messageStart) << nSizeField;
+    long fileOutPos = ftell(fileout.Get());
+    if (fileOutPos < 0)
+        throw std::ios_base::failure("CopyRecompressed(): ftell failed");
+    nPosOut = (unsigned int)fileOutPos;
+    if (fCompressed) {
+        fileout.write(vchFrame.data(), vchFrame.size());
+        fileout.write(vchStored.data() + nSize, nTrailer);
+    } else {
+        fileout.write(vchStored.data(), vchStored.size());
+    }
+    return fCompressed;
+}
+
+} // anon namespace
+
+bool RecompressBlockFile(int nFile, const CChainParams& chainparams)
+{
+    std::vector<CRecompressEntry> vBlocks, vUndos;
+    CBlockFileInfo infoOld;
+    {
+        LOCK2(cs_main, cs_LastBlockFile);
+        if (nFile < 0 || nFile >= nLastBlockFile || vinfoBlockFile[nFile].nSize == 0)
+            return false;
+        infoOld = vinfoBlockFile[nFile];
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex) {
+            CBlockIndex* pindex = item.second;
+            if (pindex->nFile != nFile)
+                continue;
+            if (pindex->nStatus & BLOCK_HAVE_DATA)
+                vBlocks.push_back(CRecompressEntry(pindex, false));
+            if (pindex->nStatus & BLOCK_HAVE_UNDO)
+                vUndos.push_back(CRecompressEntry(pindex, true));
+        }
+    }
+    if (vBlocks.empty()) {
+        pblocktree->WriteRecompressedFileMoved(nFile);
+        return false;
+    }
+    // Keep the records in the order they were written
+    std::sort(vBlocks.begin(), vBlocks.end());
+    std::sort(vUndos.begin(), vUndos.end());
+
+    // Write the new files next to the old ones, which stay in use meanwhile
+    const CDiskBlockPos posFile(nFile, 0);
+    std::vector<std::pair<uint256, CDiskTxPos> > vTxPos;
+    bool fChanged = false;
+    unsigned int nSizeNew = 0, nUndoSizeNew = infoOld.nUndoSize;
+    try {
+        CAutoFile fileBlocks(OpenBlockFile(posFile, true), SER_DISK, CLIENT_VERSION);
+        CAutoFile fileBlocksNew(fsbridge::fopen(GetRecompressedFilename(nFile, "blk"), "wb"), SER_DISK, CLIENT_VERSION);
+        if (fileBlocks.IsNull() || fileBlocksNew.IsNull())
+            throw std::ios_base::failure("cannot open block file");
+        std::vector<char> vchRecord;
+        for (CRecompressEntry& entry : vBlocks) {
+            if (ShutdownRequested())
+                throw std::ios_base::failure("shutting down");
+            fChanged |= CopyRecompressed(fileBlocks, entry.nPos, 0, fileBlocksNew, chainparams.MessageStart(), entry.nPosNew, fTxIndex ? &vchRecord : NULL);
+            if (!fTxIndex)
+                continue;
+            // Move the transaction index entries that point into the block along with it
+            CBlock block;
+            CSpanReader reader(SER_DISK, CLIENT_VERSION, vchRecord.data(), vchRecord.data() + vchRecord.size());
+            reader >> block;
+            for (const CTransactionRef& tx : block.vtx) {
+                CDiskTxPos postx;
+                if (pblocktree->ReadTxIndex(tx->GetHash(), postx) && postx.nFile == nFile && postx.nPos == entry.nPos)
+                    vTxPos.push_back(std::make_pair(tx->GetHash(), CDiskTxPos(CDiskBlockPos(nFile, entry.nPosNew), postx.nTxOffset)));
+            }
+        }
+        nSizeNew = ftell(fileBlocksNew.Get());
+        FileCommit(fileBlocksNew.Get());
+
+        if (!vUndos.empty()) {
+            CAutoFile fileUndo(OpenUndoFile(posFile, true), SER_DISK, CLIENT_VERSION);
+            CAutoFile fileUndoNew(fsbridge::fopen(GetRecompressedFilename(nFile, "rev"), "wb"), SER_DISK, CLIENT_VERSION);
+            if (fileUndo.IsNull() || fileUndoNew.IsNull())
+                throw std::ios_base::failure("cannot open undo file");
+            for (CRecompressEntry& entry : vUndos) {
+                if (ShutdownRequested())
+                    throw std::ios_base::failure("shutting down");
+                // The checksum after the undo data goes along with it
+                fChanged |= CopyRecompressed(fileUndo, entry.nPos, sizeof(uint256), fileUndoNew, chainparams.MessageStart(), entry.nPosNew, NULL);
+            }
+            nUndoSizeNew = ftell(fileUndoNew.Get());
+            FileCommit(fileUndoNew.Get());
+        }
+    } catch (const std::exception& e) {
+        RemoveRecompressedFiles(nFile);
+        return error("%s: recompressing blk/rev%05u.dat failed: %s", __func__, nFile, e.what());
+    }
+    if (!fChanged) {
+        // Everything in it is stored compressed already, or does not compress
+        RemoveRecompressedFiles(nFile);
+        pblocktree->WriteRecompressedFileMoved(nFile);
+        return false;
+    }
+
+    {
+        LOCK2(cs_main, cs_LastBlockFile);
+        // Give up if blocks or undo data were written to the files, or
+        // they were pruned, while they were being rewritten
+        const CBlockFileInfo& info = vinfoBlockFile[nFile];
+        bool fUnchanged = info.nSize == infoOld.nSize && info.nUndoSize == infoOld.nUndoSize && info.nBlocks == infoOld.nBlocks;
+        for (const CRecompressEntry& entry : vBlocks)
+            fUnchanged &= entry.pindex->nFile == nFile && (entry.pindex->nStatus & BLOCK_HAVE_DATA) && entry.pindex->nDataPos == entry.nPos;
+        for (const CRecompressEntry& entry : vUndos)
+            fUnchanged &= entry.pindex->nFile == nFile && (entry.pindex->nStatus & BLOCK_HAVE_UNDO) && entry.pindex->nUndoPos == entry.nPos;
+        if (!fUnchanged) {
+            RemoveRecompressedFiles(nFile);
+            LogPrintf("%s: blk/rev%05u.dat changed while being recompressed\n", __func__, nFile);
+            return false;
+        }
+
+        std::set<CBlockIndex*> setChanged;
+        for (const CRecompressEntry& entry : vBlocks) {
+            entry.pindex->nDataPos = entry.nPosNew;
+            setChanged.insert(entry.pindex);
+        }
+        for (const CRecompressEntry& entry : vUndos) {
+            entry.pindex->nUndoPos = entry.nPosNew;
+            setChanged.insert(entry.pindex);
+        }
+        vinfoBlockFile[nFile].nSize = nSizeNew;
+        vinfoBlockFile[nFile].nUndoSize = nUndoSizeNew;
+
+        // The index points at the new files from here on, even if they are
+        // only moved into place on the next startup
+        std::vector<const CBlockIndex*> vChanged(setChanged.begin(), setChanged.end());
+        if (!pblocktree->WriteRecompressedFile(nFile, vinfoBlockFile[nFile], vChanged, vTxPos))
+            return AbortNode("Failed to write block index of recompressed block file");
+        if (!MoveRecompressedFiles(nFile))
+            return AbortNode("Failed to move recompressed block file into place");
+    }
+    LogPrintf("Recompressed blk/rev%05u.dat from %u to %u bytes\n", nFile,
+        infoOld.nSize + infoOld.nUndoSize, nSizeNew + nUndoSizeNew);
+    return true;
+}
+
+void RecompressBlockFiles()
+{
+    // Files below this have been dealt with since startup
+    static int nNextFile = 0;
+    if (fImporting || fReindex || IsInitialBlockDownload())
+        return;
+
+    int nLastFile;
+    {
+        LOCK(cs_LastBlockFile);
+        nLastFile = nLastBlockFile;
+    }
+    for (; nNextFile < nLastFile; nNextFile++) {
+        bool fPending;
+        if (pblocktree->ReadRecompressedFile(nNextFile, fPending))
+            continue;
+        // One file at a time; one that changed meanwhile is retried after a restart
+        RecompressBlockFile(nNextFile++, Params());
+        return;
+    }
+}
+
+void ExtendAuxpowHeaderStore()
+{
+    if (!pauxpowheaders || fImporting || fReindex)
+        return;
+
+    // Gather where the headers are under cs_main, and read them without it
+    const CChainParams& chainparams = Params();
+    const int nStart = pauxpowheaders->Height();
+    std::vector<CBlockHeader> vHeaders;
+    std::vector<CDiskBlockPos> vPos;
+    std::vector<uint256> vHashes;
+    {
+        LOCK(cs_main);
+        for (int nHeight = nStart; nHeight <= chainActive.Height() && nHeight < nStart + AUXPOW_HEADER_STORE_BATCH; nHeight++) {
+            const CBlockIndex* pindex = chainActive[nHeight];
+            // Only the version matters of a header without auxpow: the
+            // store holds nothing for it
+            CBlockHeader header;
+            header.nVersion = pindex->nVersion;
+            if (header.IsAuxpow() && !(pindex->nStatus & BLOCK_HAVE_DATA))
+                break;
+            vHeaders.push_back(header);
+            vPos.push_back(header.IsAuxpow() ? pindex->GetBlockPos() : CDiskBlockPos());
+            vHashes.push_back(pindex->GetBlockHash());
+        }
+    }
+    if (vHeaders.empty()) {
+        // Write out what ConnectTip added
+        pauxpowheaders->Flush();
+        return;
+    }
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        if (vPos[i].IsNull())
+            continue;
+        if (!ReadBlockHeaderFromDisk(vHeaders[i], vPos[i], chainparams.GetConsensus(nStart + i), false) || vHeaders[i].GetHash() != vHashes[i]) {
+            vHeaders.resize(i);
+            break;
+        }
+    }
+
+    LOCK(cs_main);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        const int nHeight = nStart + i;
+        // Unless the chain was reorganized meanwhile
+        if (nHeight > chainActive.Height() || chainActive[nHeight]->GetBlockHash() != vHashes[i])
+            break;
+        if (!pauxpowheaders->Write(nHeight, vHeaders[i]))
+            break;
+    }
+    pauxpowheaders->Flush();
+}
+
 bool CheckDiskSpace(uint64_t nAdditionalBytes)
 {
     uint64_t nFreeBytesAvailable = fs::space(GetDataDir()).available;
@@ -3943,31 +4711,80 @@ CBlockIndex * InsertBlockIndex(uint256 hash)
     CBlockIndex* pindexNew = new CBlockIndex();
     if (!pindexNew)
         throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    WRITE_LOCK(cs_mapBlockIndex);
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
-bool static LoadBlockIndexDB(const CChainParams& chainparams)
+static fs::path GetBlockIndexSnapshotPath()
+{
+    return GetDataDir() / "blocks" / "index.snapshot";
+}
+
+BlockIndexSnapshotState GetBlockIndexSnapshotState(uint64_t nId)
+{
+    BlockIndexSnapshotState state;
+    state.nId = nId;
+    int nFile = 0;
+    CBlockFileInfo info;
+    if (pblocktree->ReadLastBlockFile(nFile))
+        pblocktree->ReadBlockFileInfo(nFile, info);
+    state.nLastBlockFile = nFile;
+    state.nBlocks = info.nBlocks;
+    state.nSize = info.nSize;
+    state.nHeightLast = info.nHeightLast;
+    state.hashBestChain = pcoinsdbview->GetBestBlock();
+    return state;
+}
+
+/**
+ * Load the block index from the snapshot written at the last shutdown, if the
+ * databases have not changed since, returning it in height order. The snapshot
+ * is used at most once: the database is about to change.
+ */
+static bool LoadBlockIndexFromSnapshot(std::vector<CBlockIndex*>& vSortedByHeight)
 {
-    if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+    uint64_t nId;
+    if (!pblocktree->ReadIndexSnapshot(nId)) {
+        fs::remove(GetBlockIndexSnapshotPath());
         return false;
+    }
+    if (!pblocktree->EraseIndexSnapshot())
+        return false;
+    bool fLoaded = false;
+    if (fBlockIndexSnapshot) {
+        int64_t nStart = GetTimeMicros();
+        fLoaded = LoadBlockIndexSnapshot(GetBlockIndexSnapshotPath(), GetBlockIndexSnapshotState(nId), InsertBlockIndex, vSortedByHeight);
+        if (fLoaded)
+            LogPrintf("%s: loaded %u block index entries from snapshot in %.2fs\n", __func__, vSortedByHeight.size(), (GetTimeMicros() - nStart) * 0.000001);
+    }
+    fs::remove(GetBlockIndexSnapshotPath());
+    return fLoaded;
+}
+
+bool static LoadBlockIndexDB(const CChainParams& chainparams)
+{
+    std::vector<CBlockIndex*> vSortedByHeight;
+    if (!LoadBlockIndexFromSnapshot(vSortedByHeight)) {
+        int64_t nStart = GetTimeMicros();
+        if (!pblocktree->LoadBlockIndexGuts(InsertBlockIndex))
+            return false;
+        LogPrintf("%s: loaded %u block index entries from the database in %.2fs\n", __func__, mapBlockIndex.size(), (GetTimeMicros() - nStart) * 0.000001);
+
+        vSortedByHeight.clear();
+        vSortedByHeight.reserve(mapBlockIndex.size());
+        BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+            vSortedByHeight.push_back(item.second);
+        std::stable_sort(vSortedByHeight.begin(), vSortedByHeight.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+    }
 
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*> > vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+    BOOST_FOREACH(CBlockIndex* pindex, vSortedByHeight)
     {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    BOOST_FOREACH(const PAIRTYPE(int, CBlockIndex*)& item, vSortedByHeight)
-    {
-        CBlockIndex* pindex = item.second;
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
@@ -4016,6 +4833,19 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         }
     }
 
+    // Move into place the files of a block file whose recompression was
+    // interrupted after the index was pointed at them
+    for (int nFile = 0; nFile < (int)vinfoBlockFile.size(); nFile++) {
+        bool fPending;
+        if (pblocktree->ReadRecompressedFile(nFile, fPending) && fPending) {
+            LogPrintf("%s: moving recompressed blk/rev%05u.dat into place\n", __func__, nFile);
+            if (!MoveRecompressedFiles(nFile))
+                return error("%s: moving recompressed blk/rev%05u.dat into place failed", __func__, nFile);
+        } else {
+            RemoveRecompressedFiles(nFile);
+        }
+    }
+
     // Check presence of blk files
     LogPrintf("Checking all blk files are present...\n");
     std::set<int> setBlkDataFiles;
@@ -4039,6 +4869,13 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether we have ever written compressed records
+    bool fCompressedRecords = false;
+    pblocktree->ReadFlag("compressedrecords", fCompressedRecords);
+    fHaveCompressedRecords = fCompressedRecords;
+    if (fCompressedRecords)
+        LogPrintf("LoadBlockIndexDB(): Block files hold compressed records, which versions without -compressblocks cannot read\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -4060,6 +4897,10 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
     pblocktree->ReadFlag("txindex", fTxIndex);
     LogPrintf("%s: transaction index %s\n", __func__, fTxIndex ? "enabled" : "disabled");
 
+    // Complete a chainstate write that was cut short
+    if (!ReplayBlocks(chainparams, pcoinsdbview))
+        return false;
+
     // Load pointer to end of best chain
     BlockMap::iterator it = mapBlockIndex.find(pcoinsTip->GetBestBlock());
     if (it == mapBlockIndex.end())
@@ -4179,6 +5020,58 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
     return true;
 }
 
+bool ReplayBlocks(const CChainParams& params, CCoinsViewDB* view)
+{
+    LOCK(cs_main);
+
+    std::vector<uint256> vhashHeads = view->GetHeadBlocks();
+    if (vhashHeads.empty())
+        return true; // The database is in a consistent state
+    if (vhashHeads.size() != 2)
+        return error("%s: unknown inconsistent state", __func__);
+
+    BlockMap::iterator itNew = mapBlockIndex.find(vhashHeads[0]);
+    BlockMap::iterator itOld = mapBlockIndex.find(vhashHeads[1]);
+    if (itNew == mapBlockIndex.end() || itOld == mapBlockIndex.end())
+        return error("%s: reorganization to unknown block requested", __func__);
+    const CBlockIndex* pindexNew = itNew->second;
+    const CBlockIndex* pindexOld = itOld->second;
+    if (pindexNew->GetAncestor(pindexOld->nHeight) != pindexOld)
+        return error("%s: %s does not descend from %s", __func__, pindexNew->GetBlockHash().ToString(), pindexOld->GetBlockHash().ToString());
+
+    uiInterface.ShowProgress(_("Replaying blocks..."), 0);
+    LogPrintf("Replaying blocks %d to %d\n", pindexOld->nHeight + 1, pindexNew->nHeight);
+
+    // Each coin in the database is either as of pindexOld or as of pindexNew.
+    // Applying the blocks in between without checking them is right for
+    // both: inputs already spent stay spent, and outputs are written over
+    // with what the block created.
+    CCoinsViewCache cache(view);
+    for (int nHeight = pindexOld->nHeight + 1; nHeight <= pindexNew->nHeight; ++nHeight) {
+        const CBlockIndex* pindex = pindexNew->GetAncestor(nHeight);
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, params.GetConsensus(nHeight)))
+            return error("%s: failed to read block %s from disk", __func__, pindex->GetBlockHash().ToString());
+        for (const CTransactionRef& tx : block.vtx) {
+            if (!tx->IsCoinBase()) {
+                for (const CTxIn& txin : tx->vin) {
+                    CCoinsModifier coins = cache.ModifyCoins(txin.prevout.hash);
+                    coins->Spend(txin.prevout.n);
+                }
+            }
+            cache.ModifyCoins(tx->GetHash())->FromTx(*tx, nHeight);
+        }
+        uiInterface.ShowProgress(_("Replaying blocks..."), (int)((nHeight - pindexOld->nHeight) * 100.0 / (pindexNew->nHeight - pindexOld->nHeight)));
+    }
+    cache.SetBestBlock(pindexNew->GetBlockHash());
+    // A synchronous write, which also clears the head blocks
+    bool fOk = cache.Flush();
+    uiInterface.ShowProgress("", 100);
+    if (!fOk)
+        return error("%s: failed to write to coin database", __func__);
+    return true;
+}
+
 bool RewindBlockIndex(const CChainParams& params)
 {
     LOCK(cs_main);
@@ -4286,11 +5179,15 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
-        delete entry.second;
+    {
+        WRITE_LOCK(cs_mapBlockIndex);
+        BOOST_FOREACH(BlockMap::value_type& entry, mapBlockIndex) {
+            delete entry.second;
+        }
+        mapBlockIndex.clear();
     }
-    mapBlockIndex.clear();
     fHavePruned = false;
+    fHaveCompressedRecords = false;
 }
 
 bool LoadBlockIndex(const CChainParams& chainparams)
@@ -4331,12 +5228,12 @@ bool InitBlockIndex(const CChainParams& chainparams)
         try {
             CBlock &block = const_cast<CBlock&>(chainparams.GenesisBlock());
             // Start new block file
-            unsigned int nBlockSize = ::GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+            const CDiskRecord<CBlock> record(block);
             CDiskBlockPos blockPos;
             CValidationState state;
-            if (!FindBlockPos(state, blockPos, nBlockSize+8, 0, block.GetBlockTime()))
+            if (!FindBlockPos(state, blockPos, record.GetDiskSize()+8, 0, block.GetBlockTime()))
                 return error("LoadBlockIndex(): FindBlockPos failed");
-            if (!WriteBlockToDisk(block, blockPos, chainparams.MessageStart()))
+            if (!WriteBlockRecordToDisk(record, blockPos, chainparams.MessageStart()))
                 return error("LoadBlockIndex(): writing genesis block to disk failed");
             CBlockIndex *pindex = AddToBlockIndex(block);
             if (!ReceivedBlockTransactions(block, state, pindex, blockPos))
@@ -4353,8 +5250,8 @@ bool InitBlockIndex(const CChainParams& chainparams)
 
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    // Map of disk positions and sizes for blocks with unknown parent (only used for reindex)
+    static std::multimap<uint256, std::pair<CDiskBlockPos, unsigned int> > mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
     int nLoaded = 0;
@@ -4369,6 +5266,7 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
             nRewind++; // start one byte further next time, in case of failure
             blkdat.SetLimit(); // remove former limit
             unsigned int nSize = 0;
+            bool fCompressed = false;
             try {
                 // locate a header
                 unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
@@ -4379,7 +5277,9 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                     continue;
                 // read size
                 blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                fCompressed = nSize & DISK_RECORD_COMPRESSED;
+                nSize &= ~DISK_RECORD_COMPRESSED;
+                if (nSize < (fCompressed ? 5 : 80) || nSize > MAX_BLOCK_SERIALIZED_SIZE)
                     continue;
             } catch (const std::exception&) {
                 // no valid block header found; don't complain
@@ -4394,16 +5294,24 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 blkdat.SetPos(nBlockPos);
                 std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
                 CBlock& block = *pblock;
-                blkdat >> block;
+                if (fCompressed) {
+                    std::vector<char> vchFrame(nSize), vchRecord;
+                    blkdat.read(vchFrame.data(), vchFrame.size());
+                    DecompressDiskRecord(vchFrame.data(), vchFrame.size(), vchRecord);
+                    CSpanReader reader(SER_DISK, CLIENT_VERSION, vchRecord.data(), vchRecord.data() + vchRecord.size());
+                    reader >> block;
+                } else {
+                    blkdat >> block;
+                }
                 nRewind = blkdat.GetPos();
 
                 // detect out of order blocks, and store them for later
                 uint256 hash = block.GetHash();
                 if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint("reindex", "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
                             block.hashPrevBlock.ToString());
                     if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
+                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, std::make_pair(*dbp, nSize)));
                     continue;
                 }
 
@@ -4411,12 +5319,12 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
                     LOCK(cs_main);
                     CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, NULL))
+                    if (AcceptBlock(pblock, state, chainparams, NULL, true, dbp, nSize, NULL))
                         nLoaded++;
                     if (state.IsError())
                         break;
                 } else if (hash != chainparams.GetConsensus(0).hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint("reindex", "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
                 }
 
                 // Activate the genesis block so normal node progress can continue
@@ -4435,18 +5343,18 @@ bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskB
                 while (!queue.empty()) {
                     uint256 head = queue.front();
                     queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                    std::pair<std::multimap<uint256, std::pair<CDiskBlockPos, unsigned int> >::iterator, std::multimap<uint256, std::pair<CDiskBlockPos, unsigned int> >::iterator> range = mapBlocksUnknownParent.equal_range(head);
                     while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
+                        std::multimap<uint256, std::pair<CDiskBlockPos, unsigned int> >::iterator it = range.first;
                         std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
                         // TODO: Need a valid consensus height
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus(0)))
+                        if (ReadBlockFromDisk(*pblockrecursive, it->second.first, chainparams.GetConsensus(0)))
                         {
-                            LogPrint("reindex", "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
                                     head.ToString());
                             LOCK(cs_main);
                             CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second, NULL))
+                            if (AcceptBlock(pblockrecursive, dummy, chainparams, NULL, true, &it->second.first, it->second.second, NULL))
                             {
                                 nLoaded++;
                                 queue.push_back(pblockrecursive->GetHash());
@@ -4677,7 +5585,47 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Plain list of transactions, each of which is validated in full on load
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_STATE = 1;
+//! Also records the tip and script flags the transactions were validated against; never trusted
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_CHECKSUM = 2;
+//! Records the tip and mempool script flags, and closes with a hash of the file
+static const uint64_t MEMPOOL_DUMP_VERSION = 3;
+
+/** Hash the first nSize bytes of file */
+static bool HashMempoolFile(FILE* file, uint64_t nSize, uint256& hash)
+{
+    if (fseek(file, 0, SEEK_SET) != 0)
+        return false;
+    CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+    std::vector<char> vBuf(1 << 16);
+    while (nSize > 0) {
+        const size_t nRead = fread(vBuf.data(), 1, std::min<uint64_t>(nSize, vBuf.size()), file);
+        if (nRead == 0)
+            return false;
+        hasher.write(vBuf.data(), nRead);
+        nSize -= nRead;
+    }
+    hash = hasher.GetHash();
+    return true;
+}
+
+/** Whether the hash closing mempool.dat matches the rest of it. The file position is kept. */
+static bool CheckMempoolChecksum(FILE* file)
+{
+    const long nPos = ftell(file);
+    if (nPos < 0 || fseek(file, 0, SEEK_END) != 0)
+        return false;
+    const long nSize = ftell(file);
+    uint256 hashFile;
+    uint256 hashData;
+    const bool fValid = nSize >= (long)sizeof(uint256) &&
+        fseek(file, nSize - sizeof(uint256), SEEK_SET) == 0 &&
+        fread(hashFile.begin(), 1, sizeof(uint256), file) == sizeof(uint256) &&
+        HashMempoolFile(file, nSize - sizeof(uint256), hashData) &&
+        hashData == hashFile;
+    return fseek(file, nPos, SEEK_SET) == 0 && fValid;
+}
 
 bool LoadMempool(void)
 {
@@ -4693,15 +5641,49 @@ bool LoadMempool(void)
     int64_t skipped = 0;
     int64_t failed = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMicros();
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION && version != MEMPOOL_DUMP_VERSION_NO_CHECKSUM &&
+            version != MEMPOOL_DUMP_VERSION_NO_STATE) {
             return false;
         }
+
+        // Every transaction in the pool passed the mempool script flags of
+        // the tip it was dumped at. If we are back at that tip with the same
+        // flags, those results still hold and go into the script execution
+        // cache, so that accepting the transactions again skips their
+        // scripts. Block validation still runs them under its own flags.
+        bool fTrusted = false;
+        unsigned int nMempoolFlags = 0;
+        if (version != MEMPOOL_DUMP_VERSION_NO_STATE) {
+            uint256 hashTip;
+            file >> hashTip;
+            file >> nMempoolFlags;
+            if (version == MEMPOOL_DUMP_VERSION_NO_CHECKSUM) {
+                unsigned int nBlockFlags;
+                file >> nBlockFlags;
+            }
+
+            LOCK(cs_main);
+            fTrusted = version == MEMPOOL_DUMP_VERSION &&
+                       GetBoolArg("-trustmempoolsnapshot", DEFAULT_TRUST_MEMPOOL_SNAPSHOT) &&
+                       chainActive.Tip() && chainActive.Tip()->GetBlockHash() == hashTip &&
+                       nMempoolFlags == GetMempoolScriptFlags();
+        }
+        // Nothing is trusted from a file that is not intact
+        if (fTrusted && !CheckMempoolChecksum(file.Get())) {
+            LogPrintf("mempool.dat does not match its checksum, validating its transactions in full\n");
+            fTrusted = false;
+        }
+
         uint64_t num;
         file >> num;
+        LogPrintf("Loading %u mempool transactions from disk%s\n", num, fTrusted ? ", skipping verified scripts" : "");
+        const uint64_t total = num;
+        int nLastPercent = 0;
         double prioritydummy = 0;
         while (num--) {
             CTransactionRef tx;
@@ -4718,7 +5700,9 @@ bool LoadMempool(void)
             CValidationState state;
             if (nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime);
+                if (fTrusted)
+                    scriptExecutionCache.insert(ScriptExecutionCacheEntry(*tx, nMempoolFlags));
+                AcceptToMemoryPoolWithTime(mempool, state, tx, true, NULL, nTime, NULL, false, 0, fTrusted);
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -4727,6 +5711,13 @@ bool LoadMempool(void)
             } else {
                 ++skipped;
             }
+
+            const double dProgress = (double)(total - num) / total;
+            mempool.SetLoadProgress(dProgress);
+            if ((int)(dProgress * 10) > nLastPercent / 10) {
+                nLastPercent = (int)(dProgress * 10) * 10;
+                LogPrintf("Loading mempool from disk: %d%% (%u of %u)\n", nLastPercent, total - num, total);
+            }
             if (ShutdownRequested())
                 return false;
         }
@@ -4741,19 +5732,52 @@ bool LoadMempool(void)
         return false;
     }
 
-    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired\n", count, failed, skipped);
+    LogPrintf("Imported mempool transactions from disk: %i successes, %i failed, %i expired in %.2fs\n", count, failed, skipped, (GetTimeMicros() - nStart) * 0.000001);
     return true;
 }
 
+void DumpBlockIndexSnapshot()
+{
+    if (!fBlockIndexSnapshot || fReindex || pblocktree == NULL)
+        return;
+
+    int64_t nStart = GetTimeMicros();
+    LOCK(cs_main);
+    // Only what the database holds may go into the snapshot
+    if (!setDirtyBlockIndex.empty()) {
+        LogPrintf("%s: block index not flushed, not writing a snapshot\n", __func__);
+        return;
+    }
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    BOOST_FOREACH(const PAIRTYPE(uint256, CBlockIndex*)& item, mapBlockIndex)
+        vIndex.push_back(item.second);
+
+    const uint64_t nId = GetRand(std::numeric_limits<uint64_t>::max());
+    if (!WriteBlockIndexSnapshot(GetBlockIndexSnapshotPath(), vIndex, GetBlockIndexSnapshotState(nId)))
+        return;
+    if (!pblocktree->WriteIndexSnapshot(nId)) {
+        fs::remove(GetBlockIndexSnapshotPath());
+        return;
+    }
+    LogPrintf("Dumped block index snapshot of %u entries in %.2fs\n", vIndex.size(), (GetTimeMicros() - nStart) * 0.000001);
+}
+
 void DumpMempool(void)
 {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
     std::vector<TxMempoolInfo> vinfo;
+    uint256 hashTip;
+    unsigned int nMempoolFlags;
 
     {
-        LOCK(mempool.cs);
+        // The flags are taken at the same tip as the transactions, which are
+        // all valid against it
+        LOCK2(cs_main, mempool.cs);
+        hashTip = chainActive.Tip() ? chainActive.Tip()->GetBlockHash() : uint256();
+        nMempoolFlags = GetMempoolScriptFlags();
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
         }
@@ -4763,7 +5787,7 @@ void DumpMempool(void)
     int64_t mid = GetTimeMicros();
 
     try {
-        FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb+");
         if (!filestr) {
             return;
         }
@@ -4772,6 +5796,8 @@ void DumpMempool(void)
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << hashTip;
+        file << nMempoolFlags;
 
         file << (uint64_t)vinfo.size();
         for (const auto& i : vinfo) {
@@ -4782,6 +5808,15 @@ void DumpMempool(void)
         }
 
         file << mapDeltas;
+
+        // Close with a hash of all of the above, checked before anything in
+        // the file is trusted on load
+        const long nSize = ftell(file.Get());
+        uint256 hashFile;
+        if (nSize < 0 || fflush(file.Get()) != 0 || !HashMempoolFile(file.Get(), nSize, hashFile) ||
+            fseek(file.Get(), 0, SEEK_END) != 0)
+            throw std::runtime_error("cannot hash mempool.dat.new");
+        file << hashFile;
         FileCommit(file.Get());
         file.fclose();
         RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
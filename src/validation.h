@@ -38,17 +38,21 @@
 
 #include <boost/unordered_map.hpp>
 
+class CAuxpowHeaderStore;
 class CBlockIndex;
 class CBlockTreeDB;
 class CBloomFilter;
 class CBlockUndo;
 class CChainParams;
+class CCoinsViewDB;
+class CIndexDB;
 class CInv;
 class CConnman;
 class CScriptCheck;
 class CTxMemPool;
 class CValidationInterface;
 class CValidationState;
+struct BlockIndexSnapshotState;
 struct ChainTxData;
 
 struct PrecomputedTransactionData;
@@ -83,6 +87,8 @@ static const unsigned int DEFAULT_DESCENDANT_LIMIT = 25;
 static const unsigned int DEFAULT_DESCENDANT_SIZE_LIMIT = 101;
 /** Default for -mempoolexpiry, expiration time for mempool transactions in hours */
 static const unsigned int DEFAULT_MEMPOOL_EXPIRY = 24;
+/** Default for -trustmempoolsnapshot, skipping verified scripts when reloading mempool.dat at the tip it was written at */
+static const bool DEFAULT_TRUST_MEMPOOL_SNAPSHOT = true;
 /** The maximum size of a blk?????.dat file (since 0.8) */
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
 /** The pre-allocation chunk size for blk?????.dat files (since 0.8) */
@@ -149,6 +155,28 @@ static const bool DEFAULT_TXINDEX = false;
 static const bool DEFAULT_ADDRESSINDEX = false;
 static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
+/** Default for -mmapblocks: only where block files can be mapped, with the address space to map them into */
+#ifdef WIN32
+static const bool DEFAULT_MMAP_BLOCKS = false;
+#else
+static const bool DEFAULT_MMAP_BLOCKS = sizeof(void*) >= 8;
+#endif
+/** Number of block files ReadBlockFromDisk keeps mapped */
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 64;
+/** Default for -compressblocks */
+static const bool DEFAULT_COMPRESS_BLOCKS = false;
+/** Time between attempts to recompress an old block file, in seconds */
+static const int64_t BLOCKFILE_RECOMPRESS_INTERVAL = 60;
+/** Default for -blockindexsnapshot */
+static const bool DEFAULT_BLOCK_INDEX_SNAPSHOT = true;
+/** Default for -auxpowheaderstore: only where the store can be read through memory mappings */
+static const bool DEFAULT_AUXPOW_HEADER_STORE = DEFAULT_MMAP_BLOCKS;
+/** Number of ranges of decoded headers the auxpow header store keeps */
+static const size_t AUXPOW_HEADER_STORE_RANGES = 8;
+/** Time between attempts to extend the auxpow header store up to the tip, in seconds */
+static const int64_t AUXPOW_HEADER_STORE_INTERVAL = 1;
+/** Heights added to the auxpow header store at a time while it catches up */
+static const int AUXPOW_HEADER_STORE_BATCH = 2000;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 /** Default for -mempoolreplacement */
@@ -169,14 +197,40 @@ struct BlockHasher
     size_t operator()(const uint256& hash) const { return hash.GetCheapHash(); }
 };
 
+/**
+ * Where the time of a TestBlockValidity() call went, in microseconds.
+ * Script checks run on the script verification threads while the inputs
+ * are connected; nVerify is how long the block then waited for them.
+ */
+struct BlockValidityTimings
+{
+    int64_t nHeader;
+    int64_t nCheckBlock;
+    int64_t nContextual;
+    int64_t nConnect;
+    int64_t nVerify;
+    int64_t nTotal;
+    int nInputs;
+
+    BlockValidityTimings() : nHeader(0), nCheckBlock(0), nContextual(0), nConnect(0), nVerify(0), nTotal(0), nInputs(0) {}
+};
+
 extern CScript COINBASE_FLAGS;
 extern CCriticalSection cs_main;
 extern CTxMemPool mempool;
 typedef boost::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/**
+ * Guards the shape of mapBlockIndex so it can be read without cs_main.
+ * Writers hold cs_main and take this exclusively around every insertion
+ * or removal (and while filling in the new entry's linkage), readers that
+ * do not hold cs_main take it shared, see LookupBlockIndex().
+ */
+extern CSharedCriticalSection cs_mapBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockSize;
 extern uint64_t nLastBlockWeight;
+extern BlockValidityTimings lastBlockValidityTimings;
 extern const std::string strMessageMagic;
 extern CWaitableCriticalSection csBestBlock;
 extern CConditionVariable cvBlockChange;
@@ -187,6 +241,10 @@ extern bool fSpentIndex;
 extern bool fTimestampIndex;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
+extern bool fMmapBlocks;
+extern bool fCompressBlocks;
+extern bool fBlockIndexSnapshot;
+extern bool fAuxpowHeaderStore;
 extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
@@ -284,6 +342,8 @@ bool LoadBlockIndex(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run an instance of the thread checking the scripts of pre-verified transactions */
+void ThreadMempoolScriptCheck();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Format a string that describes several potential problems detected by the core.
@@ -347,10 +407,26 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
                         bool* pfMissingInputs, std::list<CTransactionRef>* plTxnReplaced = NULL,
                         bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
 
-/** (try to) add transaction to memory pool with a specified acceptance time **/
+/**
+ * Run the scripts of a batch of transactions on the mempool script check
+ * threads, without holding cs_main, and record the ones that pass in the
+ * script execution cache. AcceptToMemoryPool then commits them one at a time
+ * without executing their scripts again. Transactions that cannot be checked
+ * yet or would fail the policy checks before the scripts (missing inputs,
+ * already in the pool, nonstandard, fee too low) are left to
+ * AcceptToMemoryPool. Does nothing without script check threads.
+ */
+void PreVerifyTransactions(CTxMemPool& pool, const std::vector<CTransactionRef>& vtx);
+
+/**
+ * (try to) add transaction to memory pool with a specified acceptance time.
+ * fTrustedScripts skips the check against the next block's script flags, for
+ * a transaction from a trusted mempool.dat whose mempool flags result was put
+ * in the script execution cache.
+ */
 bool AcceptToMemoryPoolWithTime(CTxMemPool& pool, CValidationState &state, const CTransactionRef &tx, bool fLimitFree,
                         bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced = NULL,
-                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0);
+                        bool fOverrideMempoolLimit=false, const CAmount nAbsurdFee=0, bool fTrustedScripts=false);
 
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
@@ -390,9 +466,15 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
  * instead of being performed inline.
+ * Transactions whose scripts already passed with the same flags are looked up in the script
+ * execution cache and not run again; with cacheFullScriptStore a success with inline checks is
+ * added to it. cacheSigStore does the same for individual signatures.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = NULL);
+
+/** Size the script execution cache, to be called once in AppInit2/TestingSetup */
+void InitScriptExecutionCache();
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -493,6 +575,8 @@ public:
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
 bool HashOnchainActive(const uint256 &hash);
+/** Find a block index entry by hash without holding cs_main. NULL if unknown. */
+CBlockIndex* LookupBlockIndex(const uint256& hash);
 bool GetAddressIndex(uint160 addressHash, int type, std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex, int start = 0, int end = 0);
 bool GetAddressUnspent(uint160 addressHash, int type, std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
 
@@ -501,10 +585,22 @@ bool GetAddressUnspent(uint160 addressHash, int type, std::vector<std::pair<CAdd
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
+bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 bool ReadBlockHeaderFromDisk(CBlockHeader& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams, bool fCheckPOW = true);
 
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
 
+/**
+ * Rewrite a block file and its undo file that are no longer appended to, with
+ * every record compressed that can be, and move the index over to them.
+ * Returns false if there was nothing to do or the files changed meanwhile.
+ */
+bool RecompressBlockFile(int nFile, const CChainParams& chainparams);
+/** Recompress the next old block file that has not been yet, run from the scheduler */
+void RecompressBlockFiles();
+/** Add the auxpow headers of the active chain the store is still missing, run from the scheduler */
+void ExtendAuxpowHeaderStore();
+
 /** Functions for validating blocks and updating the block tree */
 
 /** Context-independent validity checks */
@@ -521,7 +617,7 @@ bool ContextualCheckBlock(const CBlock& block, CValidationState& state, const CB
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
  *  can fail if those validity checks fail (among other reasons). */
 bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& coins,
-                  const CChainParams& chainparams, bool fJustCheck = false);
+                  const CChainParams& chainparams, bool fJustCheck = false, BlockValidityTimings* pTimings = NULL);
 
 /** Undo the effects of this block (with given index) on the UTXO set represented by coins.
  *  In case pfClean is provided, operation will try to be tolerant about errors, and *pfClean
@@ -530,7 +626,7 @@ bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockIndex* pin
 bool DisconnectBlock(const CBlock& block, CValidationState& state, const CBlockIndex* pindex, CCoinsViewCache& coins, bool* pfClean = NULL);
 
 /** Check a block is completely valid from start to finish (only works on top of our current best block, with cs_main held) */
-bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+bool TestBlockValidity(CValidationState& state, const CChainParams& chainparams, const CBlock& block, CBlockIndex* pindexPrev, bool fCheckPOW = true, bool fCheckMerkleRoot = true, BlockValidityTimings* pTimings = NULL);
 
 /** Check whether witness commitments are required for block. */
 bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& params);
@@ -538,6 +634,9 @@ bool IsWitnessEnabled(const CBlockIndex* pindexPrev, const Consensus::Params& pa
 /** When there are blocks in the active chain with missing data, rewind the chainstate and remove them from the block index */
 bool RewindBlockIndex(const CChainParams& params);
 
+/** Complete a background chainstate flush that was cut short, by applying the blocks it was writing again */
+bool ReplayBlocks(const CChainParams& params, CCoinsViewDB* view);
+
 /** Update uncommitted block structures (currently: only the witness nonce). This is safe for submitted blocks. */
 void UpdateUncommittedBlockStructures(CBlock& block, const CBlockIndex* pindexPrev, const Consensus::Params& consensusParams);
 
@@ -570,9 +669,18 @@ extern CChain chainActive;
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the coins database (protected by cs_main) */
+extern CCoinsViewDB *pcoinsdbview;
+
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the address, spent and timestamp index database */
+extern CIndexDB *pindexdb;
+
+/** Global variable that points to the auxpow headers of the active chain, if -auxpowheaderstore */
+extern CAuxpowHeaderStore *pauxpowheaders;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
@@ -605,7 +713,16 @@ CBlockFileInfo* GetBlockFileInfo(size_t n);
 /** Dump the mempool to disk. */
 void DumpMempool();
 
-/** Load the mempool from disk. */
+/** Load the mempool from disk, reporting progress through mempool.GetLoadProgress(). */
 bool LoadMempool();
 
+/**
+ * Write a snapshot of the block index for the next startup to load, once
+ * everything has been flushed at shutdown.
+ */
+void DumpBlockIndexSnapshot();
+
+/** What the block tree and chainstate databases hold, for a snapshot marked nId. */
+BlockIndexSnapshotState GetBlockIndexSnapshotState(uint64_t nId);
+
 #endif // BITCOIN_VALIDATION_H
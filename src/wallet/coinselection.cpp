@@ -0,0 +1,133 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/coinselection.h"
+
+#include "random.h"
+
+bool SelectCoinsBnB(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange,
+                    std::vector<char>& vfSelected, CAmount& nValueRet)
+{
+    vfSelected.clear();
+    nValueRet = 0;
+
+    CAmount nAvailable = 0;
+    for (size_t i = 0; i < vCoins.size(); i++)
+        nAvailable += vCoins[i].nValue;
+    if (nAvailable < nTargetValue)
+        return false;
+
+    // The current branch: vfCurr[i] says whether vCoins[i] is included, for
+    // every i < vfCurr.size(). nAvailable is the value not yet decided on.
+    std::vector<char> vfCurr;
+    vfCurr.reserve(vCoins.size());
+    CAmount nCurr = 0;
+    CAmount nBestExcess = MAX_MONEY;
+    std::vector<char> vfBest;
+
+    for (size_t nTries = 0; nTries < COIN_SELECTION_BNB_TRIES; nTries++)
+    {
+        bool fBacktrack = false;
+        if (nCurr + nAvailable < nTargetValue ||      // target no longer reachable on this branch
+            nCurr > nTargetValue + nCostOfChange)     // overshot the changeless window
+        {
+            fBacktrack = true;
+        }
+        else if (nCurr >= nTargetValue)
+        {
+            if (nCurr - nTargetValue < nBestExcess)
+            {
+                nBestExcess = nCurr - nTargetValue;
+                vfBest = vfCurr;
+                if (nBestExcess == 0)
+                    break;
+            }
+            fBacktrack = true;
+        }
+
+        if (fBacktrack)
+        {
+            // Walk back to the last included coin and try the branch without it
+            while (!vfCurr.empty() && !vfCurr.back())
+            {
+                vfCurr.pop_back();
+                nAvailable += vCoins[vfCurr.size()].nValue;
+            }
+            if (vfCurr.empty())
+                break;
+            vfCurr.back() = false;
+            nCurr -= vCoins[vfCurr.size() - 1].nValue;
+        }
+        else
+        {
+            const size_t i = vfCurr.size();
+            nAvailable -= vCoins[i].nValue;
+            // Including a coin right after excluding one of the same value
+            // only revisits a branch that has already been searched
+            if (i > 0 && !vfCurr.back() && vCoins[i].nValue == vCoins[i - 1].nValue)
+            {
+                vfCurr.push_back(false);
+            }
+            else
+            {
+                vfCurr.push_back(true);
+                nCurr += vCoins[i].nValue;
+            }
+        }
+    }
+
+    if (nBestExcess == MAX_MONEY)
+        return false;
+
+    vfBest.resize(vCoins.size(), false);
+    vfSelected.swap(vfBest);
+    nValueRet = nTargetValue + nBestExcess;
+    return true;
+}
+
+void ApproximateBestSubset(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTotalLower, const CAmount& nTargetValue,
+                           std::vector<char>& vfBest, CAmount& nBest, int iterations)
+{
+    std::vector<char> vfIncluded;
+
+    vfBest.assign(vCoins.size(), true);
+    nBest = nTotalLower;
+
+    FastRandomContext insecure_rand;
+
+    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
+    {
+        vfIncluded.assign(vCoins.size(), false);
+        CAmount nTotal = 0;
+        bool fReachedTarget = false;
+        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
+        {
+            for (unsigned int i = 0; i < vCoins.size(); i++)
+            {
+                //The solver here uses a randomized algorithm,
+                //the randomness serves no real security purpose but is just
+                //needed to prevent degenerate behavior and it is important
+                //that the rng is fast. We do not use a constant random sequence,
+                //because there may be some privacy improvement by making
+                //the selection random.
+                if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
+                {
+                    nTotal += vCoins[i].nValue;
+                    vfIncluded[i] = true;
+                    if (nTotal >= nTargetValue)
+                    {
+                        fReachedTarget = true;
+                        if (nTotal < nBest)
+                        {
+                            nBest = nTotal;
+                            vfBest = vfIncluded;
+                        }
+                        nTotal -= vCoins[i].nValue;
+                        vfIncluded[i] = false;
+                    }
+                }
+            }
+        }
+    }
+}
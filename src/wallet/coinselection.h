@@ -0,0 +1,56 @@
+// Copyright (c) 2017 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_COINSELECTION_H
+#define BITCOIN_WALLET_COINSELECTION_H
+
+#include "amount.h"
+
+#include <vector>
+
+class COutput;
+
+//! Estimated serialized size of a P2PKH input, used to price spending a coin
+static const unsigned int COIN_SELECTION_INPUT_SIZE = 148;
+//! Estimated serialized size of a P2PKH output, used to price creating change
+static const unsigned int COIN_SELECTION_OUTPUT_SIZE = 34;
+//! Upper bound on the number of nodes branch-and-bound visits per selection
+static const size_t COIN_SELECTION_BNB_TRIES = 100000;
+
+/**
+ * A candidate input for coin selection. Points back into the caller's list
+ * of available outputs so selection never copies or reorders that list.
+ */
+struct CSelectionCoin
+{
+    CAmount nValue;
+    const COutput* pOutput;
+
+    CSelectionCoin() : nValue(0), pOutput(NULL) {}
+    CSelectionCoin(CAmount nValueIn, const COutput* pOutputIn) : nValue(nValueIn), pOutput(pOutputIn) {}
+
+    bool operator<(const CSelectionCoin& other) const { return nValue < other.nValue; }
+};
+
+/**
+ * Depth-first branch-and-bound search for a subset of vCoins whose value
+ * falls within [nTargetValue, nTargetValue + nCostOfChange]. Such a selection
+ * needs no change output: the excess is cheaper to leave to the fee than to
+ * create (and later spend) change. Among the solutions found within
+ * COIN_SELECTION_BNB_TRIES the one with the least excess wins.
+ *
+ * vCoins must be sorted by descending value. On success vfSelected flags the
+ * chosen entries of vCoins and nValueRet holds their total.
+ */
+bool SelectCoinsBnB(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTargetValue, const CAmount& nCostOfChange,
+                    std::vector<char>& vfSelected, CAmount& nValueRet);
+
+/**
+ * Randomized subset sum approximation: look for the subset of vCoins with
+ * the smallest total that still reaches nTargetValue.
+ */
+void ApproximateBestSubset(const std::vector<CSelectionCoin>& vCoins, const CAmount& nTotalLower, const CAmount& nTargetValue,
+                           std::vector<char>& vfBest, CAmount& nBest, int iterations = 1000);
+
+#endif // BITCOIN_WALLET_COINSELECTION_H
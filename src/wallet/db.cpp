@@ -120,7 +120,7 @@ void CDBEnv::MakeMock()
 
     boost::this_thread::interruption_point();
 
-    LogPrint("db", "CDBEnv::MakeMock\n");
+    LogPrint(BCLog::DB, "CDBEnv::MakeMock\n");
 
     dbenv->set_cachesize(1, 0, 1);
     dbenv->set_lg_bsize(10485760 * 4);
@@ -231,13 +231,93 @@ bool CDBEnv::Salvage(const std::string& strFile, bool fAggressive, std::vector<C
 void CDBEnv::CheckpointLSN(const std::string& strFile)
 {
     dbenv->txn_checkpoint(0, 0, 0);
-    if (fMockDb)
+    if (fMockDb || IsLogDb(strFile))
         return;
     dbenv->lsn_reset(strFile.c_str(), 0);
 }
 
+bool CDBEnv::IsLogDb(const std::string& strFile, bool fCreate)
+{
+    {
+        LOCK(cs_db);
+        if (mapLogDb.count(strFile))
+            return true;
+    }
+    fs::path pathFile = GetDataDir() / strFile;
+    if (fs::exists(pathFile))
+        return CLogDB::IsLogFile(pathFile);
+    return fCreate && GetArg("-walletbackend", DEFAULT_WALLET_BACKEND) == "log";
+}
+
+
+int CDBCursor::Read(CDataStream& ssKey, CDataStream& ssValue, bool setRange)
+{
+    if (plog) {
+        std::vector<unsigned char> vchKey;
+        CSerializeData vchValue;
+        bool fFound;
+        if (setRange)
+            fFound = plog->ReadNext(std::vector<unsigned char>(ssKey.begin(), ssKey.end()), false, vchKey, vchValue);
+        else if (fStarted)
+            fFound = plog->ReadNext(vchLastKey, true, vchKey, vchValue);
+        else
+            fFound = plog->ReadNext(std::vector<unsigned char>(), false, vchKey, vchValue);
+        if (!fFound)
+            return DB_NOTFOUND;
+        fStarted = true;
+        vchLastKey = vchKey;
+
+        ssKey.SetType(SER_DISK);
+        ssKey.clear();
+        ssKey.write((const char*)vchKey.data(), vchKey.size());
+        ssValue.SetType(SER_DISK);
+        ssValue.clear();
+        ssValue.write(vchValue.data(), vchValue.size());
+        return 0;
+    }
+
+    // Read at cursor
+    Dbt datKey;
+    unsigned int fFlags = DB_NEXT;
+    if (setRange) {
+        datKey.set_data(ssKey.data());
+        datKey.set_size(ssKey.size());
+        fFlags = DB_SET_RANGE;
+    }
+    Dbt datValue;
+    datKey.set_flags(DB_DBT_MALLOC);
+    datValue.set_flags(DB_DBT_MALLOC);
+    int ret = pdbc->get(&datKey, &datValue, fFlags);
+    if (ret != 0)
+        return ret;
+    else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
+        return 99999;
+
+    // Convert to streams
+    ssKey.SetType(SER_DISK);
+    ssKey.clear();
+    ssKey.write((char*)datKey.get_data(), datKey.get_size());
+    ssValue.SetType(SER_DISK);
+    ssValue.clear();
+    ssValue.write((char*)datValue.get_data(), datValue.get_size());
+
+    // Clear and free memory
+    memory_cleanse(datKey.get_data(), datKey.get_size());
+    memory_cleanse(datValue.get_data(), datValue.get_size());
+    free(datKey.get_data());
+    free(datValue.get_data());
+    return 0;
+}
 
-CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), activeTxn(NULL)
+void CDBCursor::close()
+{
+    if (pdbc)
+        pdbc->close();
+    delete this;
+}
+
+
+CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnCloseIn) : pdb(NULL), plog(NULL), activeTxn(NULL), activeLogTxn(NULL)
 {
     int ret;
     fReadOnly = (!strchr(pszMode, '+') && !strchr(pszMode, 'w'));
@@ -257,6 +337,30 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
         strFile = strFilename;
         ++bitdb.mapFileUseCount[strFile];
+
+        if (bitdb.IsLogDb(strFile, fCreate)) {
+            plog = bitdb.mapLogDb[strFile];
+            if (plog == NULL) {
+                plog = new CLogDB(GetDataDir() / strFile);
+                if (!plog->Open(fCreate)) {
+                    delete plog;
+                    plog = NULL;
+                    bitdb.mapLogDb.erase(strFile);
+                    --bitdb.mapFileUseCount[strFile];
+                    strFile = "";
+                    throw runtime_error(strprintf("CDB: Can't open wallet log %s", strFilename));
+                }
+                bitdb.mapLogDb[strFile] = plog;
+                if (fCreate && !Exists(string("version"))) {
+                    bool fTmp = fReadOnly;
+                    fReadOnly = false;
+                    WriteVersion(CLIENT_VERSION);
+                    fReadOnly = fTmp;
+                }
+            }
+            return;
+        }
+
         pdb = bitdb.mapDb[strFile];
         if (pdb == NULL) {
             pdb = new Db(bitdb.dbenv, 0);
@@ -298,9 +402,16 @@ CDB::CDB(const std::string& strFilename, const char* pszMode, bool fFlushOnClose
 
 void CDB::Flush()
 {
-    if (activeTxn)
+    if (activeTxn || activeLogTxn)
         return;
 
+    // One fsync covers everything this handle (and any other) appended
+    if (plog) {
+        if (!fReadOnly)
+            plog->Sync();
+        return;
+    }
+
     // Flush database activity from memory pool to disk log
     unsigned int nMinutes = 0;
     if (fReadOnly)
@@ -311,15 +422,18 @@ void CDB::Flush()
 
 void CDB::Close()
 {
-    if (!pdb)
+    if (!pdb && !plog)
         return;
     if (activeTxn)
         activeTxn->abort();
     activeTxn = NULL;
+    delete activeLogTxn;
+    activeLogTxn = NULL;
     pdb = NULL;
 
     if (fFlushOnClose)
         Flush();
+    plog = NULL;
 
     {
         LOCK(bitdb.cs_db);
@@ -327,10 +441,78 @@ void CDB::Close()
     }
 }
 
+bool CDB::ReadLog(const CDataStream& ssKey, CDataStream& ssValue)
+{
+    std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+    CSerializeData vchValue;
+    if (activeLogTxn) {
+        std::map<std::vector<unsigned char>, CLogDBBatch::Entry>::const_iterator it = activeLogTxn->mapEntries.find(vchKey);
+        if (it != activeLogTxn->mapEntries.end()) {
+            if (it->second.fErase)
+                return false;
+            ssValue.write(it->second.value.data(), it->second.value.size());
+            return true;
+        }
+    }
+    if (!plog->Read(vchKey, vchValue))
+        return false;
+    ssValue.write(vchValue.data(), vchValue.size());
+    return true;
+}
+
+bool CDB::WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite)
+{
+    if (fReadOnly)
+        assert(!"Write called on database in read-only mode");
+    if (!fOverwrite && ExistsLog(ssKey))
+        return false;
+    std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+    if (activeLogTxn) {
+        activeLogTxn->Write(vchKey, ssValue.data(), ssValue.size());
+        return true;
+    }
+    return plog->Write(vchKey, ssValue.data(), ssValue.size());
+}
+
+bool CDB::EraseLog(const CDataStream& ssKey)
+{
+    if (fReadOnly)
+        assert(!"Erase called on database in read-only mode");
+    std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+    if (activeLogTxn) {
+        activeLogTxn->Erase(vchKey);
+        return true;
+    }
+    if (!plog->Exists(vchKey))
+        return true;
+    return plog->Erase(vchKey);
+}
+
+bool CDB::ExistsLog(const CDataStream& ssKey)
+{
+    std::vector<unsigned char> vchKey(ssKey.begin(), ssKey.end());
+    if (activeLogTxn) {
+        std::map<std::vector<unsigned char>, CLogDBBatch::Entry>::const_iterator it = activeLogTxn->mapEntries.find(vchKey);
+        if (it != activeLogTxn->mapEntries.end())
+            return !it->second.fErase;
+    }
+    return plog->Exists(vchKey);
+}
+
 void CDBEnv::CloseDb(const string& strFile)
 {
     {
         LOCK(cs_db);
+        map<string, CLogDB*>::iterator it = mapLogDb.find(strFile);
+        if (it != mapLogDb.end()) {
+            // Idle is the time to drop superseded records
+            CLogDB* plog = it->second;
+            if (plog->ShouldCompact())
+                plog->Compact();
+            plog->Close();
+            delete plog;
+            mapLogDb.erase(it);
+        }
         if (mapDb[strFile] != NULL) {
             // Close the database handle
             Db* pdb = mapDb[strFile];
@@ -341,6 +523,18 @@ void CDBEnv::CloseDb(const string& strFile)
     }
 }
 
+bool CDBEnv::SyncLogDb(const string& strFile)
+{
+    LOCK(cs_db);
+    map<string, CLogDB*>::iterator it = mapLogDb.find(strFile);
+    if (it == mapLogDb.end())
+        return false;
+    CLogDB* plog = it->second;
+    if (plog->ShouldCompact())
+        plog->Compact();
+    return plog->Sync();
+}
+
 bool CDBEnv::RemoveDb(const string& strFile)
 {
     this->CloseDb(strFile);
@@ -361,6 +555,16 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                 bitdb.CheckpointLSN(strFile);
                 bitdb.mapFileUseCount.erase(strFile);
 
+                if (bitdb.IsLogDb(strFile)) {
+                    // An append-only log rewrites itself by compaction
+                    LogPrintf("CDB::Rewrite: Compacting %s...\n", strFile);
+                    CLogDB log(GetDataDir() / strFile);
+                    bool fSuccess = log.Open(false) && log.Compact(pszSkip);
+                    if (!fSuccess)
+                        LogPrintf("CDB::Rewrite: Failed to compact wallet log %s\n", strFile);
+                    return fSuccess;
+                }
+
                 bool fSuccess = true;
                 LogPrintf("CDB::Rewrite: Rewriting %s...\n", strFile);
                 string strFileRes = strFile + ".rewrite";
@@ -379,7 +583,7 @@ bool CDB::Rewrite(const string& strFile, const char* pszSkip)
                         fSuccess = false;
                     }
 
-                    Dbc* pcursor = db.GetCursor();
+                    CDBCursor* pcursor = db.GetCursor();
                     if (pcursor)
                         while (fSuccess) {
                             CDataStream ssKey(SER_DISK, CLIENT_VERSION);
@@ -438,7 +642,7 @@ void CDBEnv::Flush(bool fShutdown)
 {
     int64_t nStart = GetTimeMillis();
     // Flush log data to the actual data file on all files that are not in use
-    LogPrint("db", "CDBEnv::Flush: Flush(%s)%s\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " database not started");
+    LogPrint(BCLog::DB, "CDBEnv::Flush: Flush(%s)%s\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " database not started");
     if (!fDbEnvInit)
         return;
     {
@@ -447,21 +651,21 @@ void CDBEnv::Flush(bool fShutdown)
         while (mi != mapFileUseCount.end()) {
             string strFile = (*mi).first;
             int nRefCount = (*mi).second;
-            LogPrint("db", "CDBEnv::Flush: Flushing %s (refcount = %d)...\n", strFile, nRefCount);
+            LogPrint(BCLog::DB, "CDBEnv::Flush: Flushing %s (refcount = %d)...\n", strFile, nRefCount);
             if (nRefCount == 0) {
                 // Move log data to the dat file
                 CloseDb(strFile);
-                LogPrint("db", "CDBEnv::Flush: %s checkpoint\n", strFile);
+                LogPrint(BCLog::DB, "CDBEnv::Flush: %s checkpoint\n", strFile);
                 dbenv->txn_checkpoint(0, 0, 0);
-                LogPrint("db", "CDBEnv::Flush: %s detach\n", strFile);
-                if (!fMockDb)
+                LogPrint(BCLog::DB, "CDBEnv::Flush: %s detach\n", strFile);
+                if (!fMockDb && !IsLogDb(strFile))
                     dbenv->lsn_reset(strFile.c_str(), 0);
-                LogPrint("db", "CDBEnv::Flush: %s closed\n", strFile);
+                LogPrint(BCLog::DB, "CDBEnv::Flush: %s closed\n", strFile);
                 mapFileUseCount.erase(mi++);
             } else
                 mi++;
         }
-        LogPrint("db", "CDBEnv::Flush: Flush(%s)%s took %15dms\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " database not started", GetTimeMillis() - nStart);
+        LogPrint(BCLog::DB, "CDBEnv::Flush: Flush(%s)%s took %15dms\n", fShutdown ? "true" : "false", fDbEnvInit ? "" : " database not started", GetTimeMillis() - nStart);
         if (fShutdown) {
             char** listp;
             if (mapFileUseCount.empty()) {
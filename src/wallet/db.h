@@ -12,6 +12,7 @@
 #include "streams.h"
 #include "sync.h"
 #include "version.h"
+#include "wallet/logdb.h"
 
 #include <map>
 #include <string>
@@ -38,6 +39,8 @@ public:
     DbEnv *dbenv;
     std::map<std::string, int> mapFileUseCount;
     std::map<std::string, Db*> mapDb;
+    //! Wallet files kept in append-only logs instead of Berkeley DB
+    std::map<std::string, CLogDB*> mapLogDb;
 
     CDBEnv();
     ~CDBEnv();
@@ -72,8 +75,20 @@ public:
     void CheckpointLSN(const std::string& strFile);
 
     void CloseDb(const std::string& strFile);
+    /**
+     * Make an open append-only log durable, compacting it first if that is
+     * due, while keeping it open. Returns false if strFile is no open log.
+     */
+    bool SyncLogDb(const std::string& strFile);
     bool RemoveDb(const std::string& strFile);
 
+    /**
+     * Whether strFile is (or, when fCreate is set and it does not exist yet,
+     * will be) stored as an append-only log. Existing files are recognised by
+     * their header; new ones follow -walletbackend.
+     */
+    bool IsLogDb(const std::string& strFile, bool fCreate = false);
+
     DbTxn* TxnBegin(int flags = DB_TXN_WRITE_NOSYNC)
     {
         DbTxn* ptxn = NULL;
@@ -87,13 +102,40 @@ public:
 extern CDBEnv bitdb;
 
 
+/** Cursor over a wallet database in key order, whichever backend stores it */
+class CDBCursor
+{
+private:
+    Dbc* pdbc;
+    CLogDB* plog;
+    std::vector<unsigned char> vchLastKey;
+    bool fStarted;
+
+    ~CDBCursor() {}
+
+public:
+    explicit CDBCursor(Dbc* pdbcIn) : pdbc(pdbcIn), plog(NULL), fStarted(false) {}
+    explicit CDBCursor(CLogDB* plogIn) : pdbc(NULL), plog(plogIn), fStarted(false) {}
+
+    /**
+     * Read the next record, or with setRange the first one whose key is not
+     * less than ssKey. Returns 0 on success and DB_NOTFOUND past the end.
+     */
+    int Read(CDataStream& ssKey, CDataStream& ssValue, bool setRange);
+    //! Release the cursor; like Dbc::close() this also frees it
+    void close();
+};
+
+
 /** RAII class that provides access to a Berkeley database */
 class CDB
 {
 protected:
     Db* pdb;
+    CLogDB* plog;
     std::string strFile;
     DbTxn* activeTxn;
+    CLogDBBatch* activeLogTxn;
     bool fReadOnly;
     bool fFlushOnClose;
 
@@ -108,17 +150,35 @@ private:
     CDB(const CDB&);
     void operator=(const CDB&);
 
+    bool ReadLog(const CDataStream& ssKey, CDataStream& ssValue);
+    bool WriteLog(const CDataStream& ssKey, const CDataStream& ssValue, bool fOverwrite);
+    bool EraseLog(const CDataStream& ssKey);
+    bool ExistsLog(const CDataStream& ssKey);
+
 protected:
     template <typename K, typename T>
     bool Read(const K& key, T& value)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+
+        if (plog) {
+            CDataStream ssValue(SER_DISK, CLIENT_VERSION);
+            if (!ReadLog(ssKey, ssValue))
+                return false;
+            try {
+                ssValue >> value;
+                return true;
+            } catch (const std::exception&) {
+                return false;
+            }
+        }
+
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Read
@@ -147,7 +207,7 @@ protected:
     template <typename K, typename T>
     bool Write(const K& key, const T& value, bool fOverwrite = true)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Write called on database in read-only mode");
@@ -162,6 +222,8 @@ protected:
         CDataStream ssValue(SER_DISK, CLIENT_VERSION);
         ssValue.reserve(10000);
         ssValue << value;
+        if (plog)
+            return WriteLog(ssKey, ssValue, fOverwrite);
         Dbt datValue(ssValue.data(), ssValue.size());
 
         // Write
@@ -176,7 +238,7 @@ protected:
     template <typename K>
     bool Erase(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
         if (fReadOnly)
             assert(!"Erase called on database in read-only mode");
@@ -185,6 +247,8 @@ protected:
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (plog)
+            return EraseLog(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Erase
@@ -198,13 +262,15 @@ protected:
     template <typename K>
     bool Exists(const K& key)
     {
-        if (!pdb)
+        if (!pdb && !plog)
             return false;
 
         // Key
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(1000);
         ssKey << key;
+        if (plog)
+            return ExistsLog(ssKey);
         Dbt datKey(ssKey.data(), ssKey.size());
 
         // Exists
@@ -215,55 +281,33 @@ protected:
         return (ret == 0);
     }
 
-    Dbc* GetCursor()
+    CDBCursor* GetCursor()
     {
+        if (plog)
+            return new CDBCursor(plog);
         if (!pdb)
             return NULL;
         Dbc* pcursor = NULL;
         int ret = pdb->cursor(NULL, &pcursor, 0);
         if (ret != 0)
             return NULL;
-        return pcursor;
+        return new CDBCursor(pcursor);
     }
 
-    int ReadAtCursor(Dbc* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
+    int ReadAtCursor(CDBCursor* pcursor, CDataStream& ssKey, CDataStream& ssValue, bool setRange = false)
     {
-        // Read at cursor
-        Dbt datKey;
-        unsigned int fFlags = DB_NEXT;
-        if (setRange) {
-            datKey.set_data(ssKey.data());
-            datKey.set_size(ssKey.size());
-            fFlags = DB_SET_RANGE;
-        }
-        Dbt datValue;
-        datKey.set_flags(DB_DBT_MALLOC);
-        datValue.set_flags(DB_DBT_MALLOC);
-        int ret = pcursor->get(&datKey, &datValue, fFlags);
-        if (ret != 0)
-            return ret;
-        else if (datKey.get_data() == NULL || datValue.get_data() == NULL)
-            return 99999;
-
-        // Convert to streams
-        ssKey.SetType(SER_DISK);
-        ssKey.clear();
-        ssKey.write((char*)datKey.get_data(), datKey.get_size());
-        ssValue.SetType(SER_DISK);
-        ssValue.clear();
-        ssValue.write((char*)datValue.get_data(), datValue.get_size());
-
-        // Clear and free memory
-        memory_cleanse(datKey.get_data(), datKey.get_size());
-        memory_cleanse(datValue.get_data(), datValue.get_size());
-        free(datKey.get_data());
-        free(datValue.get_data());
-        return 0;
+        return pcursor->Read(ssKey, ssValue, setRange);
     }
 
 public:
     bool TxnBegin()
     {
+        if (plog) {
+            if (activeLogTxn)
+                return false;
+            activeLogTxn = new CLogDBBatch();
+            return true;
+        }
         if (!pdb || activeTxn)
             return false;
         DbTxn* ptxn = bitdb.TxnBegin();
@@ -275,6 +319,14 @@ public:
 
     bool TxnCommit()
     {
+        if (plog) {
+            if (!activeLogTxn)
+                return false;
+            bool fSuccess = plog->WriteBatch(*activeLogTxn);
+            delete activeLogTxn;
+            activeLogTxn = NULL;
+            return fSuccess;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->commit(0);
@@ -284,6 +336,13 @@ public:
 
     bool TxnAbort()
     {
+        if (plog) {
+            if (!activeLogTxn)
+                return false;
+            delete activeLogTxn;
+            activeLogTxn = NULL;
+            return true;
+        }
         if (!pdb || !activeTxn)
             return false;
         int ret = activeTxn->abort();
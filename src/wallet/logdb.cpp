@@ -0,0 +1,470 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "wallet/logdb.h"
+
+#include "crypto/common.h"
+#include "hash.h"
+#include "support/cleanse.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+#include <boost/foreach.hpp>
+
+#ifndef WIN32
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+//! Identifies an append-only wallet log; never a valid Berkeley DB header
+const unsigned char LOGDB_MAGIC[8] = {0x00, 't', 'r', 'm', 'p', 'l', 'o', 'g'};
+const uint32_t LOGDB_VERSION = 1;
+const size_t LOGDB_HEADER_SIZE = sizeof(LOGDB_MAGIC) + 4;
+
+//! Record layout: flags, key size, value size, key, value, checksum
+const size_t RECORD_PREFIX_SIZE = 1 + 4 + 4;
+const size_t RECORD_OVERHEAD = RECORD_PREFIX_SIZE + 4;
+
+//! The record deletes its key; it carries no value
+const unsigned char RECORD_ERASE = 0x01;
+//! The record completes a batch
+const unsigned char RECORD_COMMIT = 0x02;
+
+//! Appends a record to vch and returns the offset of its value within vch
+size_t AppendRecord(std::vector<unsigned char>& vch, unsigned char nFlags, const std::vector<unsigned char>& key, const char* pvalue, size_t nValue)
+{
+    const size_t nStart = vch.size();
+    vch.resize(nStart + RECORD_OVERHEAD + key.size() + nValue);
+    unsigned char* p = &vch[nStart];
+    p[0] = nFlags;
+    WriteLE32(p + 1, key.size());
+    WriteLE32(p + 5, nValue);
+    if (!key.empty())
+        memcpy(p + RECORD_PREFIX_SIZE, &key[0], key.size());
+    if (nValue)
+        memcpy(p + RECORD_PREFIX_SIZE + key.size(), pvalue, nValue);
+    const size_t nBody = RECORD_PREFIX_SIZE + key.size() + nValue;
+    uint256 hash = Hash(p, p + nBody);
+    WriteLE32(p + nBody, ReadLE32(hash.begin()));
+    return nStart + RECORD_PREFIX_SIZE + key.size();
+}
+
+} // namespace
+
+void CLogDBBatch::Write(const std::vector<unsigned char>& key, const char* pvalue, size_t nValue)
+{
+    Entry& entry = mapEntries[key];
+    entry.fErase = false;
+    entry.value.assign(pvalue, pvalue + nValue);
+}
+
+void CLogDBBatch::Erase(const std::vector<unsigned char>& key)
+{
+    Entry& entry = mapEntries[key];
+    entry.fErase = true;
+    entry.value.clear();
+}
+
+CLogDB::CLogDB(const fs::path& pathIn) : path(pathIn), file(NULL), nSize(0), nSynced(0), nLive(0), pMap(NULL), nMapped(0)
+{
+}
+
+CLogDB::~CLogDB()
+{
+    Close();
+}
+
+bool CLogDB::IsLogFile(const fs::path& pathIn)
+{
+    FILE* f = fsbridge::fopen(pathIn, "rb");
+    if (!f)
+        return false;
+    unsigned char magic[sizeof(LOGDB_MAGIC)];
+    bool fLog = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && memcmp(magic, LOGDB_MAGIC, sizeof(magic)) == 0;
+    fclose(f);
+    return fLog;
+}
+
+bool CLogDB::Open(bool fCreate)
+{
+    LOCK(cs);
+    if (file)
+        return true;
+
+    const bool fExists = fs::exists(path);
+    if (!fExists && !fCreate)
+        return false;
+    file = fsbridge::fopen(path, fExists ? "rb+" : "wb+");
+    if (!file)
+        return error("CLogDB::Open: cannot open %s", path.string());
+
+    if (!fExists) {
+        unsigned char header[LOGDB_HEADER_SIZE];
+        memcpy(header, LOGDB_MAGIC, sizeof(LOGDB_MAGIC));
+        WriteLE32(header + sizeof(LOGDB_MAGIC), LOGDB_VERSION);
+        if (fwrite(header, 1, sizeof(header), file) != sizeof(header)) {
+            fclose(file);
+            file = NULL;
+            return error("CLogDB::Open: cannot initialize %s", path.string());
+        }
+        FileCommit(file);
+    }
+
+    mapIndex.clear();
+    nLive = 0;
+    if (!Map() || !Replay()) {
+        Unmap();
+        fclose(file);
+        file = NULL;
+        return false;
+    }
+    nSynced = nSize;
+    LogPrint(BCLog::DB, "CLogDB::Open: %s, %u keys, %u of %u bytes live\n", path.string(), mapIndex.size(), nLive, nSize);
+    return true;
+}
+
+void CLogDB::Close()
+{
+    LOCK(cs);
+    if (!file)
+        return;
+    if (nSynced != nSize)
+        FileCommit(file);
+    Unmap();
+    fclose(file);
+    file = NULL;
+    mapIndex.clear();
+    nSize = nSynced = nLive = 0;
+}
+
+bool CLogDB::Map()
+{
+    Unmap();
+    if (fseek(file, 0, SEEK_END) != 0)
+        return false;
+    long nLen = ftell(file);
+    if (nLen < 0)
+        return false;
+    nMapped = nLen;
+#ifndef WIN32
+    if (nMapped > 0) {
+        void* p = mmap(NULL, nMapped, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (p == MAP_FAILED) {
+            nMapped = 0;
+            return error("CLogDB::Map: cannot map %s", path.string());
+        }
+        pMap = (const unsigned char*)p;
+    }
+#endif
+    return true;
+}
+
+void CLogDB::Unmap()
+{
+#ifndef WIN32
+    if (pMap)
+        munmap((void*)pMap, nMapped);
+#endif
+    pMap = NULL;
+    nMapped = 0;
+}
+
+bool CLogDB::ReadAt(uint64_t nPos, uint32_t nLen, CSerializeData& value)
+{
+    value.resize(nLen);
+    if (nLen == 0)
+        return true;
+#ifndef WIN32
+    // Records appended since the file was mapped are past the end of the mapping
+    if (nPos + nLen > nMapped && !Map())
+        return false;
+    memcpy(&value[0], pMap + nPos, nLen);
+    return true;
+#else
+    if (fseek(file, nPos, SEEK_SET) != 0)
+        return false;
+    return fread(&value[0], 1, nLen, file) == nLen;
+#endif
+}
+
+bool CLogDB::Replay()
+{
+    const uint64_t nFileSize = nMapped;
+    CSerializeData vchFile;
+    const unsigned char* pData = pMap;
+    if (!pData && nFileSize) {
+        if (!ReadAt(0, nFileSize, vchFile))
+            return error("CLogDB::Replay: cannot read %s", path.string());
+        pData = (const unsigned char*)&vchFile[0];
+    }
+
+    if (nFileSize < LOGDB_HEADER_SIZE || memcmp(pData, LOGDB_MAGIC, sizeof(LOGDB_MAGIC)) != 0)
+        return error("CLogDB::Replay: %s is not a wallet log", path.string());
+    if (ReadLE32(pData + sizeof(LOGDB_MAGIC)) > LOGDB_VERSION)
+        return error("CLogDB::Replay: %s was written by a newer version", path.string());
+
+    std::vector<PendingUpdate> vBatch;
+    uint64_t nPos = LOGDB_HEADER_SIZE;
+    nSize = nPos;
+    while (nPos + RECORD_OVERHEAD <= nFileSize) {
+        const unsigned char* p = pData + nPos;
+        const unsigned char nFlags = p[0];
+        const uint64_t nKey = ReadLE32(p + 1);
+        const uint64_t nValue = ReadLE32(p + 5);
+        const uint64_t nRecord = RECORD_OVERHEAD + nKey + nValue;
+        if (nPos + nRecord > nFileSize)
+            break;
+        const size_t nBody = nRecord - 4;
+        uint256 hash = Hash(p, p + nBody);
+        if (ReadLE32(p + nBody) != ReadLE32(hash.begin()))
+            break;
+
+        PendingUpdate update;
+        update.key.assign(p + RECORD_PREFIX_SIZE, p + RECORD_PREFIX_SIZE + nKey);
+        update.fErase = (nFlags & RECORD_ERASE) != 0;
+        update.entry.nValuePos = nPos + RECORD_PREFIX_SIZE + nKey;
+        update.entry.nValueSize = nValue;
+        update.entry.nRecordSize = nRecord;
+        vBatch.push_back(update);
+        nPos += nRecord;
+
+        if (nFlags & RECORD_COMMIT) {
+            BOOST_FOREACH(const PendingUpdate& u, vBatch) {
+                index_type::iterator it = mapIndex.find(u.key);
+                if (it != mapIndex.end()) {
+                    nLive -= it->second.nRecordSize;
+                    mapIndex.erase(it);
+                }
+                if (!u.fErase) {
+                    mapIndex.insert(std::make_pair(u.key, u.entry));
+                    nLive += u.entry.nRecordSize;
+                }
+            }
+            vBatch.clear();
+            nSize = nPos;
+        }
+    }
+
+    if (nSize < nFileSize) {
+        // A batch that never completed, most likely cut short by a crash
+        LogPrintf("CLogDB::Replay: discarding %u bytes of incomplete records at the end of %s\n", nFileSize - nSize, path.string());
+        Unmap();
+        if (!TruncateFile(file, nSize))
+            return error("CLogDB::Replay: cannot truncate %s", path.string());
+        FileCommit(file);
+        if (!Map())
+            return false;
+    }
+    return true;
+}
+
+bool CLogDB::Append(const std::vector<unsigned char>& vchRecords, const std::vector<PendingUpdate>& vUpdates)
+{
+    AssertLockHeld(cs);
+    if (!file)
+        return false;
+    if (fseek(file, nSize, SEEK_SET) != 0 ||
+        fwrite(vchRecords.data(), 1, vchRecords.size(), file) != vchRecords.size() ||
+        fflush(file) != 0) {
+        // Whatever made it to the file is an incomplete batch, which replay drops
+        TruncateFile(file, nSize);
+        return error("CLogDB::Append: cannot write to %s", path.string());
+    }
+
+    BOOST_FOREACH(const PendingUpdate& u, vUpdates) {
+        index_type::iterator it = mapIndex.find(u.key);
+        if (it != mapIndex.end()) {
+            nLive -= it->second.nRecordSize;
+            mapIndex.erase(it);
+        }
+        if (!u.fErase) {
+            IndexEntry entry = u.entry;
+            entry.nValuePos += nSize;
+            mapIndex.insert(std::make_pair(u.key, entry));
+            nLive += entry.nRecordSize;
+        }
+    }
+    nSize += vchRecords.size();
+    return true;
+}
+
+bool CLogDB::Read(const std::vector<unsigned char>& key, CSerializeData& value)
+{
+    LOCK(cs);
+    index_type::const_iterator it = mapIndex.find(key);
+    if (it == mapIndex.end())
+        return false;
+    return ReadAt(it->second.nValuePos, it->second.nValueSize, value);
+}
+
+bool CLogDB::Exists(const std::vector<unsigned char>& key)
+{
+    LOCK(cs);
+    return mapIndex.count(key) > 0;
+}
+
+bool CLogDB::Write(const std::vector<unsigned char>& key, const char* pvalue, size_t nValue)
+{
+    CLogDBBatch batch;
+    batch.Write(key, pvalue, nValue);
+    return WriteBatch(batch);
+}
+
+bool CLogDB::Erase(const std::vector<unsigned char>& key)
+{
+    CLogDBBatch batch;
+    batch.Erase(key);
+    return WriteBatch(batch);
+}
+
+bool CLogDB::WriteBatch(const CLogDBBatch& batch)
+{
+    if (batch.mapEntries.empty())
+        return true;
+
+    std::vector<unsigned char> vchRecords;
+    std::vector<PendingUpdate> vUpdates;
+    vUpdates.reserve(batch.mapEntries.size());
+    size_t nRemaining = batch.mapEntries.size();
+    for (std::map<std::vector<unsigned char>, CLogDBBatch::Entry>::const_iterator it = batch.mapEntries.begin(); it != batch.mapEntries.end(); ++it) {
+        unsigned char nFlags = (--nRemaining == 0) ? RECORD_COMMIT : 0;
+        if (it->second.fErase)
+            nFlags |= RECORD_ERASE;
+        const size_t nStart = vchRecords.size();
+        PendingUpdate update;
+        update.key = it->first;
+        update.fErase = it->second.fErase;
+        update.entry.nValuePos = AppendRecord(vchRecords, nFlags, it->first, it->second.value.data(), it->second.value.size());
+        update.entry.nValueSize = it->second.value.size();
+        update.entry.nRecordSize = vchRecords.size() - nStart;
+        vUpdates.push_back(update);
+    }
+
+    bool fSuccess;
+    {
+        LOCK(cs);
+        fSuccess = Append(vchRecords, vUpdates);
+    }
+    // The buffer may hold private keys
+    memory_cleanse(vchRecords.data(), vchRecords.size());
+    return fSuccess;
+}
+
+bool CLogDB::ReadNext(const std::vector<unsigned char>& key, bool fAfter, std::vector<unsigned char>& keyRet, CSerializeData& value)
+{
+    LOCK(cs);
+    index_type::const_iterator it = fAfter ? mapIndex.upper_bound(key) : mapIndex.lower_bound(key);
+    if (it == mapIndex.end())
+        return false;
+    keyRet = it->first;
+    return ReadAt(it->second.nValuePos, it->second.nValueSize, value);
+}
+
+bool CLogDB::Sync()
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+    // Writes of other handles made since our last sync ride along with this one
+    if (nSynced == nSize)
+        return true;
+    FileCommit(file);
+    nSynced = nSize;
+    return true;
+}
+
+bool CLogDB::ShouldCompact()
+{
+    LOCK(cs);
+    const uint64_t nDead = nSize - LOGDB_HEADER_SIZE - nLive;
+    return nDead >= LOGDB_COMPACT_MIN_DEAD && nDead > nLive;
+}
+
+bool CLogDB::Compact(const char* pszSkip)
+{
+    LOCK(cs);
+    if (!file)
+        return false;
+
+    const int64_t nStart = GetTimeMillis();
+    const uint64_t nSizeBefore = nSize;
+    fs::path pathTmp = path;
+    pathTmp += ".compact";
+    FILE* fileTmp = fsbridge::fopen(pathTmp, "wb");
+    if (!fileTmp)
+        return error("CLogDB::Compact: cannot create %s", pathTmp.string());
+
+    std::vector<unsigned char> vchOut;
+    unsigned char header[LOGDB_HEADER_SIZE];
+    memcpy(header, LOGDB_MAGIC, sizeof(LOGDB_MAGIC));
+    WriteLE32(header + sizeof(LOGDB_MAGIC), LOGDB_VERSION);
+    vchOut.insert(vchOut.end(), header, header + sizeof(header));
+
+    // Every record commits on its own: until the rename below the copy is
+    // never used, so there is no partial state to guard against
+    bool fSuccess = true;
+    const size_t nSkip = pszSkip ? strlen(pszSkip) : 0;
+    CSerializeData value;
+    for (index_type::const_iterator it = mapIndex.begin(); fSuccess && it != mapIndex.end(); ++it) {
+        if (pszSkip && memcmp(it->first.data(), pszSkip, std::min(it->first.size(), nSkip)) == 0)
+            continue;
+        if (!ReadAt(it->second.nValuePos, it->second.nValueSize, value)) {
+            fSuccess = false;
+            break;
+        }
+        AppendRecord(vchOut, RECORD_COMMIT, it->first, value.data(), value.size());
+        if (vchOut.size() >= (1 << 20)) {
+            fSuccess = fwrite(vchOut.data(), 1, vchOut.size(), fileTmp) == vchOut.size();
+            memory_cleanse(vchOut.data(), vchOut.size());
+            vchOut.clear();
+        }
+    }
+    if (fSuccess)
+        fSuccess = fwrite(vchOut.data(), 1, vchOut.size(), fileTmp) == vchOut.size();
+    memory_cleanse(vchOut.data(), vchOut.size());
+    if (fSuccess)
+        FileCommit(fileTmp);
+    fclose(fileTmp);
+    if (!fSuccess) {
+        fs::remove(pathTmp);
+        return error("CLogDB::Compact: cannot write %s", pathTmp.string());
+    }
+
+    Unmap();
+    fclose(file);
+    file = NULL;
+    if (!RenameOver(pathTmp, path)) {
+        LogPrintf("CLogDB::Compact: cannot replace %s, keeping it uncompacted\n", path.string());
+        fs::remove(pathTmp);
+        fSuccess = false;
+    }
+
+    file = fsbridge::fopen(path, "rb+");
+    if (!file)
+        return error("CLogDB::Compact: cannot reopen %s", path.string());
+    mapIndex.clear();
+    nLive = 0;
+    if (!Map() || !Replay())
+        return false;
+    nSynced = nSize;
+    if (!fSuccess)
+        return false;
+    LogPrintf("CLogDB::Compact: %s from %u to %u bytes in %dms\n", path.filename().string(), nSizeBefore, nSize, GetTimeMillis() - nStart);
+    return true;
+}
+
+uint64_t CLogDB::GetFileSize()
+{
+    LOCK(cs);
+    return nSize;
+}
+
+uint64_t CLogDB::GetLiveSize()
+{
+    LOCK(cs);
+    return nLive;
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_WALLET_LOGDB_H
+#define BITCOIN_WALLET_LOGDB_H
+
+#include "fs.h"
+#include "support/allocators/zeroafterfree.h"
+#include "sync.h"
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+//! Default for -walletbackend, the storage used for newly created wallet files
+static const char* const DEFAULT_WALLET_BACKEND = "bdb";
+//! Superseded bytes a log must carry before compaction is considered
+static const uint64_t LOGDB_COMPACT_MIN_DEAD = 1 << 20;
+
+/** Updates staged by a transaction on a CLogDB, applied in one batch on commit */
+class CLogDBBatch
+{
+public:
+    struct Entry {
+        bool fErase;
+        CSerializeData value;
+    };
+    std::map<std::vector<unsigned char>, Entry> mapEntries;
+
+    void Write(const std::vector<unsigned char>& key, const char* pvalue, size_t nValue);
+    void Erase(const std::vector<unsigned char>& key);
+};
+
+/**
+ * Append-only key/value store, an alternative to Berkeley DB for wallet files.
+ *
+ * Updates are appended as checksummed records and never rewritten in place.
+ * The records of one update (a single write, or a whole committed
+ * transaction) form a batch whose last record carries a commit flag; when the
+ * file is opened only complete batches are replayed, so a tail torn by a
+ * crash is cut off instead of corrupting the wallet.
+ *
+ * The file is memory mapped, and an in-memory index sorted like a Berkeley DB
+ * btree maps every key to the location of its current value in the mapping.
+ * Appends are not synced individually: Sync() commits everything written so
+ * far with one fsync, and callers that find their writes already synced by
+ * someone else skip it. Compact() copies the live records to a fresh file to
+ * drop superseded ones.
+ */
+class CLogDB
+{
+public:
+    explicit CLogDB(const fs::path& pathIn);
+    ~CLogDB();
+
+    /** Whether the file at path holds an append-only log rather than a Berkeley DB */
+    static bool IsLogFile(const fs::path& path);
+
+    bool Open(bool fCreate);
+    void Close();
+
+    bool Read(const std::vector<unsigned char>& key, CSerializeData& value);
+    bool Exists(const std::vector<unsigned char>& key);
+    bool Write(const std::vector<unsigned char>& key, const char* pvalue, size_t nValue);
+    bool Erase(const std::vector<unsigned char>& key);
+    bool WriteBatch(const CLogDBBatch& batch);
+
+    /**
+     * Read the first record whose key is not less than key (or greater than
+     * it, if fAfter). Returns false when there is none.
+     */
+    bool ReadNext(const std::vector<unsigned char>& key, bool fAfter, std::vector<unsigned char>& keyRet, CSerializeData& value);
+
+    /** Make all appended records durable */
+    bool Sync();
+    /** Whether enough superseded records piled up to make compaction worthwhile */
+    bool ShouldCompact();
+    /** Rewrite the file with just the live records, dropping keys starting with pszSkip */
+    bool Compact(const char* pszSkip = NULL);
+
+    uint64_t GetFileSize();
+    uint64_t GetLiveSize();
+
+private:
+    struct IndexEntry {
+        uint64_t nValuePos;
+        uint32_t nValueSize;
+        uint32_t nRecordSize;
+    };
+    typedef std::map<std::vector<unsigned char>, IndexEntry> index_type;
+    struct PendingUpdate {
+        std::vector<unsigned char> key;
+        bool fErase;
+        IndexEntry entry;
+    };
+
+    CCriticalSection cs;
+    fs::path path;
+    FILE* file;
+    index_type mapIndex;
+    //! Bytes of the file that belong to complete batches
+    uint64_t nSize;
+    //! Bytes of the file known to be on disk
+    uint64_t nSynced;
+    //! Bytes taken by the records mapIndex points to
+    uint64_t nLive;
+
+    const unsigned char* pMap;
+    uint64_t nMapped;
+
+    bool Map();
+    void Unmap();
+    bool ReadAt(uint64_t nPos, uint32_t nLen, CSerializeData& value);
+    bool Replay();
+    bool Append(const std::vector<unsigned char>& vchRecords, const std::vector<PendingUpdate>& vUpdates);
+
+    CLogDB(const CLogDB&);
+    void operator=(const CLogDB&);
+};
+
+#endif // BITCOIN_WALLET_LOGDB_H
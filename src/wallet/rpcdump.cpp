@@ -35,7 +35,8 @@ using namespace std;
 void EnsureWalletIsUnlocked();
 bool EnsureWalletIsAvailable(bool avoidException);
 uint32_t getHeightParamFromRequest(const JSONRPCRequest& request, size_t pos);
-void attemptRescanFromHeight(uint32_t nHeight);
+void attemptRescanFromHeight(uint32_t nHeight, const std::vector<CScript>& vScripts = std::vector<CScript>());
+void throwRescanIncomplete();
 
 std::string static EncodeDumpTime(int64_t nTime) {
     return DateTimeStrFormat("%Y-%m-%dT%H:%M:%SZ", nTime);
@@ -174,7 +175,46 @@ uint32_t getHeightParamFromRequest(const JSONRPCRequest& request, const size_t p
     return nHeight;
 }
 
-void attemptRescanFromHeight(const uint32_t nHeight)
+/**
+ * Collect the heights of all blocks paying to or spending from the given
+ * scripts from the address index. Returns false if the index is not usable
+ * for one of them, in which case a full rescan is needed.
+ */
+static bool GetAddressIndexHeights(const std::vector<CScript>& vScripts, const uint32_t nMinHeight, std::set<int>& setHeights)
+{
+    if (!fAddressIndex || vScripts.empty() || !GetBoolArg("-rescanaddrindex", DEFAULT_RESCAN_ADDRINDEX))
+        return false;
+
+    BOOST_FOREACH(const CScript& script, vScripts) {
+        // The index only covers the standard P2PKH and P2SH forms
+        CTxDestination dest;
+        if (!ExtractDestination(script, dest) || GetScriptForDestination(dest) != script)
+            return false;
+
+        uint160 hashBytes;
+        int type;
+        if (const CKeyID* keyID = boost::get<CKeyID>(&dest)) {
+            hashBytes = *keyID;
+            type = 1;
+        } else if (const CScriptID* scriptID = boost::get<CScriptID>(&dest)) {
+            hashBytes = *scriptID;
+            type = 2;
+        } else {
+            return false;
+        }
+
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        if (!GetAddressIndex(hashBytes, type, addressIndex))
+            return false;
+        for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it = addressIndex.begin(); it != addressIndex.end(); ++it) {
+            if (it->first.blockHeight >= (int)nMinHeight)
+                setHeights.insert(it->first.blockHeight);
+        }
+    }
+    return true;
+}
+
+void attemptRescanFromHeight(const uint32_t nHeight, const std::vector<CScript>& vScripts)
 {
     CBlockIndex* pblockindex = chainActive.Genesis();
 
@@ -184,8 +224,25 @@ void attemptRescanFromHeight(const uint32_t nHeight)
     else
         pblockindex = chainActive[nHeight];
 
-    pwalletMain->ScanForWalletTransactions(pblockindex, true);
+    // Watch-only scripts known to the address index only need the blocks it lists
+    std::set<int> setHeights;
+    bool fComplete;
+    if (GetAddressIndexHeights(vScripts, nHeight, setHeights)) {
+        LogPrintf("Rescanning %u blocks found in the address index\n", setHeights.size());
+        fComplete = pwalletMain->ScanForWalletTransactions(setHeights, true);
+    } else {
+        pwalletMain->ScanForWalletTransactions(pblockindex, true, &fComplete);
+    }
     pwalletMain->ReacceptWalletTransactions();
+    if (!fComplete)
+        throwRescanIncomplete();
+}
+
+void throwRescanIncomplete()
+{
+    if (pwalletMain->IsAbortingRescan())
+        throw JSONRPCError(RPC_WALLET_ERROR, "Rescan aborted by user, transactions may be missing. Use rescan to complete it.");
+    throw JSONRPCError(RPC_WALLET_ERROR, "Rescan did not complete, transactions may be missing. Use rescan to complete it.");
 }
 
 void ImportAddress(const CBitcoinAddress& address, const string& strLabel);
@@ -236,6 +293,7 @@ UniValue importaddress(const JSONRPCRequest& request)
             "4. p2sh                 (boolean, optional, default=false) Add the P2SH version of the script as well\n"
             "5. height               (numeric, optional, default=1) If rescanning, the block height from which to start\n"
             "\nNote: This call can take minutes to complete if rescan is true.\n"
+            "With -addressindex enabled, only the blocks the index lists for a P2PKH or P2SH address are rescanned.\n"
             "If you have the full public key, you should call importpubkey instead of this.\n"
             "\nNote: If you import a non-standard raw script in hex form, outputs sending to it will be treated\n"
             "as change, and not show up in many RPCs.\n"
@@ -270,21 +328,28 @@ UniValue importaddress(const JSONRPCRequest& request)
 
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
+    // Scripts now watched, for the address index rescan fast path
+    std::vector<CScript> vScripts;
     CBitcoinAddress address(request.params[0].get_str());
     if (address.IsValid()) {
         if (fP2SH)
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Cannot use the p2sh flag with an address - use a script instead");
         ImportAddress(address, strLabel);
+        vScripts.push_back(GetScriptForDestination(address.Get()));
     } else if (IsHex(request.params[0].get_str())) {
         std::vector<unsigned char> data(ParseHex(request.params[0].get_str()));
-        ImportScript(CScript(data.begin(), data.end()), strLabel, fP2SH);
+        CScript script(data.begin(), data.end());
+        ImportScript(script, strLabel, fP2SH);
+        vScripts.push_back(script);
+        if (fP2SH)
+            vScripts.push_back(GetScriptForDestination(CScriptID(script)));
     } else {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid Trumpow address or script");
     }
 
     if (fRescan) {
         const uint32_t nHeight = getHeightParamFromRequest(request, 4);
-        attemptRescanFromHeight(nHeight);
+        attemptRescanFromHeight(nHeight, vScripts);
     }
 
     return NullUniValue;
@@ -539,11 +604,14 @@ UniValue importwallet(const JSONRPCRequest& request)
     CBlockIndex *pindex = chainActive.FindEarliestAtLeast(nTimeBegin - 7200);
 
     LogPrintf("Rescanning last %i blocks\n", pindex ? chainActive.Height() - pindex->nHeight + 1 : 0);
-    pwalletMain->ScanForWalletTransactions(pindex);
+    bool fComplete;
+    pwalletMain->ScanForWalletTransactions(pindex, false, &fComplete);
     pwalletMain->MarkDirty();
 
     if (!fGood)
         throw JSONRPCError(RPC_WALLET_ERROR, "Error adding some keys to wallet");
+    if (!fComplete)
+        throwRescanIncomplete();
 
     return NullUniValue;
 }
@@ -1121,8 +1189,12 @@ UniValue importmulti(const JSONRPCRequest& mainRequest)
         CBlockIndex* pindex = nLowestTimestamp > minimumTimestamp ? chainActive.FindEarliestAtLeast(std::max<int64_t>(nLowestTimestamp - 7200, 0)) : chainActive.Genesis();
         CBlockIndex* scannedRange = nullptr;
         if (pindex) {
-            scannedRange = pwalletMain->ScanForWalletTransactions(pindex, true);
+            bool fComplete;
+            scannedRange = pwalletMain->ScanForWalletTransactions(pindex, true, &fComplete);
             pwalletMain->ReacceptWalletTransactions();
+            // Blocks that failed to read are reported per request below
+            if (!fComplete && (pwalletMain->IsAbortingRescan() || ShutdownRequested()))
+                throwRescanIncomplete();
         }
 
         if (!scannedRange || scannedRange->nHeight > pindex->nHeight) {
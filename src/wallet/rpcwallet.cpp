@@ -134,7 +134,7 @@ UniValue getnewaddress(const JSONRPCRequest& request)
         strAccount = AccountFromValue(request.params[0]);
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->TopUpKeyPoolInBackground();
 
     // Generate a new key that is added to wallet
     CPubKey newKey;
@@ -210,7 +210,7 @@ UniValue getrawchangeaddress(const JSONRPCRequest& request)
     LOCK2(cs_main, pwalletMain->cs_wallet);
 
     if (!pwalletMain->IsLocked())
-        pwalletMain->TopUpKeyPool();
+        pwalletMain->TopUpKeyPoolInBackground();
 
     CReserveKey reservekey(pwalletMain);
     CPubKey vchPubKey;
@@ -869,7 +869,12 @@ UniValue rescan(const JSONRPCRequest& request)
 
     int64_t beforeTime = GetTime();
 
-    pwalletMain->ScanForWalletTransactions(pblockindex, true);
+    bool fComplete;
+    pwalletMain->ScanForWalletTransactions(pblockindex, true, &fComplete);
+    if (pwalletMain->IsAbortingRescan())
+        throw JSONRPCError(RPC_MISC_ERROR, "Rescan aborted by user.");
+    if (!fComplete)
+        throw JSONRPCError(RPC_MISC_ERROR, "Rescan did not complete, transactions may be missing.");
 
     UniValue afterObj(UniValue::VOBJ);
     afterObj.pushKV("balance", ValueFromAmount(pwalletMain->GetBalance()));
@@ -885,6 +890,72 @@ UniValue rescan(const JSONRPCRequest& request)
     return ret;
 }
 
+UniValue abortrescan(const JSONRPCRequest& request)
+{
+    if (!EnsureWalletIsAvailable(request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() > 0)
+        throw runtime_error(
+            "abortrescan\n"
+            "\nStops the current wallet rescan triggered e.g. by an importprivkey or rescan call.\n"
+            "\nResult:\n"
+            "true|false    (boolean) Whether a running rescan was asked to stop\n"
+            "\nExamples:\n"
+            "\nImport a private key\n"
+            + HelpExampleCli("importprivkey", "\"mykey\"") +
+            "\nAbort the running wallet rescan\n"
+            + HelpExampleCli("abortrescan", "") +
+            "\nAs a JSON-RPC call\n"
+            + HelpExampleRpc("abortrescan", "")
+        );
+
+    // No locks: a running rescan holds cs_main and cs_wallet
+    if (!pwalletMain->IsScanning() || pwalletMain->IsAbortingRescan())
+        return false;
+    pwalletMain->AbortRescan();
+    return true;
+}
+
+UniValue getrescaninfo(const JSONRPCRequest& request)
+{
+    if (!EnsureWalletIsAvailable(request.fHelp))
+        return NullUniValue;
+
+    if (request.fHelp || request.params.size() > 0)
+        throw runtime_error(
+            "getrescaninfo\n"
+            "\nReturns the progress of the current wallet rescan. Does not wait for the rescan to finish.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"scanning\": true|false,   (boolean) whether a rescan is running\n"
+            "  \"aborting\": true|false,   (boolean) whether the running rescan was asked to stop\n"
+            "  \"startheight\": n,         (numeric) the height the rescan started at\n"
+            "  \"stopheight\": n,          (numeric) the chain height when the rescan started\n"
+            "  \"height\": n,              (numeric) the height of the last block processed\n"
+            "  \"progress\": x.xxx,        (numeric) the fraction of the height range processed\n"
+            "  \"duration\": n             (numeric) milliseconds since the rescan started\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getrescaninfo", "")
+            + HelpExampleRpc("getrescaninfo", "")
+        );
+
+    // No locks: a running rescan holds cs_main and cs_wallet
+    const bool fScanning = pwalletMain->IsScanning();
+    UniValue obj(UniValue::VOBJ);
+    obj.pushKV("scanning", fScanning);
+    if (fScanning) {
+        obj.pushKV("aborting", pwalletMain->IsAbortingRescan());
+        obj.pushKV("startheight", pwalletMain->ScanningStartHeight());
+        obj.pushKV("stopheight", pwalletMain->ScanningStopHeight());
+        obj.pushKV("height", pwalletMain->ScanningHeight());
+        obj.pushKV("progress", pwalletMain->ScanningProgress());
+        obj.pushKV("duration", pwalletMain->ScanningDuration());
+    }
+    return obj;
+}
+
 
 UniValue sendfrom(const JSONRPCRequest& request)
 {
@@ -3141,7 +3212,7 @@ UniValue bumpfee(const JSONRPCRequest& request)
     // If the output would become dust, discard it (converting the dust to fee)
     poutput->nValue -= nDelta;
     if (poutput->nValue <= CWallet::discardThreshold) {
-        LogPrint("rpc", "Bumping fee and discarding dust output\n");
+        LogPrint(BCLog::RPC, "Bumping fee and discarding dust output\n");
         nNewFee += poutput->nValue;
         tx.vout.erase(tx.vout.begin() + nOutput);
     }
@@ -3225,6 +3296,7 @@ static const CRPCCommand commands[] =
     { "rawtransactions",    "fundrawtransaction",       &fundrawtransaction,       false,  {"hexstring","options"} },
     { "hidden",             "resendwallettransactions", &resendwallettransactions, true,   {} },
     { "wallet",             "abandontransaction",       &abandontransaction,       false,  {"txid"} },
+    { "wallet",             "abortrescan",              &abortrescan,              false,  {} },
     { "wallet",             "addmultisigaddress",       &addmultisigaddress,       true,   {"nrequired","keys","account"} },
     { "wallet",             "addwitnessaddress",        &addwitnessaddress,        true,   {"address"} },
     { "wallet",             "backupwallet",             &backupwallet,             true,   {"destination"} },
@@ -3240,6 +3312,7 @@ static const CRPCCommand commands[] =
     { "wallet",             "getrawchangeaddress",      &getrawchangeaddress,      true,   {} },
     { "wallet",             "getreceivedbyaccount",     &getreceivedbyaccount,     false,  {"account","minconf"} },
     { "wallet",             "getreceivedbyaddress",     &getreceivedbyaddress,     false,  {"address","minconf"} },
+    { "wallet",             "getrescaninfo",            &getrescaninfo,            true,   {} },
     { "wallet",             "gettransaction",           &gettransaction,           false,  {"txid","include_watchonly"} },
     { "wallet",             "getunconfirmedbalance",    &getunconfirmedbalance,    false,  {} },
     { "wallet",             "getwalletinfo",            &getwalletinfo,            false,  {} },
@@ -0,0 +1,130 @@
+// Copyright (c) 2025 The Trumpow Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "test/test_bitcoin.h"
+#include "util.h"
+#include "wallet/logdb.h"
+
+#include <string>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(logdb_tests, BasicTestingSetup)
+
+static std::vector<unsigned char> K(const std::string& str)
+{
+    return std::vector<unsigned char>(str.begin(), str.end());
+}
+
+static std::string ReadString(CLogDB& log, const std::string& key)
+{
+    CSerializeData value;
+    if (!log.Read(K(key), value))
+        return "<missing>";
+    return std::string(value.begin(), value.end());
+}
+
+static bool WriteString(CLogDB& log, const std::string& key, const std::string& value)
+{
+    return log.Write(K(key), value.data(), value.size());
+}
+
+BOOST_AUTO_TEST_CASE(logdb_read_write_reopen)
+{
+    fs::path path = GetDataDir() / "logdb_read_write.dat";
+    BOOST_CHECK(!CLogDB::IsLogFile(path));
+    {
+        CLogDB log(path);
+        BOOST_CHECK(!log.Open(false));
+        BOOST_CHECK(log.Open(true));
+        BOOST_CHECK(CLogDB::IsLogFile(path));
+
+        BOOST_CHECK(WriteString(log, "b", "two"));
+        BOOST_CHECK(WriteString(log, "a", "one"));
+        BOOST_CHECK(WriteString(log, "c", "three"));
+        BOOST_CHECK(WriteString(log, "a", "uno"));
+        BOOST_CHECK(log.Erase(K("c")));
+        BOOST_CHECK_EQUAL(ReadString(log, "a"), "uno");
+        BOOST_CHECK(!log.Exists(K("c")));
+
+        CLogDBBatch batch;
+        batch.Write(K("d"), "four", 4);
+        batch.Erase(K("b"));
+        BOOST_CHECK(log.WriteBatch(batch));
+        BOOST_CHECK(log.Sync());
+    }
+
+    CLogDB log(path);
+    BOOST_CHECK(log.Open(false));
+    BOOST_CHECK_EQUAL(ReadString(log, "a"), "uno");
+    BOOST_CHECK_EQUAL(ReadString(log, "b"), "<missing>");
+    BOOST_CHECK_EQUAL(ReadString(log, "c"), "<missing>");
+    BOOST_CHECK_EQUAL(ReadString(log, "d"), "four");
+
+    // Keys come back in byte order, like a Berkeley DB btree
+    std::vector<unsigned char> key;
+    CSerializeData value;
+    BOOST_CHECK(log.ReadNext(K("b"), false, key, value));
+    BOOST_CHECK(key == K("d"));
+    BOOST_CHECK(log.ReadNext(K("a"), false, key, value));
+    BOOST_CHECK(key == K("a"));
+    BOOST_CHECK(log.ReadNext(K("a"), true, key, value));
+    BOOST_CHECK(key == K("d"));
+    BOOST_CHECK(!log.ReadNext(K("d"), true, key, value));
+}
+
+BOOST_AUTO_TEST_CASE(logdb_torn_tail)
+{
+    fs::path path = GetDataDir() / "logdb_torn_tail.dat";
+    uint64_t nGoodSize;
+    {
+        CLogDB log(path);
+        BOOST_CHECK(log.Open(true));
+        BOOST_CHECK(WriteString(log, "key", "value"));
+        nGoodSize = log.GetFileSize();
+        // A batch that only got halfway to disk
+        BOOST_CHECK(WriteString(log, "key", "newer value"));
+    }
+    fs::resize_file(path, fs::file_size(path) - 3);
+
+    CLogDB log(path);
+    BOOST_CHECK(log.Open(false));
+    BOOST_CHECK_EQUAL(ReadString(log, "key"), "value");
+    BOOST_CHECK_EQUAL(log.GetFileSize(), nGoodSize);
+    BOOST_CHECK_EQUAL(fs::file_size(path), nGoodSize);
+
+    // The log keeps working after the cut
+    BOOST_CHECK(WriteString(log, "key", "newest value"));
+    BOOST_CHECK_EQUAL(ReadString(log, "key"), "newest value");
+}
+
+BOOST_AUTO_TEST_CASE(logdb_compact)
+{
+    fs::path path = GetDataDir() / "logdb_compact.dat";
+    CLogDB log(path);
+    BOOST_CHECK(log.Open(true));
+
+    const std::string strLarge(1000, 'x');
+    for (int i = 0; i < 2000; i++)
+        BOOST_CHECK(WriteString(log, "key", strLarge + strprintf("%d", i)));
+    BOOST_CHECK(WriteString(log, "\x04pool", "skipped"));
+    BOOST_CHECK(WriteString(log, "other", "kept"));
+    BOOST_CHECK(log.ShouldCompact());
+
+    const uint64_t nBefore = log.GetFileSize();
+    BOOST_CHECK(log.Compact("\x04pool"));
+    BOOST_CHECK(log.GetFileSize() < nBefore / 100);
+    BOOST_CHECK(!log.ShouldCompact());
+    BOOST_CHECK_EQUAL(ReadString(log, "key"), strLarge + "1999");
+    BOOST_CHECK_EQUAL(ReadString(log, "other"), "kept");
+    BOOST_CHECK(!log.Exists(K("\x04pool")));
+    BOOST_CHECK(!fs::exists(fs::path(path.string() + ".compact")));
+
+    log.Close();
+    BOOST_CHECK(log.Open(false));
+    BOOST_CHECK_EQUAL(ReadString(log, "key"), strLarge + "1999");
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "txmempool.h"
+#include "wallet/coinselection.h"
 #include "wallet/wallet.h"
 
 #include <set>
@@ -14,6 +15,7 @@
 #include "rpc/server.h"
 #include "test/test_bitcoin.h"
 #include "validation.h"
+#include "wallet/coincontrol.h"
 #include "wallet/test/wallet_test_fixture.h"
 
 #include <boost/foreach.hpp>
@@ -267,10 +269,11 @@ BOOST_AUTO_TEST_CASE(coin_selection_tests)
         add_coin(CWallet::GetMinChange() * 1);
         add_coin(CWallet::GetMinChange() * 100);
 
-        // trying to make 100.01 from these three outputs
+        // trying to make 100.01 from these three outputs: 100 + 0.05 overshoots by less
+        // than a change output would cost, so that beats taking all outputs plus change
         BOOST_CHECK(wallet.SelectCoinsMinConf(CWallet::GetMinChange() * 10001 / 100, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
-        BOOST_CHECK_EQUAL(nValueRet, CWallet::GetMinChange() * 10105 / 100); // we should get all outputs
-        BOOST_CHECK_EQUAL(setCoinsRet.size(), 3U);
+        BOOST_CHECK_EQUAL(nValueRet, CWallet::GetMinChange() * 10005 / 100);
+        BOOST_CHECK_EQUAL(setCoinsRet.size(), 2U);
 
         // but if we try to make 99.9, we should take the bigger of the two small outputs to avoid small change
         BOOST_CHECK(wallet.SelectCoinsMinConf(CWallet::GetMinChange() * 9990 / 100, 1, 1, 0, vCoins, setCoinsRet, nValueRet));
@@ -367,6 +370,52 @@ BOOST_AUTO_TEST_CASE(ApproximateBestSubset)
     empty_wallet();
 }
 
+BOOST_AUTO_TEST_CASE(coin_selection_bnb)
+{
+    std::vector<CSelectionCoin> vCoins;
+    std::vector<char> vfSelected;
+    CAmount nValueRet;
+
+    // sorted by descending value, as SelectCoinsBnB expects
+    vCoins.push_back(CSelectionCoin(5 * COIN, NULL));
+    vCoins.push_back(CSelectionCoin(4 * COIN, NULL));
+    vCoins.push_back(CSelectionCoin(3 * COIN, NULL));
+    vCoins.push_back(CSelectionCoin(2 * COIN, NULL));
+    vCoins.push_back(CSelectionCoin(1 * COIN, NULL));
+
+    // exact match
+    BOOST_CHECK(SelectCoinsBnB(vCoins, 10 * COIN, 0, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 10 * COIN);
+    BOOST_CHECK_EQUAL(vfSelected.size(), vCoins.size());
+    CAmount nTotal = 0;
+    for (unsigned int i = 0; i < vCoins.size(); i++)
+        if (vfSelected[i])
+            nTotal += vCoins[i].nValue;
+    BOOST_CHECK_EQUAL(nTotal, 10 * COIN);
+
+    // more than available, or nothing within the window
+    BOOST_CHECK(!SelectCoinsBnB(vCoins, 16 * COIN, 0, vfSelected, nValueRet));
+    std::vector<CSelectionCoin> vEven;
+    vEven.push_back(CSelectionCoin(4 * COIN, NULL));
+    vEven.push_back(CSelectionCoin(2 * COIN, NULL));
+    BOOST_CHECK(!SelectCoinsBnB(vEven, 5 * COIN, COIN / 2, vfSelected, nValueRet));
+
+    // the least excess within the window wins
+    BOOST_CHECK(SelectCoinsBnB(vEven, 5 * COIN, COIN, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 6 * COIN);
+    vEven.push_back(CSelectionCoin(COIN * 51 / 10, NULL));
+    std::sort(vEven.rbegin(), vEven.rend());
+    BOOST_CHECK(SelectCoinsBnB(vEven, 5 * COIN, COIN, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, COIN * 51 / 10);
+
+    // many identical coins are searched without exhausting the try budget
+    std::vector<CSelectionCoin> vSame(10000, CSelectionCoin(COIN, NULL));
+    vSame.push_back(CSelectionCoin(COIN / 2, NULL));
+    BOOST_CHECK(SelectCoinsBnB(vSame, 5000 * COIN + COIN / 2, 0, vfSelected, nValueRet));
+    BOOST_CHECK_EQUAL(nValueRet, 5000 * COIN + COIN / 2);
+    BOOST_CHECK(vfSelected.back());
+}
+
 BOOST_FIXTURE_TEST_CASE(rescan, TestChain240Setup)
 {
     LOCK(cs_main);
@@ -434,6 +483,23 @@ BOOST_FIXTURE_TEST_CASE(rescan, TestChain240Setup)
     }
 }
 
+BOOST_FIXTURE_TEST_CASE(rescan_heights, TestChain240Setup)
+{
+    LOCK(cs_main);
+
+    // Verify that a rescan over selected heights, as used with the address
+    // index, only picks up transactions from those blocks.
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    std::set<int> setHeights = {1, 10, 100};
+    wallet.ScanForWalletTransactions(setHeights);
+    BOOST_CHECK_EQUAL(wallet.mapWallet.size(), setHeights.size());
+    for (const auto& item : wallet.mapWallet)
+        BOOST_CHECK(setHeights.count(mapBlockIndex[item.second.hashBlock]->nHeight));
+    BOOST_CHECK(!wallet.IsScanning());
+}
+
 // Verify importwallet RPC starts rescan at earliest block with timestamp
 // greater or equal than key birthday. Previously there was a bug where
 // importwallet RPC would start the scan at the latest block with timestamp less
@@ -547,6 +613,42 @@ BOOST_AUTO_TEST_CASE(GetMinimumFee_dust_test)
     CWallet::discardThreshold = COIN / 100;
 }
 
+BOOST_FIXTURE_TEST_CASE(subtract_fee_dust_change, TestChain240Setup)
+{
+    LOCK(cs_main);
+    CWallet wallet;
+    LOCK(wallet.cs_wallet);
+    wallet.AddKeyPubKey(coinbaseKey, coinbaseKey.GetPubKey());
+    wallet.ScanForWalletTransactions(chainActive.Genesis());
+
+    // Overshooting by less than the discard threshold needs no change output,
+    // but with the fee taken from the amount the change is raised to the
+    // threshold at the expense of the recipient instead
+    const CAmount nAmount = coinbaseTxns[0].vout[0].nValue - CWallet::discardThreshold / 10;
+    std::vector<CRecipient> vecSend;
+    vecSend.push_back(CRecipient{GetScriptForRawPubKey(coinbaseKey.GetPubKey()), nAmount, true});
+    CCoinControl coinControl;
+    coinControl.destChange = coinbaseKey.GetPubKey().GetID();
+    CWalletTx wtx;
+    CReserveKey reservekey(&wallet);
+    CAmount nFee;
+    int nChangePos = -1;
+    std::string strError;
+    BOOST_REQUIRE(wallet.CreateTransaction(vecSend, wtx, reservekey, nFee, nChangePos, strError, &coinControl));
+    BOOST_REQUIRE_EQUAL(wtx.tx->vout.size(), 2U);
+    BOOST_REQUIRE(nChangePos == 0 || nChangePos == 1);
+
+    CAmount nIn = 0;
+    for (const CTxIn& txin : wtx.tx->vin)
+        nIn += wallet.GetWalletTx(txin.prevout.hash)->tx->vout[txin.prevout.n].nValue;
+    const CTxOut& change = wtx.tx->vout[nChangePos];
+    const CTxOut& payment = wtx.tx->vout[1 - nChangePos];
+    BOOST_CHECK(nIn - nAmount < CWallet::discardThreshold);
+    BOOST_CHECK_EQUAL(change.nValue, CWallet::discardThreshold);
+    BOOST_CHECK_EQUAL(payment.nValue, nAmount - nFee - (CWallet::discardThreshold - (nIn - nAmount)));
+    BOOST_CHECK_EQUAL(payment.nValue + change.nValue + nFee, nIn);
+}
+
 BOOST_FIXTURE_TEST_CASE(derive_new_child_key_test, WalletTestingSetup)
 {
     CWallet* wallet = pwalletMain;
@@ -592,4 +694,46 @@ BOOST_FIXTURE_TEST_CASE(derive_new_child_key_test, WalletTestingSetup)
     BOOST_CHECK_EQUAL(derivedPubKeyHex, expectedPubKeyHex);
 }
 
+BOOST_FIXTURE_TEST_CASE(generate_new_keys_batch_test, WalletTestingSetup)
+{
+    CWallet* wallet = pwalletMain;
+    LOCK(wallet->cs_wallet);
+
+    // Same fixed seed as above
+    std::vector<unsigned char> seed = ParseHex("000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f");
+    CKey masterKey;
+    masterKey.Set(seed.begin(), seed.end(), true);
+    CPubKey masterPubKey = masterKey.GetPubKey();
+    CKeyMetadata masterMetadata(GetTime());
+    masterMetadata.hdKeypath = "m";
+    masterMetadata.hdMasterKeyID = masterPubKey.GetID();
+    wallet->mapKeyMetadata[masterPubKey.GetID()] = masterMetadata;
+    BOOST_CHECK(wallet->AddKeyPubKey(masterKey, masterPubKey));
+    BOOST_CHECK(wallet->SetHDMasterKey(masterPubKey));
+
+    // A batch large enough to be derived on several threads must give the
+    // same keys, in the same order, as deriving them one by one.
+    const unsigned int nKeys = 2 * KEYPOOL_PARALLEL_MIN_KEYS;
+    std::vector<CPubKey> vPubKeys;
+    {
+        CWalletDB walletdb(wallet->strWalletFile);
+        BOOST_CHECK(walletdb.TxnBegin());
+        wallet->GenerateNewKeys(walletdb, nKeys, vPubKeys);
+        BOOST_CHECK(walletdb.TxnCommit());
+    }
+    BOOST_CHECK_EQUAL(vPubKeys.size(), nKeys);
+    BOOST_CHECK_EQUAL(HexStr(vPubKeys[0].begin(), vPubKeys[0].end()), "0305a077194300e27d320a9504f808a16f05b38dabead31f10104c075d88f81a38");
+    for (unsigned int i = 0; i < nKeys; i++) {
+        BOOST_CHECK(wallet->HaveKey(vPubKeys[i].GetID()));
+        BOOST_CHECK_EQUAL(wallet->mapKeyMetadata[vPubKeys[i].GetID()].hdKeypath, "m/0'/3'/" + std::to_string(i) + "'");
+    }
+    BOOST_CHECK_EQUAL(wallet->GetHDChain().nExternalChainCounter, nKeys);
+
+    // The next key continues the chain
+    CKeyMetadata childMetadata(GetTime());
+    CKey childKey;
+    wallet->DeriveNewChildKey(childMetadata, childKey);
+    BOOST_CHECK_EQUAL(childMetadata.hdKeypath, "m/0'/3'/" + std::to_string(nKeys) + "'");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
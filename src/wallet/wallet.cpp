@@ -12,7 +12,9 @@
 #include "trumpow.h"
 #include "trumpow-fees.h"
 #include "fs.h"
+#include "init.h"
 #include "wallet/coincontrol.h"
+#include "wallet/coinselection.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
 #include "key.h"
@@ -32,6 +34,8 @@
 
 #include <assert.h>
 
+#include <functional>
+
 #include <boost/algorithm/string/replace.hpp>
 #include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
@@ -74,15 +78,6 @@ CAmount CWallet::discardThreshold = DEFAULT_DISCARD_THRESHOLD;
  * @{
  */
 
-struct CompareValueOnly
-{
-    bool operator()(const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t1,
-                    const pair<CAmount, pair<const CWalletTx*, unsigned int> >& t2) const
-    {
-        return t1.first < t2.first;
-    }
-};
-
 std::string COutput::ToString() const
 {
     return strprintf("COutput(%s, %d, %d) [%s]", tx->GetHash().ToString(), i, nDepth, FormatMoney(tx->tx->vout[i].nValue));
@@ -97,47 +92,184 @@ const CWalletTx* CWallet::GetWalletTx(const uint256& hash) const
     return &(it->second);
 }
 
+namespace {
+
+/**
+ * Threads that are started once and then, together with the calling thread,
+ * run fn(i) for every i in [0, nCount) of each Run() call. This saves
+ * starting threads again for every batch of a long running job.
+ */
+class CWorkerGroup
+{
+    boost::mutex mutex;
+    boost::condition_variable condWork;
+    boost::condition_variable condDone;
+    boost::thread_group threadGroup;
+    std::function<void(size_t)> fn;
+    size_t nCount;
+    std::atomic<size_t> nNext;
+    uint64_t nGeneration;
+    int nBusy;
+    bool fStop;
+
+    void Drain()
+    {
+        for (size_t i = nNext++; i < nCount; i = nNext++)
+            fn(i);
+    }
+
+    void Work()
+    {
+        uint64_t nSeen = 0;
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(mutex);
+                while (!fStop && nGeneration == nSeen)
+                    condWork.wait(lock);
+                if (fStop)
+                    return;
+                nSeen = nGeneration;
+                nBusy++;
+            }
+            Drain();
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (--nBusy == 0)
+                condDone.notify_all();
+        }
+    }
+
+public:
+    //! nThreads includes the thread calling Run()
+    explicit CWorkerGroup(int nThreads) : nCount(0), nNext(0), nGeneration(0), nBusy(0), fStop(false)
+    {
+        for (int i = 1; i < nThreads; i++)
+            threadGroup.create_thread(boost::bind(&CWorkerGroup::Work, this));
+    }
+
+    ~CWorkerGroup()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            fStop = true;
+        }
+        condWork.notify_all();
+        threadGroup.join_all();
+    }
+
+    void Run(size_t nCountIn, const std::function<void(size_t)>& fnIn)
+    {
+        {
+            // A worker may still be draining the previous call
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nBusy > 0)
+                condDone.wait(lock);
+            fn = fnIn;
+            nCount = nCountIn;
+            nNext = 0;
+            nGeneration++;
+        }
+        condWork.notify_all();
+        Drain();
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (nBusy > 0)
+            condDone.wait(lock);
+    }
+};
+
+/**
+ * Run fn(i) for every i in [0, nCount) on up to nThreads threads, including
+ * the calling one.
+ */
+void ParallelFor(size_t nCount, int nThreads, const std::function<void(size_t)>& fn)
+{
+    CWorkerGroup workers(std::min<size_t>(nThreads, nCount));
+    workers.Run(nCount, fn);
+}
+
+} // anon namespace
+
 CPubKey CWallet::GenerateNewKey()
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
-    bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
+    CWalletDB walletdb(strWalletFile);
+    std::vector<CPubKey> vPubKeys;
+    GenerateNewKeys(walletdb, 1, vPubKeys);
+    return vPubKeys.front();
+}
 
-    CKey secret;
+void CWallet::GenerateNewKeys(CWalletDB& walletdb, unsigned int nKeys, std::vector<CPubKey>& vPubKeys)
+{
+    AssertLockHeld(cs_wallet); // mapKeyMetadata
+    bool fCompressed = CanSupportFeature(FEATURE_COMPRPUBKEY); // default to compressed public keys if we want 0.6.0 wallets
 
     // Create new metadata
     int64_t nCreationTime = GetTime();
-    CKeyMetadata metadata(nCreationTime);
-
-    // use HD key derivation if HD was enabled during wallet creation
-    if (IsHDEnabled()) {
-        DeriveNewChildKey(metadata, secret);
-    } else {
-        secret.MakeNewKey(fCompressed);
-    }
 
     // Compressed public keys were introduced in version 0.6.0
     if (fCompressed)
-        SetMinVersion(FEATURE_COMPRPUBKEY);
+        SetMinVersion(FEATURE_COMPRPUBKEY, &walletdb);
+
+    // use HD key derivation if HD was enabled during wallet creation
+    const bool fHD = IsHDEnabled();
+    CExtKey externalChainChildKey;
+    if (fHD)
+        GetExternalChainKey(externalChainChildKey);
+
+    const int nThreads = nKeys >= KEYPOOL_PARALLEL_MIN_KEYS ? GetNumCores() : 1;
+    const size_t nWanted = vPubKeys.size() + nKeys;
+    while (vPubKeys.size() < nWanted)
+    {
+        // Deriving the keys and computing their public keys is the expensive
+        // part and touches no wallet state, so do it on all cores.
+        const size_t nBatch = nWanted - vPubKeys.size();
+        const uint32_t nFirstChild = hdChain.nExternalChainCounter;
+        std::vector<CKey> vSecrets(nBatch);
+        std::vector<CPubKey> vNewPubKeys(nBatch);
+        ParallelFor(nBatch, nThreads, [&](size_t i) {
+            if (fHD) {
+                // always derive hardened keys
+                CExtKey childKey;
+                externalChainChildKey.Derive(childKey, (nFirstChild + i) | BIP32_HARDENED_KEY_LIMIT);
+                vSecrets[i] = childKey.key;
+            } else {
+                vSecrets[i].MakeNewKey(fCompressed);
+            }
+            vNewPubKeys[i] = vSecrets[i].GetPubKey();
+            assert(vSecrets[i].VerifyPubKey(vNewPubKeys[i]));
+        });
 
-    CPubKey pubkey = secret.GetPubKey();
-    assert(secret.VerifyPubKey(pubkey));
+        for (size_t i = 0; i < nBatch; i++)
+        {
+            CKeyMetadata metadata(nCreationTime);
+            if (fHD) {
+                metadata.hdKeypath = "m/0'/3'/" + std::to_string(nFirstChild + i) + "'";
+                metadata.hdMasterKeyID = hdChain.masterKeyID;
+                hdChain.nExternalChainCounter = nFirstChild + i + 1;
+                // skip keys already known to the wallet
+                if (HaveKey(vNewPubKeys[i].GetID()))
+                    continue;
+            }
 
-    mapKeyMetadata[pubkey.GetID()] = metadata;
-    UpdateTimeFirstKey(nCreationTime);
+            mapKeyMetadata[vNewPubKeys[i].GetID()] = metadata;
+            UpdateTimeFirstKey(nCreationTime);
 
-    if (!AddKeyPubKey(secret, pubkey))
-        throw std::runtime_error(std::string(__func__) + ": AddKey failed");
-    return pubkey;
+            if (!AddKeyPubKeyWithDB(walletdb, vSecrets[i], vNewPubKeys[i]))
+                throw std::runtime_error(std::string(__func__) + ": AddKey failed");
+            vPubKeys.push_back(vNewPubKeys[i]);
+        }
+    }
+
+    // update the chain model in the database
+    if (fHD && !walletdb.WriteHDChain(hdChain))
+        throw std::runtime_error(std::string(__func__) + ": Writing HD chain model failed");
 }
 
-void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
+void CWallet::GetExternalChainKey(CExtKey& externalChainChildKey)
 {
     // for now we use a fixed keypath scheme of m/0'/3'/k
     CKey key;                      //master key seed (256bit)
     CExtKey masterKey;             //hd master key
     CExtKey accountKey;            //key at m/0'
-    CExtKey externalChainChildKey; //key at m/0'/3'
-    CExtKey childKey;              //key at m/0'/3'/<n>'
 
     // try to get the master key
     if (!GetKey(hdChain.masterKeyID, key))
@@ -151,6 +283,14 @@ void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
 
     // derive m/0'/3'
     accountKey.Derive(externalChainChildKey, BIP44_COIN_TYPE | BIP32_HARDENED_KEY_LIMIT);
+}
+
+void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
+{
+    CExtKey externalChainChildKey; //key at m/0'/3'
+    CExtKey childKey;              //key at m/0'/3'/<n>'
+
+    GetExternalChainKey(externalChainChildKey);
 
     // derive child key at next index, skip keys already known to the wallet
     do {
@@ -171,26 +311,42 @@ void CWallet::DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret)
 }
 
 bool CWallet::AddKeyPubKey(const CKey& secret, const CPubKey &pubkey)
+{
+    CWalletDB walletdb(strWalletFile);
+    return AddKeyPubKeyWithDB(walletdb, secret, pubkey);
+}
+
+bool CWallet::AddKeyPubKeyWithDB(CWalletDB& walletdb, const CKey& secret, const CPubKey &pubkey)
 {
     AssertLockHeld(cs_wallet); // mapKeyMetadata
-    if (!CCryptoKeyStore::AddKeyPubKey(secret, pubkey))
+
+    // CCryptoKeyStore knows nothing about wallet databases but calls the
+    // AddCryptedKey override below, so tunnel the handle through to it to
+    // keep the write inside the caller's transaction.
+    const bool fTunnelDB = fFileBacked && !pwalletdbEncryption;
+    if (fTunnelDB)
+        pwalletdbEncryption = &walletdb;
+    const bool fAdded = CCryptoKeyStore::AddKeyPubKey(secret, pubkey);
+    if (fTunnelDB)
+        pwalletdbEncryption = NULL;
+    if (!fAdded)
         return false;
 
     // check if we need to remove from watch-only
     CScript script;
     script = GetScriptForDestination(pubkey.GetID());
     if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
     script = GetScriptForRawPubKey(pubkey);
     if (HaveWatchOnly(script))
-        RemoveWatchOnly(script);
+        RemoveWatchOnlyWithDB(walletdb, script);
 
     if (!fFileBacked)
         return true;
     if (!IsCrypted()) {
-        return CWalletDB(strWalletFile).WriteKey(pubkey,
-                                                 secret.GetPrivKey(),
-                                                 mapKeyMetadata[pubkey.GetID()]);
+        return walletdb.WriteKey(pubkey,
+                                 secret.GetPrivKey(),
+                                 mapKeyMetadata[pubkey.GetID()]);
     }
     return true;
 }
@@ -285,6 +441,12 @@ bool CWallet::AddWatchOnly(const CScript& dest, int64_t nCreateTime)
 }
 
 bool CWallet::RemoveWatchOnly(const CScript &dest)
+{
+    CWalletDB walletdb(strWalletFile);
+    return RemoveWatchOnlyWithDB(walletdb, dest);
+}
+
+bool CWallet::RemoveWatchOnlyWithDB(CWalletDB& walletdb, const CScript &dest)
 {
     AssertLockHeld(cs_wallet);
     if (!CCryptoKeyStore::RemoveWatchOnly(dest))
@@ -292,7 +454,7 @@ bool CWallet::RemoveWatchOnly(const CScript &dest)
     if (!HaveWatchOnly())
         NotifyWatchonlyChanged(false);
     if (fFileBacked)
-        if (!CWalletDB(strWalletFile).EraseWatchOnly(dest))
+        if (!walletdb.EraseWatchOnly(dest))
             return false;
 
     return true;
@@ -485,6 +647,16 @@ bool CWallet::Verify()
         }
     }
 
+    if (bitdb.IsLogDb(walletFile))
+    {
+        // Opening the log checks every record and drops an interrupted tail,
+        // there is nothing Berkeley DB could verify or salvage in it
+        LogPrintf("Wallet %s is stored in an append-only log\n", walletFile);
+        if (GetBoolArg("-salvagewallet", false))
+            InitWarning(strprintf(_("-salvagewallet only applies to Berkeley DB wallets, ignoring it for %s"), walletFile));
+        return true;
+    }
+
     if (GetBoolArg("-salvagewallet", false))
     {
         // Recover readable keypairs:
@@ -1516,60 +1688,194 @@ void CWalletTx::GetAccountAmounts(const string& strAccount, CAmount& nReceived,
     }
 }
 
+namespace {
+
+/** A block read from disk and pre-filtered by a rescan thread. */
+struct CRescanBlock
+{
+    CBlockIndex* pindex;
+    CBlock block;
+    bool fRead;
+    //! For each transaction: whether one of its outputs is ours
+    std::vector<bool> vIsMine;
+
+    explicit CRescanBlock(CBlockIndex* pindexIn) : pindex(pindexIn), fRead(false) {}
+};
+
+/**
+ * Read the blocks of a rescan batch from disk and run the output IsMine
+ * filter over their transactions on the rescan's worker threads. This only
+ * consults the keystore, which has its own lock, so it must not take
+ * cs_wallet: the caller already holds it.
+ */
+void ReadRescanBatch(const CWallet& wallet, std::vector<CRescanBlock>& vBatch, CWorkerGroup& workers)
+{
+    workers.Run(vBatch.size(), [&wallet, &vBatch](size_t i) {
+        if (wallet.IsAbortingRescan() || ShutdownRequested())
+            return;
+        CRescanBlock& entry = vBatch[i];
+        entry.fRead = ReadBlockFromDisk(entry.block, entry.pindex, Params().GetConsensus(entry.pindex->nHeight));
+        if (!entry.fRead)
+            return;
+        entry.vIsMine.resize(entry.block.vtx.size());
+        for (size_t posInBlock = 0; posInBlock < entry.block.vtx.size(); ++posInBlock)
+            entry.vIsMine[posInBlock] = wallet.IsMine(*entry.block.vtx[posInBlock]);
+    });
+}
+
+/** Clears the wallet's scanning flag when a rescan ends, also on exceptions. */
+class CScanningReserver
+{
+    std::atomic<bool>& fScanning;
+public:
+    explicit CScanningReserver(std::atomic<bool>& fScanningIn) : fScanning(fScanningIn) { fScanning = true; }
+    ~CScanningReserver() { fScanning = false; }
+};
+
+} // anon namespace
+
 /**
  * Scan the block chain (starting in pindexStart) for transactions
  * from or to us. If fUpdate is true, found transactions that already
  * exist in the wallet will be updated.
  *
  * Returns pointer to the first block in the last contiguous range that was
- * successfully scanned.
+ * successfully scanned. If pfComplete is given, it is set to whether every
+ * block was scanned, that is the scan was neither aborted nor cut short by
+ * shutdown and no block failed to read.
  *
  */
-CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate)
+CBlockIndex* CWallet::ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate, bool* pfComplete)
+{
+    bool fComplete;
+    CBlockIndex* ret = ScanBlocks(pindexStart, NULL, fUpdate, fComplete);
+    if (pfComplete)
+        *pfComplete = fComplete;
+    return ret;
+}
+
+bool CWallet::ScanForWalletTransactions(const std::set<int>& setHeights, bool fUpdate)
+{
+    LOCK(cs_main);
+    bool fComplete = true;
+    if (!setHeights.empty())
+        ScanBlocks(chainActive[*setHeights.begin()], &setHeights, fUpdate, fComplete);
+    return fComplete;
+}
+
+/**
+ * Blocks are read from disk and run through the output IsMine filter in
+ * batches by -rescanthreads threads. The calling thread then adds matching
+ * transactions to the wallet in chain order, so the result is the same as
+ * a serial scan. If pSetHeights is given, only blocks at those heights are
+ * visited.
+ */
+CBlockIndex* CWallet::ScanBlocks(CBlockIndex* pindexStart, const std::set<int>* pSetHeights, bool fUpdate, bool& fComplete)
 {
     CBlockIndex* ret = nullptr;
+    fComplete = true;
     int64_t nNow = GetTime();
     const CChainParams& chainParams = Params();
 
+    int nThreads = GetArg("-rescanthreads", DEFAULT_RESCAN_THREADS);
+    if (nThreads <= 0)
+        nThreads += GetNumCores();
+    nThreads = std::max(1, std::min(nThreads, MAX_RESCAN_THREADS));
+
     CBlockIndex* pindex = pindexStart;
     {
         LOCK2(cs_main, cs_wallet);
 
+        auto nextBlock = [pSetHeights](CBlockIndex* pindexPrev) -> CBlockIndex* {
+            if (!pSetHeights)
+                return chainActive.Next(pindexPrev);
+            std::set<int>::const_iterator it = pSetHeights->upper_bound(pindexPrev->nHeight);
+            return it == pSetHeights->end() ? NULL : chainActive[*it];
+        };
+
+        // Transactions whose outputs are not ours may still need to be looked
+        // at: ones we already have, ones spending our outputs and ones that
+        // conflict with our spends. These are cheap lookups under cs_wallet.
+        auto mayInvolveMe = [this](const CTransaction& tx) -> bool {
+            if (mapWallet.count(tx.GetHash()))
+                return true;
+            BOOST_FOREACH(const CTxIn& txin, tx.vin) {
+                if (mapWallet.count(txin.prevout.hash) || mapTxSpends.count(txin.prevout))
+                    return true;
+            }
+            return false;
+        };
+
         // no need to read and scan block, if block was created before
         // our wallet birthday (as adjusted for block time variability)
         while (pindex && nTimeFirstKey && (pindex->GetBlockTime() < (nTimeFirstKey - 7200)))
-            pindex = chainActive.Next(pindex);
+            pindex = nextBlock(pindex);
+
+        CScanningReserver reserver(fScanningWallet);
+        fAbortRescan = false;
+        nScanStartTime = GetTimeMillis();
+        nScanStartHeight = pindex ? pindex->nHeight : chainActive.Height();
+        nScanHeight = nScanStartHeight.load();
+        nScanStopHeight = chainActive.Height();
 
         ShowProgress(_("Rescanning..."), 0); // show rescan progress in GUI as dialog or on splashscreen, if -rescan on startup
         double dProgressStart = GuessVerificationProgress(chainParams.TxData(), pindex);
         double dProgressTip = GuessVerificationProgress(chainParams.TxData(), chainActive.Tip());
+        CWorkerGroup workers(nThreads);
+        std::vector<CRescanBlock> vBatch;
         while (pindex)
         {
-            if (pindex->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
-                ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindex) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
-            if (GetTime() >= nNow + 60) {
-                nNow = GetTime();
-                LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindex->nHeight, GuessVerificationProgress(chainParams.TxData(), pindex));
+            vBatch.clear();
+            for (; pindex && vBatch.size() < (size_t)nThreads * RESCAN_BLOCKS_PER_THREAD; pindex = nextBlock(pindex))
+                vBatch.push_back(CRescanBlock(pindex));
+            ReadRescanBatch(*this, vBatch, workers);
+            if (fAbortRescan || ShutdownRequested()) {
+                fComplete = false;
+                LogPrintf("Rescan %s at block %d. Progress=%f\n", fAbortRescan ? "aborted" : "interrupted by shutdown", nScanHeight.load(), ScanningProgress());
+                break;
             }
 
-            CBlock block;
-            if (ReadBlockFromDisk(block, pindex, Params().GetConsensus(pindex->nHeight))) {
-                for (size_t posInBlock = 0; posInBlock < block.vtx.size(); ++posInBlock) {
-                    AddToWalletIfInvolvingMe(*block.vtx[posInBlock], pindex, posInBlock, fUpdate);
+            BOOST_FOREACH(CRescanBlock& entry, vBatch)
+            {
+                CBlockIndex* pindexBlock = entry.pindex;
+                nScanHeight = pindexBlock->nHeight;
+                if (pindexBlock->nHeight % 100 == 0 && dProgressTip - dProgressStart > 0.0)
+                    ShowProgress(_("Rescanning..."), std::max(1, std::min(99, (int)((GuessVerificationProgress(chainParams.TxData(), pindexBlock) - dProgressStart) / (dProgressTip - dProgressStart) * 100))));
+                if (GetTime() >= nNow + 60) {
+                    nNow = GetTime();
+                    LogPrintf("Still rescanning. At block %d. Progress=%f\n", pindexBlock->nHeight, GuessVerificationProgress(chainParams.TxData(), pindexBlock));
                 }
-                if (!ret) {
-                    ret = pindex;
+
+                if (entry.fRead) {
+                    for (size_t posInBlock = 0; posInBlock < entry.block.vtx.size(); ++posInBlock) {
+                        const CTransaction& tx = *entry.block.vtx[posInBlock];
+                        if (entry.vIsMine[posInBlock] || mayInvolveMe(tx))
+                            AddToWalletIfInvolvingMe(tx, pindexBlock, posInBlock, fUpdate);
+                    }
+                    if (!ret) {
+                        ret = pindexBlock;
+                    }
+                } else {
+                    ret = nullptr;
+                    fComplete = false;
                 }
-            } else {
-                ret = nullptr;
             }
-            pindex = chainActive.Next(pindex);
         }
         ShowProgress(_("Rescanning..."), 100); // hide progress dialog in GUI
     }
     return ret;
 }
 
+double CWallet::ScanningProgress() const
+{
+    if (!fScanningWallet)
+        return 0.0;
+    const int nRange = nScanStopHeight - nScanStartHeight;
+    if (nRange <= 0)
+        return 1.0;
+    return std::max(0.0, std::min(1.0, (double)(nScanHeight - nScanStartHeight) / nRange));
+}
+
 void CWallet::ReacceptWalletTransactions()
 {
     // If transactions aren't being broadcasted, don't let them into local mempool either
@@ -2102,52 +2408,6 @@ void CWallet::AvailableCoins(vector<COutput> &vCoins, bool fOnlyConfirmed, const
     }
 }
 
-static void ApproximateBestSubset(vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > >vValue, const CAmount& nTotalLower, const CAmount& nTargetValue,
-                                  vector<char>& vfBest, CAmount& nBest, int iterations = 1000)
-{
-    vector<char> vfIncluded;
-
-    vfBest.assign(vValue.size(), true);
-    nBest = nTotalLower;
-
-    FastRandomContext insecure_rand;
-
-    for (int nRep = 0; nRep < iterations && nBest != nTargetValue; nRep++)
-    {
-        vfIncluded.assign(vValue.size(), false);
-        CAmount nTotal = 0;
-        bool fReachedTarget = false;
-        for (int nPass = 0; nPass < 2 && !fReachedTarget; nPass++)
-        {
-            for (unsigned int i = 0; i < vValue.size(); i++)
-            {
-                //The solver here uses a randomized algorithm,
-                //the randomness serves no real security purpose but is just
-                //needed to prevent degenerate behavior and it is important
-                //that the rng is fast. We do not use a constant random sequence,
-                //because there may be some privacy improvement by making
-                //the selection random.
-                if (nPass == 0 ? insecure_rand.randbool() : !vfIncluded[i])
-                {
-                    nTotal += vValue[i].first;
-                    vfIncluded[i] = true;
-                    if (nTotal >= nTargetValue)
-                    {
-                        fReachedTarget = true;
-                        if (nTotal < nBest)
-                        {
-                            nBest = nTotal;
-                            vfBest = vfIncluded;
-                        }
-                        nTotal -= vValue[i].first;
-                        vfIncluded[i] = false;
-                    }
-                }
-            }
-        }
-    }
-}
-
 // Trumpow: MIN_CHANGE as a function of discardThreshold and minTxFee(1000)
 // Makes the wallet change output minimums configurable instead of hardcoded
 // defaults.
@@ -2156,24 +2416,38 @@ CAmount CWallet::GetMinChange()
   return discardThreshold + minTxFee.GetFeePerK() * MIN_CHANGE_FEE_MULTIPLIER;
 }
 
-bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, vector<COutput> vCoins,
+bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMine, const int nConfTheirs, const uint64_t nMaxAncestors, const vector<COutput>& vCoins,
                                  set<pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const
 {
     setCoinsRet.clear();
     nValueRet = 0;
     FastRandomContext insecure_rand;
 
+    // Coins that cost more to spend than they are worth only add fee
+    const CAmount nInputFee = minTxFee.GetFee(COIN_SELECTION_INPUT_SIZE);
+    // Creating a change output now and spending it later costs this much, so
+    // a selection overshooting the target by less is better off without change.
+    // Overshooting by the discard threshold or more leaves change all the same.
+    const CAmount nCostOfChange = std::min(minTxFee.GetFee(COIN_SELECTION_OUTPUT_SIZE + COIN_SELECTION_INPUT_SIZE), discardThreshold);
+
+    // Candidates index into vCoins; the shuffle only reorders the index
+    vector<const COutput*> vpCoins;
+    vpCoins.reserve(vCoins.size());
+    BOOST_FOREACH(const COutput &output, vCoins)
+        vpCoins.push_back(&output);
+    shuffle(vpCoins.begin(), vpCoins.end(), insecure_rand);
+
     // List of values less than target
-    pair<CAmount, pair<const CWalletTx*,unsigned int> > coinLowestLarger;
-    coinLowestLarger.first = std::numeric_limits<CAmount>::max();
-    coinLowestLarger.second.first = NULL;
-    vector<pair<CAmount, pair<const CWalletTx*,unsigned int> > > vValue;
+    CSelectionCoin coinLowestLarger(std::numeric_limits<CAmount>::max(), NULL);
+    vector<CSelectionCoin> vValue;
+    vector<CSelectionCoin> vCandidates;
+    vValue.reserve(vpCoins.size());
+    vCandidates.reserve(vpCoins.size());
     CAmount nTotalLower = 0;
 
-    shuffle(vCoins.begin(), vCoins.end(), insecure_rand);
-
-    BOOST_FOREACH(const COutput &output, vCoins)
+    BOOST_FOREACH(const COutput *poutput, vpCoins)
     {
+        const COutput &output = *poutput;
         if (!output.fSpendable)
             continue;
 
@@ -2185,52 +2459,74 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
         if (!mempool.TransactionWithinChainLimit(pcoin->GetHash(), nMaxAncestors))
             continue;
 
-        int i = output.i;
-        CAmount n = pcoin->tx->vout[i].nValue;
+        CSelectionCoin coin(pcoin->tx->vout[output.i].nValue, poutput);
 
-        pair<CAmount,pair<const CWalletTx*,unsigned int> > coin = make_pair(n,make_pair(pcoin, i));
-
-        if (n == nTargetValue)
+        if (coin.nValue == nTargetValue)
         {
-            setCoinsRet.insert(coin.second);
-            nValueRet += coin.first;
+            setCoinsRet.insert(make_pair(pcoin, output.i));
+            nValueRet += coin.nValue;
             return true;
         }
-        else if (n < nTargetValue + GetMinChange())
+
+        if (coin.nValue <= nInputFee)
+            continue;
+        vCandidates.push_back(coin);
+
+        if (coin.nValue < nTargetValue + GetMinChange())
         {
             vValue.push_back(coin);
-            nTotalLower += n;
+            nTotalLower += coin.nValue;
         }
-        else if (n < coinLowestLarger.first)
+        else if (coin.nValue < coinLowestLarger.nValue)
         {
             coinLowestLarger = coin;
         }
     }
 
+    // Prefer a selection that needs no change output at all. The sort is not
+    // stable, so equal values keep the shuffled order between calls.
+    std::sort(vCandidates.begin(), vCandidates.end());
+    std::reverse(vCandidates.begin(), vCandidates.end());
+    vector<char> vfBest;
+    CAmount nBest;
+
+    if (SelectCoinsBnB(vCandidates, nTargetValue, nCostOfChange, vfBest, nBest))
+    {
+        LogPrint(BCLog::SELECTCOINS, "SelectCoins() branch and bound: ");
+        for (unsigned int i = 0; i < vCandidates.size(); i++)
+            if (vfBest[i])
+            {
+                const COutput *poutput = vCandidates[i].pOutput;
+                setCoinsRet.insert(make_pair(poutput->tx, poutput->i));
+                nValueRet += vCandidates[i].nValue;
+                LogPrint(BCLog::SELECTCOINS, "%s ", FormatMoney(vCandidates[i].nValue));
+            }
+        LogPrint(BCLog::SELECTCOINS, "total %s\n", FormatMoney(nBest));
+        return true;
+    }
+
     if (nTotalLower == nTargetValue)
     {
         for (unsigned int i = 0; i < vValue.size(); ++i)
         {
-            setCoinsRet.insert(vValue[i].second);
-            nValueRet += vValue[i].first;
+            setCoinsRet.insert(make_pair(vValue[i].pOutput->tx, vValue[i].pOutput->i));
+            nValueRet += vValue[i].nValue;
         }
         return true;
     }
 
     if (nTotalLower < nTargetValue)
     {
-        if (coinLowestLarger.second.first == NULL)
+        if (coinLowestLarger.pOutput == NULL)
             return false;
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
+        setCoinsRet.insert(make_pair(coinLowestLarger.pOutput->tx, coinLowestLarger.pOutput->i));
+        nValueRet += coinLowestLarger.nValue;
         return true;
     }
 
     // Solve subset sum by stochastic approximation
-    std::sort(vValue.begin(), vValue.end(), CompareValueOnly());
+    std::sort(vValue.begin(), vValue.end());
     std::reverse(vValue.begin(), vValue.end());
-    vector<char> vfBest;
-    CAmount nBest;
 
     ApproximateBestSubset(vValue, nTotalLower, nTargetValue, vfBest, nBest);
     if (nBest != nTargetValue && nTotalLower >= nTargetValue + GetMinChange())
@@ -2238,25 +2534,25 @@ bool CWallet::SelectCoinsMinConf(const CAmount& nTargetValue, const int nConfMin
 
     // If we have a bigger coin and (either the stochastic approximation didn't find a good solution,
     //                                   or the next bigger coin is closer), return the bigger coin
-    if (coinLowestLarger.second.first &&
-        ((nBest != nTargetValue && nBest < nTargetValue + GetMinChange()) || coinLowestLarger.first <= nBest))
+    if (coinLowestLarger.pOutput &&
+        ((nBest != nTargetValue && nBest < nTargetValue + GetMinChange()) || coinLowestLarger.nValue <= nBest))
     {
-        setCoinsRet.insert(coinLowestLarger.second);
-        nValueRet += coinLowestLarger.first;
+        setCoinsRet.insert(make_pair(coinLowestLarger.pOutput->tx, coinLowestLarger.pOutput->i));
+        nValueRet += coinLowestLarger.nValue;
     }
     else {
         for (unsigned int i = 0; i < vValue.size(); i++)
             if (vfBest[i])
             {
-                setCoinsRet.insert(vValue[i].second);
-                nValueRet += vValue[i].first;
+                setCoinsRet.insert(make_pair(vValue[i].pOutput->tx, vValue[i].pOutput->i));
+                nValueRet += vValue[i].nValue;
             }
 
-        LogPrint("selectcoins", "SelectCoins() best subset: ");
+        LogPrint(BCLog::SELECTCOINS, "SelectCoins() best subset: ");
         for (unsigned int i = 0; i < vValue.size(); i++)
             if (vfBest[i])
-                LogPrint("selectcoins", "%s ", FormatMoney(vValue[i].first));
-        LogPrint("selectcoins", "total %s\n", FormatMoney(nBest));
+                LogPrint(BCLog::SELECTCOINS, "%s ", FormatMoney(vValue[i].nValue));
+        LogPrint(BCLog::SELECTCOINS, "total %s\n", FormatMoney(nBest));
     }
 
     return true;
@@ -3097,46 +3393,110 @@ bool CWallet::NewKeyPool()
             return false;
 
         int64_t nKeys = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t)0);
-        for (int i = 0; i < nKeys; i++)
-        {
-            int64_t nIndex = i+1;
-            walletdb.WritePool(nIndex, CKeyPool(GenerateNewKey()));
-            setKeyPool.insert(nIndex);
-        }
+        for (int64_t nDone = 0; nDone < nKeys; nDone += KEYPOOL_TOPUP_BATCH_SIZE)
+            AddKeysToKeyPool(std::min<int64_t>(nKeys - nDone, KEYPOOL_TOPUP_BATCH_SIZE));
         LogPrintf("CWallet::NewKeyPool wrote %d new keys\n", nKeys);
     }
     return true;
 }
 
+void CWallet::AddKeysToKeyPool(unsigned int nKeys)
+{
+    AssertLockHeld(cs_wallet);
+    if (nKeys == 0)
+        return;
+
+    // One transaction for the keys, their metadata and the pool entries
+    // instead of an auto-committed write per record
+    CWalletDB walletdb(strWalletFile);
+    const bool fTxn = walletdb.TxnBegin();
+
+    std::vector<CPubKey> vPubKeys;
+    GenerateNewKeys(walletdb, nKeys, vPubKeys);
+
+    int64_t nBegin = 1;
+    if (!setKeyPool.empty())
+        nBegin = *(--setKeyPool.end()) + 1;
+    for (size_t i = 0; i < vPubKeys.size(); i++) {
+        if (fFileBacked && !walletdb.WritePool(nBegin + i, CKeyPool(vPubKeys[i])))
+            throw runtime_error(std::string(__func__) + ": writing generated key failed");
+    }
+    if (fTxn && !walletdb.TxnCommit())
+        throw runtime_error(std::string(__func__) + ": committing generated keys failed");
+
+    for (size_t i = 0; i < vPubKeys.size(); i++)
+        setKeyPool.insert(nBegin + i);
+    LogPrintf("keypool added keys %d to %d, size=%u\n", nBegin, nBegin + vPubKeys.size() - 1, setKeyPool.size());
+}
+
 bool CWallet::TopUpKeyPool(unsigned int kpSize)
 {
+    // Top up key pool
+    unsigned int nTargetSize;
+    if (kpSize > 0)
+        nTargetSize = kpSize;
+    else
+        nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
+
+    // cs_wallet is taken per batch, so a refill from a caller not already
+    // holding it (like the background thread) doesn't stall other wallet
+    // users for the whole refill.
+    while (true)
     {
         LOCK(cs_wallet);
 
         if (IsLocked())
             return false;
 
-        CWalletDB walletdb(strWalletFile);
+        if (setKeyPool.size() >= nTargetSize + 1)
+            break;
+        AddKeysToKeyPool(std::min<size_t>(nTargetSize + 1 - setKeyPool.size(), KEYPOOL_TOPUP_BATCH_SIZE));
+    }
+    return true;
+}
 
-        // Top up key pool
-        unsigned int nTargetSize;
-        if (kpSize > 0)
-            nTargetSize = kpSize;
-        else
-            nTargetSize = max(GetArg("-keypool", DEFAULT_KEYPOOL_SIZE), (int64_t) 0);
+void CWallet::TopUpKeyPoolInBackground()
+{
+    AssertLockHeld(cs_wallet);
+    if (!fKeyPoolThreadRunning) {
+        TopUpKeyPool();
+        return;
+    }
+    // Let the background thread refill the pool; only make sure there is a
+    // key to hand out now.
+    if (setKeyPool.empty() && !IsLocked())
+        AddKeysToKeyPool(1);
+    RequestKeyPoolTopUp();
+}
+
+void CWallet::RequestKeyPoolTopUp()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(csKeyPoolTopUp);
+        fKeyPoolTopUpRequested = true;
+    }
+    condKeyPoolTopUp.notify_one();
+}
 
-        while (setKeyPool.size() < (nTargetSize + 1))
+void CWallet::ThreadTopUpKeyPool()
+{
+    RenameThread("trumpow-keypool");
+
+    while (true)
+    {
         {
-            int64_t nEnd = 1;
-            if (!setKeyPool.empty())
-                nEnd = *(--setKeyPool.end()) + 1;
-            if (!walletdb.WritePool(nEnd, CKeyPool(GenerateNewKey())))
-                throw runtime_error(std::string(__func__) + ": writing generated key failed");
-            setKeyPool.insert(nEnd);
-            LogPrintf("keypool added key %d, size=%u\n", nEnd, setKeyPool.size());
+            boost::unique_lock<boost::mutex> lock(csKeyPoolTopUp);
+            while (!fKeyPoolTopUpRequested)
+                condKeyPoolTopUp.wait(lock);
+            fKeyPoolTopUpRequested = false;
+        }
+
+        try {
+            TopUpKeyPool();
+        } catch (const std::runtime_error& e) {
+            LogPrintf("%s: %s\n", __func__, e.what());
         }
     }
-    return true;
 }
 
 void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
@@ -3147,7 +3507,7 @@ void CWallet::ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool)
         LOCK(cs_wallet);
 
         if (!IsLocked())
-            TopUpKeyPool();
+            TopUpKeyPoolInBackground();
 
         // Get the oldest key
         if(setKeyPool.empty())
@@ -3648,6 +4008,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     std::string strUsage = HelpMessageGroup(_("Wallet options:"));
     strUsage += HelpMessageOpt("-disablewallet", _("Do not load the wallet and disable wallet RPC calls"));
     strUsage += HelpMessageOpt("-keypool=<n>", strprintf(_("Set key pool size to <n> (default: %u)"), DEFAULT_KEYPOOL_SIZE));
+    strUsage += HelpMessageOpt("-keypoolbackground", strprintf(_("Refill the key pool in a background thread instead of when keys are requested (default: %u)"), DEFAULT_KEYPOOL_BACKGROUND));
     strUsage += HelpMessageOpt("-discardthreshold=<amt>", strprintf(_("The minimum transaction output size (in %s) used to validate wallet transactions and discard change (to fee) (default: %s)"),
                                                                     CURRENCY_UNIT, FormatMoney(DEFAULT_DISCARD_THRESHOLD)));
     strUsage += HelpMessageOpt("-fallbackfee=<amt>", strprintf(_("A fee rate (in %s/kB) that will be used when fee estimation has insufficient data (default: %s)"),
@@ -3657,6 +4018,8 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-paytxfee=<amt>", strprintf(_("Fee (in %s/kB) to add to transactions you send (default: %s)"),
                                                             CURRENCY_UNIT, FormatMoney(payTxFee.GetFeePerK())));
     strUsage += HelpMessageOpt("-rescan", _("Rescan the block chain for missing wallet transactions on startup"));
+    strUsage += HelpMessageOpt("-rescanaddrindex", strprintf(_("Use the address index, if enabled, to only rescan blocks touching imported watch-only addresses (default: %u)"), DEFAULT_RESCAN_ADDRINDEX));
+    strUsage += HelpMessageOpt("-rescanthreads=<n>", strprintf(_("Set the number of threads reading blocks during a wallet rescan (up to %d, 0 = auto, <0 = leave that many cores free, default: %d)"), MAX_RESCAN_THREADS, DEFAULT_RESCAN_THREADS));
     strUsage += HelpMessageOpt("-salvagewallet", _("Attempt to recover private keys from a corrupt wallet on startup"));
     if (showDebug)
         strUsage += HelpMessageOpt("-sendfreetransactions", strprintf(_("Send transactions as zero-fee transactions if possible (default: %u)"), DEFAULT_SEND_FREE_TRANSACTIONS));
@@ -3666,6 +4029,7 @@ std::string CWallet::GetWalletHelpString(bool showDebug)
     strUsage += HelpMessageOpt("-walletrbf", strprintf(_("Send transactions with full-RBF opt-in enabled (default: %u)"), DEFAULT_WALLET_RBF));
     strUsage += HelpMessageOpt("-upgradewallet", _("Upgrade wallet to latest format on startup"));
     strUsage += HelpMessageOpt("-wallet=<file>", _("Specify wallet file (within data directory)") + " " + strprintf(_("(default: %s)"), DEFAULT_WALLET_DAT));
+    strUsage += HelpMessageOpt("-walletbackend=<backend>", strprintf(_("Storage for newly created wallet files, bdb (Berkeley DB) or log (append-only log); existing files keep their format (default: %s)"), DEFAULT_WALLET_BACKEND));
     strUsage += HelpMessageOpt("-walletbroadcast", _("Make the wallet broadcast transactions") + " " + strprintf(_("(default: %u)"), DEFAULT_WALLETBROADCAST));
     strUsage += HelpMessageOpt("-walletnotify=<cmd>", _("Execute command when a wallet transaction changes (%s in cmd is replaced by TxID, %i with block height, with a value of 0 if tx is no longer in chaintip)"));
     strUsage += HelpMessageOpt("-zapwallettxes=<mode>", _("Delete all wallet transactions and only recover those parts of the blockchain through -rescan on startup") +
@@ -3823,9 +4187,12 @@ CWallet* CWallet::CreateWalletFromFile(const std::string walletFile)
         uiInterface.InitMessage(_("Rescanning..."));
         LogPrintf("Rescanning last %i blocks (from block %i)...\n", chainActive.Height() - pindexRescan->nHeight, pindexRescan->nHeight);
         nStart = GetTimeMillis();
-        walletInstance->ScanForWalletTransactions(pindexRescan, true);
+        bool fComplete;
+        walletInstance->ScanForWalletTransactions(pindexRescan, true, &fComplete);
         LogPrintf(" rescan      %15dms\n", GetTimeMillis() - nStart);
-        walletInstance->SetBestChain(chainActive.GetLocator());
+        // Only record the tip as scanned up to if it was, so that the next start rescans
+        if (fComplete)
+            walletInstance->SetBestChain(chainActive.GetLocator());
         CWalletDB::IncrementUpdateCounter();
 
         // Restore wallet transaction metadata after -zapwallettxes=1
@@ -3896,6 +4263,12 @@ void CWallet::postInitProcess(boost::thread_group& threadGroup)
     if (!CWallet::fFlushThreadRunning.exchange(true)) {
         threadGroup.create_thread(ThreadFlushWalletDB);
     }
+
+    // Run a thread to refill the key pool without blocking key requests
+    if (GetBoolArg("-keypoolbackground", DEFAULT_KEYPOOL_BACKGROUND) && !fKeyPoolThreadRunning.exchange(true)) {
+        threadGroup.create_thread(boost::bind(&CWallet::ThreadTopUpKeyPool, this));
+        RequestKeyPoolTopUp();
+    }
 }
 
 bool CWallet::ParameterInteraction()
@@ -3919,6 +4292,9 @@ bool CWallet::ParameterInteraction()
 
     if (GetBoolArg("-sysperms", false))
         return InitError("-sysperms is not allowed in combination with enabled wallet functionality");
+    std::string strBackend = GetArg("-walletbackend", DEFAULT_WALLET_BACKEND);
+    if (strBackend != "bdb" && strBackend != "log")
+        return InitError(strprintf(_("Unknown wallet backend -walletbackend=%s"), strBackend));
     if (GetArg("-prune", 0) && GetBoolArg("-rescan", false))
         return InitError(_("Rescans are not possible in pruned mode. You will need to use -reindex which will download the whole blockchain again."));
 
@@ -14,6 +14,7 @@
 #include "tinyformat.h"
 #include "ui_interface.h"
 #include "utilstrencodings.h"
+#include "utiltime.h"
 #include "validationinterface.h"
 #include "policy/policy.h"
 #include "script/ismine.h"
@@ -48,6 +49,12 @@ extern bool fSendFreeTransactions;
 extern bool fWalletRbf;
 
 static const unsigned int DEFAULT_KEYPOOL_SIZE = 100;
+//! Maximum number of keys generated and written in one wallet database transaction
+static const unsigned int KEYPOOL_TOPUP_BATCH_SIZE = 500;
+//! Smallest number of keys worth deriving on several threads
+static const unsigned int KEYPOOL_PARALLEL_MIN_KEYS = 16;
+//! -keypoolbackground default
+static const bool DEFAULT_KEYPOOL_BACKGROUND = true;
 //! -paytxfee default
 static const CAmount DEFAULT_TRANSACTION_FEE = RECOMMENDED_MIN_TX_FEE;
 //! -fallbackfee default
@@ -124,6 +131,14 @@ static const bool DEFAULT_WALLETBROADCAST = true;
 static const bool DEFAULT_DISABLE_WALLET = false;
 //! if set, all keys will be derived by using BIP32
 static const bool DEFAULT_USE_HD_WALLET = true;
+//! -rescanthreads default (0 = one per core)
+static const int DEFAULT_RESCAN_THREADS = 0;
+//! Maximum number of threads reading and filtering blocks during a rescan
+static const int MAX_RESCAN_THREADS = 16;
+//! Number of blocks each rescan thread reads ahead per batch
+static const int RESCAN_BLOCKS_PER_THREAD = 8;
+//! -rescanaddrindex default
+static const bool DEFAULT_RESCAN_ADDRINDEX = true;
 
 extern const char * DEFAULT_WALLET_DAT;
 
@@ -582,6 +597,30 @@ private:
     /* the HD chain data model (external chain counters) */
     CHDChain hdChain;
 
+    /* Rescan state, readable without holding cs_wallet */
+    std::atomic<bool> fAbortRescan;
+    std::atomic<bool> fScanningWallet;
+    std::atomic<int> nScanStartHeight;
+    std::atomic<int> nScanStopHeight;
+    std::atomic<int> nScanHeight;
+    std::atomic<int64_t> nScanStartTime;
+
+    CBlockIndex* ScanBlocks(CBlockIndex* pindexStart, const std::set<int>* pSetHeights, bool fUpdate, bool& fComplete);
+
+    /* Background key pool top-up, see ThreadTopUpKeyPool */
+    boost::mutex csKeyPoolTopUp;
+    boost::condition_variable condKeyPoolTopUp;
+    bool fKeyPoolTopUpRequested;
+    std::atomic<bool> fKeyPoolThreadRunning;
+
+    void GetExternalChainKey(CExtKey& externalChainChildKey);
+    bool AddKeyPubKeyWithDB(CWalletDB& walletdb, const CKey& key, const CPubKey& pubkey);
+    bool RemoveWatchOnlyWithDB(CWalletDB& walletdb, const CScript& dest);
+    //! Generate nKeys keys in a single database transaction and add them to the key pool
+    void AddKeysToKeyPool(unsigned int nKeys);
+    void RequestKeyPoolTopUp();
+    void ThreadTopUpKeyPool();
+
     bool fFileBacked;
 
     std::set<int64_t> setKeyPool;
@@ -660,6 +699,14 @@ public:
         nLastResend = 0;
         nTimeFirstKey = 0;
         fBroadcastTransactions = false;
+        fAbortRescan = false;
+        fScanningWallet = false;
+        nScanStartHeight = 0;
+        nScanStopHeight = 0;
+        nScanHeight = 0;
+        nScanStartTime = 0;
+        fKeyPoolTopUpRequested = false;
+        fKeyPoolThreadRunning = false;
     }
 
     std::map<uint256, CWalletTx> mapWallet;
@@ -693,7 +740,7 @@ public:
      * completion the coin set and corresponding actual target value is
      * assembled
      */
-    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, std::vector<COutput> vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
+    bool SelectCoinsMinConf(const CAmount& nTargetValue, int nConfMine, int nConfTheirs, uint64_t nMaxAncestors, const std::vector<COutput>& vCoins, std::set<std::pair<const CWalletTx*,unsigned int> >& setCoinsRet, CAmount& nValueRet) const;
 
     bool IsSpent(const uint256& hash, unsigned int n) const;
 
@@ -708,6 +755,8 @@ public:
      * Generate a new key
      */
     CPubKey GenerateNewKey();
+    //! Generate nKeys new keys, deriving them on several threads, and write them through walletdb
+    void GenerateNewKeys(CWalletDB& walletdb, unsigned int nKeys, std::vector<CPubKey>& vPubKeys);
     void DeriveNewChildKey(CKeyMetadata& metadata, CKey& secret);
     //! Adds a key to the store, and saves it to disk.
     bool AddKeyPubKey(const CKey& key, const CPubKey &pubkey) override;
@@ -761,7 +810,19 @@ public:
     bool LoadToWallet(const CWalletTx& wtxIn);
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, int posInBlock) override;
     bool AddToWalletIfInvolvingMe(const CTransaction& tx, const CBlockIndex* pIndex, int posInBlock, bool fUpdate);
-    CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false);
+    CBlockIndex* ScanForWalletTransactions(CBlockIndex* pindexStart, bool fUpdate = false, bool* pfComplete = NULL);
+    //! Rescan only the given active chain heights, e.g. as found in the address index. Returns whether all of them were scanned.
+    bool ScanForWalletTransactions(const std::set<int>& setHeights, bool fUpdate = false);
+    //! Ask a running rescan to stop at the next batch boundary
+    void AbortRescan() { fAbortRescan = true; }
+    bool IsAbortingRescan() const { return fAbortRescan; }
+    bool IsScanning() const { return fScanningWallet; }
+    //! Progress of the running rescan as a fraction of its block range
+    double ScanningProgress() const;
+    int ScanningStartHeight() const { return nScanStartHeight; }
+    int ScanningStopHeight() const { return nScanStopHeight; }
+    int ScanningHeight() const { return nScanHeight; }
+    int64_t ScanningDuration() const { return fScanningWallet ? GetTimeMillis() - nScanStartTime : 0; }
     void ReacceptWalletTransactions();
     void ResendWalletTransactions(int64_t nBestBlockTime, CConnman* connman) override;
     std::vector<uint256> ResendWalletTransactionsBefore(int64_t nTime, CConnman* connman);
@@ -833,6 +894,8 @@ public:
 
     bool NewKeyPool();
     bool TopUpKeyPool(unsigned int kpSize = 0);
+    //! Leave the top-up to the background thread if it runs, adding a key now only if the pool is empty
+    void TopUpKeyPoolInBackground();
     void ReserveKeyFromKeyPool(int64_t& nIndex, CKeyPool& keypool);
     void KeepKey(int64_t nIndex);
     void ReturnKey(int64_t nIndex);
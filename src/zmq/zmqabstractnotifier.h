@@ -34,6 +34,8 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    //! New merge-mining work building on pindexPrev is available
+    virtual bool NotifyAuxWork(const CBlockIndex *pindexPrev);
 
 protected:
     void *psocket;
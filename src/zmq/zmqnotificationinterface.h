@@ -5,6 +5,7 @@
 #ifndef BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
+#include "sync.h"
 #include "validationinterface.h"
 #include <string>
 #include <map>
@@ -19,6 +20,12 @@ public:
 
     static CZMQNotificationInterface* Create();
 
+    /**
+     * Publish that new merge-mining work is available beyond a new tip (see
+     * BlockTemplateManager). Called from the template builder's thread.
+     */
+    void NotifyAuxWork(const CBlockIndex *pindexPrev);
+
 protected:
     bool Initialize();
     void Shutdown();
@@ -31,6 +38,8 @@ private:
     CZMQNotificationInterface();
 
     void *pcontext;
+    //! Guards notifiers and their sockets, which are used from more than one thread
+    CCriticalSection cs_notifiers;
     std::list<CZMQAbstractNotifier*> notifiers;
 };
 